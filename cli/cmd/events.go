@@ -148,11 +148,16 @@ scope events -n 1000 -e 'sourcetype!="console" && source.indexOf("cribl.log") ==
 			match:       match,
 		}
 
+		// Offsets into lz4 compressed events can't be seeked to, so those are read from the start
+		compressed := util.IsLZ4File(file)
+		if compressed && len(args) > 0 {
+			util.ErrAndExit("Event IDs are not supported for compressed events files")
+		}
 		if len(args) > 0 {
 			offset, err = util.DecodeOffset(args[0])
 			util.CheckErrSprintf(err, "Could not decode encoded offset: %v", err)
 			allEvents = false
-		} else if !allEvents {
+		} else if !allEvents && !compressed {
 			offset, err = util.FindReverseLineMatchOffset(lastN, file, em.filter())
 			util.CheckErrSprintf(err, "Error searching for offset: %v", err)
 			if offset < 0 {
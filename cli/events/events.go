@@ -1,6 +1,7 @@
 package events
 
 import (
+	"bufio"
 	"encoding/json"
 	"fmt"
 	"io"
@@ -11,7 +12,14 @@ import (
 // Reader reads a newline delimited JSON documents and sends parsed documents
 // to the passed out channel. It exits the process on error.
 func Reader(r io.Reader, initOffset int64, match func(string) bool, out chan map[string]interface{}) (int, error) {
-	br, err := util.NewlineReader(r, match, func(idx int, offset int64, b []byte) error {
+	rd := bufio.NewReader(r)
+	if util.IsLZ4(rd) {
+		rd = bufio.NewReader(util.NewLZ4Reader(rd))
+	}
+	if util.IsBinary(rd) {
+		return binaryReader(rd, initOffset, match, out)
+	}
+	br, err := util.NewlineReader(rd, match, func(idx int, offset int64, b []byte) error {
 		event, err := ParseEvent(b)
 		if err != nil {
 			if err.Error() == "config event" {
@@ -27,6 +35,26 @@ func Reader(r io.Reader, initOffset int64, match func(string) bool, out chan map
 	return br, err
 }
 
+// binaryReader is Reader for the binary format, where non-event messages arrive as JSON frames
+func binaryReader(r io.Reader, initOffset int64, match func(string) bool, out chan map[string]interface{}) (int, error) {
+	br, err := util.BinaryReader(r, match, func(offset int64, event map[string]interface{}, raw []byte) error {
+		if event == nil {
+			var err error
+			if event, err = ParseEvent(raw); err != nil {
+				if err.Error() == "config event" {
+					return nil
+				}
+				return err
+			}
+		}
+		event["id"] = util.EncodeOffset(initOffset + offset)
+		out <- event
+		return nil
+	})
+	close(out)
+	return br, err
+}
+
 // ParseEvent returns an event from an array of bytes containing one event
 func ParseEvent(b []byte) (map[string]interface{}, error) {
 	event := map[string]interface{}{}
@@ -2,6 +2,7 @@ package events
 
 import (
 	"bytes"
+	"encoding/hex"
 	"testing"
 
 	"github.com/criblio/scope/util"
@@ -24,6 +25,21 @@ func TestReader(t *testing.T) {
 	assert.Equal(t, "true", event["data"])
 }
 
+func TestReaderLZ4(t *testing.T) {
+	// The four events of TestReaderWithFilter, written with SCOPE_EVENT_COMPRESSION=lz4
+	frame, err := hex.DecodeString("04224d18604082f1000000f30e7b2274797065223a22657674222c22626f6479223a7b22736f757263651b00f017636f6e736f6c65222c226964223a226435353830356535633235652d6563686f2d2f62696e2f0a0040207472752800f3075f74696d65223a313630393139313638332e3938352c560080223a227374646f7570004b686f7374530070222c2270726f6393008063686f222c22636d76000d640010708d00f11c31303131372c225f6368616e6e656c223a22363431353033353537323038383032222c2264617461223a229b003f7d7d0af2006320666fcb000fef00d60fe1013a1f38e101851f36d302450ff200175065227d7d0a00000000")
+	assert.NoError(t, err)
+
+	in := make(chan map[string]interface{})
+	go Reader(bytes.NewBuffer(frame), 0, util.MatchField("pid", 10118), in)
+	events := []map[string]interface{}{}
+	for e := range in {
+		events = append(events, e)
+	}
+	assert.Len(t, events, 2)
+	assert.Equal(t, 1609191683.986, events[1]["_time"])
+}
+
 func TestParseEvent(t *testing.T) {
 	rawEvent := `{"type":"evt","body":{"sourcetype":"console","id":"d55805e5c25e-echo-/bin/echo true","_time":1609191683.985,"source":"stdout","host":"d55805e5c25e","proc":"echo","cmd":"/bin/echo true","pid":10117,"_channel":"641503557208802","data":"true"}}
 `
@@ -60,3 +76,51 @@ func TestReaderWithFilter(t *testing.T) {
 	testFilter(util.MatchAll([]util.MatchFunc{util.MatchField("pid", 10118), util.MatchString("foo")}...), 0)
 	testFilter(util.MatchAll([]util.MatchFunc{util.MatchField("pid", 10117), util.MatchString("foo")}...), 1)
 }
+
+// An fs.error metric event, a console event and an info message as written
+// by libscope with SCOPE_EVENT_FORMAT=binary
+const binaryEvents = "0201014503206435353830356535633235652d6563686f2d2f62696e2f6563686f20747275650c643535383035653563323565046563686f0e2f62696e2f6563686f2074727565854f0b02570866732e6572726f720702a302037069640602ab01026f700b0294060773756d6d6172790802c4060466696c650902800805636c6173730d025f0a6f70656e5f636c6f73650802880404756e69740d028702096f7065726174696f6e38053d0aff4094fad74103e29599fd9aee9101570000010601a302e6ca0a02ab01940602c406000773756d6d6172790280085f0288048702000a02a701067374646f75741305a01aff4094fad7410100a7010204747275650c067b22696e666f223a7b7d7d"
+
+func TestBinaryReader(t *testing.T) {
+	b, err := hex.DecodeString(binaryEvents)
+	assert.NoError(t, err)
+
+	in := make(chan map[string]interface{}, 3)
+	_, err = Reader(bytes.NewBuffer(b), 0, util.MatchAlways, in)
+	assert.NoError(t, err)
+
+	events := []map[string]interface{}{}
+	for e := range in {
+		events = append(events, e)
+	}
+	// The info message is not an event
+	assert.Len(t, events, 2)
+
+	assert.Equal(t, "metric", events[0]["sourcetype"])
+	assert.Equal(t, "fs.error", events[0]["source"])
+	assert.Equal(t, 1609191683.985, events[0]["_time"])
+	assert.Equal(t, "641503557208802", events[0]["_channel"])
+	assert.Equal(t, "d55805e5c25e", events[0]["host"])
+	assert.Equal(t, float64(10117), events[0]["pid"])
+	data := events[0]["data"].(map[string]interface{})
+	assert.Equal(t, "fs.error", data["_metric"])
+	assert.Equal(t, "counter", data["_metric_type"])
+	assert.Equal(t, float64(3), data["_value"])
+	assert.Equal(t, "summary", data["file"])
+	assert.Equal(t, float64(86707), data["pid"])
+
+	assert.Equal(t, "console", events[1]["sourcetype"])
+	assert.Equal(t, "stdout", events[1]["source"])
+	assert.Equal(t, "true", events[1]["data"])
+	assert.Equal(t, "/bin/echo true", events[1]["cmd"])
+
+	in = make(chan map[string]interface{}, 3)
+	_, err = Reader(bytes.NewBuffer(b), 0, util.MatchField("sourcetype", "console"), in)
+	assert.NoError(t, err)
+	events = []map[string]interface{}{}
+	for e := range in {
+		events = append(events, e)
+	}
+	assert.Len(t, events, 1)
+	assert.Equal(t, "stdout", events[0]["source"])
+}
@@ -1,6 +1,7 @@
 package metrics
 
 import (
+	"bufio"
 	"encoding/json"
 	"fmt"
 	"io"
@@ -50,7 +51,14 @@ var metricTypesToCodes map[string]MetricType = map[string]MetricType{
 
 // Reader reads dogstatsd metrics from a file
 func Reader(r io.Reader, match func(string) bool, out chan Metric) (int, error) {
-	br, err := util.NewlineReader(r, match, func(idx int, offset int64, b []byte) error {
+	rd := bufio.NewReader(r)
+	if util.IsLZ4(rd) {
+		rd = bufio.NewReader(util.NewLZ4Reader(rd))
+	}
+	if util.IsBinary(rd) {
+		return binaryReader(rd, match, out)
+	}
+	br, err := util.NewlineReader(rd, match, func(idx int, offset int64, b []byte) error {
 		m, err := parseJSONMetric(b)
 		if err != nil {
 			return err
@@ -62,13 +70,29 @@ func Reader(r io.Reader, match func(string) bool, out chan Metric) (int, error)
 	return br, err
 }
 
+func binaryReader(r io.Reader, match func(string) bool, out chan Metric) (int, error) {
+	br, err := util.BinaryReader(r, match, func(offset int64, metricMap map[string]interface{}, raw []byte) error {
+		if metricMap == nil {
+			return nil
+		}
+		out <- parseMetricMap(metricMap)
+		return nil
+	})
+	close(out)
+	return br, err
+}
+
 func parseJSONMetric(b []byte) (Metric, error) {
-	m := Metric{}
 	metricMap := map[string]interface{}{}
 	err := json.Unmarshal(b, &metricMap)
 	if err != nil {
-		return m, err
+		return Metric{}, err
 	}
+	return parseMetricMap(metricMap), nil
+}
+
+func parseMetricMap(metricMap map[string]interface{}) Metric {
+	m := Metric{}
 	m.Name = metricMap["_metric"].(string)
 	delete(metricMap, "_metric")
 	m.Value = metricMap["_value"].(float64)
@@ -97,5 +121,5 @@ func parseJSONMetric(b []byte) (Metric, error) {
 		}
 		m.Tags = append(m.Tags, t)
 	}
-	return m, nil
+	return m
 }
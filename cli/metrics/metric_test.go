@@ -1,6 +1,8 @@
 package metrics
 
 import (
+	"bytes"
+	"encoding/hex"
 	"sort"
 	"testing"
 
@@ -30,3 +32,38 @@ func TestJsonMetric(t *testing.T) {
 	assert.Equal(t, util.ParseEventTime(1610682430.52), m.Time)
 
 }
+
+// Two fs.error metrics as written by libscope with SCOPE_METRIC_FORMAT=binary.
+// The second one refers to names defined with the first.
+const binaryMetrics = "0201010b02570866732e6572726f720702a302037069640602ab01026f700b0294060773756d6d6172790902800805636c6173730d025f0a6f70656e5f636c6f73650802880404756e69740d028702096f7065726174696f6e2204cff7d3ea5bb5da415700010601a302e6ca0a02ab0194060280085f0288048702002204cff7d3ea5bb5da415700010601a302e6ca0a02ab0194060280085f028804870200"
+
+func TestBinaryReader(t *testing.T) {
+	b, err := hex.DecodeString(binaryMetrics)
+	assert.NoError(t, err)
+
+	in := make(chan Metric, 2)
+	n, err := Reader(bytes.NewBuffer(b), util.MatchAlways, in)
+	assert.NoError(t, err)
+	assert.Equal(t, len(b), n)
+
+	metrics := []Metric{}
+	for m := range in {
+		metrics = append(metrics, m)
+	}
+	assert.Len(t, metrics, 2)
+	for _, m := range metrics {
+		sort.Slice(m.Tags, func(i, j int) bool { return m.Tags[i].Name < m.Tags[j].Name })
+		assert.Equal(t, "fs.error", m.Name)
+		assert.Equal(t, float64(3), m.Value)
+		assert.Equal(t, MetricType(Count), m.Type)
+		assert.Equal(t, "operation", m.Unit)
+		assert.Equal(t, 86707, m.Pid)
+		assert.Equal(t, []MetricTag{{"class", "open_close"}, {"op", "summary"}}, m.Tags)
+	}
+
+	in = make(chan Metric, 2)
+	_, err = Reader(bytes.NewBuffer(b), util.MatchString("nomatch"), in)
+	assert.NoError(t, err)
+	_, ok := <-in
+	assert.False(t, ok)
+}
@@ -0,0 +1,307 @@
+package util
+
+import (
+	"bufio"
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"math"
+	"reflect"
+)
+
+// Frame types and field kinds of the libscope binary format, see src/binformat.h
+const (
+	binHello  = 1
+	binDefine = 2
+	binProc   = 3
+	binMetric = 4
+	binEvent  = 5
+	binJSON   = 6
+
+	binFldEnd = 0
+	binFldInt = 1
+	binFldStr = 2
+	binFldFlt = 3
+
+	binSchemaVersion = 1
+	binSrcMetric     = 3
+)
+
+var binMetricTypes = []string{"counter", "gauge", "timer", "histogram", "set"}
+var binSourceTypes = []string{"file", "console", "syslog", "metric", "http", "net", "fs", "dns"}
+
+var errBinTruncated = errors.New("truncated binary frame")
+var errBinUnknownName = errors.New("unknown binary dictionary id")
+
+// IsBinary returns true if r starts with the libscope binary format rather than ndjson
+func IsBinary(r *bufio.Reader) bool {
+	b, err := r.Peek(1)
+	return err == nil && b[0] != '{'
+}
+
+// BinaryDecoder decodes frames written with SCOPE_METRIC_FORMAT=binary or SCOPE_EVENT_FORMAT=binary.
+// Metrics and events are returned as the map their ndjson counterpart would unmarshal to.
+type BinaryDecoder struct {
+	r      *bufio.Reader
+	names  map[uint64]string
+	proc   map[string]interface{}
+	offset int64
+}
+
+// NewBinaryDecoder returns a decoder reading from r
+func NewBinaryDecoder(r io.Reader) *BinaryDecoder {
+	br, ok := r.(*bufio.Reader)
+	if !ok {
+		br = bufio.NewReader(r)
+	}
+	return &BinaryDecoder{r: br, names: map[uint64]string{}}
+}
+
+// Offset returns the number of bytes consumed so far
+func (d *BinaryDecoder) Offset() int64 {
+	return d.offset
+}
+
+// Next returns the next metric or event as a map, or the bytes of a JSON frame in raw.
+// It returns io.EOF at the end of the stream.
+func (d *BinaryDecoder) Next() (m map[string]interface{}, raw []byte, err error) {
+	for {
+		frame, err := d.frame()
+		if err != nil {
+			return nil, nil, err
+		}
+		if len(frame) == 0 {
+			continue
+		}
+		c := &binCursor{b: frame[1:]}
+		switch frame[0] {
+		case binHello:
+			if v := c.varint(); c.err == nil && v > binSchemaVersion {
+				return nil, nil, fmt.Errorf("unsupported binary schema version %d", v)
+			}
+		case binDefine:
+			id := c.varint()
+			name := c.str()
+			if c.err == nil {
+				d.names[id] = name
+			}
+		case binProc:
+			d.proc = map[string]interface{}{
+				"id":   c.str(),
+				"host": c.str(),
+				"proc": c.str(),
+				"cmd":  c.str(),
+				"pid":  float64(c.varint()),
+			}
+		case binMetric:
+			m = d.metric(c)
+		case binEvent:
+			m = d.event(c)
+		case binJSON:
+			return nil, frame[1:], nil
+		}
+		if c.err == errBinTruncated {
+			return nil, nil, c.err
+		}
+		// Records that refer to names we never saw are skipped
+		if m != nil && c.err == nil {
+			return m, nil, nil
+		}
+		m = nil
+	}
+}
+
+func (d *BinaryDecoder) frame() ([]byte, error) {
+	length, err := binary.ReadUvarint(d.r)
+	if err != nil {
+		return nil, err
+	}
+	frame := make([]byte, length)
+	if _, err := io.ReadFull(d.r, frame); err != nil {
+		if err == io.EOF {
+			err = io.ErrUnexpectedEOF
+		}
+		return nil, err
+	}
+	d.offset += int64(uvarintLen(length)) + int64(length)
+	return frame, nil
+}
+
+func (d *BinaryDecoder) metric(c *binCursor) map[string]interface{} {
+	m := map[string]interface{}{}
+	timestamp := c.f64()
+	m["_metric"] = c.ref(d.names)
+	d.sample(c, m)
+	m["_time"] = timestamp
+	return m
+}
+
+func (d *BinaryDecoder) event(c *binCursor) map[string]interface{} {
+	body := map[string]interface{}{}
+	for k, v := range d.proc {
+		body[k] = v
+	}
+	body["_time"] = c.f64()
+	sourcetype := int(c.byte())
+	body["_channel"] = fmt.Sprintf("%d", c.varint())
+	source := c.ref(d.names)
+	body["source"] = source
+	if sourcetype < len(binSourceTypes) {
+		body["sourcetype"] = binSourceTypes[sourcetype]
+	}
+	if c.byte() == binFldStr {
+		body["data"] = c.str()
+		return body
+	}
+	data := map[string]interface{}{}
+	d.sample(c, data)
+	if sourcetype == binSrcMetric {
+		data["_metric"] = source
+	} else {
+		delete(data, "_metric_type")
+		delete(data, "_value")
+	}
+	body["data"] = data
+	return body
+}
+
+func (d *BinaryDecoder) sample(c *binCursor, m map[string]interface{}) {
+	metricType := int(c.byte())
+	if metricType < len(binMetricTypes) {
+		m["_metric_type"] = binMetricTypes[metricType]
+	} else {
+		m["_metric_type"] = "unknown"
+	}
+	switch c.byte() {
+	case binFldInt:
+		m["_value"] = float64(c.signed())
+	case binFldFlt:
+		m["_value"] = c.f64()
+	}
+	for c.err == nil {
+		switch c.byte() {
+		case binFldInt:
+			name := c.ref(d.names)
+			m[name] = float64(c.signed())
+		case binFldStr:
+			name := c.ref(d.names)
+			m[name] = c.ref(d.names)
+		default:
+			return
+		}
+	}
+}
+
+type binCursor struct {
+	b   []byte
+	err error
+}
+
+func (c *binCursor) byte() byte {
+	if len(c.b) < 1 {
+		c.fail(errBinTruncated)
+		return 0
+	}
+	v := c.b[0]
+	c.b = c.b[1:]
+	return v
+}
+
+func (c *binCursor) varint() uint64 {
+	v, n := binary.Uvarint(c.b)
+	if n <= 0 {
+		c.fail(errBinTruncated)
+		return 0
+	}
+	c.b = c.b[n:]
+	return v
+}
+
+func (c *binCursor) signed() int64 {
+	v := c.varint()
+	return int64(v>>1) ^ -int64(v&1)
+}
+
+func (c *binCursor) f64() float64 {
+	if len(c.b) < 8 {
+		c.fail(errBinTruncated)
+		return 0
+	}
+	v := math.Float64frombits(binary.LittleEndian.Uint64(c.b))
+	c.b = c.b[8:]
+	return v
+}
+
+func (c *binCursor) str() string {
+	n := c.varint()
+	if uint64(len(c.b)) < n {
+		c.fail(errBinTruncated)
+		return ""
+	}
+	s := string(c.b[:n])
+	c.b = c.b[n:]
+	return s
+}
+
+func (c *binCursor) ref(names map[uint64]string) string {
+	id := c.varint()
+	if id == 0 {
+		return c.str()
+	}
+	s, ok := names[id]
+	if !ok {
+		c.fail(errBinUnknownName)
+	}
+	return s
+}
+
+func (c *binCursor) fail(err error) {
+	if c.err == nil {
+		c.err = err
+	}
+}
+
+func uvarintLen(v uint64) int {
+	n := 1
+	for v >= 0x80 {
+		v >>= 7
+		n++
+	}
+	return n
+}
+
+// BinaryReader reads the libscope binary format from r, matches each record against a given callback,
+// and calls a callback with the record's offset and either its decoded map or the bytes of a JSON frame
+func BinaryReader(r io.Reader, match func(string) bool, callback func(offset int64, m map[string]interface{}, raw []byte) error) (int, error) {
+	// Records only need rendering as JSON for a match function that looks at them
+	matchAll := reflect.ValueOf(match).Pointer() == reflect.ValueOf(MatchAlways).Pointer()
+	d := NewBinaryDecoder(r)
+	for {
+		offset := d.Offset()
+		m, raw, err := d.Next()
+		if err == io.EOF {
+			return int(d.Offset()), nil
+		}
+		if err != nil {
+			return int(d.Offset()), err
+		}
+		if !matchAll {
+			text := string(raw)
+			if m != nil {
+				b, err := json.Marshal(m)
+				if err != nil {
+					return int(d.Offset()), err
+				}
+				text = string(b)
+			}
+			if !match(text) {
+				continue
+			}
+		}
+		if err := callback(offset, m, raw); err != nil {
+			return int(d.Offset()), err
+		}
+	}
+}
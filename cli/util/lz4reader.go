@@ -0,0 +1,268 @@
+package util
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+)
+
+// LZ4 frame format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+const (
+	lz4Magic          = 0x184D2204
+	lz4SkippableMagic = 0x184D2A50 // through 0x184D2A5F
+	lz4Uncompressed   = 0x80000000
+	lz4Window         = 64 * 1024
+
+	lz4FlgIndep       = 0x20
+	lz4FlgBlockSum    = 0x10
+	lz4FlgContentSize = 0x08
+	lz4FlgContentSum  = 0x04
+	lz4FlgDictID      = 0x01
+	lz4FlgVersionMask = 0xC0
+	lz4FlgVersion     = 0x40
+)
+
+var errLZ4Corrupt = errors.New("corrupt lz4 block")
+
+// IsLZ4 returns true if r starts with an lz4 frame, as written with SCOPE_EVENT_COMPRESSION=lz4
+func IsLZ4(r *bufio.Reader) bool {
+	b, err := r.Peek(4)
+	return err == nil && binary.LittleEndian.Uint32(b) == lz4Magic
+}
+
+// IsLZ4File returns true if the file behind r starts with an lz4 frame, leaving r at its start
+func IsLZ4File(r io.ReadSeeker) bool {
+	var b [4]byte
+	_, err := io.ReadFull(r, b[:])
+	if _, serr := r.Seek(0, io.SeekStart); serr != nil {
+		return false
+	}
+	return err == nil && binary.LittleEndian.Uint32(b[:]) == lz4Magic
+}
+
+// LZ4Reader decompresses a stream of concatenated lz4 frames.
+// Checksums are skipped rather than verified.
+type LZ4Reader struct {
+	r       *bufio.Reader
+	inFrame bool
+	flags   byte
+	maxSize int
+	block   []byte
+	hist    []byte // decoded output; the last 64KB of it may be referenced by dependent blocks
+	out     []byte // decoded output not yet returned by Read
+}
+
+// NewLZ4Reader returns a reader decompressing r
+func NewLZ4Reader(r io.Reader) *LZ4Reader {
+	br, ok := r.(*bufio.Reader)
+	if !ok {
+		br = bufio.NewReader(r)
+	}
+	return &LZ4Reader{r: br}
+}
+
+// Read implements io.Reader
+func (z *LZ4Reader) Read(p []byte) (int, error) {
+	for len(z.out) == 0 {
+		if err := z.next(); err != nil {
+			return 0, err
+		}
+	}
+	n := copy(p, z.out)
+	z.out = z.out[n:]
+	return n, nil
+}
+
+// next decodes the next block into z.out, reading frame headers as it goes
+func (z *LZ4Reader) next() error {
+	if !z.inFrame {
+		if err := z.header(); err != nil {
+			return err
+		}
+	}
+
+	var b [4]byte
+	if _, err := io.ReadFull(z.r, b[:]); err != nil {
+		return unexpected(err)
+	}
+	size := binary.LittleEndian.Uint32(b[:])
+	if size == 0 {
+		// End mark
+		z.inFrame = false
+		if z.flags&lz4FlgContentSum != 0 {
+			if _, err := io.ReadFull(z.r, b[:]); err != nil {
+				return unexpected(err)
+			}
+		}
+		return nil
+	}
+	if size == lz4Magic {
+		// A frame that was never finished (e.g. the writer died) followed by a new one
+		return z.restart()
+	}
+
+	raw := size&lz4Uncompressed != 0
+	size &^= lz4Uncompressed
+	if int(size) > z.maxSize {
+		return fmt.Errorf("lz4 block of %d bytes exceeds max of %d", size, z.maxSize)
+	}
+	if cap(z.block) < int(size) {
+		z.block = make([]byte, size)
+	}
+	block := z.block[:size]
+	if _, err := io.ReadFull(z.r, block); err != nil {
+		return unexpected(err)
+	}
+	if z.flags&lz4FlgBlockSum != 0 {
+		if _, err := io.ReadFull(z.r, b[:]); err != nil {
+			return unexpected(err)
+		}
+	}
+
+	// Only dependent blocks need what came before
+	if z.flags&lz4FlgIndep != 0 || len(z.hist) > lz4Window {
+		keep := 0
+		if z.flags&lz4FlgIndep == 0 {
+			keep = lz4Window
+		}
+		z.hist = append(z.hist[:0], z.hist[len(z.hist)-keep:]...)
+	}
+	start := len(z.hist)
+	var err error
+	if raw {
+		z.hist = append(z.hist, block...)
+	} else if z.hist, err = lz4Block(block, z.hist); err != nil {
+		return err
+	}
+	z.out = z.hist[start:]
+	return nil
+}
+
+func (z *LZ4Reader) header() error {
+	var b [4]byte
+	for {
+		if _, err := io.ReadFull(z.r, b[:]); err != nil {
+			return err
+		}
+		magic := binary.LittleEndian.Uint32(b[:])
+		if magic == lz4Magic {
+			return z.restart()
+		}
+		if magic&0xFFFFFFF0 != lz4SkippableMagic {
+			return fmt.Errorf("not an lz4 frame: magic %#x", magic)
+		}
+		if _, err := io.ReadFull(z.r, b[:]); err != nil {
+			return unexpected(err)
+		}
+		if _, err := z.r.Discard(int(binary.LittleEndian.Uint32(b[:]))); err != nil {
+			return unexpected(err)
+		}
+	}
+}
+
+// restart reads the frame descriptor following a magic number
+func (z *LZ4Reader) restart() error {
+	var d [2]byte
+	if _, err := io.ReadFull(z.r, d[:]); err != nil {
+		return unexpected(err)
+	}
+	flags, bd := d[0], d[1]
+	if flags&lz4FlgVersionMask != lz4FlgVersion {
+		return fmt.Errorf("unsupported lz4 frame version %#x", flags)
+	}
+	blockID := (bd >> 4) & 0x7
+	if blockID < 4 {
+		return fmt.Errorf("invalid lz4 block size id %d", blockID)
+	}
+	// Optional content size and dictionary id, then the header checksum byte
+	skip := 1
+	if flags&lz4FlgContentSize != 0 {
+		skip += 8
+	}
+	if flags&lz4FlgDictID != 0 {
+		skip += 4
+	}
+	if _, err := z.r.Discard(skip); err != nil {
+		return unexpected(err)
+	}
+	z.flags = flags
+	z.maxSize = 1 << (8 + 2*uint(blockID))
+	z.hist = z.hist[:0]
+	z.inFrame = true
+	return nil
+}
+
+func unexpected(err error) error {
+	if err == io.EOF {
+		return io.ErrUnexpectedEOF
+	}
+	return err
+}
+
+// lz4Block appends the decompressed contents of src to dst, whose tail holds the history matches can refer to
+func lz4Block(src, dst []byte) ([]byte, error) {
+	for i := 0; i < len(src); {
+		token := src[i]
+		i++
+
+		lit := int(token >> 4)
+		if lit == 15 {
+			for {
+				if i >= len(src) {
+					return nil, errLZ4Corrupt
+				}
+				b := src[i]
+				i++
+				lit += int(b)
+				if b != 255 {
+					break
+				}
+			}
+		}
+		if i+lit > len(src) {
+			return nil, errLZ4Corrupt
+		}
+		dst = append(dst, src[i:i+lit]...)
+		i += lit
+		if i == len(src) {
+			// The last sequence has no match
+			break
+		}
+
+		if i+2 > len(src) {
+			return nil, errLZ4Corrupt
+		}
+		offset := int(src[i]) | int(src[i+1])<<8
+		i += 2
+		mlen := int(token & 0x0F)
+		if mlen == 15 {
+			for {
+				if i >= len(src) {
+					return nil, errLZ4Corrupt
+				}
+				b := src[i]
+				i++
+				mlen += int(b)
+				if b != 255 {
+					break
+				}
+			}
+		}
+		mlen += 4
+		if offset == 0 || offset > len(dst) {
+			return nil, errLZ4Corrupt
+		}
+		// Matches may overlap what they produce, so copy byte by byte when they do
+		pos := len(dst) - offset
+		if offset >= mlen {
+			dst = append(dst, dst[pos:pos+mlen]...)
+		} else {
+			for j := 0; j < mlen; j++ {
+				dst = append(dst, dst[pos+j])
+			}
+		}
+	}
+	return dst, nil
+}
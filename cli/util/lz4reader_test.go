@@ -0,0 +1,66 @@
+package util
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/hex"
+	"io"
+	"io/ioutil"
+	"strings"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func lz4Hex(t *testing.T, s string) []byte {
+	b, err := hex.DecodeString(s)
+	assert.NoError(t, err)
+	return b
+}
+
+// One frame as libscope writes them: independent block, no checksums
+const lz4Scope = "04224d1860408216000000cf68656c6c6f2073636f7065200c000c50636f70650a00000000"
+
+// The same text from "lz4 -BD -BX --content-size": dependent blocks, block and content checksums
+const lz4Full = "04224d187c403000000000000000cf16000000cf68656c6c6f2073636f7065200c000c50636f70650a8cc7061200000000c753b5ff"
+
+const lz4Text = "hello scope hello scope hello scope hello scope\n"
+
+func TestLZ4Reader(t *testing.T) {
+	for _, frame := range []string{lz4Scope, lz4Full} {
+		out, err := ioutil.ReadAll(NewLZ4Reader(bytes.NewReader(lz4Hex(t, frame))))
+		assert.NoError(t, err)
+		assert.Equal(t, lz4Text, string(out))
+	}
+}
+
+func TestLZ4ReaderConcatenatedFrames(t *testing.T) {
+	// Frames from separate flushes or processes follow one another,
+	// and a frame cut short by a writer that died is followed by a new one
+	b := lz4Hex(t, lz4Scope+lz4Full)
+	b = append(b, lz4Hex(t, lz4Scope)[:33]...)
+	b = append(b, lz4Hex(t, lz4Scope)...)
+	out, err := ioutil.ReadAll(NewLZ4Reader(bytes.NewReader(b)))
+	assert.NoError(t, err)
+	assert.Equal(t, strings.Repeat(lz4Text, 4), string(out))
+}
+
+func TestLZ4ReaderTruncated(t *testing.T) {
+	b := lz4Hex(t, lz4Scope)
+	_, err := ioutil.ReadAll(NewLZ4Reader(bytes.NewReader(b[:20])))
+	assert.Equal(t, io.ErrUnexpectedEOF, err)
+
+	_, err = ioutil.ReadAll(NewLZ4Reader(strings.NewReader("not lz4")))
+	assert.Error(t, err)
+}
+
+func TestIsLZ4(t *testing.T) {
+	assert.True(t, IsLZ4(bufio.NewReader(bytes.NewReader(lz4Hex(t, lz4Scope)))))
+	assert.False(t, IsLZ4(bufio.NewReader(strings.NewReader(lz4Text))))
+
+	r := bytes.NewReader(lz4Hex(t, lz4Scope))
+	assert.True(t, IsLZ4File(r))
+	pos, _ := r.Seek(0, io.SeekCurrent)
+	assert.Equal(t, int64(0), pos)
+	assert.False(t, IsLZ4File(strings.NewReader("{}")))
+}
@@ -659,6 +659,28 @@ osGetCgroup(pid_t pid, char *cgroup, size_t cglen)
     return FALSE;
 }
 
+// All of /proc/<pid>/cgroup, v1 lines and all; truncated to fit
+bool
+osGetCgroups(pid_t pid, char *cgroups, size_t cglen)
+{
+    char path[PATH_MAX];
+
+    if (!g_fn.fopen || !g_fn.fread || !g_fn.fclose || !cgroups || (cglen <= 0)) {
+        return FALSE;
+    }
+
+    if (snprintf(path, sizeof(path), "/proc/%d/cgroup", pid) < 0) return FALSE;
+
+    FILE *fstream = g_fn.fopen(path, "r");
+    if (fstream == NULL) return FALSE;
+
+    size_t len = g_fn.fread(cgroups, 1, cglen - 1, fstream);
+    cgroups[len] = '\0';
+
+    g_fn.fclose(fstream);
+    return (len > 0);
+}
+
 char *
 osGetFileMode(mode_t perm)
 {
@@ -734,12 +756,38 @@ static const char scope_help_configuration[] =
 "        Specify a directory from which conf/scope.yml or ./scope.yml can\n"
 "        be found. Used only at start time, and only if SCOPE_CONF_PATH does\n"
 "        not exist. For more info, see Config File Resolution below.\n"
+"    SCOPE_LIB_CACHE_DIR\n"
+"        Directory where ldscope keeps the copy of libscope.so that the\n"
+"        processes it starts preload, so they all share one copy. Set to\n"
+"        empty to give every launch a private copy. Default is /dev/shm.\n"
 "    SCOPE_METRIC_ENABLE\n"
 "        Single flag to make it possible to disable all metric output.\n"
 "        true,false  Default is true.\n"
 "    SCOPE_METRIC_VERBOSITY\n"
 "        0-9 are valid values. Default is 4.\n"
 "        For more info, see Metric Verbosity below.\n"
+"    SCOPE_METRIC_CARDINALITY\n"
+"        Counters and gauges with the same name and tags are combined and\n"
+"        sent once per summary period.  This is the most distinct sets of\n"
+"        tags kept per period; past it, metrics keep only host, proc, pid\n"
+"        and lower verbosity tags.  0 sends every metric as it happens.\n"
+"        Default is 4096.\n"
+"    SCOPE_METRIC_AGGREGATE\n"
+"        What metrics are summed over.  process,container\n"
+"        process: each process's metrics are its own.  container: pid\n"
+"        and proc tags are left off counters and timers, so every process\n"
+"        in a container sends the same series and a node-local statsd\n"
+"        sums them per container.  Gauges keep them, as statsd keeps\n"
+"        only the last value of a gauge.  Metrics are tagged with\n"
+"        container_id and pod_uid either way, when the process is in a\n"
+"        container or pod.\n"
+"        Default is process.\n"
+"    SCOPE_METRIC_MODE\n"
+"        Overrides the summarization that verbosity picks, per metric.\n"
+"        A comma separated list of name:mode, e.g. net.rx:fd,fs.read:off\n"
+"        Modes are off, event (metric events only), summary (in the\n"
+"        period's totals) and fd (per fd or operation as well).\n"
+"        For the names, see Metric Verbosity below.  Default is none.\n"
 "    SCOPE_METRIC_DEST\n"
 "        Default is udp://localhost:8125\n"
 "        Format is one of:\n"
@@ -747,9 +795,27 @@ static const char scope_help_configuration[] =
 "                                      special allowed values)\n"
 "            udp://<server>:<123>         (<server> is servername or address;\n"
 "                                      <123> is port number or service name)\n"
+"            syslog://                (to the local syslog daemon, through\n"
+"                                      /dev/log; one message per line)\n"
 "    SCOPE_METRIC_FORMAT\n"
-"        statsd, ndjson\n"
+"        statsd, ndjson, binary\n"
 "        Default is statsd.\n"
+"    SCOPE_METRIC_COMPRESSION\n"
+"        none, lz4  Compresses tcp and file output into lz4 frames,\n"
+"        which are written when a block fills or output is flushed.\n"
+"        Default is none.\n"
+"    SCOPE_METRIC_BLOCKSIZE\n"
+"        Bytes of uncompressed output per lz4 frame, 1024 to 4194304.\n"
+"        Default is 65536.\n"
+"    SCOPE_METRIC_QUEUESIZE\n"
+"        Bytes of tcp output kept in memory while the destination is\n"
+"        behind or unreachable, 4096 to 1073741824.  0 sends with blocking\n"
+"        writes instead.  Default is 1048576.\n"
+"    SCOPE_METRIC_SPILLDIR\n"
+"        Directory for a file that takes tcp output the queue has no room\n"
+"        for.  It's unlinked as soon as it's made.  Default is none.\n"
+"    SCOPE_METRIC_SPILLSIZE\n"
+"        Most bytes to put in the spill file.  Default is 67108864.\n"
 "    SCOPE_STATSD_PREFIX\n"
 "        Specify a string to be prepended to every scope metric.\n"
 "    SCOPE_STATSD_MAXLEN\n"
@@ -763,8 +829,18 @@ static const char scope_help_configuration[] =
 "        Same format as SCOPE_METRIC_DEST above.\n"
 "        Default is tcp://localhost:9109\n"
 "    SCOPE_EVENT_FORMAT\n"
-"        ndjson\n"
+"        ndjson, binary\n"
 "        Default is ndjson.\n"
+"    SCOPE_EVENT_COMPRESSION\n"
+"        Same as SCOPE_METRIC_COMPRESSION above.  Default is none.\n"
+"    SCOPE_EVENT_BLOCKSIZE\n"
+"        Same as SCOPE_METRIC_BLOCKSIZE above.  Default is 65536.\n"
+"    SCOPE_EVENT_QUEUESIZE\n"
+"        Same as SCOPE_METRIC_QUEUESIZE above.  Default is 1048576.\n"
+"    SCOPE_EVENT_SPILLDIR\n"
+"        Same as SCOPE_METRIC_SPILLDIR above.  Default is none.\n"
+"    SCOPE_EVENT_SPILLSIZE\n"
+"        Same as SCOPE_METRIC_SPILLSIZE above.  Default is 67108864.\n"
 "    SCOPE_EVENT_LOGFILE\n"
 "        Create events from writes to log files.\n"
 "        true,false  Default is false.\n"
@@ -783,6 +859,19 @@ static const char scope_help_configuration[] =
 "    SCOPE_EVENT_CONSOLE_VALUE\n"
 "        An extended regex to filter console events by field value.\n"
 "        Used only if SCOPE_EVENT_CONSOLE is true. Default is .*\n"
+"    SCOPE_EVENT_SYSLOG\n"
+"        Create events from messages the app sends with syslog().\n"
+"        true,false  Default is false.\n"
+"    SCOPE_EVENT_SYSLOG_NAME\n"
+"        An extended regex to filter syslog events by event name, which\n"
+"        is syslog.<facility>, e.g. syslog.daemon.\n"
+"        Used only if SCOPE_EVENT_SYSLOG is true. Default is .*\n"
+"    SCOPE_EVENT_SYSLOG_FIELD\n"
+"        An extended regex to filter syslog events by field name.\n"
+"        Used only if SCOPE_EVENT_SYSLOG is true. Default is .*\n"
+"    SCOPE_EVENT_SYSLOG_VALUE\n"
+"        An extended regex to filter syslog events by field value.\n"
+"        Used only if SCOPE_EVENT_SYSLOG is true. Default is .*\n"
 "    SCOPE_EVENT_METRIC\n"
 "        Create events from metrics.\n"
 "        true,false  Default is false.\n"
@@ -866,9 +955,40 @@ static const char scope_help_configuration[] =
 "    SCOPE_PAYLOAD_DIR\n"
 "        Specifies a directory where payload capture files can be written.\n"
 "        Default is /tmp\n"
+"    SCOPE_PAYLOAD_LIMIT\n"
+"        Maximum number of bytes captured per connection. Data past it\n"
+"        is not captured.  0 is 'no limit'; 0 is the default.\n"
+"    SCOPE_PAYLOAD_HEAD\n"
+"        Capture only the first buffer sent or received each time a\n"
+"        connection changes direction; the start of each request and\n"
+"        response.  true,false  Default is false.\n"
+"    SCOPE_PAYLOAD_MAXSIZE\n"
+"        Size in bytes at which a payload file is renamed with a .1\n"
+"        suffix, replacing any earlier one, and a new file started.\n"
+"        0 is 'never'; 0 is the default.\n"
+"    SCOPE_PAYLOAD_MAXAGE\n"
+"        Like SCOPE_PAYLOAD_MAXSIZE, but a file is started every this\n"
+"        many seconds.  0 is 'never'; 0 is the default.\n"
+"    SCOPE_PAYLOAD_MAXTOTAL\n"
+"        Bytes of payload files, rotated ones included, each process may\n"
+"        keep in the directory.  Data past it is not written.\n"
+"        0 is 'no limit'; 0 is the default.\n"
+"    SCOPE_PAYLOAD_FORMAT\n"
+"        raw writes each connection's data, as is, to files of its own.\n"
+"        pcapng writes all of a process's payloads to <pid>.pcapng, with\n"
+"        made up IP and TCP or UDP headers, to be read by wireshark.\n"
+"        raw,pcapng  Default is raw.\n"
 "    SCOPE_CONFIG_EVENT\n"
 "        Sends a single process-identifying event, when a transport\n"
 "        connection is established.  true,false  Default is true.\n"
+"    SCOPE_PREFORK\n"
+"        How children made by fork() are treated.  off,on,funnel\n"
+"        off: each child starts over, as if it had been exec'd.\n"
+"        on: for pre-fork worker pools; children keep what the parent\n"
+"        knew about the process and their metrics are tagged with a\n"
+"        worker index.  funnel: as on, and children send through the\n"
+"        parent's connections rather than making their own (not with\n"
+"        the binary format).  Default is off.\n"
 "\n"
 "    Dynamic Configuration:\n"
 "        Dynamic Configuration allows configuration settings to be\n"
@@ -910,6 +1030,15 @@ static const char scope_help_metrics[] =
 "            8   turns off 'filesystem seek'\n"
 "            9   turns off 'filesystem read/write' and 'network send/receive'\n"
 "\n"
+"        SCOPE_METRIC_MODE overrides this per metric.  The names it takes\n"
+"        are fs.error, fs.open, fs.close, fs.stat, fs.seek, fs.read,\n"
+"        fs.write, fs.duration, net.error, net.dns, net.dns.duration,\n"
+"        net.port, net.conn (net.tcp, net.udp and net.other),\n"
+"        net.conn_duration, net.rx, net.tx, proc.cpu, proc.mem,\n"
+"        proc.thread, proc.fd, proc.child, proc.wait and proc.transport\n"
+"        (the proc.transport.queued, .spilled and .dropped bytes of tcp\n"
+"        destinations).\n"
+"\n"
 "    The http.status metric is emitted when the http watch type has been\n"
 "    enabled as an event. The http.status metric is not controlled with\n"
 "    summarization settings.\n"
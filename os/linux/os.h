@@ -59,6 +59,7 @@ extern int osGetPageProt(unsigned long);
 extern int osGetExePath(char **);
 extern bool osTimerStop(void);
 extern bool osGetCgroup(pid_t, char *, size_t);
+extern bool osGetCgroups(pid_t, char *, size_t);
 extern char *osGetFileMode(mode_t);
 
 #endif  //__OS_H__
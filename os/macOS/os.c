@@ -164,3 +164,9 @@ osGetCgroup(pid_t pid, char *cgroup, size_t cglen)
 {
     return FALSE;
 }
+
+bool
+osGetCgroups(pid_t pid, char *cgroups, size_t cglen)
+{
+    return FALSE;
+}
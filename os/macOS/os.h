@@ -42,4 +42,5 @@ extern void osInitJavaAgent(void);
 extern int osGetPageProt(uint64_t);
 extern bool osTimerStop(void);
 extern bool osGetCgroup(pid_t, char *, size_t);
+extern bool osGetCgroups(pid_t, char *, size_t);
 extern char *osGetFileMode(mode_t);
@@ -47,6 +47,16 @@ atomicSwapU64(uint64_t *ptr, uint64_t val) {
     return __sync_lock_test_and_set(ptr, val);
 }
 
+static inline uint64_t
+atomicLoadU64(uint64_t *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+atomicStoreU64(uint64_t *ptr, uint64_t val) {
+    __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
 
 
 static inline bool
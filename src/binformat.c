@@ -0,0 +1,494 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "binformat.h"
+#include "com.h"
+#include "dbg.h"
+#include "plattime.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// Must be a power of two.  Once the dictionary is full, names are
+// simply sent inline.
+#define BIN_DICT_SIZE 1024
+#define BIN_DICT_PROBES 8
+
+// Field values are interned too when they are low cardinality
+// (class, proto, op, host, proc, ...)
+#define BIN_INTERN_CARDINALITY 4
+
+#define BIN_MAX_VARINT 10
+
+typedef struct {
+    char *name;             // claimed once, never freed until destroy
+    unsigned sent;          // generation the DEFINE was delivered in
+} bin_name_t;
+
+struct _bin_fmt_t
+{
+    unsigned gen;           // bumped by every reset; never 0
+    unsigned hello;         // generation the HELLO was delivered in
+    struct {
+        unsigned sent;
+        pid_t pid;
+    } proc;
+    bin_name_t name[BIN_DICT_SIZE];
+};
+
+bin_fmt_t *
+binFormatCreate(void)
+{
+    bin_fmt_t *bin = calloc(1, sizeof(bin_fmt_t));
+    if (!bin) {
+        DBG(NULL);
+        return NULL;
+    }
+    bin->gen = 1;
+    return bin;
+}
+
+void
+binFormatDestroy(bin_fmt_t **bin)
+{
+    if (!bin || !*bin) return;
+    bin_fmt_t *b = *bin;
+    int i;
+    for (i = 0; i < BIN_DICT_SIZE; i++) {
+        if (b->name[i].name) free(b->name[i].name);
+    }
+    free(b);
+    *bin = NULL;
+}
+
+void
+binFormatReset(bin_fmt_t *bin)
+{
+    if (!bin) return;
+
+    int gen;
+    do {
+        gen = bin->gen;
+    } while (!atomicCas32((int *)&bin->gen, gen, (gen + 1) ? gen + 1 : 1));
+}
+
+static int
+bufReserve(bin_buf_t *b, size_t n)
+{
+    if (b->len + n <= b->size) return TRUE;
+
+    size_t size = b->size * 2;
+    while (size < b->len + n) size *= 2;
+
+    char *data;
+    if (b->data == b->stack) {
+        if ((data = malloc(size))) memcpy(data, b->stack, b->len);
+    } else {
+        data = realloc(b->data, size);
+    }
+    if (!data) {
+        DBG(NULL);
+        return FALSE;
+    }
+    b->data = data;
+    b->size = size;
+    return TRUE;
+}
+
+static void
+bufInit(bin_buf_t *b)
+{
+    b->data = b->stack;
+    b->len = 0;
+    b->size = sizeof(b->stack);
+}
+
+static void
+bufFree(bin_buf_t *b)
+{
+    if (b->data != b->stack) free(b->data);
+    bufInit(b);
+}
+
+static int
+putByte(bin_buf_t *b, uint8_t val)
+{
+    if (!bufReserve(b, 1)) return FALSE;
+    b->data[b->len++] = val;
+    return TRUE;
+}
+
+static int
+putVarint(bin_buf_t *b, uint64_t val)
+{
+    if (!bufReserve(b, BIN_MAX_VARINT)) return FALSE;
+    while (val >= 0x80) {
+        b->data[b->len++] = (char)(val | 0x80);
+        val >>= 7;
+    }
+    b->data[b->len++] = (char)val;
+    return TRUE;
+}
+
+static int
+putSigned(bin_buf_t *b, long long val)
+{
+    // zigzag, so that small negative numbers stay small
+    return putVarint(b, ((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+static int
+putDouble(bin_buf_t *b, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    if (!bufReserve(b, sizeof(bits))) return FALSE;
+    int i;
+    for (i = 0; i < sizeof(bits); i++) {
+        b->data[b->len++] = (char)(bits >> (8 * i));
+    }
+    return TRUE;
+}
+
+static int
+putBytes(bin_buf_t *b, const char *data, size_t len)
+{
+    if (!bufReserve(b, len)) return FALSE;
+    memcpy(&b->data[b->len], data, len);
+    b->len += len;
+    return TRUE;
+}
+
+static int
+putString(bin_buf_t *b, const char *str)
+{
+    if (!str) str = "";
+    size_t len = strlen(str);
+    return putVarint(b, len) && putBytes(b, str, len);
+}
+
+static size_t
+varintLen(uint64_t val)
+{
+    size_t n = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static size_t
+stringLen(const char *str)
+{
+    size_t len = (str) ? strlen(str) : 0;
+    return varintLen(len) + len;
+}
+
+// Starts a frame directly in the message, for frames whose size is
+// known up front.  len excludes the frame type byte.
+static int
+putFrameHeader(bin_msg_t *msg, bin_frame_t type, size_t len)
+{
+    return putVarint(&msg->buf, len + 1) && putByte(&msg->buf, type);
+}
+
+// Appends body as a complete frame to the message
+static int
+putFrame(bin_msg_t *msg, bin_buf_t *body)
+{
+    return putVarint(&msg->buf, body->len) &&
+           putBytes(&msg->buf, body->data, body->len);
+}
+
+static uint32_t
+binHash(const char *str)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for ( ; *str; str++) {
+        h ^= (uint8_t)*str;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns the dictionary id for str, or 0 if the dictionary is full
+static unsigned
+binIntern(bin_fmt_t *bin, const char *str)
+{
+    uint32_t h = binHash(str);
+    int i;
+    for (i = 0; i < BIN_DICT_PROBES; i++) {
+        unsigned slot = (h + i) & (BIN_DICT_SIZE - 1);
+        bin_name_t *n = &bin->name[slot];
+
+        if (!n->name) {
+            char *dup = strdup(str);
+            if (!dup) return 0;
+            if (!atomicCasU64((uint64_t *)&n->name, 0, (uint64_t)dup)) {
+                // Another thread claimed this slot first
+                free(dup);
+            }
+        }
+        if (!strcmp(n->name, str)) return slot + 1;
+    }
+    return 0;
+}
+
+static int
+msgHasDef(bin_msg_t *msg, unsigned id)
+{
+    int i;
+    for (i = 0; i < msg->ndefs; i++) {
+        if (msg->defs[i] == id) return TRUE;
+    }
+    return FALSE;
+}
+
+static int
+putHello(bin_fmt_t *bin, bin_msg_t *msg)
+{
+    if (msg->hello || bin->hello == msg->gen) return TRUE;
+
+    msg->hello = putFrameHeader(msg, BIN_HELLO, varintLen(BIN_SCHEMA_VERSION)) &&
+                 putVarint(&msg->buf, BIN_SCHEMA_VERSION);
+    return msg->hello;
+}
+
+// Writes a ref for str into body.  A DEFINE frame is added to the
+// message ahead of the body when str hasn't been delivered yet.
+static int
+putRef(bin_fmt_t *bin, bin_msg_t *msg, bin_buf_t *body, const char *str)
+{
+    if (!str) str = "";
+
+    unsigned id = binIntern(bin, str);
+    if (!id) goto inline_str;
+
+    if ((bin->name[id - 1].sent != msg->gen) && !msgHasDef(msg, id)) {
+        if (msg->ndefs >= BIN_MSG_DEFS) goto inline_str;
+
+        if (!putFrameHeader(msg, BIN_DEFINE, varintLen(id) + stringLen(str)) ||
+            !putVarint(&msg->buf, id) ||
+            !putString(&msg->buf, str)) return FALSE;
+        msg->defs[msg->ndefs++] = id;
+    }
+    return putVarint(body, id);
+
+inline_str:
+    return putVarint(body, 0) && putString(body, str);
+}
+
+static int
+putProc(bin_fmt_t *bin, bin_msg_t *msg, proc_id_t *proc)
+{
+    if (msg->pid == proc->pid) return TRUE;
+    if ((bin->proc.sent == msg->gen) && (bin->proc.pid == proc->pid)) return TRUE;
+
+    size_t len = stringLen(proc->id) + stringLen(proc->hostname) +
+                 stringLen(proc->procname) + stringLen(proc->cmd) +
+                 varintLen(proc->pid);
+    if (!putFrameHeader(msg, BIN_PROC, len) ||
+        !putString(&msg->buf, proc->id) ||
+        !putString(&msg->buf, proc->hostname) ||
+        !putString(&msg->buf, proc->procname) ||
+        !putString(&msg->buf, proc->cmd) ||
+        !putVarint(&msg->buf, proc->pid)) return FALSE;
+    msg->pid = proc->pid;
+    return TRUE;
+}
+
+static int
+putValue(bin_buf_t *body, event_t *e)
+{
+    switch (e->value.type) {
+        case FMT_INT:
+            return putByte(body, BIN_FLD_INT) && putSigned(body, e->value.integer);
+        case FMT_FLT:
+            return putByte(body, BIN_FLD_FLT) && putDouble(body, e->value.floating);
+        default:
+            DBG(NULL);
+            return FALSE;
+    }
+}
+
+static int
+putField(bin_fmt_t *bin, bin_msg_t *msg, bin_buf_t *body, event_field_t *f)
+{
+    switch (f->value_type) {
+        case FMT_NUM:
+            return putByte(body, BIN_FLD_INT) &&
+                   putRef(bin, msg, body, f->name) &&
+                   putSigned(body, f->value.num);
+        case FMT_STR:
+            if (!putByte(body, BIN_FLD_STR) ||
+                !putRef(bin, msg, body, f->name)) return FALSE;
+            if (f->cardinality <= BIN_INTERN_CARDINALITY) {
+                return putRef(bin, msg, body, f->value.str);
+            }
+            return putVarint(body, 0) && putString(body, f->value.str);
+        default:
+            DBG("%d %s", f->value_type, f->name);
+            return FALSE;
+    }
+}
+
+void
+binMsgInit(bin_fmt_t *bin, bin_msg_t *msg)
+{
+    if (!msg) return;
+    bufInit(&msg->buf);
+    msg->gen = (bin) ? bin->gen : 0;
+    msg->ndefs = 0;
+    msg->hello = FALSE;
+    msg->pid = 0;
+}
+
+void
+binMsgFree(bin_msg_t *msg)
+{
+    if (!msg) return;
+    bufFree(&msg->buf);
+    msg->ndefs = 0;
+    msg->hello = FALSE;
+    msg->pid = 0;
+}
+
+void
+binFormatSent(bin_fmt_t *bin, bin_msg_t *msg, int rc)
+{
+    if (!bin || !msg) return;
+
+    if (rc) {
+        // We don't know what made it to the other side; start over
+        binFormatReset(bin);
+        return;
+    }
+
+    // If a reset happened since msg was encoded, msg->gen is stale
+    // and none of this counts as delivered on the new connection.
+    int i;
+    for (i = 0; i < msg->ndefs; i++) {
+        bin->name[msg->defs[i] - 1].sent = msg->gen;
+    }
+    if (msg->hello) bin->hello = msg->gen;
+    if (msg->pid) {
+        bin->proc.pid = msg->pid;
+        bin->proc.sent = msg->gen;
+    }
+}
+
+int
+binFormatMetric(bin_fmt_t *bin, bin_msg_t *msg, event_t *e,
+                unsigned verbosity, custom_tag_t **tags)
+{
+    if (!bin || !msg || !e) return -1;
+    if (!putHello(bin, msg)) return -1;
+
+    bin_buf_t body;
+    bufInit(&body);
+
+    if (!putByte(&body, BIN_METRIC) ||
+        !putDouble(&body, getWallTime(e->tsc) / 1e9) ||
+        !putRef(bin, msg, &body, e->name) ||
+        !putByte(&body, e->type) ||
+        !putValue(&body, e)) goto err;
+
+    // Custom tags lead, like they do in statsd
+    custom_tag_t *t;
+    int i = 0;
+    while (tags && (t = tags[i++])) {
+        if (!putByte(&body, BIN_FLD_STR) ||
+            !putRef(bin, msg, &body, t->name) ||
+            !putRef(bin, msg, &body, t->value)) goto err;
+    }
+
+    event_field_t *f;
+    for (f = e->fields; f && f->value_type != FMT_END; f++) {
+        // Honor Verbosity
+        if (f->cardinality > verbosity) continue;
+        if (!putField(bin, msg, &body, f)) goto err;
+    }
+
+    if (!putByte(&body, BIN_FLD_END) || !putFrame(msg, &body)) goto err;
+    bufFree(&body);
+    return 0;
+
+err:
+    bufFree(&body);
+    return -1;
+}
+
+int
+binFormatEvent(bin_fmt_t *bin, bin_msg_t *msg, event_t *e, regex_t *fieldFilter,
+               double timestamp, uint64_t uid, proc_id_t *proc, watch_t src)
+{
+    if (!bin || !msg || !e || !proc) return -1;
+    if (!putHello(bin, msg) || !putProc(bin, msg, proc)) return -1;
+
+    bin_buf_t body;
+    bufInit(&body);
+
+    if (!putByte(&body, BIN_EVENT) ||
+        !putDouble(&body, timestamp) ||
+        !putByte(&body, src) ||
+        !putVarint(&body, uid) ||
+        !putRef(bin, msg, &body, e->name) ||
+        !putByte(&body, BIN_FLD_END) ||
+        !putByte(&body, e->type) ||
+        !putValue(&body, e)) goto err;
+
+    event_field_t *f;
+    for (f = e->fields; f && f->value_type != FMT_END; f++) {
+        // skip outputting anything that doesn't match fieldFilter
+        if (fieldFilter && regexec_wrapper(fieldFilter, f->name, 0, NULL, 0)) continue;
+
+        // skip if this field is not used in events
+        if (f->event_usage == FALSE) continue;
+
+        if (!putField(bin, msg, &body, f)) goto err;
+    }
+
+    if (!putByte(&body, BIN_FLD_END) || !putFrame(msg, &body)) goto err;
+    bufFree(&body);
+    return 0;
+
+err:
+    bufFree(&body);
+    return -1;
+}
+
+int
+binFormatNotice(bin_fmt_t *bin, bin_msg_t *msg, const char *src, const char *data,
+                double timestamp, proc_id_t *proc, watch_t sourcetype)
+{
+    if (!bin || !msg || !src || !data || !proc) return -1;
+    if (!putHello(bin, msg) || !putProc(bin, msg, proc)) return -1;
+
+    bin_buf_t body;
+    bufInit(&body);
+    int rv = putByte(&body, BIN_EVENT) &&
+             putDouble(&body, timestamp) &&
+             putByte(&body, sourcetype) &&
+             putVarint(&body, 0) &&
+             putRef(bin, msg, &body, src) &&
+             putByte(&body, BIN_FLD_STR) &&
+             putString(&body, data) &&
+             putFrame(msg, &body);
+    bufFree(&body);
+    return (rv) ? 0 : -1;
+}
+
+int
+binFormatJson(bin_fmt_t *bin, bin_msg_t *msg, const char *json, size_t len)
+{
+    if (!bin || !msg || !json) return -1;
+    if (!putHello(bin, msg)) return -1;
+
+    if (!putFrameHeader(msg, BIN_JSON, len) ||
+        !putBytes(&msg->buf, json, len)) return -1;
+    return 0;
+}
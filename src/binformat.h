@@ -0,0 +1,99 @@
+#ifndef __BIN_FORMAT_H__
+#define __BIN_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pcre2posix.h"
+#include "mtcformat.h"
+
+// The binary format ("format: binary") is a stream of length-prefixed
+// frames.  Every buffer handed to transportSend() holds whole frames.
+//
+//   frame    := varint(len) body[len]
+//   body     := u8 frame type, then one of
+//     HELLO  := varint schema version
+//     DEFINE := varint id, string                 (id is never 0)
+//     PROC   := string id, string host, string proc, string cmd, varint pid
+//     METRIC := f64 time, ref name, sample
+//     EVENT  := f64 time, u8 sourcetype, varint uid, ref source,
+//               u8 BIN_FLD_END followed by a sample, or
+//               u8 BIN_FLD_STR followed by a string
+//     JSON   := the bytes of one ndjson message, without the newline
+//   sample   := u8 data_type, value, field*, u8 BIN_FLD_END
+//   value    := u8 BIN_FLD_INT, zigzag varint | u8 BIN_FLD_FLT, f64
+//   field    := u8 BIN_FLD_INT, ref name, zigzag varint |
+//               u8 BIN_FLD_STR, ref name, ref value
+//   ref      := varint id of a DEFINE'd string, or 0 followed by a string
+//   string   := varint len, bytes
+//
+// Varints are unsigned LEB128, f64 is a little-endian IEEE double.
+// Names are interned per sender; a DEFINE always goes out before the
+// first frame that refers to its id, and is repeated after a reset.
+// Ids are never reused for another string, so a decoder can keep its
+// dictionary across HELLO frames.
+
+#define BIN_SCHEMA_VERSION 1
+
+typedef enum {
+    BIN_HELLO  = 1,
+    BIN_DEFINE = 2,
+    BIN_PROC   = 3,
+    BIN_METRIC = 4,
+    BIN_EVENT  = 5,
+    BIN_JSON   = 6,
+} bin_frame_t;
+
+typedef enum {
+    BIN_FLD_END = 0,
+    BIN_FLD_INT = 1,
+    BIN_FLD_STR = 2,
+    BIN_FLD_FLT = 3,
+} bin_field_t;
+
+// Max number of new dictionary entries one message can define.
+// Names beyond this are sent inline.
+#define BIN_MSG_DEFS 32
+#define BIN_MSG_STACK 1024
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t size;
+    char stack[BIN_MSG_STACK];
+} bin_buf_t;
+
+// One message for transportSend(); lives on the caller's stack.
+typedef struct {
+    bin_buf_t buf;
+    unsigned gen;           // dictionary generation this was encoded in
+    int ndefs;
+    unsigned defs[BIN_MSG_DEFS];
+    int hello;
+    pid_t pid;              // non-zero if a PROC frame was encoded
+} bin_msg_t;
+
+// Constructors Destructors
+bin_fmt_t *         binFormatCreate(void);
+void                binFormatDestroy(bin_fmt_t **);
+
+// Message lifetime.  Every message that was initialized is released with
+// binMsgFree().  When one is handed to transportSend(), binFormatSent()
+// gets the result: success marks the definitions in msg as delivered,
+// failure makes the next message start over with HELLO and DEFINEs.
+void                binMsgInit(bin_fmt_t *, bin_msg_t *);
+void                binMsgFree(bin_msg_t *);
+void                binFormatSent(bin_fmt_t *, bin_msg_t *, int);
+
+// Forget what has been delivered, e.g. on a new connection
+void                binFormatReset(bin_fmt_t *);
+
+// Encoders append frames to msg; each returns 0 on success, -1 on error
+int                 binFormatMetric(bin_fmt_t *, bin_msg_t *, event_t *,
+                                    unsigned, custom_tag_t **);
+int                 binFormatEvent(bin_fmt_t *, bin_msg_t *, event_t *,
+                                   regex_t *, double, uint64_t, proc_id_t *, watch_t);
+int                 binFormatNotice(bin_fmt_t *, bin_msg_t *, const char *,
+                                    const char *, double, proc_id_t *, watch_t);
+int                 binFormatJson(bin_fmt_t *, bin_msg_t *, const char *, size_t);
+
+#endif // __BIN_FORMAT_H__
@@ -16,6 +16,15 @@ typedef struct {
         char* path;                      // For type CFG_FILE
         cfg_buffer_t buf_policy;
     } file;
+    struct {                             // For type CFG_TCP and CFG_FILE
+        cfg_compress_t type;
+        unsigned block;
+    } compress;
+    struct {                             // For type CFG_TCP
+        unsigned size;
+        char* spilldir;
+        unsigned long long spillsize;
+    } queue;
 } transport_struct_t;
 
 struct _config_t
@@ -29,6 +38,9 @@ struct _config_t
         } statsd;
         unsigned period;
         unsigned verbosity;
+        unsigned cardinality;
+        cfg_mtc_aggregate_t aggregate;
+        char* mode;
     } mtc;
 
     struct {
@@ -48,6 +60,12 @@ struct _config_t
     struct {
         unsigned int enable;
         char *dir;
+        unsigned long long limit;
+        unsigned head;
+        unsigned long long maxsize;
+        unsigned maxage;
+        unsigned long long maxtotal;
+        cfg_pay_format_t format;
     } pay;
 
     // CFG_MTC, CFG_CTL, or CFG_LOG
@@ -59,6 +77,7 @@ struct _config_t
     char* commanddir;
     unsigned processstartmsg;
     unsigned enhancefs;
+    cfg_prefork_t prefork;
 };
 
 #define DEFAULT_SUMMARY_PERIOD 10
@@ -174,6 +193,9 @@ cfgCreateDefault()
     c->mtc.statsd.maxlen = DEFAULT_STATSD_MAX_LEN;
     c->mtc.period = DEFAULT_SUMMARY_PERIOD;
     c->mtc.verbosity = DEFAULT_MTC_VERBOSITY;
+    c->mtc.cardinality = DEFAULT_MTC_CARDINALITY;
+    c->mtc.aggregate = DEFAULT_MTC_AGGREGATE;
+    c->mtc.mode = (DEFAULT_MTC_MODE) ? strdup(DEFAULT_MTC_MODE) : NULL;
     c->evt.enable = DEFAULT_EVT_ENABLE;
     c->evt.format = DEFAULT_CTL_FORMAT;
     c->evt.ratelimit = DEFAULT_MAXEVENTSPERSEC;
@@ -199,12 +221,23 @@ cfgCreateDefault()
         const char* path_def = pathDefault[tp];
         c->transport[tp].file.path = (path_def) ? strdup(path_def) : NULL;
         c->transport[tp].file.buf_policy = bufDefault[tp];
+        c->transport[tp].compress.type = DEFAULT_COMPRESS;
+        c->transport[tp].compress.block = DEFAULT_COMPRESS_BLOCK;
+        c->transport[tp].queue.size = DEFAULT_QUEUE_SIZE;
+        c->transport[tp].queue.spilldir = (DEFAULT_SPILL_DIR) ? strdup(DEFAULT_SPILL_DIR) : NULL;
+        c->transport[tp].queue.spillsize = DEFAULT_SPILL_SIZE;
     }
 
     c->log.level = DEFAULT_LOG_LEVEL;
 
     c->pay.enable = DEFAULT_PAYLOAD_ENABLE;
     c->pay.dir = (DEFAULT_PAYLOAD_DIR) ? strdup(DEFAULT_PAYLOAD_DIR) : NULL;
+    c->pay.limit = DEFAULT_PAYLOAD_LIMIT;
+    c->pay.head = DEFAULT_PAYLOAD_HEAD;
+    c->pay.maxsize = DEFAULT_PAYLOAD_MAXSIZE;
+    c->pay.maxage = DEFAULT_PAYLOAD_MAXAGE;
+    c->pay.maxtotal = DEFAULT_PAYLOAD_MAXTOTAL;
+    c->pay.format = DEFAULT_PAYLOAD_FORMAT;
 
     c->tags = DEFAULT_TAGS;
     c->max_tags = DEFAULT_NUM_TAGS;
@@ -212,6 +245,7 @@ cfgCreateDefault()
     c->commanddir = (DEFAULT_COMMAND_DIR) ? strdup(DEFAULT_COMMAND_DIR) : NULL;
     c->processstartmsg = DEFAULT_PROCESS_START_MSG;
     c->enhancefs = DEFAULT_ENHANCE_FS;
+    c->prefork = DEFAULT_PREFORK;
 
     return c;
 }
@@ -222,6 +256,7 @@ cfgDestroy(config_t** cfg)
     if (!cfg || !*cfg) return;
     config_t* c = *cfg;
     if (c->mtc.statsd.prefix) free(c->mtc.statsd.prefix);
+    if (c->mtc.mode) free(c->mtc.mode);
     if (c->commanddir) free(c->commanddir);
 
     watch_t src;
@@ -236,6 +271,7 @@ cfgDestroy(config_t** cfg)
         if (c->transport[t].net.host) free(c->transport[t].net.host);
         if (c->transport[t].net.port) free(c->transport[t].net.port);
         if (c->transport[t].file.path) free(c->transport[t].file.path);
+        if (c->transport[t].queue.spilldir) free(c->transport[t].queue.spilldir);
     }
 
     if (c->pay.dir) free(c->pay.dir);
@@ -299,6 +335,12 @@ cfgSendProcessStartMsg(config_t* cfg)
     return (cfg) ? cfg->processstartmsg : DEFAULT_PROCESS_START_MSG;
 }
 
+cfg_prefork_t
+cfgPrefork(config_t* cfg)
+{
+    return (cfg) ? cfg->prefork : DEFAULT_PREFORK;
+}
+
 unsigned
 cfgEvtEnable(config_t* cfg)
 {
@@ -377,6 +419,24 @@ cfgMtcVerbosity(config_t* cfg)
     return (cfg) ? cfg->mtc.verbosity : DEFAULT_MTC_VERBOSITY;
 }
 
+unsigned
+cfgMtcCardinality(config_t* cfg)
+{
+    return (cfg) ? cfg->mtc.cardinality : DEFAULT_MTC_CARDINALITY;
+}
+
+cfg_mtc_aggregate_t
+cfgMtcAggregate(config_t* cfg)
+{
+    return (cfg) ? cfg->mtc.aggregate : DEFAULT_MTC_AGGREGATE;
+}
+
+const char*
+cfgMtcMode(config_t* cfg)
+{
+    return (cfg && cfg->mtc.mode) ? cfg->mtc.mode : DEFAULT_MTC_MODE;
+}
+
 cfg_transport_t
 cfgTransportType(config_t* cfg, which_transport_t t)
 {
@@ -437,6 +497,66 @@ cfgTransportBuf(config_t* cfg, which_transport_t t)
     return bufDefault[CFG_LOG];
 }
 
+cfg_compress_t
+cfgTransportCompress(config_t* cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].compress.type;
+        return DEFAULT_COMPRESS;
+    }
+
+    DBG("%d", t);
+    return DEFAULT_COMPRESS;
+}
+
+unsigned
+cfgTransportCompressBlock(config_t* cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].compress.block;
+        return DEFAULT_COMPRESS_BLOCK;
+    }
+
+    DBG("%d", t);
+    return DEFAULT_COMPRESS_BLOCK;
+}
+
+unsigned
+cfgTransportQueueSize(config_t* cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].queue.size;
+        return DEFAULT_QUEUE_SIZE;
+    }
+
+    DBG("%d", t);
+    return DEFAULT_QUEUE_SIZE;
+}
+
+const char*
+cfgTransportSpillDir(config_t* cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].queue.spilldir;
+        return DEFAULT_SPILL_DIR;
+    }
+
+    DBG("%d", t);
+    return DEFAULT_SPILL_DIR;
+}
+
+unsigned long long
+cfgTransportSpillSize(config_t* cfg, which_transport_t t)
+{
+    if (t >= 0 && t < CFG_WHICH_MAX) {
+        if (cfg) return cfg->transport[t].queue.spillsize;
+        return DEFAULT_SPILL_SIZE;
+    }
+
+    DBG("%d", t);
+    return DEFAULT_SPILL_SIZE;
+}
+
 custom_tag_t**
 cfgCustomTags(config_t* cfg)
 {
@@ -487,6 +607,42 @@ cfgPayDir(config_t *cfg)
     return (cfg) ? cfg->pay.dir : DEFAULT_PAYLOAD_DIR;
 }
 
+unsigned long long
+cfgPayLimit(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.limit : DEFAULT_PAYLOAD_LIMIT;
+}
+
+unsigned
+cfgPayHead(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.head : DEFAULT_PAYLOAD_HEAD;
+}
+
+unsigned long long
+cfgPayMaxSize(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.maxsize : DEFAULT_PAYLOAD_MAXSIZE;
+}
+
+unsigned
+cfgPayMaxAge(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.maxage : DEFAULT_PAYLOAD_MAXAGE;
+}
+
+unsigned long long
+cfgPayMaxTotal(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.maxtotal : DEFAULT_PAYLOAD_MAXTOTAL;
+}
+
+cfg_pay_format_t
+cfgPayFormat(config_t *cfg)
+{
+    return (cfg) ? cfg->pay.format : DEFAULT_PAYLOAD_FORMAT;
+}
+
 ///////////////////////////////////
 // Setters 
 ///////////////////////////////////
@@ -565,6 +721,13 @@ cfgSendProcessStartMsgSet(config_t* cfg, unsigned val)
     cfg->processstartmsg = val;
 }
 
+void
+cfgPreforkSet(config_t* cfg, cfg_prefork_t val)
+{
+    if (!cfg || val > CFG_PREFORK_FUNNEL) return;
+    cfg->prefork = val;
+}
+
 void
 cfgMtcVerbositySet(config_t* cfg, unsigned val)
 {
@@ -573,6 +736,28 @@ cfgMtcVerbositySet(config_t* cfg, unsigned val)
     cfg->mtc.verbosity = val;
 }
 
+void
+cfgMtcCardinalitySet(config_t* cfg, unsigned val)
+{
+    if (!cfg) return;
+    cfg->mtc.cardinality = val;
+}
+
+void
+cfgMtcAggregateSet(config_t* cfg, cfg_mtc_aggregate_t val)
+{
+    if (!cfg || val > CFG_AGG_CONTAINER) return;
+    cfg->mtc.aggregate = val;
+}
+
+void
+cfgMtcModeSet(config_t* cfg, const char* mode)
+{
+    if (!cfg) return;
+    if (cfg->mtc.mode) free(cfg->mtc.mode);
+    cfg->mtc.mode = strdup((mode) ? mode : DEFAULT_MTC_MODE);
+}
+
 void
 cfgEvtEnableSet(config_t* cfg, unsigned val)
 {
@@ -688,6 +873,47 @@ cfgTransportBufSet(config_t* cfg, which_transport_t t, cfg_buffer_t buf)
     cfg->transport[t].file.buf_policy = buf;
 }
 
+void
+cfgTransportCompressSet(config_t* cfg, which_transport_t t, cfg_compress_t type)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    if (type < CFG_COMPRESS_NONE || type > CFG_COMPRESS_LZ4) return;
+    cfg->transport[t].compress.type = type;
+}
+
+void
+cfgTransportCompressBlockSet(config_t* cfg, which_transport_t t, unsigned block)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    // lz4 frames can't describe blocks over 4MB
+    if (block < DEFAULT_COMPRESS_BLOCK_MIN || block > 4 * 1024 * 1024) return;
+    cfg->transport[t].compress.block = block;
+}
+
+void
+cfgTransportQueueSizeSet(config_t* cfg, which_transport_t t, unsigned size)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    // 0 turns the queue off; sends block as they did before it
+    if (size && (size < DEFAULT_QUEUE_SIZE_MIN || size > DEFAULT_QUEUE_SIZE_MAX)) return;
+    cfg->transport[t].queue.size = size;
+}
+
+void
+cfgTransportSpillDirSet(config_t* cfg, which_transport_t t, const char* dir)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    if (cfg->transport[t].queue.spilldir) free(cfg->transport[t].queue.spilldir);
+    cfg->transport[t].queue.spilldir = (dir && dir[0]) ? strdup(dir) : NULL;
+}
+
+void
+cfgTransportSpillSizeSet(config_t* cfg, which_transport_t t, unsigned long long size)
+{
+    if (!cfg || t < 0 || t >= CFG_WHICH_MAX) return;
+    cfg->transport[t].queue.spillsize = size;
+}
+
 void
 cfgCustomTagAdd(config_t* c, const char* name, const char* value)
 {
@@ -778,3 +1004,45 @@ cfgPayDirSet(config_t *cfg, const char *dir)
     cfg->pay.dir = strdup(dir);
 }
 
+void
+cfgPayLimitSet(config_t *cfg, unsigned long long val)
+{
+    if (!cfg) return;
+    cfg->pay.limit = val;
+}
+
+void
+cfgPayHeadSet(config_t *cfg, unsigned val)
+{
+    if (!cfg || val > 1) return;
+    cfg->pay.head = val;
+}
+
+void
+cfgPayMaxSizeSet(config_t *cfg, unsigned long long val)
+{
+    if (!cfg) return;
+    cfg->pay.maxsize = val;
+}
+
+void
+cfgPayMaxAgeSet(config_t *cfg, unsigned val)
+{
+    if (!cfg) return;
+    cfg->pay.maxage = val;
+}
+
+void
+cfgPayMaxTotalSet(config_t *cfg, unsigned long long val)
+{
+    if (!cfg) return;
+    cfg->pay.maxtotal = val;
+}
+
+void
+cfgPayFormatSet(config_t *cfg, cfg_pay_format_t val)
+{
+    if (!cfg || val < CFG_PAYLOAD_RAW || val > CFG_PAYLOAD_PCAPNG) return;
+    cfg->pay.format = val;
+}
+
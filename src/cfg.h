@@ -21,7 +21,11 @@ unsigned            cfgMtcStatsDMaxLen(config_t*);
 unsigned            cfgMtcPeriod(config_t*);
 const char*         cfgCmdDir(config_t*);
 unsigned            cfgSendProcessStartMsg(config_t*);
+cfg_prefork_t       cfgPrefork(config_t*);
 unsigned            cfgMtcVerbosity(config_t*);
+unsigned            cfgMtcCardinality(config_t*);
+cfg_mtc_aggregate_t cfgMtcAggregate(config_t*);
+const char*         cfgMtcMode(config_t*);
 unsigned            cfgEvtEnable(config_t*);
 cfg_mtc_format_t    cfgEventFormat(config_t*);
 unsigned            cfgEvtRateLimit(config_t*);
@@ -35,11 +39,22 @@ const char*         cfgTransportHost(config_t*, which_transport_t);
 const char*         cfgTransportPort(config_t*, which_transport_t);
 const char*         cfgTransportPath(config_t*, which_transport_t);
 cfg_buffer_t        cfgTransportBuf(config_t*, which_transport_t);
+cfg_compress_t      cfgTransportCompress(config_t*, which_transport_t);
+unsigned            cfgTransportCompressBlock(config_t*, which_transport_t);
+unsigned            cfgTransportQueueSize(config_t*, which_transport_t);
+const char*         cfgTransportSpillDir(config_t*, which_transport_t);
+unsigned long long  cfgTransportSpillSize(config_t*, which_transport_t);
 custom_tag_t**      cfgCustomTags(config_t*);
 const char*         cfgCustomTagValue(config_t*, const char*);
 cfg_log_level_t     cfgLogLevel(config_t*);
 unsigned int        cfgPayEnable(config_t*);
 const char *        cfgPayDir(config_t*);
+unsigned long long  cfgPayLimit(config_t*);
+unsigned            cfgPayHead(config_t*);
+unsigned long long  cfgPayMaxSize(config_t*);
+unsigned            cfgPayMaxAge(config_t*);
+unsigned long long  cfgPayMaxTotal(config_t*);
+cfg_pay_format_t    cfgPayFormat(config_t*);
 
 // Setters (modifies config_t, but does not persist modifications)
 void                cfgMtcEnableSet(config_t*, unsigned);
@@ -49,7 +64,11 @@ void                cfgMtcStatsDMaxLenSet(config_t*, unsigned);
 void                cfgMtcPeriodSet(config_t*, unsigned);
 void                cfgCmdDirSet(config_t*, const char*);
 void                cfgSendProcessStartMsgSet(config_t*, unsigned);
+void                cfgPreforkSet(config_t*, cfg_prefork_t);
 void                cfgMtcVerbositySet(config_t*, unsigned);
+void                cfgMtcCardinalitySet(config_t*, unsigned);
+void                cfgMtcAggregateSet(config_t*, cfg_mtc_aggregate_t);
+void                cfgMtcModeSet(config_t*, const char*);
 void                cfgEvtEnableSet(config_t*, unsigned);
 void                cfgEventFormatSet(config_t*, cfg_mtc_format_t);
 void                cfgEvtRateLimitSet(config_t*, unsigned);
@@ -63,8 +82,19 @@ void                cfgTransportHostSet(config_t*, which_transport_t, const char
 void                cfgTransportPortSet(config_t*, which_transport_t, const char*);
 void                cfgTransportPathSet(config_t*, which_transport_t, const char*);
 void                cfgTransportBufSet(config_t*, which_transport_t, cfg_buffer_t);
+void                cfgTransportCompressSet(config_t*, which_transport_t, cfg_compress_t);
+void                cfgTransportCompressBlockSet(config_t*, which_transport_t, unsigned);
+void                cfgTransportQueueSizeSet(config_t*, which_transport_t, unsigned);
+void                cfgTransportSpillDirSet(config_t*, which_transport_t, const char*);
+void                cfgTransportSpillSizeSet(config_t*, which_transport_t, unsigned long long);
 void                cfgCustomTagAdd(config_t*, const char*, const char*);
 void                cfgLogLevelSet(config_t*, cfg_log_level_t);
 void                cfgPayEnableSet(config_t*, unsigned int);
 void                cfgPayDirSet(config_t*, const char *);
+void                cfgPayLimitSet(config_t*, unsigned long long);
+void                cfgPayHeadSet(config_t*, unsigned);
+void                cfgPayMaxSizeSet(config_t*, unsigned long long);
+void                cfgPayMaxAgeSet(config_t*, unsigned);
+void                cfgPayMaxTotalSet(config_t*, unsigned long long);
+void                cfgPayFormatSet(config_t*, cfg_pay_format_t);
 #endif // __CFG_H__
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include <dlfcn.h>
 #include <errno.h>
+#include <limits.h>
 #include <pwd.h>
 #include "pcre2posix.h"
 #include <stddef.h>
@@ -27,6 +28,9 @@
 #define STATSDPREFIX_NODE            "statsdprefix"
 #define STATSDMAXLEN_NODE            "statsdmaxlen"
 #define VERBOSITY_NODE               "verbosity"
+#define CARDINALITY_NODE             "cardinality"
+#define AGGREGATE_NODE               "aggregate"
+#define MODE_NODE                    "mode"
 #define TAGS_NODE                    "tags"
 #define TRANSPORT_NODE           "transport"
 #define TYPE_NODE                    "type"
@@ -34,6 +38,11 @@
 #define PORT_NODE                    "port"
 #define PATH_NODE                    "path"
 #define BUFFERING_NODE               "buffering"
+#define COMPRESSION_NODE             "compression"
+#define BLOCKSIZE_NODE               "blocksize"
+#define QUEUESIZE_NODE               "queuesize"
+#define SPILLDIR_NODE                "spilldir"
+#define SPILLSIZE_NODE               "spillsize"
 
 #define LIBSCOPE_NODE        "libscope"
 #define LOG_NODE                 "log"
@@ -42,6 +51,7 @@
 #define SUMMARYPERIOD_NODE       "summaryperiod"
 #define COMMANDDIR_NODE          "commanddir"
 #define CFGEVENT_NODE            "configevent"
+#define PREFORK_NODE             "prefork"
 
 #define EVENT_NODE           "event"
 #define TRANSPORT_NODE           "transport"
@@ -58,11 +68,18 @@
 #define PAYLOAD_NODE          "payload"
 #define ENABLE_NODE              "enable"
 #define DIR_NODE                 "dir"
+#define LIMIT_NODE               "limit"
+#define HEAD_NODE                "head"
+#define MAXSIZE_NODE             "maxsize"
+#define MAXAGE_NODE              "maxage"
+#define MAXTOTAL_NODE            "maxtotal"
+#define PAYFORMAT_NODE           "format"
 
 
 enum_map_t formatMap[] = {
     {"statsd",                CFG_FMT_STATSD},
     {"ndjson",                CFG_FMT_NDJSON},
+    {"binary",                CFG_FMT_BINARY},
     {NULL,                    -1}
 };
 
@@ -92,6 +109,31 @@ enum_map_t bufferMap[] = {
     {NULL,                    -1}
 };
 
+enum_map_t payFormatMap[] = {
+    {"raw",                   CFG_PAYLOAD_RAW},
+    {"pcapng",                CFG_PAYLOAD_PCAPNG},
+    {NULL,                    -1}
+};
+
+enum_map_t aggregateMap[] = {
+    {"process",               CFG_AGG_PROCESS},
+    {"container",             CFG_AGG_CONTAINER},
+    {NULL,                    -1}
+};
+
+enum_map_t preforkMap[] = {
+    {"off",                   CFG_PREFORK_OFF},
+    {"on",                    CFG_PREFORK_ON},
+    {"funnel",                CFG_PREFORK_FUNNEL},
+    {NULL,                    -1}
+};
+
+enum_map_t compressMap[] = {
+    {"none",                  CFG_COMPRESS_NONE},
+    {"lz4",                   CFG_COMPRESS_LZ4},
+    {NULL,                    -1}
+};
+
 enum_map_t watchTypeMap[] = {
     {"file",                  CFG_SRC_FILE},
     {"console",               CFG_SRC_CONSOLE},
@@ -118,6 +160,7 @@ void cfgMtcStatsDMaxLenSetFromStr(config_t*, const char*);
 void cfgMtcPeriodSetFromStr(config_t*, const char*);
 void cfgCmdDirSetFromStr(config_t*, const char*);
 void cfgConfigEventSetFromStr(config_t*, const char*);
+void cfgPreforkSetFromStr(config_t*, const char*);
 void cfgEvtEnableSetFromStr(config_t*, const char*);
 void cfgEventFormatSetFromStr(config_t*, const char*);
 void cfgEvtRateLimitSetFromStr(config_t*, const char*);
@@ -127,11 +170,25 @@ void cfgEvtFormatFieldFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatNameFilterSetFromStr(config_t*, watch_t, const char*);
 void cfgEvtFormatSourceEnabledSetFromStr(config_t*, watch_t, const char*);
 void cfgMtcVerbositySetFromStr(config_t*, const char*);
+void cfgMtcCardinalitySetFromStr(config_t*, const char*);
+void cfgMtcAggregateSetFromStr(config_t*, const char*);
+void cfgMtcModeSetFromStr(config_t*, const char*);
 void cfgTransportSetFromStr(config_t*, which_transport_t, const char*);
+void cfgTransportCompressSetFromStr(config_t*, which_transport_t, const char*);
+void cfgTransportCompressBlockSetFromStr(config_t*, which_transport_t, const char*);
+void cfgTransportQueueSizeSetFromStr(config_t*, which_transport_t, const char*);
+void cfgTransportSpillDirSetFromStr(config_t*, which_transport_t, const char*);
+void cfgTransportSpillSizeSetFromStr(config_t*, which_transport_t, const char*);
 void cfgCustomTagAddFromStr(config_t*, const char*, const char*);
 void cfgLogLevelSetFromStr(config_t*, const char*);
 void cfgPayEnableSetFromStr(config_t*, const char*);
 void cfgPayDirSetFromStr(config_t*, const char*);
+void cfgPayLimitSetFromStr(config_t*, const char*);
+void cfgPayHeadSetFromStr(config_t*, const char*);
+void cfgPayMaxSizeSetFromStr(config_t*, const char*);
+void cfgPayMaxAgeSetFromStr(config_t*, const char*);
+void cfgPayMaxTotalSetFromStr(config_t*, const char*);
+void cfgPayFormatSetFromStr(config_t*, const char*);
 
 // These global variables limits us to only reading one config file at a time...
 // which seems fine for now, I guess.
@@ -398,12 +455,30 @@ processEnvStyleInput(config_t* cfg, const char* env_line)
         cfgCmdDirSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_CONFIG_EVENT")) {
         cfgConfigEventSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PREFORK")) {
+        cfgPreforkSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_METRIC_VERBOSITY")) {
         cfgMtcVerbositySetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_CARDINALITY")) {
+        cfgMtcCardinalitySetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_AGGREGATE")) {
+        cfgMtcAggregateSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_MODE")) {
+        cfgMtcModeSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_LOG_LEVEL")) {
         cfgLogLevelSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_METRIC_DEST")) {
         cfgTransportSetFromStr(cfg, CFG_MTC, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_COMPRESSION")) {
+        cfgTransportCompressSetFromStr(cfg, CFG_MTC, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_BLOCKSIZE")) {
+        cfgTransportCompressBlockSetFromStr(cfg, CFG_MTC, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_QUEUESIZE")) {
+        cfgTransportQueueSizeSetFromStr(cfg, CFG_MTC, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_SPILLDIR")) {
+        cfgTransportSpillDirSetFromStr(cfg, CFG_MTC, value);
+    } else if (startsWith(env_line, "SCOPE_METRIC_SPILLSIZE")) {
+        cfgTransportSpillSizeSetFromStr(cfg, CFG_MTC, value);
     } else if (startsWith(env_line, "SCOPE_LOG_DEST")) {
         cfgTransportSetFromStr(cfg, CFG_LOG, value);
     } else if (startsWith(env_line, "SCOPE_TAG_")) {
@@ -412,10 +487,32 @@ processEnvStyleInput(config_t* cfg, const char* env_line)
         cfgPayEnableSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_PAYLOAD_DIR")) {
         cfgPayDirSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_LIMIT")) {
+        cfgPayLimitSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_HEAD")) {
+        cfgPayHeadSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_MAXSIZE")) {
+        cfgPayMaxSizeSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_MAXAGE")) {
+        cfgPayMaxAgeSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_MAXTOTAL")) {
+        cfgPayMaxTotalSetFromStr(cfg, value);
+    } else if (startsWith(env_line, "SCOPE_PAYLOAD_FORMAT")) {
+        cfgPayFormatSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_CMD_DBG_PATH")) {
         processCmdDebug(value);
     } else if (startsWith(env_line, "SCOPE_EVENT_DEST")) {
         cfgTransportSetFromStr(cfg, CFG_CTL, value);
+    } else if (startsWith(env_line, "SCOPE_EVENT_COMPRESSION")) {
+        cfgTransportCompressSetFromStr(cfg, CFG_CTL, value);
+    } else if (startsWith(env_line, "SCOPE_EVENT_BLOCKSIZE")) {
+        cfgTransportCompressBlockSetFromStr(cfg, CFG_CTL, value);
+    } else if (startsWith(env_line, "SCOPE_EVENT_QUEUESIZE")) {
+        cfgTransportQueueSizeSetFromStr(cfg, CFG_CTL, value);
+    } else if (startsWith(env_line, "SCOPE_EVENT_SPILLDIR")) {
+        cfgTransportSpillDirSetFromStr(cfg, CFG_CTL, value);
+    } else if (startsWith(env_line, "SCOPE_EVENT_SPILLSIZE")) {
+        cfgTransportSpillSizeSetFromStr(cfg, CFG_CTL, value);
     } else if (startsWith(env_line, "SCOPE_EVENT_ENABLE")) {
         cfgEvtEnableSetFromStr(cfg, value);
     } else if (startsWith(env_line, "SCOPE_EVENT_FORMAT")) {
@@ -597,6 +694,13 @@ cfgConfigEventSetFromStr(config_t* cfg, const char* value)
     cfgSendProcessStartMsgSet(cfg, strToVal(boolMap, value));
 }
 
+void
+cfgPreforkSetFromStr(config_t* cfg, const char* value)
+{
+    if (!cfg || !value) return;
+    cfgPreforkSet(cfg, strToVal(preforkMap, value));
+}
+
 void
 cfgEvtEnableSetFromStr(config_t* cfg, const char* value)
 {
@@ -608,9 +712,12 @@ void
 cfgEventFormatSetFromStr(config_t* cfg, const char* value)
 {
     if (!cfg || !value) return;
-    // only ndjson is valid
-    cfgEventFormatSet(cfg, CFG_FMT_NDJSON);
-    //cfgEventFormatSet(cfg, strToVal(formatMap, value));
+    // only ndjson and binary are valid
+    if (strToVal(formatMap, value) == CFG_FMT_BINARY) {
+        cfgEventFormatSet(cfg, CFG_FMT_BINARY);
+    } else {
+        cfgEventFormatSet(cfg, CFG_FMT_NDJSON);
+    }
 }
 
 void
@@ -672,12 +779,38 @@ cfgMtcVerbositySetFromStr(config_t* cfg, const char* value)
     cfgMtcVerbositySet(cfg, x);
 }
 
+void
+cfgMtcCardinalitySetFromStr(config_t* cfg, const char* value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr || x > UINT_MAX) return;
+
+    cfgMtcCardinalitySet(cfg, x);
+}
+
+void
+cfgMtcAggregateSetFromStr(config_t* cfg, const char* value)
+{
+    if (!cfg || !value) return;
+    cfgMtcAggregateSet(cfg, strToVal(aggregateMap, value));
+}
+
+void
+cfgMtcModeSetFromStr(config_t* cfg, const char* value)
+{
+    // Names and modes are checked when the modes are applied
+    cfgMtcModeSet(cfg, value);
+}
+
 void
 cfgTransportSetFromStr(config_t* cfg, which_transport_t t, const char* value)
 {
     if (!cfg || !value) return;
 
-    // see if value starts with udp:// or file://
+    // see if value starts with udp://, tcp://, file:// or syslog://
     if (value == strstr(value, "udp://")) {
 
         // copied to avoid directly modifing the process's env variable
@@ -720,9 +853,63 @@ cfgTransportSetFromStr(config_t* cfg, which_transport_t t, const char* value)
         const char* path = value + strlen("file://");
         cfgTransportTypeSet(cfg, t, CFG_FILE);
         cfgTransportPathSet(cfg, t, path);
+
+    } else if (value == strstr(value, "syslog://")) {
+        // Always /dev/log
+        cfgTransportTypeSet(cfg, t, CFG_SYSLOG);
     }
 }
 
+void
+cfgTransportCompressSetFromStr(config_t* cfg, which_transport_t t, const char* value)
+{
+    if (!cfg || !value) return;
+    cfgTransportCompressSet(cfg, t, strToVal(compressMap, value));
+}
+
+void
+cfgTransportCompressBlockSetFromStr(config_t* cfg, which_transport_t t, const char* value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgTransportCompressBlockSet(cfg, t, x);
+}
+
+void
+cfgTransportQueueSizeSetFromStr(config_t* cfg, which_transport_t t, const char* value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr || x > UINT_MAX) return;
+
+    cfgTransportQueueSizeSet(cfg, t, x);
+}
+
+void
+cfgTransportSpillDirSetFromStr(config_t* cfg, which_transport_t t, const char* value)
+{
+    if (!cfg || !value) return;
+    cfgTransportSpillDirSet(cfg, t, value);
+}
+
+void
+cfgTransportSpillSizeSetFromStr(config_t* cfg, which_transport_t t, const char* value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long long x = strtoull(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgTransportSpillSizeSet(cfg, t, x);
+}
+
 void
 cfgCustomTagAddFromStr(config_t* cfg, const char* name, const char* value)
 {
@@ -752,6 +939,68 @@ cfgPayDirSetFromStr(config_t *cfg, const char *value)
     cfgPayDirSet(cfg, value);
 }
 
+void
+cfgPayLimitSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long long x = strtoull(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgPayLimitSet(cfg, x);
+}
+
+void
+cfgPayHeadSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    cfgPayHeadSet(cfg, strToVal(boolMap, value));
+}
+
+void
+cfgPayMaxSizeSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long long x = strtoull(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgPayMaxSizeSet(cfg, x);
+}
+
+void
+cfgPayMaxAgeSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long x = strtoul(value, &endptr, 10);
+    if (errno || *endptr || (x > UINT_MAX)) return;
+
+    cfgPayMaxAgeSet(cfg, x);
+}
+
+void
+cfgPayMaxTotalSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    errno = 0;
+    char* endptr = NULL;
+    unsigned long long x = strtoull(value, &endptr, 10);
+    if (errno || *endptr) return;
+
+    cfgPayMaxTotalSet(cfg, x);
+}
+
+void
+cfgPayFormatSetFromStr(config_t *cfg, const char *value)
+{
+    if (!cfg || !value) return;
+    cfgPayFormatSet(cfg, strToVal(payFormatMap, value));
+}
+
 #ifndef NO_YAML
 
 #define foreach(pair, pairs) \
@@ -848,6 +1097,51 @@ processBuf(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     if (value) free(value);
 }
 
+static void
+processCompression(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    cfgTransportCompressSetFromStr(config, c, value);
+    if (value) free(value);
+}
+
+static void
+processBlockSize(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    cfgTransportCompressBlockSetFromStr(config, c, value);
+    if (value) free(value);
+}
+
+static void
+processQueueSize(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    cfgTransportQueueSizeSetFromStr(config, c, value);
+    if (value) free(value);
+}
+
+static void
+processSpillDir(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    cfgTransportSpillDirSetFromStr(config, c, value);
+    if (value) free(value);
+}
+
+static void
+processSpillSize(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    which_transport_t c = transport_context;
+    cfgTransportSpillSizeSetFromStr(config, c, value);
+    if (value) free(value);
+}
+
 static void
 processTransport(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -859,6 +1153,11 @@ processTransport(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    PORT_NODE,            processPort},
         {YAML_SCALAR_NODE,    PATH_NODE,            processPath},
         {YAML_SCALAR_NODE,    BUFFERING_NODE,       processBuf},
+        {YAML_SCALAR_NODE,    COMPRESSION_NODE,     processCompression},
+        {YAML_SCALAR_NODE,    BLOCKSIZE_NODE,       processBlockSize},
+        {YAML_SCALAR_NODE,    QUEUESIZE_NODE,       processQueueSize},
+        {YAML_SCALAR_NODE,    SPILLDIR_NODE,        processSpillDir},
+        {YAML_SCALAR_NODE,    SPILLSIZE_NODE,       processSpillSize},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
@@ -983,6 +1282,66 @@ processVerbosity(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     if (value) free(value);
 }
 
+static void
+processCardinality(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgMtcCardinalitySetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processAggregate(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgMtcAggregateSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processMode(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgMtcModeSetFromStr(config, value);
+    if (value) free(value);
+}
+
+// Turns a map of metric name to mode into the name:mode,... string form
+static void
+processModeMap(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    if (node->type != YAML_MAPPING_NODE) return;
+
+    char* modes = NULL;
+    size_t len = 0;
+    yaml_node_pair_t* pair;
+    foreach(pair, node->data.mapping.pairs) {
+        yaml_node_t* key = yaml_document_get_node(doc, pair->key);
+        yaml_node_t* value = yaml_document_get_node(doc, pair->value);
+        if (key->type != YAML_SCALAR_NODE) continue;
+        if (value->type != YAML_SCALAR_NODE) continue;
+
+        char* key_str = stringVal(key);
+        char* value_str = stringVal(value);
+        if (key_str && value_str) {
+            size_t add = strlen(key_str) + strlen(value_str) + 2;
+            char* temp = realloc(modes, len + add + 1);
+            if (temp) {
+                modes = temp;
+                len += snprintf(&modes[len], add + 1, "%s%s:%s",
+                                (len) ? "," : "", key_str, value_str);
+            } else {
+                DBG(NULL);
+            }
+        }
+        if (key_str) free(key_str);
+        if (value_str) free(value_str);
+    }
+
+    cfgMtcModeSetFromStr(config, modes);
+    if (modes) free(modes);
+}
+
 static void
 processMetricEnable(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1001,6 +1360,10 @@ processFormat(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    STATSDPREFIX_NODE,    processStatsDPrefix},
         {YAML_SCALAR_NODE,    STATSDMAXLEN_NODE,    processStatsDMaxLen},
         {YAML_SCALAR_NODE,    VERBOSITY_NODE,       processVerbosity},
+        {YAML_SCALAR_NODE,    CARDINALITY_NODE,     processCardinality},
+        {YAML_SCALAR_NODE,    AGGREGATE_NODE,       processAggregate},
+        {YAML_SCALAR_NODE,    MODE_NODE,            processMode},
+        {YAML_MAPPING_NODE,   MODE_NODE,            processModeMap},
         {YAML_MAPPING_NODE,   TAGS_NODE,            processTags},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
@@ -1035,6 +1398,14 @@ processConfigEvent(config_t* config, yaml_document_t* doc, yaml_node_t* node)
     if (value) free(value);
 }
 
+static void
+processPrefork(config_t* config, yaml_document_t* doc, yaml_node_t* node)
+{
+    char* value = stringVal(node);
+    cfgPreforkSetFromStr(config, value);
+    if (value) free(value);
+}
+
 static void
 processMetric(config_t* config, yaml_document_t* doc, yaml_node_t* node)
 {
@@ -1206,6 +1577,7 @@ processLibscope(config_t* config, yaml_document_t* doc, yaml_node_t* node)
         {YAML_SCALAR_NODE,    SUMMARYPERIOD_NODE,   processSummaryPeriod},
         {YAML_SCALAR_NODE,    COMMANDDIR_NODE,      processCommandDir},
         {YAML_SCALAR_NODE,    CFGEVENT_NODE,        processConfigEvent},
+        {YAML_SCALAR_NODE,    PREFORK_NODE,         processPrefork},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
@@ -1231,6 +1603,54 @@ processPayloadDir(config_t *config, yaml_document_t *doc, yaml_node_t *node)
     if (value) free(value);
 }
 
+static void
+processPayloadLimit(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayLimitSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processPayloadHead(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayHeadSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processPayloadMaxSize(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayMaxSizeSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processPayloadMaxAge(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayMaxAgeSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processPayloadMaxTotal(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayMaxTotalSetFromStr(config, value);
+    if (value) free(value);
+}
+
+static void
+processPayloadFormat(config_t *config, yaml_document_t *doc, yaml_node_t *node)
+{
+    char* value = stringVal(node);
+    cfgPayFormatSetFromStr(config, value);
+    if (value) free(value);
+}
+
 static void
 processPayload(config_t *config, yaml_document_t *doc, yaml_node_t *node)
 {
@@ -1239,6 +1659,12 @@ processPayload(config_t *config, yaml_document_t *doc, yaml_node_t *node)
     parse_table_t t[] = {
         {YAML_SCALAR_NODE,    ENABLE_NODE,          processPayloadEnable},
         {YAML_SCALAR_NODE,    DIR_NODE,             processPayloadDir},
+        {YAML_SCALAR_NODE,    LIMIT_NODE,           processPayloadLimit},
+        {YAML_SCALAR_NODE,    HEAD_NODE,            processPayloadHead},
+        {YAML_SCALAR_NODE,    MAXSIZE_NODE,         processPayloadMaxSize},
+        {YAML_SCALAR_NODE,    MAXAGE_NODE,          processPayloadMaxAge},
+        {YAML_SCALAR_NODE,    MAXTOTAL_NODE,        processPayloadMaxTotal},
+        {YAML_SCALAR_NODE,    PAYFORMAT_NODE,       processPayloadFormat},
         {YAML_NO_NODE,        NULL,                 NULL}
     };
 
@@ -1369,6 +1795,17 @@ createTransportJson(config_t* cfg, which_transport_t trans)
                                      cfgTransportHost(cfg, trans))) goto err;
             if (!cJSON_AddStringToObjLN(root, PORT_NODE,
                                      cfgTransportPort(cfg, trans))) goto err;
+            if (cfgTransportType(cfg, trans) == CFG_UDP) break;
+            if (!cJSON_AddStringToObjLN(root, COMPRESSION_NODE,
+                 valToStr(compressMap, cfgTransportCompress(cfg, trans)))) goto err;
+            if (!cJSON_AddNumberToObjLN(root, BLOCKSIZE_NODE,
+                             cfgTransportCompressBlock(cfg, trans))) goto err;
+            if (!cJSON_AddNumberToObjLN(root, QUEUESIZE_NODE,
+                             cfgTransportQueueSize(cfg, trans))) goto err;
+            if (!cJSON_AddStringToObjLN(root, SPILLDIR_NODE,
+                 (cfgTransportSpillDir(cfg, trans)) ? cfgTransportSpillDir(cfg, trans) : "")) goto err;
+            if (!cJSON_AddNumberToObjLN(root, SPILLSIZE_NODE,
+                             cfgTransportSpillSize(cfg, trans))) goto err;
             break;
         case CFG_UNIX:
             if (!cJSON_AddStringToObjLN(root, PATH_NODE,
@@ -1379,6 +1816,10 @@ createTransportJson(config_t* cfg, which_transport_t trans)
                                      cfgTransportPath(cfg, trans))) goto err;
             if (!cJSON_AddStringToObjLN(root, BUFFERING_NODE,
                  valToStr(bufferMap, cfgTransportBuf(cfg, trans)))) goto err;
+            if (!cJSON_AddStringToObjLN(root, COMPRESSION_NODE,
+                 valToStr(compressMap, cfgTransportCompress(cfg, trans)))) goto err;
+            if (!cJSON_AddNumberToObjLN(root, BLOCKSIZE_NODE,
+                             cfgTransportCompressBlock(cfg, trans))) goto err;
             break;
         case CFG_SYSLOG:
         case CFG_SHM:
@@ -1450,6 +1891,12 @@ createMetricFormatJson(config_t* cfg)
                                     cfgMtcStatsDMaxLen(cfg))) goto err;
     if (!cJSON_AddNumberToObjLN(root, VERBOSITY_NODE,
                                        cfgMtcVerbosity(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, CARDINALITY_NODE,
+                                     cfgMtcCardinality(cfg))) goto err;
+    if (!cJSON_AddStringToObjLN(root, AGGREGATE_NODE,
+                 valToStr(aggregateMap, cfgMtcAggregate(cfg)))) goto err;
+    if (!cJSON_AddStringToObjLN(root, MODE_NODE,
+                                            cfgMtcMode(cfg))) goto err;
 
     if (!(tags = createTagsJson(cfg))) goto err;
     cJSON_AddItemToObjectCS(root, TAGS_NODE, tags);
@@ -1582,6 +2029,18 @@ createPayloadJson(config_t *cfg)
                          valToStr(boolMap, cfgPayEnable(cfg)))) goto err;
     if (!cJSON_AddStringToObjLN(root, DIR_NODE,
                          cfgPayDir(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, LIMIT_NODE,
+                         cfgPayLimit(cfg))) goto err;
+    if (!cJSON_AddStringToObjLN(root, HEAD_NODE,
+                         valToStr(boolMap, cfgPayHead(cfg)))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, MAXSIZE_NODE,
+                         cfgPayMaxSize(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, MAXAGE_NODE,
+                         cfgPayMaxAge(cfg))) goto err;
+    if (!cJSON_AddNumberToObjLN(root, MAXTOTAL_NODE,
+                         cfgPayMaxTotal(cfg))) goto err;
+    if (!cJSON_AddStringToObjLN(root, PAYFORMAT_NODE,
+                         valToStr(payFormatMap, cfgPayFormat(cfg)))) goto err;
 
     return root;
 err:
@@ -1609,6 +2068,9 @@ createLibscopeJson(config_t* cfg)
     if (!cJSON_AddStringToObjLN(root, COMMANDDIR_NODE,
                                          cfgCmdDir(cfg))) goto err;
 
+    if (!cJSON_AddStringToObjLN(root, PREFORK_NODE,
+                 valToStr(preforkMap, cfgPrefork(cfg)))) goto err;
+
     return root;
 err:
     if (root) cJSON_Delete(root);
@@ -1659,7 +2121,7 @@ initTransport(config_t* cfg, which_transport_t t)
 
     switch (cfgTransportType(cfg, t)) {
         case CFG_SYSLOG:
-            transport = transportCreateSyslog();
+            transport = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
             break;
         case CFG_FILE:
             transport = transportCreateFile(cfgTransportPath(cfg, t), cfgTransportBuf(cfg,t));
@@ -1674,11 +2136,22 @@ initTransport(config_t* cfg, which_transport_t t)
             transport = transportCreateTCP(cfgTransportHost(cfg, t), cfgTransportPort(cfg, t));
             break;
         case CFG_SHM:
-            transport = transportCreateShm();
+            // Only pre-fork workers have a ring to put records in
+            transport = transportCreateShm(NULL, t);
             break;
         default:
             DBG("%d", cfgTransportType(cfg, t));
     }
+
+    if (cfgTransportCompress(cfg, t) != CFG_COMPRESS_NONE) {
+        transportCompressSet(transport, cfgTransportCompress(cfg, t),
+                             cfgTransportCompressBlock(cfg, t));
+    }
+    if (cfgTransportQueueSize(cfg, t)) {
+        transportQueueSet(transport, cfgTransportQueueSize(cfg, t),
+                          cfgTransportSpillDir(cfg, t),
+                          cfgTransportSpillSize(cfg, t));
+    }
     return transport;
 }
 
@@ -1712,13 +2185,23 @@ initLog(config_t* cfg)
 
 mtc_t*
 initMtc(config_t* cfg)
+{
+    return initMtcWithTransport(cfg, initTransport(cfg, CFG_MTC));
+}
+
+mtc_t*
+initMtcWithTransport(config_t* cfg, transport_t* t)
 {
     mtc_t* mtc = mtcCreate();
-    if (!mtc) return mtc;
+    if (!mtc) {
+        transportDestroy(&t);
+        return mtc;
+    }
 
     mtcEnabledSet(mtc, cfgMtcEnable(cfg));
+    mtcAggregateSet(mtc, cfgMtcCardinality(cfg));
+    mtcAggregateBySet(mtc, cfgMtcAggregate(cfg));
 
-    transport_t* t = initTransport(cfg, CFG_MTC);
     if (!t) {
         mtcDestroy(&mtc);
         return mtc;
@@ -1778,10 +2261,17 @@ initCtl(config_t *cfg)
         return ctl;
     }
     ctlEvtSet(ctl, evt);
+    ctlFormatSet(ctl, cfgEventFormat(cfg));
 
     ctlEnhanceFsSet(ctl, cfgEnhanceFs(cfg));
     ctlPayEnableSet(ctl, cfgPayEnable(cfg));
     ctlPayDirSet(ctl,    cfgPayDir(cfg));
+    ctlPayLimitSet(ctl,  cfgPayLimit(cfg));
+    ctlPayHeadSet(ctl,   cfgPayHead(cfg));
+    ctlPayMaxSizeSet(ctl, cfgPayMaxSize(cfg));
+    ctlPayMaxAgeSet(ctl, cfgPayMaxAge(cfg));
+    ctlPayMaxTotalSet(ctl, cfgPayMaxTotal(cfg));
+    ctlPayFormatSet(ctl, cfgPayFormat(cfg));
 
     return ctl;
 }
@@ -33,6 +33,9 @@ void cfgProcessCommands(config_t* cfg, FILE* file);
 
 log_t* initLog(config_t* cfg);
 mtc_t* initMtc(config_t* cfg);
+// Like initMtc, but sends on t (which it owns from here on) rather than
+// on the transport cfg describes
+mtc_t* initMtcWithTransport(config_t* cfg, transport_t* t);
 evt_fmt_t* initEvtFormat(config_t* cfg);
 ctl_t* initCtl(config_t* cfg);
 
@@ -260,15 +260,14 @@ cmdCbufEmpty(ctl_t *ctl)
 }
 
 int
-cmdPostPayload(ctl_t *ctl, char *pay)
+cmdPostPayload(ctl_t *ctl, const void *hdr, size_t hlen, const void *data, size_t len)
 {
-    return ctlPostPayload(ctl, pay);
+    return ctlPostPayload(ctl, hdr, hlen, data, len);
 }
 
-uint64_t
-msgPayloadGet(ctl_t *ctl)
+int
+msgPayloadDrain(ctl_t *ctl, paybuf_fn fn, void *arg)
 {
-    if (!ctl) return (uint64_t) -1;
-    return ctlGetPayload(ctl);
+    return ctlDrainPayload(ctl, fn, arg);
 }
 
@@ -55,7 +55,7 @@ bool cmdCbufEmpty(ctl_t *);
 
 // payloads
 int cmdSendPayload(ctl_t *, char *, size_t);
-int cmdPostPayload(ctl_t *, char *);
-uint64_t msgPayloadGet(ctl_t *);
+int cmdPostPayload(ctl_t *, const void *, size_t, const void *, size_t);
+int msgPayloadDrain(ctl_t *, paybuf_fn, void *);
 
 #endif // __COM_H__
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "dbg.h"
+
+// See https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+// and lz4_Block_format.md
+#define LZ4_HEADER_SIZE 7        // magic, FLG, BD, HC
+#define LZ4_BLOCK_HDR 4
+#define LZ4_END_MARK 4
+#define LZ4_FLG_V1_INDEP 0x60    // version 01, independent blocks
+#define LZ4_UNCOMPRESSED 0x80000000U
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5       // a block always ends with 5 literals
+#define LZ4_MFLIMIT 12           // no match may start in the last 12 bytes
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_LOG 12
+#define LZ4_SKIP_TRIGGER 6       // search faster through incompressible data
+
+#define XXH_PRIME32_1 2654435761U
+#define XXH_PRIME32_2 2246822519U
+#define XXH_PRIME32_3 3266489917U
+#define XXH_PRIME32_4 668265263U
+#define XXH_PRIME32_5 374761393U
+
+struct _compress_t
+{
+    cfg_compress_t type;
+    size_t block;                // max bytes of input per frame
+    unsigned char header[LZ4_HEADER_SIZE];
+    unsigned char *in;
+    size_t in_len;
+    unsigned char *out;
+    uint32_t table[1 << LZ4_HASH_LOG];
+};
+
+static uint32_t
+rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t
+read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void
+writeLE32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// xxHash32 for the few bytes of a frame descriptor
+static uint32_t
+xxh32Small(const unsigned char *p, size_t len)
+{
+    const unsigned char *end = p + len;
+    uint32_t h = XXH_PRIME32_5 + (uint32_t)len;
+
+    for (; p + 4 <= end; p += 4) {
+        uint32_t k = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+        h += k * XXH_PRIME32_3;
+        h = rotl32(h, 17) * XXH_PRIME32_4;
+    }
+    for (; p < end; p++) {
+        h += *p * XXH_PRIME32_5;
+        h = rotl32(h, 11) * XXH_PRIME32_1;
+    }
+    h ^= h >> 15;
+    h *= XXH_PRIME32_2;
+    h ^= h >> 13;
+    h *= XXH_PRIME32_3;
+    h ^= h >> 16;
+    return h;
+}
+
+compress_t *
+compressCreate(cfg_compress_t type, size_t block)
+{
+    if (type != CFG_COMPRESS_LZ4) return NULL;
+
+    if (block < DEFAULT_COMPRESS_BLOCK_MIN) block = DEFAULT_COMPRESS_BLOCK_MIN;
+    if (block > LZ4_MAX_BLOCK) block = LZ4_MAX_BLOCK;
+
+    compress_t *z = calloc(1, sizeof(compress_t));
+    if (!z) {
+        DBG(NULL);
+        return NULL;
+    }
+    z->type = type;
+    z->block = block;
+
+    // A block is stored as is when it doesn't compress, so the
+    // frame is never bigger than this.
+    size_t out_size = LZ4_HEADER_SIZE + LZ4_BLOCK_HDR + block + LZ4_END_MARK;
+    if (!(z->in = malloc(block)) || !(z->out = malloc(out_size))) {
+        DBG("%zu", block);
+        compressDestroy(&z);
+        return NULL;
+    }
+
+    // The smallest of the 64KB, 256KB, 1MB and 4MB max block sizes
+    // that holds a whole block
+    unsigned bd = 4;
+    while ((64 * 1024UL << (2 * (bd - 4))) < block) bd++;
+
+    writeLE32(z->header, LZ4_FRAME_MAGIC);
+    z->header[4] = LZ4_FLG_V1_INDEP;
+    z->header[5] = bd << 4;
+    z->header[6] = (xxh32Small(&z->header[4], 2) >> 8) & 0xFF;
+
+    return z;
+}
+
+void
+compressDestroy(compress_t **zp)
+{
+    if (!zp || !*zp) return;
+    compress_t *z = *zp;
+    if (z->in) free(z->in);
+    if (z->out) free(z->out);
+    free(z);
+    *zp = NULL;
+}
+
+cfg_compress_t
+compressType(compress_t *z)
+{
+    return (z) ? z->type : CFG_COMPRESS_NONE;
+}
+
+size_t
+compressBlockSize(compress_t *z)
+{
+    return (z) ? z->block : 0;
+}
+
+size_t
+compressPending(compress_t *z)
+{
+    return (z) ? z->in_len : 0;
+}
+
+size_t
+compressWrite(compress_t *z, const char *buf, size_t len)
+{
+    if (!z || !buf) return 0;
+
+    size_t room = z->block - z->in_len;
+    if (len > room) len = room;
+    memcpy(&z->in[z->in_len], buf, len);
+    z->in_len += len;
+    return len;
+}
+
+void
+compressDiscard(compress_t *z)
+{
+    if (z) z->in_len = 0;
+}
+
+static unsigned char *
+putLength(unsigned char *op, size_t len)
+{
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static unsigned char *
+putSequence(unsigned char *op, const unsigned char *lit, size_t lit_len,
+            size_t offset, size_t match_len)
+{
+    unsigned char *token = op++;
+    *token = (lit_len < 15) ? lit_len << 4 : 0xF0;
+    if (lit_len >= 15) op = putLength(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    // the last sequence has literals only
+    if (!match_len) return op;
+
+    *op++ = offset;
+    *op++ = offset >> 8;
+    match_len -= LZ4_MINMATCH;
+    *token |= (match_len < 15) ? match_len : 0x0F;
+    if (match_len >= 15) op = putLength(op, match_len - 15);
+    return op;
+}
+
+// Greedy single-probe match finder, the same approach as LZ4_compress_fast.
+// Returns the compressed size, or 0 if it wouldn't be smaller than len.
+static size_t
+lz4Block(compress_t *z, const unsigned char *src, size_t len, unsigned char *dst)
+{
+    unsigned char *op = dst;
+    unsigned char *op_limit = dst + len;
+    size_t anchor = 0;
+
+    if (len > LZ4_MFLIMIT) {
+        size_t ip = 0;
+        size_t ip_limit = len - LZ4_MFLIMIT;
+        size_t match_limit = len - LZ4_LASTLITERALS;
+
+        memset(z->table, 0, sizeof(z->table));
+
+        while (ip < ip_limit) {
+            uint32_t seq = read32(&src[ip]);
+            uint32_t h = (seq * XXH_PRIME32_1) >> (32 - LZ4_HASH_LOG);
+            size_t ref = z->table[h];
+            z->table[h] = ip;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET ||
+                read32(&src[ref]) != seq) {
+                ip += 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t match_len = LZ4_MINMATCH;
+            while (ip + match_len < match_limit &&
+                   src[ip + match_len] == src[ref + match_len]) {
+                match_len++;
+            }
+
+            // worst case for a sequence is token, length bytes, offset
+            size_t lit_len = ip - anchor;
+            if (op + 1 + lit_len / 255 + 1 + lit_len + 2 +
+                match_len / 255 + 1 >= op_limit) return 0;
+
+            op = putSequence(op, &src[anchor], lit_len, ip - ref, match_len);
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    size_t lit_len = len - anchor;
+    if (op + 1 + lit_len / 255 + 1 + lit_len >= op_limit) return 0;
+    op = putSequence(op, &src[anchor], lit_len, 0, 0);
+
+    return op - dst;
+}
+
+size_t
+compressFrame(compress_t *z, const char **frame)
+{
+    if (!z || !frame || !z->in_len) return 0;
+
+    unsigned char *op = z->out;
+    memcpy(op, z->header, LZ4_HEADER_SIZE);
+    op += LZ4_HEADER_SIZE;
+
+    size_t size = lz4Block(z, z->in, z->in_len, op + LZ4_BLOCK_HDR);
+    if (size) {
+        writeLE32(op, size);
+    } else {
+        size = z->in_len;
+        writeLE32(op, size | LZ4_UNCOMPRESSED);
+        memcpy(op + LZ4_BLOCK_HDR, z->in, size);
+    }
+    op += LZ4_BLOCK_HDR + size;
+
+    writeLE32(op, 0);
+    op += LZ4_END_MARK;
+
+    z->in_len = 0;
+    *frame = (const char *)z->out;
+    return op - z->out;
+}
@@ -0,0 +1,42 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopetypes.h"
+
+// Streaming compression for the tcp and file transports.
+//
+// Data is gathered into blocks of a configurable size.  Each block goes
+// out as one complete lz4 frame (magic, descriptor, one independent block,
+// end mark; no checksums), so frames written by separate flushes,
+// processes, or connections can simply be concatenated.  The stream is
+// readable with the stock lz4 tool ("lz4 -dc") and by the scope cli.
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define LZ4_MAX_BLOCK (4 * 1024 * 1024)
+
+typedef struct _compress_t compress_t;
+
+// Constructors Destructors
+compress_t *        compressCreate(cfg_compress_t, size_t);
+void                compressDestroy(compress_t **);
+
+// Accessors
+cfg_compress_t      compressType(compress_t *);
+size_t              compressBlockSize(compress_t *);
+size_t              compressPending(compress_t *);
+
+// Buffers data, returning how much of it fit in the current block.
+// When less than len was taken, the block is full and must be framed.
+size_t              compressWrite(compress_t *, const char *, size_t);
+
+// Encodes everything buffered as one frame and empties the block.
+// Returns the length of the frame (0 if nothing was buffered) and points
+// the last arg at it; the frame is valid until the next call.
+size_t              compressFrame(compress_t *, const char **);
+
+// Empties the block without framing it
+void                compressDiscard(compress_t *);
+
+#endif // __COMPRESS_H__
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <string.h>
+#include "container.h"
+
+// What container runtimes' systemd cgroup drivers put around the id
+static const char *id_prefix[] = {
+    "docker-",
+    "cri-containerd-",
+    "crio-",
+    "libpod-",
+    NULL
+};
+
+#define SCOPE_SUFFIX ".scope"
+
+static int
+isHex(const char *str, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)str[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+// Is the segment a container id?  If so, where does the id start.
+static const char *
+segmentId(const char *seg, size_t len)
+{
+    int i;
+    for (i = 0; id_prefix[i]; i++) {
+        size_t plen = strlen(id_prefix[i]);
+        if ((len > plen) && !strncmp(seg, id_prefix[i], plen)) {
+            seg += plen;
+            len -= plen;
+            break;
+        }
+    }
+
+    size_t slen = strlen(SCOPE_SUFFIX);
+    if ((len > slen) && !strncmp(&seg[len - slen], SCOPE_SUFFIX, slen)) {
+        len -= slen;
+    }
+
+    return ((len == CONTAINER_ID_LEN) && isHex(seg, len)) ? seg : NULL;
+}
+
+static int
+isUidChar(char c)
+{
+    return isxdigit((unsigned char)c) || (c == '-') || (c == '_');
+}
+
+// Is there a pod<uid> in the segment?  If so, where does the uid start.
+static const char *
+segmentPod(const char *seg, size_t len)
+{
+    const char *end = seg + len;
+    const char *p = seg;
+
+    // "kubepods" has a "pod" in it too, so keep looking past ones that
+    // aren't followed by a uid
+    while ((p = memmem(p, end - p, "pod", 3))) {
+        const char *uid = p + 3;
+        p = uid;
+        if (end - uid < POD_UID_LEN) break;
+
+        int i;
+        for (i = 0; i < POD_UID_LEN && isUidChar(uid[i]); i++);
+        if (i < POD_UID_LEN) continue;
+        if ((uid + i < end) && (uid[i] != '.')) continue;
+        return uid;
+    }
+    return NULL;
+}
+
+static void
+copyOut(char *dst, size_t dlen, const char *src, size_t slen, int dashes)
+{
+    if (slen >= dlen) return;
+
+    size_t i;
+    for (i = 0; i < slen; i++) {
+        dst[i] = (dashes && (src[i] == '_')) ? '-' : tolower((unsigned char)src[i]);
+    }
+    dst[slen] = '\0';
+}
+
+// Looks through each segment of one cgroup path; the innermost wins
+static void
+parsePath(const char *path, size_t len, char *id, size_t idlen,
+          char *pod, size_t podlen)
+{
+    int need_id = (id[0] == '\0');
+    int need_pod = (pod[0] == '\0');
+    const char *end = path + len;
+    const char *seg = path;
+
+    while (seg < end) {
+        const char *slash = memchr(seg, '/', end - seg);
+        size_t slen = (slash) ? slash - seg : end - seg;
+
+        const char *found;
+        if (need_id && (found = segmentId(seg, slen))) {
+            copyOut(id, idlen, found, CONTAINER_ID_LEN, FALSE);
+        }
+        if (need_pod && (found = segmentPod(seg, slen))) {
+            copyOut(pod, podlen, found, POD_UID_LEN, TRUE);
+        }
+
+        seg += slen + 1;
+    }
+}
+
+bool
+containerParse(const char *cgroups, char *id, size_t idlen,
+               char *pod, size_t podlen)
+{
+    if (!id || !idlen || !pod || !podlen) return FALSE;
+    id[0] = '\0';
+    pod[0] = '\0';
+    if (!cgroups) return FALSE;
+
+    // First the v2 line, then the v1 lines for what it didn't have
+    int v2;
+    for (v2 = TRUE; v2 >= FALSE; v2--) {
+        const char *line = cgroups;
+        while (*line) {
+            const char *eol = strchr(line, '\n');
+            if (!eol) eol = line + strlen(line);
+            const char *c1 = memchr(line, ':', eol - line);
+            const char *c2 = (c1) ? memchr(c1 + 1, ':', eol - c1 - 1) : NULL;
+
+            if (c2) {
+                int is_v2 = (c1 - line == 1) && (line[0] == '0') && (c2 == c1 + 1);
+                if (is_v2 == v2) {
+                    parsePath(c2 + 1, eol - c2 - 1, id, idlen, pod, podlen);
+                }
+            }
+
+            line = (*eol) ? eol + 1 : eol;
+        }
+        if (id[0] && pod[0]) break;
+    }
+
+    return (id[0] || pod[0]);
+}
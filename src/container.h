@@ -0,0 +1,24 @@
+#ifndef __CONTAINER_H__
+#define __CONTAINER_H__
+
+#include <stddef.h>
+#include "scopetypes.h"
+
+// Works out which container, and which kubernetes pod, a process is in
+// from the text of /proc/<pid>/cgroup.
+//
+// The cgroup v2 line (0::<path>) is looked at first, then the v1 lines.
+// A container id is a 64 hex digit path segment, possibly wrapped the way
+// systemd drivers do it (docker-<id>.scope, cri-containerd-<id>.scope,
+// crio-<id>.scope, libpod-<id>.scope).  A pod uid follows "pod" in a
+// segment (pod<uid> or kubepods-burstable-pod<uid>.slice); the systemd
+// form's underscores go back to dashes.
+
+#define CONTAINER_ID_LEN 64
+#define POD_UID_LEN 36
+
+// Fills in the id and the pod uid, or makes them empty.  Returns TRUE if
+// either was found.
+bool                containerParse(const char *, char *, size_t, char *, size_t);
+
+#endif // __CONTAINER_H__
@@ -3,15 +3,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "binformat.h"
 #include "circbuf.h"
 #include "cfgutils.h"
 #include "ctl.h"
 #include "dbg.h"
+#include "epoch.h"
 
 struct _ctl_t
 {
     transport_t *transport;
     evt_fmt_t *evt;
+    unsigned evt_gen;           // changes whenever evt does
+    cfg_mtc_format_t format;
+    bin_fmt_t *bin;             // created the first time binary is set
     cbuf_handle_t events;
     cbuf_handle_t evbuf;
     unsigned enhancefs;
@@ -19,10 +24,19 @@ struct _ctl_t
     struct {
         unsigned int enable;
         char * dir;
-        cbuf_handle_t ringbuf;
+        unsigned long long limit;
+        unsigned head;
+        unsigned long long maxsize;
+        unsigned maxage;
+        unsigned long long maxtotal;
+        cfg_pay_format_t format;
+        paybuf_t *buf;
     } payload;
 };
 
+// Shared by every ctl_t, so that no two evt formats get the same one
+static unsigned g_evt_gen = 0;
+
 typedef struct {
     const char *str;
     cmd_t cmd;
@@ -534,15 +548,18 @@ ctlCreate()
         return NULL;
     }
 
+    ctl->evt_gen = __atomic_add_fetch(&g_evt_gen, 1, __ATOMIC_RELAXED);
+    ctl->format = DEFAULT_CTL_FORMAT;
     ctl->enhancefs = DEFAULT_ENHANCE_FS;
 
     ctl->payload.enable = DEFAULT_PAYLOAD_ENABLE;
     ctl->payload.dir = (DEFAULT_PAYLOAD_DIR) ? strdup(DEFAULT_PAYLOAD_DIR) : NULL;
-    ctl->payload.ringbuf = cbufInit(DEFAULT_PAYLOAD_RING_SIZE);
-    if (!ctl->payload.ringbuf) {
-        DBG(NULL);
-        return NULL;
-    }
+    ctl->payload.limit = DEFAULT_PAYLOAD_LIMIT;
+    ctl->payload.head = DEFAULT_PAYLOAD_HEAD;
+    ctl->payload.maxsize = DEFAULT_PAYLOAD_MAXSIZE;
+    ctl->payload.maxage = DEFAULT_PAYLOAD_MAXAGE;
+    ctl->payload.maxtotal = DEFAULT_PAYLOAD_MAXTOTAL;
+    ctl->payload.format = DEFAULT_PAYLOAD_FORMAT;
 
     return ctl;
 }
@@ -557,10 +574,11 @@ ctlDestroy(ctl_t **ctl)
     cbufFree((*ctl)->events);
 
     if ((*ctl)->payload.dir) free((*ctl)->payload.dir);
-    cbufFree((*ctl)->payload.ringbuf);
+    paybufDestroy(&(*ctl)->payload.buf);
 
     transportDestroy(&(*ctl)->transport);
     evtFormatDestroy(&(*ctl)->evt);
+    binFormatDestroy(&(*ctl)->bin);
 
     free(*ctl);
     *ctl = NULL;
@@ -637,6 +655,29 @@ ctlPostMsg(ctl_t *ctl, cJSON *body, upload_type_t type, request_t *req, bool now
     return rc;
 }
 
+static int
+sendBinMsg(ctl_t *ctl, bin_msg_t *msg)
+{
+    int rc = ctlSendBin(ctl, msg->buf.data, msg->buf.len);
+    binFormatSent(ctl->bin, msg, rc);
+    return rc;
+}
+
+// In the binary format, ndjson messages travel as JSON frames
+static int
+sendBinJson(ctl_t *ctl, const char *json)
+{
+    int rc = -1;
+    bin_msg_t msg;
+
+    binMsgInit(ctl->bin, &msg);
+    if (!binFormatJson(ctl->bin, &msg, json, strlen(json))) {
+        rc = sendBinMsg(ctl, &msg);
+    }
+    binMsgFree(&msg);
+    return rc;
+}
+
 int
 ctlSendHttp(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 {
@@ -647,8 +688,22 @@ ctlSendHttp(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 
     if (!ctl || !evt || !proc) return -1;
 
+    // ctl->evt can be replaced by a config change while it's in use
+    unsigned pin = epochEnter();
+    if (ctl->format == CFG_FMT_BINARY) {
+        bin_msg_t msg;
+        binMsgInit(ctl->bin, &msg);
+        rc = evtFormatHttpBin(ctl->evt, evt, uid, proc, ctl->bin, &msg);
+        epochExit(pin);
+        if (!rc) rc = sendBinMsg(ctl, &msg);
+        binMsgFree(&msg);
+        return rc;
+    }
+
     // get a cJSON object for the given event
-    if ((json = evtFormatHttp(ctl->evt, evt, uid, proc)) == NULL) return -1;
+    json = evtFormatHttp(ctl->evt, evt, uid, proc);
+    epochExit(pin);
+    if (!json) return -1;
 
     // send it
     upld.type = UPLD_EVT;
@@ -671,8 +726,21 @@ ctlSendEvent(ctl_t *ctl, event_t *evt, uint64_t uid, proc_id_t *proc)
 
     if (!ctl || !evt || !proc) return -1;
 
+    unsigned pin = epochEnter();
+    if (ctl->format == CFG_FMT_BINARY) {
+        bin_msg_t msg;
+        binMsgInit(ctl->bin, &msg);
+        rc = evtFormatMetricBin(ctl->evt, evt, uid, proc, ctl->bin, &msg);
+        epochExit(pin);
+        if (!rc) rc = sendBinMsg(ctl, &msg);
+        binMsgFree(&msg);
+        return rc;
+    }
+
     // get a cJSON object for the given event
-    if ((json = evtFormatMetric(ctl->evt, evt, uid, proc)) == NULL) return -1;
+    json = evtFormatMetric(ctl->evt, evt, uid, proc);
+    epochExit(pin);
+    if (!json) return -1;
 
     // send it
     upld.type = UPLD_EVT;
@@ -705,14 +773,16 @@ ctlPostEvent(ctl_t *ctl, char *event)
 }
 
 int
-ctlSendLog(ctl_t *ctl, const char *path, const void *buf, size_t count, uint64_t uid, proc_id_t *proc)
+ctlSendLog(ctl_t *ctl, watch_t type, const char *path, const void *buf, size_t count, uint64_t uid, proc_id_t *proc)
 {
     if (!ctl || !path || !buf || !proc) return -1;
 
     upload_t upld;
 
     // get a cJSON object for the given log msg
-    cJSON *json = evtFormatLog(ctl->evt, path, buf, count, uid, proc);
+    unsigned pin = epochEnter();
+    cJSON *json = evtFormatLogOfType(ctl->evt, type, path, buf, count, uid, proc);
+    epochExit(pin);
     if (!json) return -1;
 
     upld.type = UPLD_EVT;
@@ -741,6 +811,12 @@ sendBufferedMessages(ctl_t *ctl)
         if (data) {
             char *msg = (char*) data;
 
+            if (ctl->format == CFG_FMT_BINARY) {
+                sendBinJson(ctl, msg);
+                free(msg);
+                continue;
+            }
+
             // Add the newline delimiter to the msg.
             {
                 int strsize = strlen(msg);
@@ -781,7 +857,26 @@ ctlFlush(ctl_t *ctl)
     if (!ctl) return;
 
     sendBufferedMessages(ctl);
-    transportFlush(ctl->transport);
+
+    // A compressed block that failed to go out, or queued records that
+    // were thrown away, may have carried binary format definitions
+    if (transportFlush(ctl->transport) == -1) {
+        binFormatReset(ctl->bin);
+    }
+}
+
+int
+ctlDrain(ctl_t *ctl, unsigned ms)
+{
+    if (!ctl) return 0;
+    return transportDrain(ctl->transport, ms);
+}
+
+int
+ctlQueueStats(ctl_t *ctl, uint64_t *queued, uint64_t *dropped, uint64_t *spilled)
+{
+    if (!ctl) return -1;
+    return transportQueueStats(ctl->transport, queued, dropped, spilled);
 }
 
 int
@@ -802,6 +897,8 @@ int
 ctlConnect(ctl_t *ctl)
 {
     if (!ctl) return 0;
+    binFormatReset(ctl->bin);
+    if (ctl->format == CFG_FMT_BINARY) transportQueueDiscard(ctl->transport);
     return transportConnect(ctl->transport);
 }
 
@@ -816,6 +913,7 @@ int
 ctlReconnect(ctl_t *ctl)
 {
     if (!ctl) return 0;
+    binFormatReset(ctl->bin);
     return transportReconnect(ctl->transport);
 }
 
@@ -837,23 +935,74 @@ ctlTransportType(ctl_t *ctl)
     return transportType(ctl->transport);
 }
 
+static void
+freeEvtFormat(void *evt)
+{
+    evt_fmt_t *e = evt;
+    evtFormatDestroy(&e);
+}
+
 void
 ctlEvtSet(ctl_t *ctl, evt_fmt_t *evt)
 {
     if (!ctl) return;
 
-    // Don't leak if ctlEvtSet is called repeatedly
-    // TODO: need to ensure that previous object is no longer in use
-    // evtFormatDestroy(&ctl->evt);
+    // Don't leak if ctlEvtSet is called repeatedly.  Other threads may
+    // still be using the old one, so it's freed once they're done with it.
+    evt_fmt_t *old = ctl->evt;
     ctl->evt = evt;
+    ctl->evt_gen = __atomic_add_fetch(&g_evt_gen, 1, __ATOMIC_RELAXED);
+    epochRetire(old, freeEvtFormat);
+}
+
+unsigned
+ctlEvtGen(ctl_t *ctl)
+{
+    return (ctl) ? ctl->evt_gen : 0;
+}
+
+watch_t
+ctlLogType(ctl_t *ctl, const char *path)
+{
+    if (!ctl) return CFG_SRC_MAX;
+
+    unsigned pin = epochEnter();
+    watch_t type = evtFormatLogType(ctl->evt, path);
+    epochExit(pin);
+    return type;
+}
+
+cfg_mtc_format_t
+ctlFormat(ctl_t *ctl)
+{
+    return (ctl) ? ctl->format : DEFAULT_CTL_FORMAT;
+}
+
+void
+ctlFormatSet(ctl_t *ctl, cfg_mtc_format_t format)
+{
+    if (!ctl || format >= CFG_FORMAT_MAX) return;
+
+    // statsd is not an event format
+    if (format == CFG_FMT_STATSD) format = CFG_FMT_NDJSON;
+
+    // The dictionary is kept once created; other threads may be using it
+    if ((format == CFG_FMT_BINARY) && !ctl->bin) {
+        if (!(ctl->bin = binFormatCreate())) return;
+    }
+    ctl->format = format;
 }
 
 bool
 ctlEvtSourceEnabled(ctl_t *ctl, watch_t src)
 {
     if (src < CFG_SRC_MAX) {
-        if (ctl && ctl->evt) return evtFormatSourceEnabled(ctl->evt, src);
-        return srcEnabledDefault[src];
+        bool rc = srcEnabledDefault[src];
+        unsigned pin = epochEnter();
+        evt_fmt_t *evt = (ctl) ? ctl->evt : NULL;
+        if (evt) rc = evtFormatSourceEnabled(evt, src);
+        epochExit(pin);
+        return rc;
     }
 
     DBG("%d", src);
@@ -884,6 +1033,11 @@ ctlPayEnableSet(ctl_t *ctl, unsigned int val)
 {
     if (!ctl) return;
     ctl->payload.enable = val;
+
+    if (val && !ctl->payload.buf) {
+        ctl->payload.buf = paybufCreate(DEFAULT_PAYLOAD_BUF_SIZE);
+        if (!ctl->payload.buf) DBG(NULL);
+    }
 }
 
 const char *
@@ -905,6 +1059,84 @@ ctlPayDirSet(ctl_t *ctl, const char *dir)
     ctl->payload.dir = strdup(dir);
 }
 
+unsigned long long
+ctlPayLimit(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.limit : DEFAULT_PAYLOAD_LIMIT;
+}
+
+void
+ctlPayLimitSet(ctl_t *ctl, unsigned long long val)
+{
+    if (!ctl) return;
+    ctl->payload.limit = val;
+}
+
+unsigned
+ctlPayHead(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.head : DEFAULT_PAYLOAD_HEAD;
+}
+
+void
+ctlPayHeadSet(ctl_t *ctl, unsigned val)
+{
+    if (!ctl) return;
+    ctl->payload.head = val;
+}
+
+unsigned long long
+ctlPayMaxSize(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.maxsize : DEFAULT_PAYLOAD_MAXSIZE;
+}
+
+void
+ctlPayMaxSizeSet(ctl_t *ctl, unsigned long long val)
+{
+    if (!ctl) return;
+    ctl->payload.maxsize = val;
+}
+
+unsigned
+ctlPayMaxAge(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.maxage : DEFAULT_PAYLOAD_MAXAGE;
+}
+
+void
+ctlPayMaxAgeSet(ctl_t *ctl, unsigned val)
+{
+    if (!ctl) return;
+    ctl->payload.maxage = val;
+}
+
+unsigned long long
+ctlPayMaxTotal(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.maxtotal : DEFAULT_PAYLOAD_MAXTOTAL;
+}
+
+void
+ctlPayMaxTotalSet(ctl_t *ctl, unsigned long long val)
+{
+    if (!ctl) return;
+    ctl->payload.maxtotal = val;
+}
+
+cfg_pay_format_t
+ctlPayFormat(ctl_t *ctl)
+{
+    return (ctl) ? ctl->payload.format : DEFAULT_PAYLOAD_FORMAT;
+}
+
+void
+ctlPayFormatSet(ctl_t *ctl, cfg_pay_format_t val)
+{
+    if (!ctl) return;
+    ctl->payload.format = val;
+}
+
 
 uint64_t
 ctlGetEvent(ctl_t *ctl)
@@ -925,29 +1157,30 @@ ctlCbufEmpty(ctl_t *ctl)
 }
 
 int
-ctlPostPayload(ctl_t *ctl, char *pay)
+ctlPostPayload(ctl_t *ctl, const void *hdr, size_t hlen, const void *data, size_t len)
 {
-    if (!pay || !ctl) return -1;
+    if (!ctl || !ctl->payload.buf) return -1;
 
-    if ((ctl->payload.ringbuf) &&
-        (cbufPut(ctl->payload.ringbuf, (uint64_t)pay) == -1)) {
-        // Full; drop and ignore
-        DBG(NULL);
-        return -1;
-    }
-    return 0;
+    // Full; dropped and counted
+    return paybufPut(ctl->payload.buf, hdr, hlen, data, len);
 }
 
-uint64_t
-ctlGetPayload(ctl_t *ctl)
+size_t
+ctlPayMaxLen(ctl_t *ctl, size_t hlen)
 {
-    uint64_t data;
+    return (ctl) ? paybufMaxLen(ctl->payload.buf, hlen) : 0;
+}
 
-    if ((ctl->payload.ringbuf) &&
-        (cbufGet(ctl->payload.ringbuf, &data) == 0)) {
-        return data;
-    } else {
-        return (uint64_t)-1;
-    }
+int
+ctlDrainPayload(ctl_t *ctl, paybuf_fn fn, void *arg)
+{
+    if (!ctl || !ctl->payload.buf) return 0;
+    return paybufDrain(ctl->payload.buf, fn, arg);
+}
+
+uint64_t
+ctlPayDropped(ctl_t *ctl)
+{
+    return (ctl) ? paybufDropped(ctl->payload.buf) : 0;
 }
 
@@ -5,6 +5,7 @@
 #include "cJSON.h"
 #include "transport.h"
 #include "evtformat.h"
+#include "paybuf.h"
 
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include "pcre2.h"
@@ -100,8 +101,10 @@ void    ctlSendJson(ctl_t *, cJSON *);
 int     ctlPostMsg(ctl_t *, cJSON *, upload_type_t, request_t *, bool);
 int     ctlSendEvent(ctl_t *, event_t *, uint64_t, proc_id_t *);
 int     ctlSendHttp(ctl_t *, event_t *, uint64_t, proc_id_t *);
-int     ctlSendLog(ctl_t *, const char *, const void *, size_t, uint64_t, proc_id_t *);
+int     ctlSendLog(ctl_t *, watch_t, const char *, const void *, size_t, uint64_t, proc_id_t *);
 void    ctlFlush(ctl_t *);
+int     ctlDrain(ctl_t *, unsigned);
+int     ctlQueueStats(ctl_t *, uint64_t *, uint64_t *, uint64_t *);
 int     ctlPostEvent(ctl_t *, char *);
 
 // Connection oriented stuff
@@ -113,25 +116,46 @@ int              ctlReconnect(ctl_t *);
 void             ctlTransportSet(ctl_t *, transport_t *);
 void             ctlEvtSet(ctl_t *, evt_fmt_t *);
 cfg_transport_t  ctlTransportType(ctl_t *);
+cfg_mtc_format_t ctlFormat(ctl_t *);
+void             ctlFormatSet(ctl_t *, cfg_mtc_format_t);
 
 // Accessor for performance
 bool            ctlEvtSourceEnabled(ctl_t *, watch_t);
 
+// The log source a path belongs to (see evtFormatLogType()).  Callers
+// can keep the answer until ctlEvtGen() changes.
+watch_t         ctlLogType(ctl_t *, const char *);
+unsigned        ctlEvtGen(ctl_t *);
+
 unsigned        ctlEnhanceFs(ctl_t *);
 void            ctlEnhanceFsSet(ctl_t *, unsigned);
 unsigned int    ctlPayEnable(ctl_t *);
 void            ctlPayEnableSet(ctl_t *, unsigned int);
 const char *    ctlPayDir(ctl_t *);
 void            ctlPayDirSet(ctl_t *, const char *);
+unsigned long long ctlPayLimit(ctl_t *);
+void            ctlPayLimitSet(ctl_t *, unsigned long long);
+unsigned        ctlPayHead(ctl_t *);
+void            ctlPayHeadSet(ctl_t *, unsigned);
+unsigned long long ctlPayMaxSize(ctl_t *);
+void            ctlPayMaxSizeSet(ctl_t *, unsigned long long);
+unsigned        ctlPayMaxAge(ctl_t *);
+void            ctlPayMaxAgeSet(ctl_t *, unsigned);
+unsigned long long ctlPayMaxTotal(ctl_t *);
+void            ctlPayMaxTotalSet(ctl_t *, unsigned long long);
+cfg_pay_format_t ctlPayFormat(ctl_t *);
+void            ctlPayFormatSet(ctl_t *, cfg_pay_format_t);
 
 // Retreive events
 uint64_t   ctlGetEvent(ctl_t *);
 void       ctlFlushLog(ctl_t *);
 bool       ctlCbufEmpty(ctl_t *);
 
-// Payloads
-int        ctlPostPayload(ctl_t *, char *);
-uint64_t   ctlGetPayload(ctl_t *);
+// Payloads; the arena is only allocated once payloads are enabled
+int        ctlPostPayload(ctl_t *, const void *, size_t, const void *, size_t);
+size_t     ctlPayMaxLen(ctl_t *, size_t);
+int        ctlDrainPayload(ctl_t *, paybuf_fn, void *);
+uint64_t   ctlPayDropped(ctl_t *);
 int        ctlSendBin(ctl_t *, char *, size_t);
 
 #endif // _CTL_H__
@@ -7,6 +7,10 @@
 #define QTYPE_QUERY 0x01
 #define QCLASS_IN 0x01
 
+// Masks for the third and fourth header bytes, as they appear on the wire
+#define DNS_QR_MASK 0x80
+#define DNS_RCODE_MASK 0x0f
+
 // DNS full header definition per RFC 1035
 /*
       0  1  2  3  4  5  6  7  8  9  0  1  2  3  4  5
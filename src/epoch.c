@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "epoch.h"
+
+#define EPOCH_STRIPES 64
+#define EPOCH_LINE 64
+
+typedef struct {
+    uint64_t readers[2];         // indexed by the low bit of the epoch
+    char pad[EPOCH_LINE - 2 * sizeof(uint64_t)];
+} epoch_stripe_t;
+
+typedef struct _retired_t {
+    void *obj;
+    epoch_free_fn fn;
+    struct _retired_t *next;
+} retired_t;
+
+static uint64_t g_epoch = 0;
+static epoch_stripe_t g_stripe[EPOCH_STRIPES] __attribute__((aligned(EPOCH_LINE)));
+static uint64_t g_next_stripe = 0;
+static __thread unsigned g_my_stripe = 0;       // 1 based; 0 is unassigned
+
+// Only touched by the reclaiming thread
+static retired_t *g_pending = NULL;             // retired since the last flip
+static retired_t *g_waiting = NULL;             // waiting for a counter to drain
+static unsigned g_retired = 0;
+
+unsigned
+epochEnter(void)
+{
+    if (!g_my_stripe) {
+        g_my_stripe = (__atomic_fetch_add(&g_next_stripe, 1, __ATOMIC_RELAXED) % EPOCH_STRIPES) + 1;
+    }
+    unsigned s = g_my_stripe - 1;
+
+    while (1) {
+        unsigned e = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST) & 1;
+        __atomic_add_fetch(&g_stripe[s].readers[e], 1, __ATOMIC_SEQ_CST);
+
+        // Still the same epoch, so the reclaimer will see us in this counter
+        if ((__atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST) & 1) == e) return (s << 1) | e;
+
+        __atomic_sub_fetch(&g_stripe[s].readers[e], 1, __ATOMIC_RELEASE);
+    }
+}
+
+void
+epochExit(unsigned pin)
+{
+    __atomic_sub_fetch(&g_stripe[(pin >> 1) % EPOCH_STRIPES].readers[pin & 1], 1, __ATOMIC_RELEASE);
+}
+
+void
+epochRetire(void *obj, epoch_free_fn fn)
+{
+    if (!obj || !fn) return;
+
+    retired_t *r = malloc(sizeof(retired_t));
+    if (!r) {
+        // Better to leak it than to free it out from under a reader
+        DBG(NULL);
+        return;
+    }
+    r->obj = obj;
+    r->fn = fn;
+    r->next = g_pending;
+    g_pending = r;
+    g_retired++;
+}
+
+static int
+drained(unsigned e)
+{
+    int i;
+    for (i = 0; i < EPOCH_STRIPES; i++) {
+        if (__atomic_load_n(&g_stripe[i].readers[e], __ATOMIC_ACQUIRE)) return 0;
+    }
+    return 1;
+}
+
+static void
+freeRetired(retired_t **list)
+{
+    retired_t *r = *list;
+    while (r) {
+        retired_t *next = r->next;
+        r->fn(r->obj);
+        free(r);
+        g_retired--;
+        r = next;
+    }
+    *list = NULL;
+}
+
+unsigned
+epochReclaim(void)
+{
+    // Readers are never counted in the old counter after a flip; once it
+    // drains, nothing retired before the flip can be in use
+    unsigned old = (atomicLoadU64(&g_epoch) & 1) ^ 1;
+    if (g_waiting && drained(old)) freeRetired(&g_waiting);
+
+    // Only one flip at a time; otherwise readers in the old counter would
+    // be mixed up with ones that entered after the next flip
+    if (!g_waiting && g_pending) {
+        g_waiting = g_pending;
+        g_pending = NULL;
+        old = __atomic_fetch_add(&g_epoch, 1, __ATOMIC_SEQ_CST) & 1;
+        if (drained(old)) freeRetired(&g_waiting);
+    }
+
+    return g_retired;
+}
+
+void
+epochReset(void)
+{
+    memset(g_stripe, 0, sizeof(g_stripe));
+}
@@ -0,0 +1,38 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+// Lets one thread replace objects that every thread uses (the metric and
+// log transports and the event format when the config changes) and free
+// the old ones once nothing can be using them, without readers taking a
+// lock.
+//
+// Readers bracket their use with epochEnter() and epochExit(), and load
+// the shared pointer in between.  The writer swaps in the new object and
+// hands the old one to epochRetire(); epochReclaim() frees it after every
+// reader that might have loaded it has left.
+//
+// Readers count themselves in one of two counters, picked by the low bit
+// of the epoch.  Reclaiming flips the epoch, so new readers count in the
+// other one, then frees what was retired before the flip when the old
+// counter has drained.  A reader that catches a flip between picking a
+// counter and counting itself moves over to the new one.  The counters
+// are spread across cache lines by thread so readers don't contend.
+//
+// Pins nest.  epochRetire() and epochReclaim() are for one thread only.
+
+typedef void (*epoch_free_fn)(void *);
+
+// Returns a pin to pass to epochExit()
+unsigned            epochEnter(void);
+void                epochExit(unsigned);
+
+// Frees obj with fn once no reader can be using it
+void                epochRetire(void *, epoch_free_fn);
+
+// Frees what it can without waiting; returns how many are still retired
+unsigned            epochReclaim(void);
+
+// Forgets readers from other threads; for a child after fork()
+void                epochReset(void);
+
+#endif // __EPOCH_H__
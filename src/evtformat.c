@@ -1,12 +1,12 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/timeb.h>
 #include <time.h>
 
 #include "dbg.h"
 #include "evtformat.h"
 #include "com.h"
+#include "plattime.h"
 
 
 // This is ugly, but...
@@ -375,20 +375,24 @@ err:
     return NULL;
 }
 
+static int
+rateLimitText(char *buf, size_t len, unsigned maxEvtPerSec)
+{
+    return snprintf(buf, len, "Truncated metrics. Your rate exceeded %u metrics per second", maxEvtPerSec);
+}
+
 cJSON *
 rateLimitMessage(proc_id_t *proc, watch_t src, unsigned maxEvtPerSec)
 {
     event_format_t event;
 
-    struct timeb tb;
-    ftime(&tb);
-    event.timestamp = tb.time + (double)tb.millitm/1000;
+    event.timestamp = getWallTime(0) / 1e9;
     event.src = "notice";
     event.proc = proc;
     event.uid = 0ULL;
 
     char string[128];
-    if (snprintf(string, sizeof(string), "Truncated metrics. Your rate exceeded %u metrics per second", maxEvtPerSec) == -1) {
+    if (rateLimitText(string, sizeof(string), maxEvtPerSec) == -1) {
         return NULL;
     }
     event.data = cJSON_CreateString(string);
@@ -483,22 +487,21 @@ err:
     return NULL;
 }
 
-static cJSON *
-evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc, watch_t src)
+// Returns TRUE if metric passes the source, name and value filters and
+// the rate limit.  notify is set when a rate limit notice is due instead.
+static int
+evtFormatFilter(evt_fmt_t *evt, event_t *metric, watch_t src, int *notify)
 {
-    event_format_t event;
-    struct timeb tb;
     time_t now;
-    
     regex_t *filter;
 
-    if (!evt || !metric || !proc) return NULL;
+    *notify = FALSE;
 
     // Test for a name field match.  No match, no metric output
     if (!evtFormatSourceEnabled(evt, src) ||
         !(filter = evtFormatNameFilter(evt, src)) ||
         (regexec_wrapper(filter, metric->name, 0, NULL, 0))) {
-        return NULL;
+        return FALSE;
     }
 
     // rate limited to maxEvtPerSec
@@ -510,9 +513,8 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
     } else if (++evt->ratelimit.evtCount >= evt->ratelimit.maxEvtPerSec) {
         // one notice per truncate
         if (evt->ratelimit.notified == 0) {
-            cJSON* notice = rateLimitMessage(proc, src, evt->ratelimit.maxEvtPerSec);
-            evt->ratelimit.notified = (notice)?1:0;
-            return notice;
+            *notify = TRUE;
+            return FALSE;
         }
     }
 
@@ -521,11 +523,28 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
      * No match, no metric output
      */
     if (!anyValueFieldMatches(evtFormatValueFilter(evt, src), metric)) {
-        return NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static cJSON *
+evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc, watch_t src)
+{
+    event_format_t event;
+    int notify;
+
+    if (!evt || !metric || !proc) return NULL;
+
+    if (!evtFormatFilter(evt, metric, src, &notify)) {
+        if (!notify) return NULL;
+        cJSON* notice = rateLimitMessage(proc, src, evt->ratelimit.maxEvtPerSec);
+        evt->ratelimit.notified = (notice)?1:0;
+        return notice;
     }
 
-    ftime(&tb);
-    event.timestamp = tb.time + (double)tb.millitm/1000;
+    event.timestamp = getWallTime(metric->tsc) / 1e9;
     event.src = metric->name;
     event.proc = proc;
     event.uid = uid;
@@ -538,6 +557,31 @@ evtFormatHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
     return fmtEventJson(&event);
 }
 
+static int
+evtFormatBinHelper(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
+                   watch_t src, bin_fmt_t *bin, bin_msg_t *msg)
+{
+    int notify;
+
+    if (!evt || !metric || !proc || !bin || !msg) return -1;
+
+    double timestamp = getWallTime(metric->tsc) / 1e9;
+
+    if (!evtFormatFilter(evt, metric, src, &notify)) {
+        if (!notify) return -1;
+        char string[128];
+        if (rateLimitText(string, sizeof(string), evt->ratelimit.maxEvtPerSec) == -1) {
+            return -1;
+        }
+        int rv = binFormatNotice(bin, msg, "notice", string, timestamp, proc, src);
+        evt->ratelimit.notified = (rv == 0)?1:0;
+        return rv;
+    }
+
+    return binFormatEvent(bin, msg, metric, evtFormatFieldFilter(evt, src),
+                          timestamp, uid, proc, src);
+}
+
 cJSON *
 evtFormatMetric(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc)
 {
@@ -550,31 +594,60 @@ evtFormatHttp(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc)
     return evtFormatHelper(evt, metric, uid, proc, CFG_SRC_HTTP);
 }
 
-cJSON *
-evtFormatLog(evt_fmt_t *evt, const char *path, const void *buf, size_t count,
-       uint64_t uid, proc_id_t* proc)
+int
+evtFormatMetricBin(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
+                   bin_fmt_t *bin, bin_msg_t *msg)
 {
-    event_format_t event;
-    struct timeb tb;
-    watch_t logType;
+    if (!metric) return -1;
+    return evtFormatBinHelper(evt, metric, uid, proc, metric->src, bin, msg);
+}
 
-    if (!evt || !path || !buf || !proc) return NULL;
+int
+evtFormatHttpBin(evt_fmt_t *evt, event_t *metric, uint64_t uid, proc_id_t *proc,
+                 bin_fmt_t *bin, bin_msg_t *msg)
+{
+    return evtFormatBinHelper(evt, metric, uid, proc, CFG_SRC_HTTP, bin, msg);
+}
+
+watch_t
+evtFormatLogType(evt_fmt_t *evt, const char *path)
+{
+    if (!evt || !path) return CFG_SRC_MAX;
 
     regex_t* filter;
     if (evtFormatSourceEnabled(evt, CFG_SRC_CONSOLE) &&
        (filter = evtFormatNameFilter(evt, CFG_SRC_CONSOLE)) &&
        (!regexec_wrapper(filter, path, 0, NULL, 0))) {
-        logType = CFG_SRC_CONSOLE;
+        return CFG_SRC_CONSOLE;
     } else if (evtFormatSourceEnabled(evt, CFG_SRC_FILE) &&
        (filter = evtFormatNameFilter(evt, CFG_SRC_FILE)) &&
        (!regexec_wrapper(filter, path, 0, NULL, 0))) {
-        logType = CFG_SRC_FILE;
-    } else {
-        return NULL;
+        return CFG_SRC_FILE;
     }
+    return CFG_SRC_MAX;
+}
+
+cJSON *
+evtFormatLog(evt_fmt_t *evt, const char *path, const void *buf, size_t count,
+       uint64_t uid, proc_id_t* proc)
+{
+    return evtFormatLogOfType(evt, evtFormatLogType(evt, path), path, buf,
+                              count, uid, proc);
+}
+
+cJSON *
+evtFormatLogOfType(evt_fmt_t *evt, watch_t logType, const char *path,
+       const void *buf, size_t count, uint64_t uid, proc_id_t* proc)
+{
+    event_format_t event;
+
+    if (!evt || !path || !buf || !proc) return NULL;
+    if ((logType != CFG_SRC_CONSOLE) && (logType != CFG_SRC_FILE)) return NULL;
+
+    // The type may have been worked out against an older config
+    if (!evtFormatSourceEnabled(evt, logType)) return NULL;
 
-    ftime(&tb);
-    event.timestamp = tb.time + (double)tb.millitm/1000;
+    event.timestamp = getWallTime(0) / 1e9;
     event.src = path;
     event.proc = proc;
     event.uid = uid;
@@ -588,7 +661,7 @@ evtFormatLog(evt_fmt_t *evt, const char *path, const void *buf, size_t count,
 
     cJSON* dataField = cJSON_GetObjectItem(json, "data");
     if (dataField && dataField->valuestring) {
-        filter = evtFormatValueFilter(evt, logType);
+        regex_t *filter = evtFormatValueFilter(evt, logType);
         if (filter && regexec_wrapper(filter, dataField->valuestring, 0, NULL, 0)) {
             // This event doesn't match.  Drop it on the floor.
             cJSON_Delete(json);
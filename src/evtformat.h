@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include "cJSON.h"
 #include "mtcformat.h"
+#include "binformat.h"
 
 typedef struct _evt_fmt_t evt_fmt_t;
 
@@ -24,6 +25,22 @@ cJSON *             evtFormatHttp(evt_fmt_t *, event_t *, uint64_t, proc_id_t *)
 cJSON *             evtFormatLog(evt_fmt_t *, const char *, const void *, size_t,
                                  uint64_t, proc_id_t *);
 
+// Which log source a path belongs to, by the console and file name
+// filters; CFG_SRC_MAX if neither.  evtFormatLogOfType() skips the
+// filters for callers that have already worked this out.
+watch_t             evtFormatLogType(evt_fmt_t *, const char *);
+cJSON *             evtFormatLogOfType(evt_fmt_t *, watch_t, const char *,
+                                       const void *, size_t, uint64_t,
+                                       proc_id_t *);
+
+// Binary counterparts of evtFormatMetric() and evtFormatHttp().  These
+// apply the same filters and rate limit, then append to the bin_msg_t.
+// Returns 0 if something was appended, -1 otherwise.
+int                 evtFormatMetricBin(evt_fmt_t *, event_t *, uint64_t, proc_id_t *,
+                                       bin_fmt_t *, bin_msg_t *);
+int                 evtFormatHttpBin(evt_fmt_t *, event_t *, uint64_t, proc_id_t *,
+                                     bin_fmt_t *, bin_msg_t *);
+
 // Could be static; these are lower level funcs only exposed for testing
 cJSON *             fmtMetricJson(event_t *, regex_t *, watch_t);
 cJSON *             fmtEventJson(event_format_t *);
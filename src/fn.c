@@ -8,6 +8,8 @@ void
 initFn(void)
 {
     g_fn.vsyslog = dlsym(RTLD_NEXT, "vsyslog");
+    g_fn.syslog = dlsym(RTLD_NEXT, "syslog");
+    g_fn.openlog = dlsym(RTLD_NEXT, "openlog");
     g_fn.fork = dlsym(RTLD_NEXT, "fork");
     g_fn.open = dlsym(RTLD_NEXT, "open");
     g_fn.openat = dlsym(RTLD_NEXT, "openat");
@@ -184,6 +186,7 @@ initFn(void)
     g_fn.clock_nanosleep = dlsym(RTLD_NEXT, "clock_nanosleep");
     g_fn.usleep = dlsym(RTLD_NEXT, "usleep");
     g_fn.io_getevents = dlsym(RTLD_NEXT, "io_getevents");
+    g_fn.__vsyslog_chk = dlsym(RTLD_NEXT, "__vsyslog_chk");
 
     // These functions are not interposed.  They're here because
     // we've seen applications override the weak glibc implementation,
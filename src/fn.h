@@ -43,6 +43,8 @@ typedef uint64_t fpos64_t;
 
 typedef struct {
     void (*vsyslog)(int, const char *, va_list);
+    void (*syslog)(int, const char *, ...);
+    void (*openlog)(const char *, int, int);
     pid_t (*fork)(void);
     int (*open)(const char *, int, ...);
     int (*openat)(int, const char *, int, ...);
@@ -214,6 +216,7 @@ typedef struct {
     int (*clock_nanosleep)(clockid_t, int, const struct timespec *, struct timespec *);
     int (*usleep)(useconds_t);
     int (*io_getevents)(io_context_t, long, long, struct io_event *, struct timespec *);
+    void (*__vsyslog_chk)(int, int, const char *, va_list);
 #endif // __LINUX__
 
 #if defined(__LINUX__) && defined(__STATX__)
@@ -60,5 +60,8 @@ extern void go_hook_readResponse(void);
 extern void go_hook_pc_write(void);
 extern void go_hook_exit(void);
 extern void go_hook_die(void);
+extern void go_hook_stw_stop(void);
+extern void go_hook_stw_start(void);
+extern void go_hook_gc_done(void);
 
 #endif // __GOTCONTEXT_H__
@@ -209,6 +209,7 @@ reportHttp(http_state_t *httpstate)
     post->ssl = httpstate->id.isSsl;
     post->start_duration = getTime();
     post->id = httpstate->id.uid;
+    proto->tsc = post->start_duration;
 
     // "transfer ownership" of dynamically allocated header from
     // httpstate object to post object
@@ -6,6 +6,11 @@
 #include <jvmti.h>
 #include "javabci.h"
 
+// Most apps hand SSLEngine one or two buffers at a time
+#define JAVA_MAX_BUFFERS 16
+
+#define ASYNC_IO_SIGNATURE "(ZLjava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;JLjava/util/concurrent/TimeUnit;Ljava/lang/Object;Ljava/nio/channels/CompletionHandler;)Ljava/util/concurrent/Future;"
+
 typedef struct {
     jmethodID mid_Object_hashCode;
     jmethodID mid_SSLSocketImpl_getSession;
@@ -16,6 +21,7 @@ typedef struct {
     jfieldID  fid_AppInputStream_socket;
     
     jmethodID mid_ByteBuffer_array;
+    jmethodID mid_ByteBuffer_arrayOffset;
     jmethodID mid_ByteBuffer_position;
     jmethodID mid_ByteBuffer_limit;
     jfieldID  fid_ByteBuffer___fd;
@@ -23,6 +29,8 @@ typedef struct {
     jmethodID mid_SSLEngineImpl___wrap;
     jmethodID mid_SSLEngineImpl___unwrap;
     jmethodID mid_SSLEngineImpl_getSession;
+    jfieldID  fid_SSLEngineImpl___session;
+    jfieldID  fid_SSLEngineImpl___fd;
     
     jmethodID mid_Socket_getInetAddress;
     jmethodID mid_Socket_getPort;
@@ -43,6 +51,12 @@ typedef struct {
 
 static java_global_t g_java = {0};
 
+// DirectByteBuffer was loaded with a public __fd field
+static int g_dbb_fd = FALSE;
+
+// The fd netty last read from on this thread, until an engine claims it
+static __thread int g_netty_fd = -1;
+
 static void 
 logJvmtiError(jvmtiEnv *jvmti, jvmtiError errnum, const char *str) 
 {
@@ -195,6 +209,10 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     g_java.mid_SSLEngineImpl___unwrap    = (*jni)->GetMethodID(jni, sslEngineImplClass, "__unwrap", "(Ljava/nio/ByteBuffer;[Ljava/nio/ByteBuffer;II)Ljavax/net/ssl/SSLEngineResult;");
     g_java.mid_SSLEngineImpl___wrap      = (*jni)->GetMethodID(jni, sslEngineImplClass, "__wrap", "([Ljava/nio/ByteBuffer;IILjava/nio/ByteBuffer;)Ljavax/net/ssl/SSLEngineResult;");
     g_java.mid_SSLEngineImpl_getSession  = (*jni)->GetMethodID(jni, sslEngineImplClass, "getSession", "()Ljavax/net/ssl/SSLSession;");
+    g_java.fid_SSLEngineImpl___session   = (*jni)->GetFieldID(jni, sslEngineImplClass, "__session", "I");
+    clearJniException(jni);
+    g_java.fid_SSLEngineImpl___fd        = (*jni)->GetFieldID(jni, sslEngineImplClass, "__fd", "I");
+    clearJniException(jni);
 
     jclass socketChannelClass = (*jni)->FindClass(jni, "sun/nio/ch/SocketChannelImpl");
     g_java.mid_SocketChannelImpl___read  = (*jni)->GetMethodID(jni, socketChannelClass, "__read", "(Ljava/nio/ByteBuffer;)I");
@@ -210,6 +228,7 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     jclass byteBufferClass         = (*jni)->FindClass(jni, "java/nio/ByteBuffer");
     jclass bufferClass             = (*jni)->FindClass(jni, "java/nio/Buffer");
     g_java.mid_ByteBuffer_array    = (*jni)->GetMethodID(jni, byteBufferClass, "array", "()[B");
+    g_java.mid_ByteBuffer_arrayOffset = (*jni)->GetMethodID(jni, byteBufferClass, "arrayOffset", "()I");
     g_java.mid_ByteBuffer_position = (*jni)->GetMethodID(jni, bufferClass, "position", "()I");
     g_java.mid_ByteBuffer_limit    = (*jni)->GetMethodID(jni, bufferClass, "limit", "()I");
 
@@ -223,6 +242,129 @@ initSSLEngineImplGlobals(JNIEnv *jni)
     }
 }
 
+/*
+ * Rewrites a SocketChannelImpl read or write(ByteBuffer) as
+ *
+ *   if (buf instanceof DirectByteBuffer) ((DirectByteBuffer)buf).__fd = getFDVal();
+ *   return __read(buf);
+ *
+ * with the original kept as __read.  The bytes themselves are counted by
+ * the read and write calls we interpose in libc, so this is all the
+ * channel needs and it's done without a round trip through JNI.
+ */
+static void
+injectSaveFd(java_class_t *info, int methodIndex, const char *copy, const char *desc)
+{
+    uint16_t dbb      = javaAddClassTag(info, "java/nio/DirectByteBuffer");
+    uint16_t fdField  = javaAddFieldRefTag(info, dbb, javaAddNameAndTypeTag(info, "__fd", "I"));
+    uint16_t getFDVal = javaAddMethodRefTag(info, info->this_class, javaAddNameAndTypeTag(info, "getFDVal", "()I"));
+    uint16_t orig     = javaAddMethodRefTag(info, info->this_class, javaAddNameAndTypeTag(info, copy, desc));
+
+    javaCopyMethod(info, info->methods[methodIndex], copy);
+
+    uint8_t code[] = {
+        OP_ALOAD_1,
+        OP_INSTANCEOF, JAVA_U2(dbb),
+        OP_IFEQ, JAVA_U2(14),
+        OP_ALOAD_1,
+        OP_CHECKCAST, JAVA_U2(dbb),
+        OP_ALOAD_0,
+        OP_INVOKEVIRTUAL, JAVA_U2(getFDVal),
+        OP_PUTFIELD, JAVA_U2(fdField),
+        // 18:
+        OP_ALOAD_0,
+        OP_ALOAD_1,
+        OP_INVOKEVIRTUAL, JAVA_U2(orig),
+        OP_IRETURN,
+    };
+    javaInjectCode(info, methodIndex, 2, 2, code, sizeof(code));
+}
+
+/*
+ * The same for UnixAsynchronousSocketChannelImpl implRead and implWrite,
+ * which take (boolean, ByteBuffer, ByteBuffer[], long, TimeUnit, Object,
+ * CompletionHandler).  Only single buffer I/O has its buffer tagged; that's
+ * what an SSLEngine is given.
+ */
+static void
+injectAsyncSaveFd(java_class_t *info, int methodIndex, const char *copy)
+{
+    uint16_t dbb     = javaAddClassTag(info, "java/nio/DirectByteBuffer");
+    uint16_t fdField = javaAddFieldRefTag(info, dbb, javaAddNameAndTypeTag(info, "__fd", "I"));
+    uint16_t fdVal   = javaAddFieldRefTag(info, info->this_class, javaAddNameAndTypeTag(info, "fdVal", "I"));
+    uint16_t orig    = javaAddMethodRefTag(info, info->this_class, javaAddNameAndTypeTag(info, copy, ASYNC_IO_SIGNATURE));
+
+    javaCopyMethod(info, info->methods[methodIndex], copy);
+
+    uint8_t code[] = {
+        OP_ALOAD_2,
+        OP_INSTANCEOF, JAVA_U2(dbb),
+        OP_IFEQ, JAVA_U2(14),
+        OP_ALOAD_2,
+        OP_CHECKCAST, JAVA_U2(dbb),
+        OP_ALOAD_0,
+        OP_GETFIELD, JAVA_U2(fdVal),
+        OP_PUTFIELD, JAVA_U2(fdField),
+        // 18:
+        OP_ALOAD_0,
+        OP_ILOAD_1,
+        OP_ALOAD_2,
+        OP_ALOAD_3,
+        OP_LLOAD, 4,
+        OP_ALOAD, 6,
+        OP_ALOAD, 7,
+        OP_ALOAD, 8,
+        OP_INVOKEVIRTUAL, JAVA_U2(orig),
+        OP_ARETURN,
+    };
+    javaInjectCode(info, methodIndex, 9, 9, code, sizeof(code));
+}
+
+/*
+ * Netty reads into its own ByteBufs and hands SSLEngine fresh ByteBuffer
+ * views of them, so there's no buffer to tag.  It does decrypt what it
+ * read on the same thread, before its next read, so doReadBytes becomes
+ *
+ *   __fd(socket.intValue());
+ *   return __doReadBytes(buf);
+ *
+ * where __fd is a native method that remembers the fd for the thread.
+ * The code has no branches, so it needs no stack map frames to pass the
+ * verifier that app classes go through.
+ */
+static void
+injectNettyReadFd(java_class_t *info, int methodIndex, int fieldIndex)
+{
+    unsigned char *field = info->fields[fieldIndex];
+    char *fieldDesc = javaGetUtf8String(info, be16toh(*((uint16_t *)(field + 4))));
+    // "Lio/netty/channel/epoll/LinuxSocket;" -> "io/netty/channel/epoll/LinuxSocket"
+    char *socketClass = strndup(fieldDesc + 1, strlen(fieldDesc) - 2);
+
+    uint16_t socket   = javaAddFieldRefTag(info, info->this_class, javaAddNameAndTypeTag(info, "socket", fieldDesc));
+    uint16_t intValue = javaAddMethodRefTag(info, javaAddClassTag(info, socketClass),
+                                            javaAddNameAndTypeTag(info, "intValue", "()I"));
+    uint16_t saveFd   = javaAddMethodRefTag(info, info->this_class, javaAddNameAndTypeTag(info, "__fd", "(I)V"));
+    uint16_t orig     = javaAddMethodRefTag(info, info->this_class,
+                                            javaAddNameAndTypeTag(info, "__doReadBytes", "(Lio/netty/buffer/ByteBuf;)I"));
+    free(socketClass);
+    free(fieldDesc);
+
+    javaCopyMethod(info, info->methods[methodIndex], "__doReadBytes");
+    javaAddMethod(info, "__fd", "(I)V", ACC_PRIVATE | ACC_STATIC | ACC_NATIVE, 0, 0, NULL, 0);
+
+    uint8_t code[] = {
+        OP_ALOAD_0,
+        OP_GETFIELD, JAVA_U2(socket),
+        OP_INVOKEVIRTUAL, JAVA_U2(intValue),
+        OP_INVOKESTATIC, JAVA_U2(saveFd),
+        OP_ALOAD_0,
+        OP_ALOAD_1,
+        OP_INVOKEVIRTUAL, JAVA_U2(orig),
+        OP_IRETURN,
+    };
+    javaInjectCode(info, methodIndex, 2, 2, code, sizeof(code));
+}
+
 void JNICALL 
 ClassFileLoadHook(jvmtiEnv *jvmti_env,
     JNIEnv* jni,
@@ -313,7 +455,12 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
         }
         javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__unwrap");
         javaConvertMethodToNative(classInfo, methodIndex);
-        
+
+        // add a private field which will hold the id of the engine's session
+        javaAddField(classInfo, "__session", "I", ACC_PRIVATE);
+        // and one for the fd of a netty channel it was seen to read from
+        javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+
         unsigned char *dest;
         (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
         javaWriteClass(dest, classInfo);
@@ -334,17 +481,76 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
             scopeLog("ERROR: 'read' method not found in SocketChannelImpl class\n", -1, CFG_LOG_ERROR);
             return;
         }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
-        javaConvertMethodToNative(classInfo, methodIndex);
-
-        methodIndex = javaFindMethodIndex(classInfo, "write", "(Ljava/nio/ByteBuffer;)I");
-        if (methodIndex == -1) {
+        int writeIndex = javaFindMethodIndex(classInfo, "write", "(Ljava/nio/ByteBuffer;)I");
+        if (writeIndex == -1) {
             javaDestroy(&classInfo);
             scopeLog("ERROR: 'write' method not found in SocketChannelImpl class\n", -1, CFG_LOG_ERROR);
             return;
         }
-        javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__write");
-        javaConvertMethodToNative(classInfo, methodIndex);
+
+        if (g_dbb_fd && javaFindMethodIndex(classInfo, "getFDVal", "()I") != -1) {
+            // save the fd in the buffer without leaving java
+            injectSaveFd(classInfo, methodIndex, "__read", "(Ljava/nio/ByteBuffer;)I");
+            injectSaveFd(classInfo, writeIndex, "__write", "(Ljava/nio/ByteBuffer;)I");
+        } else {
+            javaCopyMethod(classInfo, classInfo->methods[methodIndex], "__read");
+            javaConvertMethodToNative(classInfo, methodIndex);
+            javaCopyMethod(classInfo, classInfo->methods[writeIndex], "__write");
+            javaConvertMethodToNative(classInfo, writeIndex);
+        }
+
+        unsigned char *dest;
+        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
+        javaWriteClass(dest, classInfo);
+
+        *new_class_data_len = classInfo->length;
+        *new_class_data = dest;
+        javaDestroy(&classInfo);
+    }
+
+    if (strcmp(name, "sun/nio/ch/UnixAsynchronousSocketChannelImpl") == 0) {
+
+        // Without the field in DirectByteBuffer there's nowhere to save the fd
+        if (!g_dbb_fd) return;
+
+        java_class_t *classInfo = javaReadClass(class_data);
+
+        int readIndex = javaFindMethodIndex(classInfo, "implRead", ASYNC_IO_SIGNATURE);
+        int writeIndex = javaFindMethodIndex(classInfo, "implWrite", ASYNC_IO_SIGNATURE);
+        if (readIndex == -1 || writeIndex == -1 ||
+            javaFindFieldIndex(classInfo, "fdVal", "I") == -1) {
+            javaDestroy(&classInfo);
+            scopeLog("ERROR: 'implRead', 'implWrite' or 'fdVal' not found in UnixAsynchronousSocketChannelImpl class\n", -1, CFG_LOG_ERROR);
+            return;
+        }
+
+        scopeLog("installing Java SSL hooks for UnixAsynchronousSocketChannelImpl class...", -1, CFG_LOG_INFO);
+        injectAsyncSaveFd(classInfo, readIndex, "__implRead");
+        injectAsyncSaveFd(classInfo, writeIndex, "__implWrite");
+
+        unsigned char *dest;
+        (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
+        javaWriteClass(dest, classInfo);
+
+        *new_class_data_len = classInfo->length;
+        *new_class_data = dest;
+        javaDestroy(&classInfo);
+    }
+
+    if (strcmp(name, "io/netty/channel/epoll/AbstractEpollChannel") == 0) {
+
+        java_class_t *classInfo = javaReadClass(class_data);
+
+        int methodIndex = javaFindMethodIndex(classInfo, "doReadBytes", "(Lio/netty/buffer/ByteBuf;)I");
+        int fieldIndex = javaFindFieldIndex(classInfo, "socket", NULL);
+        if (methodIndex == -1 || fieldIndex == -1) {
+            javaDestroy(&classInfo);
+            scopeLog("ERROR: 'doReadBytes' or 'socket' not found in AbstractEpollChannel class\n", -1, CFG_LOG_ERROR);
+            return;
+        }
+
+        scopeLog("installing Java SSL hooks for netty AbstractEpollChannel class...", -1, CFG_LOG_INFO);
+        injectNettyReadFd(classInfo, methodIndex, fieldIndex);
 
         unsigned char *dest;
         (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
@@ -356,13 +562,22 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
     }
 
     if (strcmp(name, "java/nio/DirectByteBuffer") == 0 ||
-        strcmp(name, "java/nio/DirectByteBufferR") == 0) {
+        (strcmp(name, "java/nio/DirectByteBufferR") == 0 && !g_dbb_fd)) {
 
         scopeLog("installing Java SSL hooks for java.nio.DirectByteBuffer class...", -1, CFG_LOG_INFO);
         java_class_t *classInfo = javaReadClass(class_data);
 
-        // add a private field which will hold the fd used to read/write data for that buffer
-        javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+        // add a field which will hold the fd used to read/write data for that buffer
+        if (strcmp(name, "java/nio/DirectByteBuffer") == 0) {
+            // public, along with the class, so the code injected in
+            // the sun.nio.ch channels can set it
+            classInfo->access_flags |= ACC_PUBLIC;
+            javaAddField(classInfo, "__fd", "I", ACC_PUBLIC);
+            g_dbb_fd = TRUE;
+        } else {
+            // DirectByteBufferR inherits the field when DirectByteBuffer has it
+            javaAddField(classInfo, "__fd", "I", ACC_PRIVATE);
+        }
 
         unsigned char *dest;
         (*jvmti_env)->Allocate(jvmti_env, classInfo->length, &dest);
@@ -377,27 +592,134 @@ ClassFileLoadHook(jvmtiEnv *jvmti_env,
 static void 
 doJavaProtocol(JNIEnv *jni, jobject session, jbyteArray buf, jint offset, jint len, metric_t src, int fd)
 {
+    if (len <= 0) return;
     jint  hash      = (*jni)->CallIntMethod(jni, session, g_java.mid_Object_hashCode);
     jbyte *byteBuf  = (*jni)->GetPrimitiveArrayCritical(jni, buf, 0);
-    doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)(len - offset), src, BUF);
-    (*jni)->ReleasePrimitiveArrayCritical(jni, buf, buf, 0);
+    if (!byteBuf) return;
+    doProtocol((uint64_t)hash, fd, &byteBuf[offset], (size_t)len, src, BUF);
+    (*jni)->ReleasePrimitiveArrayCritical(jni, buf, byteBuf, JNI_ABORT);
+}
+
+/*
+ * An engine belongs to one connection for its whole life, so the id
+ * handed to doProtocol is looked up once per engine and kept in the
+ * __session field added to SSLEngineImpl when it was loaded.  The
+ * engine's own hash is used rather than its session's; the session
+ * isn't known until the handshake is done and changes on renegotiation.
+ */
+static uint64_t
+getEngineId(JNIEnv *jni, jobject engine)
+{
+    jint id = 0;
+    if (g_java.fid_SSLEngineImpl___session) {
+        id = (*jni)->GetIntField(jni, engine, g_java.fid_SSLEngineImpl___session);
+        if (id) return (uint64_t)id;
+    }
+    id = (*jni)->CallIntMethod(jni, engine, g_java.mid_Object_hashCode);
+    if (g_java.fid_SSLEngineImpl___session) {
+        (*jni)->SetIntField(jni, engine, g_java.fid_SSLEngineImpl___session, id);
+    }
+    return (uint64_t)id;
+}
+
+// The fd that was saved in a direct buffer by a SocketChannelImpl read or write
+static int
+getBufferFd(JNIEnv *jni, jobject buf)
+{
+    if (!buf || !g_java.fid_ByteBuffer___fd) return -1;
+    // Only direct buffers have the field
+    if (!(*jni)->GetDirectBufferAddress(jni, buf)) return -1;
+    jint fd = (*jni)->GetIntField(jni, buf, g_java.fid_ByteBuffer___fd);
+    return (fd) ? fd : -1;
+}
+
+// Passes the bytes of a ByteBuffer from start to end to doProtocol.
+// Direct buffers are read in place, without any upcalls into the JVM.
+static void
+doJavaBuffer(JNIEnv *jni, uint64_t id, jobject bb, jint start, jint end, metric_t src, int fd)
+{
+    if (end <= start) return;
+
+    jbyte *addr = (*jni)->GetDirectBufferAddress(jni, bb);
+    if (addr) {
+        doProtocol(id, fd, &addr[start], (size_t)(end - start), src, BUF);
+        return;
+    }
+
+    // A read only heap buffer throws rather than expose its array
+    jbyteArray buf = (*jni)->CallObjectMethod(jni, bb, g_java.mid_ByteBuffer_array);
+    if (!buf) {
+        clearJniException(jni);
+        return;
+    }
+    jint base = (*jni)->CallIntMethod(jni, bb, g_java.mid_ByteBuffer_arrayOffset);
+    jbyte *byteBuf = (*jni)->GetPrimitiveArrayCritical(jni, buf, 0);
+    if (byteBuf) {
+        doProtocol(id, fd, &byteBuf[base + start], (size_t)(end - start), src, BUF);
+        (*jni)->ReleasePrimitiveArrayCritical(jni, buf, byteBuf, JNI_ABORT);
+    }
+    (*jni)->DeleteLocalRef(jni, buf);
+}
+
+// How many of the len buffers from offset in an array are there; the
+// original method throws for the rest
+static int
+bufferCount(JNIEnv *jni, jobjectArray bufs, jint offset, jint len)
+{
+    if (!bufs || offset < 0 || len <= 0) return 0;
+    jsize size = (*jni)->GetArrayLength(jni, bufs);
+    if (offset >= size) return 0;
+    return (len < size - offset) ? len : size - offset;
 }
 
 static void
 saveSocketChannel(JNIEnv *jni, jobject socketChannel, jobject buf)
 {
+    // Heap buffers are copied to a direct one by the channel, and
+    // there's nowhere to keep the fd in them
+    if (!g_java.fid_ByteBuffer___fd || !(*jni)->GetDirectBufferAddress(jni, buf)) return;
+
     jint fd = (*jni)->CallIntMethod(jni, socketChannel, g_java.mid_SocketChannelImpl_getFDVal);
     //store the file descriptor in the internal byte buffer's field
     (*jni)->SetIntField(jni, buf, g_java.fid_ByteBuffer___fd, fd);
 }
 
+/*
+ * The fd of the channel an engine is used with.  A buffer tagged by
+ * SocketChannelImpl says so itself.  Netty's buffers aren't tagged; the
+ * fd its last read on this thread saved is claimed by the first unwrap
+ * after it, so it's used once, and kept in the engine's __fd field for
+ * the engine's later wraps and unwraps.
+ */
+static int
+getEngineFd(JNIEnv *jni, jobject engine, jobject buf, int claim)
+{
+    int fd = getBufferFd(jni, buf);
+    if (fd != -1 || !g_java.fid_SSLEngineImpl___fd) return fd;
+
+    if (claim && g_netty_fd != -1) {
+        fd = g_netty_fd;
+        g_netty_fd = -1;
+        (*jni)->SetIntField(jni, engine, g_java.fid_SSLEngineImpl___fd, fd);
+        return fd;
+    }
+    fd = (*jni)->GetIntField(jni, engine, g_java.fid_SSLEngineImpl___fd);
+    return (fd) ? fd : -1;
+}
+
+JNIEXPORT void JNICALL
+Java_io_netty_channel_epoll_AbstractEpollChannel__1_1fd(JNIEnv *jni, jclass cls, jint fd)
+{
+    g_netty_fd = fd;
+}
+
 JNIEXPORT jint JNICALL
 Java_sun_nio_ch_SocketChannelImpl_read(JNIEnv *jni, jobject obj, jobject buf)
 {
     initJniGlobals(jni);
     initSSLEngineImplGlobals(jni);
     
-    saveSocketChannel(jni, obj, buf);
+    if (doProtocolEnabled()) saveSocketChannel(jni, obj, buf);
     
     jint res = (*jni)->CallIntMethod(jni, obj, g_java.mid_SocketChannelImpl___read, buf);
     return res;
@@ -409,7 +731,7 @@ Java_sun_nio_ch_SocketChannelImpl_write(JNIEnv *jni, jobject obj, jobject buf)
     initJniGlobals(jni);
     initSSLEngineImplGlobals(jni);
     
-    saveSocketChannel(jni, obj, buf);
+    if (doProtocolEnabled()) saveSocketChannel(jni, obj, buf);
     
     jint res = (*jni)->CallIntMethod(jni, obj, g_java.mid_SocketChannelImpl___write, buf);
     return res;
@@ -418,26 +740,41 @@ Java_sun_nio_ch_SocketChannelImpl_write(JNIEnv *jni, jobject obj, jobject buf)
 JNIEXPORT jobject JNICALL
 Java_sun_security_ssl_SSLEngineImpl_unwrap(JNIEnv *jni, jobject obj, jobject src, jobjectArray dsts, jint offset, jint len)
 {
-    int fd = -1;
-
     initJniGlobals(jni);
     initSSLEngineImplGlobals(jni);
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, src, g_java.fid_ByteBuffer___fd);
-    if (fdVal) {
-        fd = fdVal;
+    if (!doProtocolEnabled()) {
+        return (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___unwrap, src, dsts, offset, len);
+    }
+
+    int fd = getEngineFd(jni, obj, src, TRUE);
+
+    // Decrypted data lands between each buffer's position before and after the call
+    int i, count = bufferCount(jni, dsts, offset, len);
+    if (count > JAVA_MAX_BUFFERS) count = JAVA_MAX_BUFFERS;
+    jobject bufs[JAVA_MAX_BUFFERS];
+    jint start[JAVA_MAX_BUFFERS];
+    for (i = 0; i < count; i++) {
+        bufs[i] = (*jni)->GetObjectArrayElement(jni, dsts, offset + i);
+        start[i] = (bufs[i]) ? (*jni)->CallIntMethod(jni, bufs[i], g_java.mid_ByteBuffer_position) : 0;
     }
 
     //call the original method
     jobject res = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___unwrap, src, dsts, offset, len);
 
-    jobject session = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl_getSession);
-    int i;
-    for(i=offset;i<len - offset;i++) {
-        jobject bufEl  = (*jni)->GetObjectArrayElement(jni, dsts, i);
-        jint pos       = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
-        jbyteArray buf = (*jni)->CallObjectMethod(jni, bufEl, g_java.mid_ByteBuffer_array);
-        doJavaProtocol(jni, session, buf, 0, pos, TLSRX, fd);
+    // The app's exception is left for it; no more calls into the jvm
+    int failed = (*jni)->ExceptionCheck(jni);
+    uint64_t id = 0;
+    for (i = 0; i < count; i++) {
+        if (!bufs[i]) continue;
+        if (!failed) {
+            jint pos = (*jni)->CallIntMethod(jni, bufs[i], g_java.mid_ByteBuffer_position);
+            if (pos > start[i]) {
+                if (!id) id = getEngineId(jni, obj);
+                doJavaBuffer(jni, id, bufs[i], start[i], pos, TLSRX, fd);
+            }
+        }
+        (*jni)->DeleteLocalRef(jni, bufs[i]);
     }
     return res;
 }
@@ -451,28 +788,44 @@ Java_com_sun_net_ssl_internal_ssl_SSLEngineImpl_unwrap(JNIEnv *jni, jobject obj,
 JNIEXPORT jobject JNICALL 
 Java_sun_security_ssl_SSLEngineImpl_wrap(JNIEnv *jni, jobject obj, jobjectArray srcs, jint offset, jint len, jobject dst) 
 {
-    int fd = -1;
-
     initJniGlobals(jni);
     initSSLEngineImplGlobals(jni);
 
-    jint fdVal = (uint64_t) (*jni)->GetIntField(jni, dst, g_java.fid_ByteBuffer___fd);
-    if (fdVal) {
-        fd = fdVal;
+    if (!doProtocolEnabled()) {
+        return (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___wrap, srcs, offset, len, dst);
     }
-    
-    jobject session = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl_getSession);
-    int i;
-    for(i=offset;i<len - offset;i++) {
-        jobject bufEl  = (*jni)->GetObjectArrayElement(jni, srcs, i);
-        jint pos       = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_position);
-        jint limit     = (*jni)->CallIntMethod(jni, bufEl, g_java.mid_ByteBuffer_limit);
-        jbyteArray buf = (*jni)->CallObjectMethod(jni, bufEl, g_java.mid_ByteBuffer_array);
-        doJavaProtocol(jni, session, buf, pos, limit, TLSTX, fd);
+
+    int fd = getEngineFd(jni, obj, dst, FALSE);
+
+    // A call consumes at most a record; what it took from each buffer is
+    // between its position before and after the call.  The rest is
+    // reported by the call that takes it.
+    int i, count = bufferCount(jni, srcs, offset, len);
+    if (count > JAVA_MAX_BUFFERS) count = JAVA_MAX_BUFFERS;
+    jobject bufs[JAVA_MAX_BUFFERS];
+    jint start[JAVA_MAX_BUFFERS];
+    for (i = 0; i < count; i++) {
+        bufs[i] = (*jni)->GetObjectArrayElement(jni, srcs, offset + i);
+        start[i] = (bufs[i]) ? (*jni)->CallIntMethod(jni, bufs[i], g_java.mid_ByteBuffer_position) : 0;
     }
-    
+
     //call the original method
     jobject res = (*jni)->CallObjectMethod(jni, obj, g_java.mid_SSLEngineImpl___wrap, srcs, offset, len, dst);
+
+    // The app's exception is left for it; no more calls into the jvm
+    int failed = (*jni)->ExceptionCheck(jni);
+    uint64_t id = 0;
+    for (i = 0; i < count; i++) {
+        if (!bufs[i]) continue;
+        if (!failed) {
+            jint pos = (*jni)->CallIntMethod(jni, bufs[i], g_java.mid_ByteBuffer_position);
+            if (pos > start[i]) {
+                if (!id) id = getEngineId(jni, obj);
+                doJavaBuffer(jni, id, bufs[i], start[i], pos, TLSTX, fd);
+            }
+        }
+        (*jni)->DeleteLocalRef(jni, bufs[i]);
+    }
     return res;
 }
 
@@ -490,6 +843,11 @@ Java_sun_security_ssl_AppOutputStream_write(JNIEnv *jni, jobject obj, jbyteArray
     initJniGlobals(jni);
     initAppOutputStreamGlobals(jni);
 
+    if (!doProtocolEnabled()) {
+        (*jni)->CallVoidMethod(jni, obj, g_java.mid_AppOutputStream___write, buf, offset, len);
+        return;
+    }
+
     jobject session;
     if (g_java.fid_AppOutputStream_socket != NULL) {
         jobject socket  = (*jni)->GetObjectField(jni, obj, g_java.fid_AppOutputStream_socket);
@@ -526,6 +884,10 @@ Java_sun_security_ssl_AppInputStream_read(JNIEnv *jni, jobject obj, jbyteArray b
     initJniGlobals(jni);
     initAppInputStreamGlobals(jni);
 
+    if (!doProtocolEnabled()) {
+        return (*jni)->CallIntMethod(jni, obj, g_java.mid_AppInputStream___read, buf, offset, len);
+    }
+
     jobject session;
     if (g_java.fid_AppInputStream_socket != NULL) {
         jobject socket  = (*jni)->GetObjectField(jni, obj, g_java.fid_AppInputStream_socket);
@@ -125,6 +125,41 @@ javaAddMethodRefTag(java_class_t *info, uint16_t classIndex, uint16_t nameAndTyp
     return addTag(info, tag);
 }
 
+/*
+Adds a field ref tag to the contant pool
+see: https://docs.oracle.com/javase/specs/jvms/se14/html/jvms-4.html#jvms-4.4.2
+*/
+uint16_t 
+javaAddFieldRefTag(java_class_t *info, uint16_t classIndex, uint16_t nameAndTypeIndex) 
+{
+    size_t bufsize = 5;
+    unsigned char *tag = malloc(bufsize);
+    *((uint8_t *)tag)        = CONSTANT_Fieldref;
+    *((uint16_t *)(tag + 1)) = htobe16(classIndex);
+    *((uint16_t *)(tag + 3)) = htobe16(nameAndTypeIndex);
+    info->length += bufsize;
+    return addTag(info, tag);
+}
+
+/*
+Adds a class tag to the constant pool, or returns the existing one
+see: https://docs.oracle.com/javase/specs/jvms/se14/html/jvms-4.html#jvms-4.4.1
+*/
+uint16_t 
+javaAddClassTag(java_class_t *info, const char *className) 
+{
+    int idx = javaFindClassIndex(info, className);
+    if (idx != -1) return idx;
+
+    uint16_t nameIndex = addUtf8Tag(info, className);
+    size_t bufsize = 3;
+    unsigned char *tag = malloc(bufsize);
+    *((uint8_t *)tag)        = CONSTANT_Class;
+    *((uint16_t *)(tag + 1)) = htobe16(nameIndex);
+    info->length += bufsize;
+    return addTag(info, tag);
+}
+
 /*
 Adds a string tag to the constant pool
 see: https://docs.oracle.com/javase/specs/jvms/se14/html/jvms-4.html#jvms-4.4.3
@@ -133,9 +168,11 @@ uint16_t
 javaAddStringTag(java_class_t *info, const char* str)
 {
     uint16_t idx = addUtf8Tag(info, str);
-    unsigned char *tag = malloc(3);
+    size_t bufsize = 3;
+    unsigned char *tag = malloc(bufsize);
     *((uint8_t *)tag)        = CONSTANT_String;
     *((uint16_t *)(tag + 1)) = htobe16(idx);
+    info->length += bufsize;
     return addTag(info, tag);
 }
 
@@ -187,6 +224,8 @@ javaFindClassIndex(java_class_t *info, const char *className)
     int i;
     for(i=1;i<info->constant_pool_count;i++) {
         unsigned char *cp_info = info->constant_pool[i - 1];
+        // the slot after a long or double is left empty
+        if (cp_info == NULL) continue;
         uint8_t tag = *((uint8_t *)cp_info);
         if(tag == CONSTANT_Class) {
             uint16_t name_index = be16toh(*((uint16_t *)(cp_info + 1)));
@@ -224,6 +263,33 @@ javaFindMethodIndex(java_class_t *info, const char *method, const char *signatur
     return idx;
 }
 
+/*
+Returns the index of a field, matching any type when signature is NULL
+*/
+int 
+javaFindFieldIndex(java_class_t *info, const char *field, const char *signature) 
+{
+    int idx = -1;
+    int i;
+    for (i=0;i<info->fields_count;i++) {
+        unsigned char *addr = info->fields[i];
+        uint16_t name_index       = be16toh(*((uint16_t *)(addr + 2)));
+        uint16_t descriptor_index = be16toh(*((uint16_t *)(addr + 4)));
+        
+        char *field_name = javaGetUtf8String(info, name_index);
+        char *field_desc = javaGetUtf8String(info, descriptor_index);
+
+        if (strcmp(field, field_name) == 0 && 
+            (signature == NULL || strcmp(signature, field_desc) == 0)) {
+            idx = i;
+        }
+        free(field_name);
+        free(field_desc);
+        if (idx != -1) break;
+    }
+    return idx;
+}
+
 void 
 javaCopyMethod(java_class_t *info, unsigned char *method, const char *newName) 
 {
@@ -334,13 +400,48 @@ javaAddField(java_class_t *info, const char* name, const char* descriptor, uint1
     *((uint16_t *)buf) = htobe16(attrCount);        buf += 2;
 }
 
+/*
+Replaces the code of a method. The exception table and the attributes of the
+old Code attribute (line numbers, stack map frames) describe the old code, so
+they are dropped; the method's other attributes are kept.
+see: https://docs.oracle.com/javase/specs/jvms/se14/html/jvms-4.html#jvms-4.7.3
+*/
 void 
-javaInjectCode(java_class_t *classInfo, unsigned char *method, uint8_t *code, size_t len) 
+javaInjectCode(java_class_t *info, int methodIndex, uint16_t maxStack, uint16_t maxLocals, 
+               uint8_t *code, uint32_t codeLen) 
 {
-    unsigned char *codeAttr = getCodeAttributeAddress(classInfo, method);
-    uint32_t codeLen = be32toh(*((uint32_t *)(codeAttr + 10)));
-    memset(codeAttr + 14, 0, codeLen - 1);
-    memcpy(codeAttr + 14, code, len);
+    unsigned char *method   = info->methods[methodIndex];
+    unsigned char *codeAttr = getCodeAttributeAddress(info, method);
+    if (codeAttr == NULL) return;
+
+    uint32_t len         = javaGetMethodLength(method);
+    uint32_t oldAttrSize = be32toh(*((uint32_t *)(codeAttr + 2))) + 6;
+    uint32_t codeAttrLen = 12 + codeLen;
+    size_t before        = codeAttr - method;
+    size_t after         = len - before - oldAttrSize;
+    size_t bufsize       = before + 6 + codeAttrLen + after;
+
+    unsigned char *addr = malloc(bufsize);
+    info->methods[methodIndex] = addr;
+
+    //everything up to the Code attribute is unchanged
+    memcpy(addr, method, before);                             addr += before;
+
+    uint16_t exceptionLen = 0;
+    uint16_t codeAttrCount = 0;
+    memcpy(addr, codeAttr, 2);                                addr += 2;
+    *((uint32_t *)addr) = htobe32(codeAttrLen);               addr += 4;
+    *((uint16_t *)addr) = htobe16(maxStack);                  addr += 2;
+    *((uint16_t *)addr) = htobe16(maxLocals);                 addr += 2;
+    *((uint32_t *)addr) = htobe32(codeLen);                   addr += 4;
+    memcpy(addr, code, codeLen);                              addr += codeLen;
+    *((uint16_t *)addr) = htobe16(exceptionLen);              addr += 2;
+    *((uint16_t *)addr) = htobe16(codeAttrCount);             addr += 2;
+
+    //and so is everything after it
+    memcpy(addr, codeAttr + oldAttrSize, after);
+
+    info->length += bufsize - len;
 } 
 
 void 
@@ -24,9 +24,27 @@
 #define CONSTANT_Module               19
 #define CONSTANT_Package              20
 
+// opcodes
+#define OP_ILOAD_1                    0x1b
+#define OP_LLOAD                      0x16
+#define OP_ALOAD                      0x19
 #define OP_ALOAD_0                    0x2a
 #define OP_ALOAD_1                    0x2b
+#define OP_ALOAD_2                    0x2c
+#define OP_ALOAD_3                    0x2d
+#define OP_IFEQ                       0x99
+#define OP_IRETURN                    0xac
+#define OP_ARETURN                    0xb0
+#define OP_RETURN                     0xb1
+#define OP_GETFIELD                   0xb4
+#define OP_PUTFIELD                   0xb5
 #define OP_INVOKEVIRTUAL              0xb6
+#define OP_INVOKESTATIC               0xb8
+#define OP_CHECKCAST                  0xc0
+#define OP_INSTANCEOF                 0xc1
+
+// the two bytes of a constant pool index or branch offset operand
+#define JAVA_U2(x)                    (((x) >> 8) & 0xff), ((x) & 0xff)
 
 // access flags
 #define ACC_PUBLIC                    0x0001
@@ -73,16 +91,20 @@ void            javaDestroy(java_class_t **info);
 
 int             javaFindClassIndex(java_class_t *info, const char *className);
 int             javaFindMethodIndex(java_class_t *info, const char *method, const char *signature);
+int             javaFindFieldIndex(java_class_t *info, const char *field, const char *signature);
 void            javaCopyMethod(java_class_t *info, unsigned char *method, const char *newName);
 void            javaAddMethod(java_class_t *info, const char* name, const char* descriptor, 
                               uint16_t accessFlags, uint16_t maxStack, uint16_t maxLocals, 
                               uint8_t *code, uint32_t codeLen);
 void            javaAddField(java_class_t *info, const char* name, const char* descriptor, uint16_t accessFlags);
-void            javaInjectCode(java_class_t *info, unsigned char *method, uint8_t *code, size_t len);
+void            javaInjectCode(java_class_t *info, int methodIndex, uint16_t maxStack, uint16_t maxLocals,
+                               uint8_t *code, uint32_t codeLen);
 
 uint16_t        javaAddStringTag(java_class_t *info, const char* str);
 uint16_t        javaAddNameAndTypeTag(java_class_t *info, const char *name, const char *desc);
 uint16_t        javaAddMethodRefTag(java_class_t *info, uint16_t classIndex, uint16_t nameAndTypeIndex);
+uint16_t        javaAddFieldRefTag(java_class_t *info, uint16_t classIndex, uint16_t nameAndTypeIndex);
+uint16_t        javaAddClassTag(java_class_t *info, const char *className);
 
 char*           javaGetUtf8String(java_class_t *info, int tagIndex);
 uint16_t        javaGetTagLength(unsigned char *addr);
@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "linebuf.h"
+
+struct _linebuf_t
+{
+    int lock;
+    size_t max;
+    size_t len;                  // of the partial line in buf
+    uint64_t start;              // when the partial line was started
+    char *buf;                   // max bytes; only while a line is partial
+};
+
+linebuf_t *
+linebufCreate(size_t max)
+{
+    if (!max) return NULL;
+
+    linebuf_t *lb = calloc(1, sizeof(linebuf_t));
+    if (!lb) {
+        DBG(NULL);
+        return NULL;
+    }
+    lb->max = max;
+    return lb;
+}
+
+void
+linebufDestroy(linebuf_t **lb)
+{
+    if (!lb || !*lb) return;
+
+    if ((*lb)->buf) free((*lb)->buf);
+    free(*lb);
+    *lb = NULL;
+}
+
+size_t
+linebufPending(linebuf_t *lb)
+{
+    return (lb) ? lb->len : 0;
+}
+
+// Sends what's pending with len more bytes from data on the end of it
+static int
+sendLine(linebuf_t *lb, const char *data, size_t len, linebuf_fn fn, void *arg)
+{
+    if (!lb->len) {
+        if (!len) return 0;
+        fn(arg, data, len);
+        return 1;
+    }
+
+    if (len) memcpy(&lb->buf[lb->len], data, len);
+    fn(arg, lb->buf, lb->len + len);
+    lb->len = 0;
+    return 1;
+}
+
+int
+linebufAdd(linebuf_t *lb, const void *data, size_t count, uint64_t now,
+           linebuf_fn fn, void *arg)
+{
+    if (!lb || !data || !fn) return -1;
+    if (!atomicCas32(&lb->lock, 0, 1)) return -1;
+
+    const char *p = data;
+    int lines = 0;
+
+    while (count) {
+        const char *nl = memchr(p, '\n', count);
+        size_t seg = (nl) ? nl - p : count;
+
+        // Too long for one event; send it in pieces
+        while (lb->len + seg > lb->max) {
+            size_t take = lb->max - lb->len;
+            lines += sendLine(lb, p, take, fn, arg);
+            p += take;
+            seg -= take;
+            count -= take;
+        }
+
+        if (nl) {
+            lines += sendLine(lb, p, seg, fn, arg);
+            p += seg + 1;
+            count -= seg + 1;
+        } else {
+            count = 0;
+            if (!seg) break;
+            if (!lb->buf && !(lb->buf = malloc(lb->max))) {
+                // Can't keep it, so send it as it is
+                DBG(NULL);
+                lines += sendLine(lb, p, seg, fn, arg);
+                break;
+            }
+            if (!lb->len) lb->start = now;
+            memcpy(&lb->buf[lb->len], p, seg);
+            lb->len += seg;
+        }
+    }
+
+    atomicSwap32(&lb->lock, 0);
+    return lines;
+}
+
+int
+linebufFlush(linebuf_t *lb, uint64_t before, linebuf_fn fn, void *arg)
+{
+    if (!lb || !fn) return 0;
+
+    // A write holds the lock while it sends the lines it completes,
+    // so this can wait for as long as those take
+    while (!atomicCas32(&lb->lock, 0, 1)) sched_yield();
+
+    int sent = 0;
+    if (lb->len && (lb->start <= before)) {
+        sent = sendLine(lb, NULL, 0, fn, arg);
+
+        // Gone quiet, so give the memory back until it's needed again
+        free(lb->buf);
+        lb->buf = NULL;
+    }
+
+    atomicSwap32(&lb->lock, 0);
+    return sent;
+}
@@ -0,0 +1,42 @@
+#ifndef __LINEBUF_H__
+#define __LINEBUF_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Assembles what an app writes to a log into lines, so that each line
+// becomes one event no matter how the app splits it up across writes.
+//
+// Complete lines are handed to the callback without their newline,
+// straight from the caller's buffer when nothing is pending.  A partial
+// line is kept until the rest of it arrives, or until linebufFlush() finds
+// it old enough (or the fd is closed).  The buffer for it is only there
+// while there's a partial line to keep.  No line is longer than max;
+// longer ones go out in max sized pieces.  Empty lines are dropped.
+//
+// Each linebuf_t has a try-lock; a write that finds it busy (another
+// thread writing the same fd, or a flush) gets -1 and the caller should
+// send the data as it is.
+
+typedef struct _linebuf_t linebuf_t;
+
+// Called once per line
+typedef void (*linebuf_fn)(void *, const char *, size_t);
+
+// Constructors Destructors
+linebuf_t *         linebufCreate(size_t);
+void                linebufDestroy(linebuf_t **);
+
+// Accessors
+size_t              linebufPending(linebuf_t *);
+
+// Returns how many lines went to the callback, or -1 if it was busy.
+// The uint64_t is the time now, in whatever units linebufFlush() gets.
+int                 linebufAdd(linebuf_t *, const void *, size_t, uint64_t,
+                               linebuf_fn, void *);
+
+// Sends a partial line if it was started at or before the time given;
+// returns 1 if one was sent.  Waits for the lock.
+int                 linebufFlush(linebuf_t *, uint64_t, linebuf_fn, void *);
+
+#endif // __LINEBUF_H__
@@ -1,8 +1,10 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include "binformat.h"
 #include "dbg.h"
 #include "mtc.h"
+#include "mtcagg.h"
 #include "circbuf.h"
 
 struct _mtc_t
@@ -10,8 +12,13 @@ struct _mtc_t
     unsigned enable;
     transport_t* transport;
     mtc_fmt_t* format;
+    mtc_agg_t* agg;             // NULL when metrics go out as they come
+    cfg_mtc_aggregate_t by;
 };
 
+// Tags that tell one process in a container from another
+static const char *proc_tags[] = {"pid", "proc", NULL};
+
 mtc_t *
 mtcCreate()
 {
@@ -21,6 +28,7 @@ mtcCreate()
         return NULL;
     }
     mtc->enable = DEFAULT_MTC_ENABLE;
+    mtc->by = DEFAULT_MTC_AGGREGATE;
 
     return mtc;
 }
@@ -30,6 +38,10 @@ mtcDestroy(mtc_t **mtc)
 {
     if (!mtc || !*mtc) return;
     mtc_t *mtcb = *mtc;
+
+    // Send what's been combined before the transport goes
+    mtcFlush(mtcb);
+    mtcAggDestroy(&mtcb->agg);
     transportDestroy(&mtcb->transport);
     mtcFormatDestroy(&mtcb->format);
     free(mtcb);
@@ -43,6 +55,12 @@ mtcEnabled(mtc_t *mtc)
     return mtc->enable;
 }
 
+mtc_fmt_t *
+mtcFormat(mtc_t *mtc)
+{
+    return (mtc) ? mtc->format : NULL;
+}
+
 int
 mtcSend(mtc_t *mtc, const char *msg)
 {
@@ -51,10 +69,38 @@ mtcSend(mtc_t *mtc, const char *msg)
     return transportSend(mtc->transport, msg, strlen(msg));
 }
 
-int
-mtcSendMetric(mtc_t *mtc, event_t *evt)
+static int
+mtcSendBinMetric(mtc_t *mtc, bin_fmt_t *bin, event_t *evt)
 {
-    if (!mtc || !evt) return -1;
+    int rv = -1;
+    bin_msg_t msg;
+
+    binMsgInit(bin, &msg);
+    if (!binFormatMetric(bin, &msg, evt, mtcFormatVerbosity(mtc->format),
+                         mtcFormatCustomTags(mtc->format))) {
+        rv = transportSend(mtc->transport, msg.buf.data, msg.buf.len);
+        binFormatSent(bin, &msg, rv);
+    }
+    binMsgFree(&msg);
+    return rv;
+}
+
+static int
+mtcSendNow(mtc_t *mtc, event_t *evt)
+{
+    bin_fmt_t *bin = mtcFormatBin(mtc->format);
+    if (bin) return mtcSendBinMetric(mtc, bin, evt);
+
+    // statsd output is bounded by max_len, so when that's no more than the
+    // default it's built on the stack rather than in a buffer malloc'd and
+    // freed for every metric.  This runs on the app's threads, go's small
+    // stacks included, so a bigger max_len, or another format, takes the
+    // heap.
+    char buf[DEFAULT_STATSD_MAX_LEN + 1];
+    if ((mtcFormatStatsDMaxLen(mtc->format) < sizeof(buf)) &&
+        (mtcFormatEventIntoBuffer(mtc->format, evt, NULL, buf, sizeof(buf)) >= 0)) {
+        return mtcSend(mtc, buf);
+    }
 
     char *msg = mtcFormatEventForOutput(mtc->format, evt, NULL);
     int rv = mtcSend(mtc, msg);
@@ -62,12 +108,92 @@ mtcSendMetric(mtc_t *mtc, event_t *evt)
     return rv;
 }
 
+static void
+mtcSendCombined(void *mtc, event_t *evt)
+{
+    mtcSendNow((mtc_t *)mtc, evt);
+}
+
+static int
+mtcSendOne(mtc_t *mtc, event_t *evt)
+{
+    // Combined with others like it, to go out at the next mtcFlush
+    if (!mtcAggAdd(mtc->agg, evt, mtcFormatVerbosity(mtc->format))) return 0;
+
+    return mtcSendNow(mtc, evt);
+}
+
+// Sends a copy without the process tags, so each process in a container
+// sends the same series; counters and timings add up, here and at the
+// receiver.  A gauge doesn't: a receiver keeps the last value it was
+// sent for a series.  Gauges keep their tags, so there's one per process.
+static int
+mtcSendForContainer(mtc_t *mtc, event_t *evt)
+{
+    if (evt->type == CURRENT) return mtcSendOne(mtc, evt);
+
+    size_t n = 0;
+    while (evt->fields && evt->fields[n].value_type != FMT_END) n++;
+    if (!n) return mtcSendOne(mtc, evt);
+
+    event_field_t fields[n + 1];
+    memcpy(fields, evt->fields, sizeof(fields));
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        int j;
+        for (j = 0; proc_tags[j]; j++) {
+            if (strcmp(fields[i].name, proc_tags[j])) continue;
+            // Above any verbosity, so nothing formats it
+            fields[i].cardinality = CFG_MAX_VERBOSITY + 1;
+            break;
+        }
+    }
+
+    event_t copy = *evt;
+    copy.fields = fields;
+    return mtcSendOne(mtc, &copy);
+}
+
+int
+mtcSendMetric(mtc_t *mtc, event_t *evt)
+{
+    if (!mtc || !evt) return -1;
+
+    if (mtc->by == CFG_AGG_CONTAINER) return mtcSendForContainer(mtc, evt);
+    return mtcSendOne(mtc, evt);
+}
+
 void
 mtcFlush(mtc_t *mtc)
 {
     if (!mtc) return;
 
-    transportFlush(mtc->transport);
+    mtcAggFlush(mtc->agg, mtcSendCombined, mtc);
+
+    int rc = transportFlush(mtc->transport);
+
+    // Datagrams can be lost, so udp receivers get the dictionary
+    // again every period.  The same goes after a compressed block
+    // failed to go out, or queued records were thrown away, as either
+    // may have carried definitions.
+    if (rc == -1 || transportType(mtc->transport) == CFG_UDP) {
+        binFormatReset(mtcFormatBin(mtc->format));
+    }
+}
+
+int
+mtcDrain(mtc_t *mtc, unsigned ms)
+{
+    if (!mtc) return 0;
+    return transportDrain(mtc->transport, ms);
+}
+
+int
+mtcQueueStats(mtc_t *mtc, uint64_t *queued, uint64_t *dropped, uint64_t *spilled)
+{
+    if (!mtc) return -1;
+    return transportQueueStats(mtc->transport, queued, dropped, spilled);
 }
 
 int
@@ -81,6 +207,8 @@ int
 mtcConnect(mtc_t *mtc)
 {
     if (!mtc) return 0;
+    binFormatReset(mtcFormatBin(mtc->format));
+    if (mtcFormatBin(mtc->format)) transportQueueDiscard(mtc->transport);
     return transportConnect(mtc->transport);
 }
 
@@ -95,6 +223,10 @@ int
 mtcReconnect(mtc_t *mtc)
 {
     if (!mtc) return 0;
+    binFormatReset(mtcFormatBin(mtc->format));
+
+    // What the parent combined is the parent's to send
+    mtcAggFlush(mtc->agg, NULL, NULL);
     return transportReconnect(mtc->transport);
 }
 
@@ -105,6 +237,24 @@ mtcEnabledSet(mtc_t *mtc, unsigned val)
     mtc->enable = val;
 }
 
+void
+mtcAggregateSet(mtc_t *mtc, unsigned max)
+{
+    if (!mtc) return;
+
+    // Don't leak, or lose what's been combined, if called repeatedly
+    mtcAggFlush(mtc->agg, mtcSendCombined, mtc);
+    mtcAggDestroy(&mtc->agg);
+    if (max) mtc->agg = mtcAggCreate(max);
+}
+
+void
+mtcAggregateBySet(mtc_t *mtc, cfg_mtc_aggregate_t by)
+{
+    if (!mtc || by > CFG_AGG_CONTAINER) return;
+    mtc->by = by;
+}
+
 void
 mtcTransportSet(mtc_t *mtc, transport_t *transport)
 {
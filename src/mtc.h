@@ -12,9 +12,12 @@ void                mtcDestroy(mtc_t**);
 
 // Accessors
 unsigned            mtcEnabled(mtc_t*);
+mtc_fmt_t*          mtcFormat(mtc_t*);
 int                 mtcSend(mtc_t*, const char* msg);
 int                 mtcSendMetric(mtc_t*, event_t*);
 void                mtcFlush(mtc_t*);
+int                 mtcDrain(mtc_t*, unsigned);
+int                 mtcQueueStats(mtc_t*, uint64_t*, uint64_t*, uint64_t*);
 
 // Setters (modifies mtc_t, but does not persist modifications)
 int                 mtcNeedsConnection(mtc_t *);
@@ -22,6 +25,8 @@ int                 mtcConnect(mtc_t *);
 int                 mtcDisconnect(mtc_t *);
 int                 mtcReconnect(mtc_t *);
 void                mtcEnabledSet(mtc_t*, unsigned);
+void                mtcAggregateSet(mtc_t*, unsigned);
+void                mtcAggregateBySet(mtc_t*, cfg_mtc_aggregate_t);
 void                mtcTransportSet(mtc_t*, transport_t*);
 void                mtcFormatSet(mtc_t*, mtc_fmt_t*);
 
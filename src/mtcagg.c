@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "mtcagg.h"
+
+#define MTCAGG_SHARDS 8
+#define MTCAGG_MIN_SLOTS 16
+#define MTCAGG_KEY_MAX 1024
+#define MTCAGG_FOLD_CARDINALITY 4    // tags kept once a shard is full
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    void *blob;                  // NULL when the slot is free
+    const char *key;             // type, name and kept tags, rendered
+    uint64_t hash;
+    const char *name;
+    value_t vtype;
+    union {
+        long long integer;
+        double floating;
+    } value;
+    data_type_t type;
+    watch_t src;
+    event_field_t *fields;       // FIELDEND terminated
+} agg_entry_t;
+
+typedef struct {
+    int lock;
+    unsigned count;              // entries in use, folded ones included
+    unsigned keyed;              // entries with their full tag set
+    unsigned max;                // of keyed
+    unsigned size;               // slots; a power of 2
+    agg_entry_t *slot;
+    char pad[64];
+} agg_shard_t;
+
+struct _mtc_agg_t
+{
+    agg_shard_t shard[MTCAGG_SHARDS];
+    uint64_t folded;
+};
+
+mtc_agg_t *
+mtcAggCreate(unsigned max)
+{
+    if (!max) return NULL;
+
+    mtc_agg_t *agg = calloc(1, sizeof(mtc_agg_t));
+    if (!agg) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    // Room for twice max, so probes stay short and folded entries fit
+    unsigned per = (max + MTCAGG_SHARDS - 1) / MTCAGG_SHARDS;
+    unsigned size = MTCAGG_MIN_SLOTS;
+    while (size < per * 2) size <<= 1;
+
+    int i;
+    for (i = 0; i < MTCAGG_SHARDS; i++) {
+        agg_shard_t *s = &agg->shard[i];
+        if (!(s->slot = calloc(size, sizeof(agg_entry_t)))) {
+            DBG(NULL);
+            mtcAggDestroy(&agg);
+            return NULL;
+        }
+        s->max = per;
+        s->size = size;
+    }
+    return agg;
+}
+
+static void
+clearShard(agg_shard_t *s)
+{
+    unsigned i;
+    for (i = 0; i < s->size && s->count; i++) {
+        if (!s->slot[i].blob) continue;
+        free(s->slot[i].blob);
+        s->slot[i].blob = NULL;
+        s->count--;
+    }
+    s->count = s->keyed = 0;
+}
+
+void
+mtcAggDestroy(mtc_agg_t **agg)
+{
+    if (!agg || !*agg) return;
+
+    int i;
+    for (i = 0; i < MTCAGG_SHARDS; i++) {
+        agg_shard_t *s = &(*agg)->shard[i];
+        if (!s->slot) continue;
+        clearShard(s);
+        free(s->slot);
+    }
+    free(*agg);
+    *agg = NULL;
+}
+
+unsigned
+mtcAggEntries(mtc_agg_t *agg)
+{
+    if (!agg) return 0;
+
+    unsigned i, count = 0;
+    for (i = 0; i < MTCAGG_SHARDS; i++) count += agg->shard[i].count;
+    return count;
+}
+
+uint64_t
+mtcAggFolded(mtc_agg_t *agg)
+{
+    return (agg) ? agg->folded : 0;
+}
+
+static int
+keptField(event_field_t *f, unsigned cardinality)
+{
+    return (f->cardinality <= cardinality) &&
+           ((f->value_type == FMT_STR) || (f->value_type == FMT_NUM));
+}
+
+// Renders type, name and kept tags into buf; returns the length or -1
+static int
+renderKey(event_t *evt, unsigned cardinality, char *buf, size_t size)
+{
+    int len = snprintf(buf, size, "%d|%s|", evt->type, evt->name);
+    if ((len < 0) || (len >= size)) return -1;
+
+    event_field_t *f;
+    for (f = evt->fields; f && f->value_type != FMT_END; f++) {
+        if (!keptField(f, cardinality)) continue;
+
+        int n;
+        if (f->value_type == FMT_NUM) {
+            n = snprintf(&buf[len], size - len, "%s:%lld,", f->name, f->value.num);
+        } else {
+            n = snprintf(&buf[len], size - len, "%s:%s,", f->name,
+                         (f->value.str) ? f->value.str : "");
+        }
+        if ((n < 0) || (n >= size - len)) return -1;
+        len += n;
+    }
+    return len;
+}
+
+static uint64_t
+hashKey(const char *key, int len)
+{
+    uint64_t h = FNV_OFFSET;
+    int i;
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// Copies the fields, key, name and tag strings into one allocation
+static int
+fillEntry(agg_entry_t *e, event_t *evt, unsigned cardinality,
+          const char *key, int klen, uint64_t hash)
+{
+    size_t nfields = 0;
+    size_t bytes = klen + 1 + strlen(evt->name) + 1;
+    event_field_t *f;
+
+    for (f = evt->fields; f && f->value_type != FMT_END; f++) {
+        if (!keptField(f, cardinality)) continue;
+        nfields++;
+        bytes += strlen(f->name) + 1;
+        if (f->value_type == FMT_STR && f->value.str) bytes += strlen(f->value.str) + 1;
+    }
+
+    size_t fbytes = (nfields + 1) * sizeof(event_field_t);
+    char *blob = malloc(fbytes + bytes);
+    if (!blob) {
+        DBG(NULL);
+        return -1;
+    }
+
+    event_field_t *fields = (event_field_t *)blob;
+    char *str = blob + fbytes;
+
+    e->key = str;
+    str = stpcpy(str, key) + 1;
+    e->name = str;
+    str = stpcpy(str, evt->name) + 1;
+
+    event_field_t *out = fields;
+    for (f = evt->fields; f && f->value_type != FMT_END; f++) {
+        if (!keptField(f, cardinality)) continue;
+        *out = *f;
+        out->name = str;
+        str = stpcpy(str, f->name) + 1;
+        if (f->value_type == FMT_STR && f->value.str) {
+            out->value.str = str;
+            str = stpcpy(str, f->value.str) + 1;
+        }
+        out++;
+    }
+    event_field_t end = FIELDEND;
+    *out = end;
+
+    e->blob = blob;
+    e->fields = fields;
+    e->hash = hash;
+    e->type = evt->type;
+    e->src = evt->src;
+    e->vtype = evt->value.type;
+    if (e->vtype == FMT_INT) {
+        e->value.integer = evt->value.integer;
+    } else {
+        e->value.floating = evt->value.floating;
+    }
+    return 0;
+}
+
+static void
+combine(agg_entry_t *e, event_t *evt)
+{
+    if (e->type == CURRENT) {
+        e->vtype = evt->value.type;
+        if (e->vtype == FMT_INT) {
+            e->value.integer = evt->value.integer;
+        } else {
+            e->value.floating = evt->value.floating;
+        }
+        return;
+    }
+
+    // DELTA; sums go to floating point if either side is
+    if ((e->vtype == FMT_INT) && (evt->value.type == FMT_INT)) {
+        e->value.integer += evt->value.integer;
+        return;
+    }
+    if (e->vtype == FMT_INT) {
+        e->value.floating = (double)e->value.integer;
+        e->vtype = FMT_FLT;
+    }
+    e->value.floating += (evt->value.type == FMT_INT) ?
+        (double)evt->value.integer : evt->value.floating;
+}
+
+// Finds the entry for a key, or the free slot it would go in
+static agg_entry_t *
+probe(agg_shard_t *s, const char *key, uint64_t hash)
+{
+    unsigned mask = s->size - 1;
+    unsigned i = hash & mask;
+
+    while (1) {
+        agg_entry_t *e = &s->slot[i];
+        if (!e->blob) return e;
+        if ((e->hash == hash) && !strcmp(e->key, key)) return e;
+        i = (i + 1) & mask;
+    }
+}
+
+int
+mtcAggAdd(mtc_agg_t *agg, event_t *evt, unsigned verbosity)
+{
+    if (!agg || !evt || !evt->name) return -1;
+    if ((evt->type != DELTA) && (evt->type != CURRENT)) return -1;
+
+    char key[MTCAGG_KEY_MAX];
+    int klen = renderKey(evt, verbosity, key, sizeof(key));
+    if (klen < 0) return -1;
+    uint64_t hash = hashKey(key, klen);
+
+    // High bits pick the shard; low bits pick the slot in it
+    agg_shard_t *s = &agg->shard[(hash >> 56) % MTCAGG_SHARDS];
+    if (!atomicCas32(&s->lock, 0, 1)) return -1;
+
+    int rc = -1;
+    agg_entry_t *e = probe(s, key, hash);
+    if (e->blob) {
+        combine(e, evt);
+        rc = 0;
+    } else if (s->keyed < s->max) {
+        if (!fillEntry(e, evt, verbosity, key, klen, hash)) {
+            s->count++;
+            s->keyed++;
+            rc = 0;
+        }
+    } else {
+        // Full; fold it in with others of the same name
+        unsigned fold = (verbosity < MTCAGG_FOLD_CARDINALITY) ?
+            verbosity : MTCAGG_FOLD_CARDINALITY;
+        if ((klen = renderKey(evt, fold, key, sizeof(key))) >= 0) {
+            hash = hashKey(key, klen);
+            e = probe(s, key, hash);
+            if (e->blob) {
+                combine(e, evt);
+                atomicAddU64(&agg->folded, 1);
+                rc = 0;
+            } else if ((s->count < (s->size / 4) * 3) &&
+                       !fillEntry(e, evt, fold, key, klen, hash)) {
+                s->count++;
+                atomicAddU64(&agg->folded, 1);
+                rc = 0;
+            }
+        }
+    }
+
+    atomicSwap32(&s->lock, 0);
+    return rc;
+}
+
+int
+mtcAggFlush(mtc_agg_t *agg, mtc_agg_fn fn, void *arg)
+{
+    if (!agg) return 0;
+
+    int i, sent = 0;
+    for (i = 0; i < MTCAGG_SHARDS; i++) {
+        agg_shard_t *s = &agg->shard[i];
+
+        // Adds only hold the lock briefly
+        while (!atomicCas32(&s->lock, 0, 1)) sched_yield();
+
+        unsigned j;
+        for (j = 0; j < s->size; j++) {
+            agg_entry_t *e = &s->slot[j];
+            if (!e->blob) continue;
+
+            if (fn) {
+                if (e->vtype == FMT_INT) {
+                    event_t evt = INT_EVENT(e->name, e->value.integer, e->type, e->fields);
+                    evt.src = e->src;
+                    fn(arg, &evt);
+                } else {
+                    event_t evt = FLT_EVENT(e->name, e->value.floating, e->type, e->fields);
+                    evt.src = e->src;
+                    fn(arg, &evt);
+                }
+            }
+            sent++;
+        }
+        clearShard(s);
+
+        atomicSwap32(&s->lock, 0);
+    }
+    return sent;
+}
@@ -0,0 +1,43 @@
+#ifndef __MTCAGG_H__
+#define __MTCAGG_H__
+
+#include <stdint.h>
+#include "mtcformat.h"
+
+// Combines metrics on their way out so that each name and tag set goes
+// out once per period, rather than once per fd or per operation.
+//
+// Metrics are keyed by their type, name and the tags that verbosity lets
+// through.  Counters (DELTA) are summed and gauges (CURRENT) keep the last
+// value.  Timers, histograms and sets aren't combined, as statsd can't
+// carry more than one sample of them in a line; they're sent as they come.
+//
+// At most max tag sets are kept per period.  Past that, a metric with a
+// new tag set is folded into one entry for its name that keeps only the
+// process level tags (cardinality of 4 and under), so a process with
+// huge numbers of short lived fds can't flood the receiver.
+//
+// The table is split into shards, each with a try-lock; a metric that
+// finds its shard busy is sent straight through rather than waiting.
+
+typedef struct _mtc_agg_t mtc_agg_t;
+
+// Called by mtcAggFlush once per combined metric
+typedef void (*mtc_agg_fn)(void *, event_t *);
+
+// Constructors Destructors
+mtc_agg_t *         mtcAggCreate(unsigned);
+void                mtcAggDestroy(mtc_agg_t **);
+
+// Accessors
+unsigned            mtcAggEntries(mtc_agg_t *);
+uint64_t            mtcAggFolded(mtc_agg_t *);
+
+// Returns 0 if the metric was taken, -1 if the caller should send it
+int                 mtcAggAdd(mtc_agg_t *, event_t *, unsigned);
+
+// Hands each combined metric to the callback and empties the table;
+// returns how many there were
+int                 mtcAggFlush(mtc_agg_t *, mtc_agg_fn, void *);
+
+#endif // __MTCAGG_H__
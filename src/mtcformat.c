@@ -4,11 +4,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/timeb.h>
 #include <inttypes.h>
+#include "atomic.h"
+#include "binformat.h"
 #include "cJSON.h"
 #include "dbg.h"
 #include "mtcformat.h"
+#include "plattime.h"
 #include "scopetypes.h"
 #include "com.h"
 
@@ -16,15 +18,39 @@
 #define FALSE 0
 
 
+// Number of leading event fields whose rendered statsd tags are cached.
+// report.c leads nearly every metric with proc, pid and host.
+#define STATSD_CACHED_FIELDS 3
+
+typedef struct {
+    char* name;
+    field_value_t value_type;
+    union {
+        char* str;
+        long long num;
+    } value;
+    unsigned cardinality;
+} cached_field_t;
+
+typedef struct {
+    int lock;                   // try-lock; contention just skips the cache
+    int count;                  // number of valid entries in field[]
+    cached_field_t field[STATSD_CACHED_FIELDS];
+    char* str;                  // field[] rendered as "name:value,..."
+} field_cache_t;
+
 struct _mtc_fmt_t
 {
     cfg_mtc_format_t format;
     struct {
         char* prefix;
         unsigned max_len;       // Max length in bytes of a statsd string
+        char* tags;             // custom tags rendered as "name:value,..."
+        field_cache_t fields;
     } statsd;
     unsigned verbosity;
     custom_tag_t** tags;
+    bin_fmt_t* bin;             // only for CFG_FMT_BINARY
 };
 
 
@@ -45,6 +71,12 @@ mtcFormatCreate(cfg_mtc_format_t format)
     f->verbosity = DEFAULT_MTC_VERBOSITY;
     f->tags = DEFAULT_CUSTOM_TAGS;
 
+    if ((format == CFG_FMT_BINARY) && !(f->bin = binFormatCreate())) {
+        free(f->statsd.prefix);
+        free(f);
+        return NULL;
+    }
+
     return f;
 }
 
@@ -65,13 +97,42 @@ mtcFormatDestroyTags(custom_tag_t*** tags)
     *tags = NULL;
 }
 
+static void
+fieldCacheClear(field_cache_t* cache)
+{
+    int i;
+    for (i = 0; i < cache->count; i++) {
+        cached_field_t* c = &cache->field[i];
+        free(c->name);
+        if (c->value_type == FMT_STR) free(c->value.str);
+    }
+    cache->count = 0;
+    if (cache->str) free(cache->str);
+    cache->str = NULL;
+}
+
+static void
+fieldCacheInvalidate(mtc_fmt_t* fmt)
+{
+    field_cache_t* cache = &fmt->statsd.fields;
+
+    // Setters run at config time, but don't pull the rug out from
+    // under a thread that is formatting with the cache right now.
+    while (!atomicCas32(&cache->lock, 0, 1)) ;
+    fieldCacheClear(cache);
+    atomicSwap32(&cache->lock, 0);
+}
+
 void
 mtcFormatDestroy(mtc_fmt_t** fmt)
 {
     if (!fmt || !*fmt) return;
     mtc_fmt_t* f = *fmt;
     if (f->statsd.prefix) free(f->statsd.prefix);
+    if (f->statsd.tags) free(f->statsd.tags);
+    fieldCacheClear(&f->statsd.fields);
     mtcFormatDestroyTags(&f->tags);
+    binFormatDestroy(&f->bin);
     free(f);
     *fmt = NULL;
 }
@@ -117,24 +178,127 @@ createStatsFieldString(mtc_fmt_t* fmt, event_field_t* f, char* tag, int sizeofta
     return sz;
 }
 
-static void
-appendStatsdFieldString(mtc_fmt_t* fmt, char* tag, int sz, char** end, int* bytes, int* firstTagAdded)
+// Returns TRUE if tag fit and was appended
+static int
+appendStatsdFieldString(mtc_fmt_t* fmt, const char* tag, int sz, char** end, int* bytes, int* firstTagAdded)
 {
     if (!*firstTagAdded) {
         sz += 2; // add space for the |#
-        if ((*bytes + sz) >= fmt->statsd.max_len) return;
+        if ((*bytes + sz) >= fmt->statsd.max_len) return FALSE;
         *end = stpcpy(*end, "|#");
         *end = stpcpy(*end, tag);
         strcpy(*end, "\n"); // add newline, but don't advance end
         *firstTagAdded = 1;
     } else {
         sz += 1; // add space for the comma
-        if ((*bytes + sz) >= fmt->statsd.max_len) return;
+        if ((*bytes + sz) >= fmt->statsd.max_len) return FALSE;
         *end = stpcpy(*end, ",");
         *end = stpcpy(*end, tag);
         strcpy(*end, "\n"); // add newline, but don't advance end
     }
     *bytes += sz;
+    return TRUE;
+}
+
+static int
+fieldCacheMatches(field_cache_t* cache, event_field_t* fields)
+{
+    if (!cache->str) return FALSE;
+
+    int i;
+    for (i = 0; i < cache->count; i++) {
+        cached_field_t* c = &cache->field[i];
+        event_field_t* f = &fields[i];
+        if (f->value_type != c->value_type) return FALSE;
+        if (f->cardinality != c->cardinality) return FALSE;
+        if (strcmp(f->name, c->name)) return FALSE;
+        if (f->value_type == FMT_NUM) {
+            if (f->value.num != c->value.num) return FALSE;
+        } else {
+            if (strcmp(f->value.str, c->value.str)) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int
+fieldCacheFill(mtc_fmt_t* fmt, field_cache_t* cache, event_field_t* fields)
+{
+    fieldCacheClear(cache);
+
+    // Stop at FMT_END so we never read past the end of fields
+    int i;
+    for (i = 0; i < STATSD_CACHED_FIELDS; i++) {
+        if ((fields[i].value_type != FMT_NUM) &&
+            (fields[i].value_type != FMT_STR)) return FALSE;
+    }
+
+    char tag[fmt->statsd.max_len+1];
+    tag[fmt->statsd.max_len] = '\0'; // Ensures null termination
+    char str[fmt->statsd.max_len+1];
+    char* end = str;
+    str[0] = '\0';
+
+    for (i = 0; i < STATSD_CACHED_FIELDS; i++) {
+        event_field_t* f = &fields[i];
+        cached_field_t* c = &cache->field[i];
+
+        c->name = strdup(f->name);
+        c->value_type = f->value_type;
+        c->cardinality = f->cardinality;
+        if (f->value_type == FMT_NUM) {
+            c->value.num = f->value.num;
+        } else {
+            c->value.str = strdup(f->value.str);
+        }
+        cache->count++;
+        if (!c->name || ((f->value_type == FMT_STR) && !c->value.str)) {
+            DBG(NULL);
+            fieldCacheClear(cache);
+            return FALSE;
+        }
+
+        // Honor Verbosity
+        if (f->cardinality > fmt->verbosity) continue;
+
+        int sz = createStatsFieldString(fmt, f, tag, sizeof(tag));
+        if ((sz < 0) || ((end - str) + sz + 1 >= sizeof(str))) {
+            fieldCacheClear(cache);
+            return FALSE;
+        }
+        if (end != str) end = stpcpy(end, ",");
+        end = stpcpy(end, tag);
+    }
+
+    if (!(cache->str = strdup(str))) {
+        DBG(NULL);
+        fieldCacheClear(cache);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Returns the number of leading fields that were appended from the cache
+static int
+addCachedStatsdFields(mtc_fmt_t* fmt, event_field_t* fields, char** end, int* bytes, int* firstTagAdded)
+{
+    field_cache_t* cache = &fmt->statsd.fields;
+    int used = 0;
+
+    if (!atomicCas32(&cache->lock, 0, 1)) return 0;
+
+    if (fieldCacheMatches(cache, fields) || fieldCacheFill(fmt, cache, fields)) {
+        // An empty string means verbosity filtered out every cached field.
+        // If the whole string doesn't fit, let the caller fit what it can.
+        if (!cache->str[0] ||
+            appendStatsdFieldString(fmt, cache->str, strlen(cache->str),
+                                    end, bytes, firstTagAdded)) {
+            used = cache->count;
+        }
+    }
+
+    atomicSwap32(&cache->lock, 0);
+    return used;
 }
 
 
@@ -147,8 +311,12 @@ addStatsdFields(mtc_fmt_t* fmt, event_field_t* fields, char** end, int* bytes, i
     tag[fmt->statsd.max_len] = '\0'; // Ensures null termination
     int sz;
 
-    event_field_t* f;
-    for (f = fields; f->value_type != FMT_END; f++) {
+    event_field_t* f = fields;
+
+    // The cache doesn't know about field filters
+    if (!fieldFilter) f += addCachedStatsdFields(fmt, fields, end, bytes, firstTagAdded);
+
+    for ( ; f->value_type != FMT_END; f++) {
 
         if (fieldFilter && regexec_wrapper(fieldFilter, f->name, 0, NULL, 0)) continue;
 
@@ -167,6 +335,11 @@ addCustomFields(mtc_fmt_t* fmt, custom_tag_t** tags, char** end, int* bytes, int
 {
     if (!fmt || !tags || !*tags || !end || !*end || !bytes) return;
 
+    // All of the tags at once if they fit, otherwise fit what we can
+    if (fmt->statsd.tags &&
+        appendStatsdFieldString(fmt, fmt->statsd.tags, strlen(fmt->statsd.tags),
+                                end, bytes, firstTagAdded)) return;
+
     char tag[fmt->statsd.max_len+1];
     tag[fmt->statsd.max_len] = '\0'; // Ensures null termination
     int sz;
@@ -184,18 +357,11 @@ addCustomFields(mtc_fmt_t* fmt, custom_tag_t** tags, char** end, int* bytes, int
     }
 }
 
-static char*
-mtcFormatStatsDString(mtc_fmt_t* fmt, event_t* e, regex_t* fieldFilter)
+// buf must be at least fmt->statsd.max_len + 1 bytes
+static int
+mtcFormatStatsDBuffer(mtc_fmt_t* fmt, event_t* e, regex_t* fieldFilter, char* buf)
 {
-    if (!fmt || !e) return NULL;
-
-    char* end = calloc(1, fmt->statsd.max_len + 1);
-    if (!end) {
-         DBG("%s", e->name);
-         return NULL;
-    }
-
-    char* end_start = end;
+    char* end = buf;
 
     // First, calculate size
     int bytes = 0;
@@ -213,19 +379,13 @@ mtcFormatStatsDString(mtc_fmt_t* fmt, event_t* e, regex_t* fieldFilter)
         default:
             DBG(NULL);
     }
-    if (n < 0) {
-        free(end_start);
-        return NULL;
-    }
+    if (n < 0) return -1;
     bytes += n; // size of value in valuebuf
     char* type = statsdType(e->type);
     bytes += strlen(type);
 
-    // Test the calloc'd size is adequate
-    if (bytes >= fmt->statsd.max_len) {
-        free(end_start);
-        return NULL;
-    }
+    // Test the buffer size is adequate
+    if (bytes >= fmt->statsd.max_len) return -1;
 
     // Then construct it
     end = stpcpy(end, fmt->statsd.prefix);
@@ -244,7 +404,37 @@ mtcFormatStatsDString(mtc_fmt_t* fmt, event_t* e, regex_t* fieldFilter)
     // Now that we're done, we can count the trailing newline
     bytes += 1;
 
-    return end_start;
+    return bytes;
+}
+
+static char*
+mtcFormatStatsDString(mtc_fmt_t* fmt, event_t* e, regex_t* fieldFilter)
+{
+    if (!fmt || !e) return NULL;
+
+    char* buf = calloc(1, fmt->statsd.max_len + 1);
+    if (!buf) {
+         DBG("%s", e->name);
+         return NULL;
+    }
+
+    if (mtcFormatStatsDBuffer(fmt, e, fieldFilter, buf) < 0) {
+        free(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+int
+mtcFormatEventIntoBuffer(mtc_fmt_t* fmt, event_t* evt, regex_t* fieldFilter, char* buf, size_t len)
+{
+    if (!fmt || !evt || !buf) return -1;
+    if (fmt->format != CFG_FMT_STATSD) return -1;
+    if (len < fmt->statsd.max_len + 1) return -1;
+
+    buf[0] = '\0';
+    return mtcFormatStatsDBuffer(fmt, evt, fieldFilter, buf);
 }
 
 char *
@@ -261,10 +451,7 @@ mtcFormatEventForOutput(mtc_fmt_t *fmt, event_t *evt, regex_t *fieldFilter)
         if (!json) return NULL;
 
         // Request is for this json, plus a _time field
-        struct timeb tb;
-        ftime(&tb);
-        double timestamp = tb.time + (double)tb.millitm/1000;
-        cJSON_AddNumberToObjLN(json, "_time", timestamp);
+        cJSON_AddNumberToObjLN(json, "_time", getWallTime(evt->tsc) / 1e9);
 
         if ((msg = cJSON_PrintUnformatted(json))) {
             int strsize = strlen(msg);
@@ -310,6 +497,12 @@ mtcFormatCustomTags(mtc_fmt_t* fmt)
     return (fmt) ? fmt->tags : DEFAULT_CUSTOM_TAGS;
 }
 
+bin_fmt_t*
+mtcFormatBin(mtc_fmt_t* fmt)
+{
+    return (fmt) ? fmt->bin : NULL;
+}
+
 // Setters
 
 void
@@ -327,6 +520,7 @@ mtcFormatStatsDMaxLenSet(mtc_fmt_t* fmt, unsigned v)
 {
     if (!fmt) return;
     fmt->statsd.max_len = v;
+    fieldCacheInvalidate(fmt);
 }
 
 void
@@ -335,6 +529,7 @@ mtcFormatVerbositySet(mtc_fmt_t* fmt, unsigned v)
     if (!fmt) return;
     if (v > CFG_MAX_VERBOSITY) v = CFG_MAX_VERBOSITY;
     fmt->verbosity = v;
+    fieldCacheInvalidate(fmt);
 }
 
 void
@@ -344,6 +539,8 @@ mtcFormatCustomTagsSet(mtc_fmt_t* fmt, custom_tag_t** tags)
 
     // Don't leak with multiple set operations
     mtcFormatDestroyTags(&fmt->tags);
+    if (fmt->statsd.tags) free(fmt->statsd.tags);
+    fmt->statsd.tags = NULL;
 
     if (!tags || !*tags) return;
 
@@ -373,6 +570,20 @@ mtcFormatCustomTagsSet(mtc_fmt_t* fmt, custom_tag_t** tags)
         t->value = v;
         fmt->tags[j++]=t;
     }
+
+    // Render them once here rather than for every metric
+    size_t len = 0;
+    for (i = 0; i < j; i++) {
+        len += strlen(fmt->tags[i]->name) + strlen(fmt->tags[i]->value) + 2;
+    }
+    if (!j || !(fmt->statsd.tags = calloc(1, len + 1))) return;
+    char* end = fmt->statsd.tags;
+    for (i = 0; i < j; i++) {
+        if (i) end = stpcpy(end, ",");
+        end = stpcpy(end, fmt->tags[i]->name);
+        end = stpcpy(end, ":");
+        end = stpcpy(end, fmt->tags[i]->value);
+    }
 }
 
 static int
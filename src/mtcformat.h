@@ -1,6 +1,7 @@
 #ifndef __MTC_FORMAT_H__
 #define __MTC_FORMAT_H__
 
+#include <stdint.h>
 #include "pcre2posix.h"
 #include "scopetypes.h"
 #include "cfg.h"
@@ -44,6 +45,7 @@ typedef struct {
     const data_type_t type;
     event_field_t *fields;
     watch_t src;
+    uint64_t tsc;               // getTime() when it happened; 0 for now
 } event_t;
 
 #define INT_EVENT(n, v, t, f) {n, { FMT_INT, .integer=v}, t, f, CFG_SRC_METRIC}
@@ -59,6 +61,7 @@ typedef struct event_format {
 } event_format_t;
 
 typedef struct _mtc_fmt_t mtc_fmt_t;
+typedef struct _bin_fmt_t bin_fmt_t;     // see binformat.h
 
 // Constructors Destructors
 mtc_fmt_t*          mtcFormatCreate(cfg_mtc_format_t);
@@ -70,10 +73,19 @@ unsigned            mtcFormatStatsDMaxLen(mtc_fmt_t*);
 unsigned            mtcFormatVerbosity(mtc_fmt_t*);
 custom_tag_t**      mtcFormatCustomTags(mtc_fmt_t*);
 
+// Non-NULL only for the binary format; it carries the name dictionary
+bin_fmt_t*          mtcFormatBin(mtc_fmt_t*);
+
 // This function returns a pointer to a malloc()'d buffer.
 // The caller is responsible for deallocating with free().
+// Returns NULL for the binary format, which isn't a string.
 char*               mtcFormatEventForOutput(mtc_fmt_t*, event_t*, regex_t*);
 
+// For statsd only, formats into the caller's buffer, which must be at
+// least mtcFormatStatsDMaxLen()+1 bytes.  Returns the length of the
+// string or -1 if it could not be formatted (including other formats).
+int                 mtcFormatEventIntoBuffer(mtc_fmt_t*, event_t*, regex_t*, char*, size_t);
+
 // Setters
 void                mtcFormatStatsDPrefixSet(mtc_fmt_t*, const char*);
 void                mtcFormatStatsDMaxLenSet(mtc_fmt_t*, unsigned);
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "paybuf.h"
+
+// Records are laid end to end from the start of a half, each padded so
+// the next one (and any header struct in it) is 8 byte aligned.  A record
+// with a len of zero marks the end of a half that filled up.
+typedef struct {
+    uint32_t hlen;
+    uint32_t len;
+} pay_rec_t;
+
+#define PAYBUF_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+typedef struct {
+    char *buf;
+    uint64_t used;               // bytes claimed; can run past size when full
+    int writers;                 // threads copying in right now
+} pay_half_t;
+
+struct _paybuf_t
+{
+    size_t size;                 // bytes in each half
+    int active;                  // index of the half being written to
+    pay_half_t half[2];
+    uint64_t dropped;
+};
+
+paybuf_t *
+paybufCreate(size_t size)
+{
+    size = PAYBUF_ALIGN(size);
+    if (size < sizeof(pay_rec_t)) return NULL;
+
+    paybuf_t *pb = calloc(1, sizeof(paybuf_t));
+    if (!pb) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    // malloc rather than calloc; pages are only touched as they're used
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (!(pb->half[i].buf = malloc(size))) {
+            DBG(NULL);
+            paybufDestroy(&pb);
+            return NULL;
+        }
+    }
+
+    pb->size = size;
+    return pb;
+}
+
+void
+paybufDestroy(paybuf_t **pb)
+{
+    if (!pb || !*pb) return;
+
+    if ((*pb)->half[0].buf) free((*pb)->half[0].buf);
+    if ((*pb)->half[1].buf) free((*pb)->half[1].buf);
+    free(*pb);
+    *pb = NULL;
+}
+
+size_t
+paybufSize(paybuf_t *pb)
+{
+    return (pb) ? pb->size : 0;
+}
+
+uint64_t
+paybufDropped(paybuf_t *pb)
+{
+    return (pb) ? atomicLoadU64(&pb->dropped) : 0;
+}
+
+size_t
+paybufMaxLen(paybuf_t *pb, size_t hlen)
+{
+    if (!pb || (sizeof(pay_rec_t) + hlen >= pb->size)) return 0;
+    return pb->size - sizeof(pay_rec_t) - hlen;
+}
+
+int
+paybufPut(paybuf_t *pb, const void *hdr, size_t hlen, const void *data, size_t len)
+{
+    if (!pb || !data || !len || (hlen && !hdr)) return -1;
+
+    size_t need = PAYBUF_ALIGN(sizeof(pay_rec_t) + hlen + len);
+    if (need > pb->size) {
+        atomicAddU64(&pb->dropped, 1);
+        return -1;
+    }
+
+    // Register as a writer of the active half.  If a drain swapped halves
+    // before we were counted, back out and use the new one; the drain
+    // can't have missed us if we're still on the half it's waiting for.
+    pay_half_t *half;
+    int h;
+    for (;;) {
+        h = __atomic_load_n(&pb->active, __ATOMIC_SEQ_CST);
+        half = &pb->half[h];
+        atomicAdd32(&half->writers, 1);
+        if (__atomic_load_n(&pb->active, __ATOMIC_SEQ_CST) == h) break;
+        atomicSub32(&half->writers, 1);
+    }
+
+    uint64_t off = __sync_fetch_and_add(&half->used, need);
+    if (off + need > pb->size) {
+        // Full.  The first writer past the end marks where the records stop
+        if (off < pb->size) {
+            pay_rec_t end = {0, 0};
+            memcpy(&half->buf[off], &end, sizeof(end));
+        }
+        atomicSub32(&half->writers, 1);
+        atomicAddU64(&pb->dropped, 1);
+        return -1;
+    }
+
+    pay_rec_t rec = {(uint32_t)hlen, (uint32_t)len};
+    char *dst = &half->buf[off];
+    memcpy(dst, &rec, sizeof(rec));
+    if (hlen) memcpy(dst + sizeof(rec), hdr, hlen);
+    memcpy(dst + sizeof(rec) + hlen, data, len);
+
+    atomicSub32(&half->writers, 1);
+    return 0;
+}
+
+int
+paybufDrain(paybuf_t *pb, paybuf_fn fn, void *arg)
+{
+    if (!pb || !fn) return 0;
+
+    int h = pb->active;
+    pay_half_t *half = &pb->half[h];
+
+    // Point new writers at the other half, then wait out the ones
+    // still copying into this one.  They only ever hold it for a memcpy.
+    atomicSwap32(&pb->active, !h);
+    __sync_synchronize();
+    while (__atomic_load_n(&half->writers, __ATOMIC_SEQ_CST)) {
+        sched_yield();
+    }
+
+    uint64_t end = atomicLoadU64(&half->used);
+    if (end > pb->size) end = pb->size;
+
+    int count = 0;
+    uint64_t off = 0;
+    while (off + sizeof(pay_rec_t) <= end) {
+        pay_rec_t rec;
+        memcpy(&rec, &half->buf[off], sizeof(rec));
+        if (!rec.len) break;
+
+        const char *hdr = &half->buf[off + sizeof(rec)];
+        fn(arg, hdr, rec.hlen, hdr + rec.hlen, rec.len);
+        off += PAYBUF_ALIGN(sizeof(rec) + rec.hlen + rec.len);
+        count++;
+    }
+
+    // Nothing writes here again until the next drain makes it active
+    atomicStoreU64(&half->used, 0);
+    return count;
+}
@@ -0,0 +1,41 @@
+#ifndef __PAYBUF_H__
+#define __PAYBUF_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A fixed size arena that payload data is copied into as it's intercepted.
+//
+// The arena has two halves.  Any number of threads append records to the
+// active half (a fetch-and-add claims the space, then the copy is done
+// without locks) while a single reader drains the other.  A drain makes
+// the other half active, waits for writers still copying into the old
+// one, and hands each record to a callback.  When a record doesn't fit in
+// what's left of the active half it's dropped and counted; nothing is
+// allocated after paybufCreate().
+
+typedef struct _paybuf_t paybuf_t;
+
+// Called once per record by paybufDrain with the header and data that
+// were given to paybufPut.  Both stay valid until the next paybufDrain.
+typedef void (*paybuf_fn)(void *, const void *, size_t, const void *, size_t);
+
+// Constructors Destructors
+paybuf_t *          paybufCreate(size_t);
+void                paybufDestroy(paybuf_t **);
+
+// Accessors
+size_t              paybufSize(paybuf_t *);
+uint64_t            paybufDropped(paybuf_t *);
+
+// The most data a record with a header of the given length can hold;
+// anything bigger is always dropped
+size_t              paybufMaxLen(paybuf_t *, size_t);
+
+// Copies a header and data in as one record; 0 on success, -1 if dropped
+int                 paybufPut(paybuf_t *, const void *, size_t, const void *, size_t);
+
+// Single reader only.  Returns the number of records handed to the callback
+int                 paybufDrain(paybuf_t *, paybuf_fn, void *);
+
+#endif // __PAYBUF_H__
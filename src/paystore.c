@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "dbg.h"
+#include "fn.h"
+#include "paystore.h"
+
+#define PAYSTORE_IOV 64          // writes queued per file before a writev
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    char *path;                  // NULL when the slot is free
+    uint64_t hash;
+    int fd;
+    unsigned long long size;     // bytes in the file, counting what's queued
+    time_t window;               // maxage window the file was started in
+    uint64_t used;               // ps->tick when last written; for the LRU
+    int iovcnt;
+    struct iovec iov[PAYSTORE_IOV];
+} pay_file_t;
+
+struct _paystore_t
+{
+    char *dir;
+    unsigned files;
+    unsigned long long maxsize;
+    unsigned maxage;
+    unsigned long long maxtotal;
+    unsigned long long total;    // bytes of our files in the directory
+    uint64_t dropped;            // writes refused for maxtotal
+    uint64_t tick;
+    char *header;
+    size_t hlen;
+    pay_file_t *file;
+};
+
+static uint64_t
+hashName(const char *name)
+{
+    uint64_t h = FNV_OFFSET;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+paystore_t *
+paystoreCreate(const char *dir, unsigned files, unsigned long long maxsize, unsigned maxage)
+{
+    if (!dir || !files) return NULL;
+
+    paystore_t *ps = calloc(1, sizeof(paystore_t));
+    if (!ps) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    ps->dir = strdup(dir);
+    ps->file = calloc(files, sizeof(pay_file_t));
+    if (!ps->dir || !ps->file) {
+        DBG(NULL);
+        paystoreDestroy(&ps);
+        return NULL;
+    }
+
+    ps->files = files;
+    ps->maxsize = maxsize;
+    ps->maxage = maxage;
+    return ps;
+}
+
+static void
+flushFile(pay_file_t *f)
+{
+    struct iovec *iov = f->iov;
+    int cnt = f->iovcnt;
+
+    f->iovcnt = 0;
+    if (!cnt || !g_fn.writev) return;
+
+    while (cnt > 0) {
+        ssize_t rc = g_fn.writev(f->fd, iov, cnt);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            DBG("%s", f->path);
+            return;
+        }
+
+        // Skip what was written; resume partway into an iovec if need be
+        while (cnt && (rc >= (ssize_t)iov->iov_len)) {
+            rc -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt) {
+            iov->iov_base = (char *)iov->iov_base + rc;
+            iov->iov_len -= rc;
+        }
+    }
+}
+
+static void
+closeFile(pay_file_t *f)
+{
+    if (!f->path) return;
+
+    flushFile(f);
+    if (g_fn.close) g_fn.close(f->fd);
+    free(f->path);
+    f->path = NULL;
+}
+
+static int
+openFile(paystore_t *ps, pay_file_t *f, time_t now)
+{
+    struct stat sbuf;
+
+    if (!g_fn.open) return -1;
+
+    f->fd = g_fn.open(f->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (f->fd == -1) return -1;
+
+    // Pick up where an earlier open of the same file left off
+    f->size = 0;
+    f->window = (ps->maxage) ? now / ps->maxage : 0;
+    if (fstat(f->fd, &sbuf) == 0) {
+        f->size = sbuf.st_size;
+        if (ps->maxage && f->size) f->window = sbuf.st_mtime / ps->maxage;
+    }
+
+    if (!f->size && ps->header) {
+        f->iov[0].iov_base = ps->header;
+        f->iov[0].iov_len = ps->hlen;
+        f->iovcnt = 1;
+        f->size = ps->hlen;
+        ps->total += ps->hlen;
+    }
+    return 0;
+}
+
+static int
+rotateFile(paystore_t *ps, pay_file_t *f, time_t now)
+{
+    char old[PATH_MAX];
+
+    flushFile(f);
+    if (g_fn.close) g_fn.close(f->fd);
+
+    if (snprintf(old, sizeof(old), "%s.1", f->path) < sizeof(old)) {
+        // The one being replaced is gone from the directory
+        struct stat sbuf;
+        if (g_fn.stat && !g_fn.stat(old, &sbuf)) {
+            ps->total -= (sbuf.st_size < ps->total) ? sbuf.st_size : ps->total;
+        }
+        rename(f->path, old);
+    }
+    return openFile(ps, f, now);
+}
+
+static pay_file_t *
+getFile(paystore_t *ps, const char *name, time_t now)
+{
+    uint64_t hash = hashName(name);
+    pay_file_t *lru = NULL;
+    char path[PATH_MAX];
+    int i;
+
+    if (snprintf(path, sizeof(path), "%s/%s", ps->dir, name) >= sizeof(path)) {
+        return NULL;
+    }
+
+    for (i = 0; i < ps->files; i++) {
+        pay_file_t *f = &ps->file[i];
+        if (!f->path) {
+            if (!lru || lru->path) lru = f;
+            continue;
+        }
+        if ((f->hash == hash) && !strcmp(f->path, path)) return f;
+        if (!lru || (lru->path && (f->used < lru->used))) lru = f;
+    }
+
+    // Not open; take a free slot or the least recently written one
+    closeFile(lru);
+    if (!(lru->path = strdup(path))) return NULL;
+    lru->hash = hash;
+    lru->iovcnt = 0;
+    if (openFile(ps, lru, now)) {
+        free(lru->path);
+        lru->path = NULL;
+        return NULL;
+    }
+    return lru;
+}
+
+int
+paystoreWriteAt(paystore_t *ps, const char *name, const void *buf, size_t len, time_t now)
+{
+    if (!ps || !name || !buf || !len) return -1;
+
+    pay_file_t *f = getFile(ps, name, now);
+    if (!f) return -1;
+
+    if ((f->size > ps->hlen) &&
+        ((ps->maxsize && (f->size + len > ps->maxsize)) ||
+         (ps->maxage && (f->window != now / ps->maxage)))) {
+        if (rotateFile(ps, f, now)) {
+            free(f->path);
+            f->path = NULL;
+            return -1;
+        }
+    }
+
+    if (ps->maxtotal && (ps->total + len > ps->maxtotal)) {
+        ps->dropped++;
+        return -1;
+    }
+
+    if (f->iovcnt == PAYSTORE_IOV) flushFile(f);
+    f->iov[f->iovcnt].iov_base = (void *)buf;
+    f->iov[f->iovcnt].iov_len = len;
+    f->iovcnt++;
+    f->size += len;
+    ps->total += len;
+    f->used = ++ps->tick;
+    return 0;
+}
+
+int
+paystoreWrite(paystore_t *ps, const char *name, const void *buf, size_t len)
+{
+    return paystoreWriteAt(ps, name, buf, len, time(NULL));
+}
+
+void
+paystoreFlush(paystore_t *ps)
+{
+    if (!ps) return;
+
+    int i;
+    for (i = 0; i < ps->files; i++) {
+        if (ps->file[i].path) flushFile(&ps->file[i]);
+    }
+}
+
+int
+paystoreHeaderSet(paystore_t *ps, const void *header, size_t len)
+{
+    if (!ps) return -1;
+
+    char *copy = NULL;
+    if (header && len) {
+        if (!(copy = malloc(len))) {
+            DBG(NULL);
+            return -1;
+        }
+        memcpy(copy, header, len);
+    }
+
+    // Files already open keep queued pointers to the old one
+    paystoreFlush(ps);
+    if (ps->header) free(ps->header);
+    ps->header = copy;
+    ps->hlen = (copy) ? len : 0;
+    return 0;
+}
+
+void
+paystoreMaxTotalSet(paystore_t *ps, unsigned long long maxtotal)
+{
+    if (ps) ps->maxtotal = maxtotal;
+}
+
+uint64_t
+paystoreDropped(paystore_t *ps)
+{
+    return (ps) ? ps->dropped : 0;
+}
+
+unsigned
+paystoreOpenFiles(paystore_t *ps)
+{
+    if (!ps) return 0;
+
+    unsigned i, count = 0;
+    for (i = 0; i < ps->files; i++) {
+        if (ps->file[i].path) count++;
+    }
+    return count;
+}
+
+void
+paystoreDestroy(paystore_t **ps)
+{
+    if (!ps || !*ps) return;
+
+    if ((*ps)->file) {
+        int i;
+        for (i = 0; i < (*ps)->files; i++) closeFile(&(*ps)->file[i]);
+        free((*ps)->file);
+    }
+    if ((*ps)->dir) free((*ps)->dir);
+    if ((*ps)->header) free((*ps)->header);
+    free(*ps);
+    *ps = NULL;
+}
+
+void
+paystoreDiscard(paystore_t **ps)
+{
+    if (!ps || !*ps) return;
+
+    if ((*ps)->file) {
+        int i;
+        for (i = 0; i < (*ps)->files; i++) (*ps)->file[i].iovcnt = 0;
+    }
+    paystoreDestroy(ps);
+}
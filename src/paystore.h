@@ -0,0 +1,52 @@
+#ifndef __PAYSTORE_H__
+#define __PAYSTORE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Writes payload data to files in a directory, one per connection and
+// direction.
+//
+// Files stay open between writes in a small LRU cache so that a busy
+// connection doesn't cost an open and close per record.  Writes are
+// queued per file and go out together in one writev when the file's
+// queue fills or paystoreFlush() is called; queued data isn't copied, so
+// it must stay valid until then.
+//
+// When a file would grow past maxsize bytes, or was started in an earlier
+// maxage second window, it's renamed with a ".1" suffix (replacing the
+// previous one) and a new file is started.  0 turns off either limit.
+// If a header is set, every file starts with it, rotated ones included.
+//
+// Rotation bounds each file, but a file is kept per connection, so it
+// takes maxtotal to bound the directory.  It's the bytes of the files
+// written through this store, rotated ones included, that may be in the
+// directory at once; a rotation that replaces an earlier ".1" gives its
+// bytes back.  Writes past it are dropped and counted.  It's per
+// process; each process that captures payloads has its own.
+
+typedef struct _paystore_t paystore_t;
+
+// Constructors Destructors
+paystore_t *        paystoreCreate(const char *, unsigned, unsigned long long, unsigned);
+void                paystoreDestroy(paystore_t **);
+// Like paystoreDestroy, but what's queued is thrown away, not written;
+// for a forked child's copy of its parent's store
+void                paystoreDiscard(paystore_t **);
+
+// Accessors
+unsigned            paystoreOpenFiles(paystore_t *);
+int                 paystoreHeaderSet(paystore_t *, const void *, size_t);
+void                paystoreMaxTotalSet(paystore_t *, unsigned long long);
+uint64_t            paystoreDropped(paystore_t *);
+
+// Queues data for the named file in the directory; 0 on success.
+// paystoreWriteAt takes the time to judge maxage by instead of now.
+int                 paystoreWrite(paystore_t *, const char *, const void *, size_t);
+int                 paystoreWriteAt(paystore_t *, const char *, const void *, size_t, time_t);
+
+// Writes everything queued for every open file
+void                paystoreFlush(paystore_t *);
+
+#endif // __PAYSTORE_H__
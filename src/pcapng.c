@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "pcapng.h"
+
+// See https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-03.html
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_RAW 101      // starts at the IP header; v4 or v6
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_EPB_FIXED 32          // block fields around the packet data
+#define PCAPNG_IFNAME_MAX 200
+#define PCAPNG_HEADER_MAX 512
+
+#define IPV4_HDR 20
+#define IPV6_HDR 40
+#define TCP_HDR 20
+#define UDP_HDR 8
+#define TCP_PSH_ACK 0x18
+
+#define PAD4(x) (((x) + 3) & ~(size_t)3)
+
+struct _pcapng_t
+{
+    char header[PCAPNG_HEADER_MAX];
+    size_t hlen;
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static char *
+put16(char *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static char *
+put32(char *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+// An option; the value is padded out to 32 bits
+static char *
+putOpt(char *p, uint16_t code, const void *val, uint16_t len)
+{
+    p = put16(p, code);
+    p = put16(p, len);
+    memset(p, 0, PAD4(len));
+    if (len) memcpy(p, val, len);
+    return p + PAD4(len);
+}
+
+// Fills in the length at the start and end of a block
+static char *
+endBlock(char *start, char *p)
+{
+    uint32_t len = (p - start) + sizeof(uint32_t);
+    put32(start + sizeof(uint32_t), len);
+    return put32(p, len);
+}
+
+static size_t
+buildHeader(char *buf, const char *ifname)
+{
+    static const char appl[] = "libscope";
+    char *p = buf, *start;
+
+    start = p;
+    p = put32(p, PCAPNG_SHB);
+    p = put32(p, 0);
+    p = put32(p, PCAPNG_BYTE_ORDER);
+    p = put16(p, 1);
+    p = put16(p, 0);
+    p = put32(p, 0xFFFFFFFF);                // section length unknown
+    p = put32(p, 0xFFFFFFFF);
+    p = putOpt(p, PCAPNG_OPT_SHB_USERAPPL, appl, strlen(appl));
+    p = putOpt(p, PCAPNG_OPT_END, NULL, 0);
+    p = endBlock(start, p);
+
+    start = p;
+    uint8_t tsresol = 9;                     // nanoseconds
+    p = put32(p, PCAPNG_IDB);
+    p = put32(p, 0);
+    p = put16(p, PCAPNG_LINKTYPE_RAW);
+    p = put16(p, 0);
+    p = put32(p, 0);                         // no snaplen
+    if (ifname && ifname[0]) {
+        p = putOpt(p, PCAPNG_OPT_IF_NAME, ifname, strnlen(ifname, PCAPNG_IFNAME_MAX));
+    }
+    p = putOpt(p, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+    p = putOpt(p, PCAPNG_OPT_END, NULL, 0);
+    p = endBlock(start, p);
+
+    return p - buf;
+}
+
+pcapng_t *
+pcapngCreate(size_t size, const char *ifname)
+{
+    pcapng_t *pc = calloc(1, sizeof(pcapng_t));
+    if (!pc) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    // Always room for at least one whole segment
+    size_t min = PCAPNG_EPB_FIXED + IPV6_HDR + TCP_HDR + PCAPNG_MAX_SEGMENT + 4;
+    if (size < min) size = min;
+
+    if (!(pc->buf = malloc(size))) {
+        DBG(NULL);
+        free(pc);
+        return NULL;
+    }
+    pc->size = size;
+    pc->hlen = buildHeader(pc->header, ifname);
+    return pc;
+}
+
+void
+pcapngDestroy(pcapng_t **pc)
+{
+    if (!pc || !*pc) return;
+
+    if ((*pc)->buf) free((*pc)->buf);
+    free(*pc);
+    *pc = NULL;
+}
+
+size_t
+pcapngHeader(pcapng_t *pc, const char **hdr)
+{
+    if (!pc || !hdr) return 0;
+    *hdr = pc->header;
+    return pc->hlen;
+}
+
+static uint16_t
+addrPort(const struct sockaddr_storage *ss)
+{
+    if (!ss) return 0;
+    if (ss->ss_family == AF_INET) return ((struct sockaddr_in *)ss)->sin_port;
+    if (ss->ss_family == AF_INET6) return ((struct sockaddr_in6 *)ss)->sin6_port;
+    return 0;
+}
+
+static void
+addr4(const struct sockaddr_storage *ss, char *p)
+{
+    memset(p, 0, 4);
+    if (ss && (ss->ss_family == AF_INET)) {
+        memcpy(p, &((struct sockaddr_in *)ss)->sin_addr, 4);
+    }
+}
+
+// v4 addresses on a v6 connection show up as v4 mapped
+static void
+addr6(const struct sockaddr_storage *ss, char *p)
+{
+    memset(p, 0, 16);
+    if (!ss) return;
+    if (ss->ss_family == AF_INET6) {
+        memcpy(p, &((struct sockaddr_in6 *)ss)->sin6_addr, 16);
+    } else if (ss->ss_family == AF_INET) {
+        p[10] = p[11] = (char)0xFF;
+        memcpy(&p[12], &((struct sockaddr_in *)ss)->sin_addr, 4);
+    }
+}
+
+static uint16_t
+ipChecksum(const unsigned char *p, size_t len)
+{
+    uint32_t sum = 0;
+    size_t i;
+    for (i = 0; i + 1 < len; i += 2) sum += (p[i] << 8) | p[i + 1];
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return htons(~sum & 0xFFFF);
+}
+
+// Writes the IP and TCP or UDP headers for one segment; returns their length
+static size_t
+buildHeaders(char *p, const pcapng_pkt_t *pkt, size_t seg)
+{
+    const struct sockaddr_storage *src = (pkt->tx) ? pkt->local : pkt->remote;
+    const struct sockaddr_storage *dst = (pkt->tx) ? pkt->remote : pkt->local;
+    int v6 = ((src && src->ss_family == AF_INET6) || (dst && dst->ss_family == AF_INET6));
+    int tcp = (pkt->proto != IPPROTO_UDP);
+    size_t l4 = (tcp) ? TCP_HDR : UDP_HDR;
+    size_t ip = (v6) ? IPV6_HDR : IPV4_HDR;
+    unsigned char *h = (unsigned char *)p;
+
+    memset(p, 0, ip + l4);
+    if (v6) {
+        h[0] = 0x60;
+        *(uint16_t *)&h[4] = htons(l4 + seg);
+        h[6] = (tcp) ? IPPROTO_TCP : IPPROTO_UDP;
+        h[7] = 64;
+        addr6(src, &p[8]);
+        addr6(dst, &p[24]);
+    } else {
+        h[0] = 0x45;
+        *(uint16_t *)&h[2] = htons(IPV4_HDR + l4 + seg);
+        *(uint16_t *)&h[6] = htons(0x4000);              // don't fragment
+        h[8] = 64;
+        h[9] = (tcp) ? IPPROTO_TCP : IPPROTO_UDP;
+        addr4(src, &p[12]);
+        addr4(dst, &p[16]);
+        *(uint16_t *)&h[10] = ipChecksum(h, IPV4_HDR);
+    }
+
+    h += ip;
+    *(uint16_t *)&h[0] = addrPort(src);
+    *(uint16_t *)&h[2] = addrPort(dst);
+    if (tcp) {
+        *(uint32_t *)&h[4] = htonl(pkt->seq);
+        *(uint32_t *)&h[8] = htonl(pkt->ack);
+        h[12] = (TCP_HDR / 4) << 4;
+        h[13] = TCP_PSH_ACK;
+        *(uint16_t *)&h[14] = htons(0xFFFF);
+    } else {
+        *(uint16_t *)&h[4] = htons(UDP_HDR + seg);
+    }
+    return ip + l4;
+}
+
+size_t
+pcapngPacket(pcapng_t *pc, pcapng_pkt_t *pkt, const void *data, size_t len)
+{
+    if (!pc || !pkt || !data) return 0;
+
+    size_t taken = 0;
+    while (taken < len) {
+        size_t seg = len - taken;
+        if (seg > PCAPNG_MAX_SEGMENT) seg = PCAPNG_MAX_SEGMENT;
+
+        // Sized for the biggest headers; a few bytes may go unused
+        size_t need = PCAPNG_EPB_FIXED + PAD4(IPV6_HDR + TCP_HDR + seg);
+        if (pc->len + need > pc->size) break;
+
+        char *start = &pc->buf[pc->len];
+        char *p = start;
+        p = put32(p, PCAPNG_EPB);
+        p = put32(p, 0);
+        p = put32(p, 0);                                 // interface 0
+        p = put32(p, pkt->ns >> 32);
+        p = put32(p, pkt->ns & 0xFFFFFFFF);
+        char *caplen = p;
+        p += 2 * sizeof(uint32_t);
+
+        size_t hdrs = buildHeaders(p, pkt, seg);
+        memcpy(p + hdrs, (const char *)data + taken, seg);
+        size_t plen = hdrs + seg;
+        memset(p + plen, 0, PAD4(plen) - plen);
+        p += PAD4(plen);
+
+        put32(caplen, plen);
+        put32(caplen + sizeof(uint32_t), plen);
+        p = endBlock(start, p);
+        pc->len += p - start;
+
+        taken += seg;
+        if (pkt->proto != IPPROTO_UDP) pkt->seq += seg;
+    }
+    return taken;
+}
+
+size_t
+pcapngTake(pcapng_t *pc, const char **buf)
+{
+    if (!pc || !buf) return 0;
+
+    size_t len = pc->len;
+    *buf = pc->buf;
+    pc->len = 0;
+    return len;
+}
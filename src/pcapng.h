@@ -0,0 +1,52 @@
+#ifndef __PCAPNG_H__
+#define __PCAPNG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// Formats captured payloads as pcapng, so they can be read by wireshark,
+// tshark, tcpdump and the like.
+//
+// A file is a section header and one interface (the process) with a raw
+// IP link type and nanosecond timestamps, then an enhanced packet block
+// per segment of payload.  The IP and TCP or UDP headers in front of the
+// data are made up from the connection's addresses; TCP sequence and ack
+// numbers count the bytes captured in each direction, so streams can be
+// followed and reassembled.  Checksums other than the IPv4 header's are
+// left zero.
+//
+// Packet blocks go into a buffer of a fixed size, which is handed back to
+// be written out when it fills.
+
+#define PCAPNG_MAX_SEGMENT 65000
+
+typedef struct _pcapng_t pcapng_t;
+
+typedef struct {
+    uint64_t ns;                             // wall clock time
+    int tx;                                  // sent, rather than received
+    int proto;                               // IPPROTO_TCP or IPPROTO_UDP
+    uint32_t seq;                            // advanced by pcapngPacket
+    uint32_t ack;
+    const struct sockaddr_storage *local;
+    const struct sockaddr_storage *remote;
+} pcapng_pkt_t;
+
+// Constructors Destructors
+pcapng_t *          pcapngCreate(size_t, const char *);
+void                pcapngDestroy(pcapng_t **);
+
+// The section header and interface description every file starts with
+size_t              pcapngHeader(pcapng_t *, const char **);
+
+// Appends a packet block per segment of data, returning how much of the
+// data fit in the buffer.  When less than len was taken, the buffer is
+// full and should be written out with pcapngTake().
+size_t              pcapngPacket(pcapng_t *, pcapng_pkt_t *, const void *, size_t);
+
+// Returns the length of the buffered blocks and points the last arg at
+// them, then empties the buffer; they're valid until the next pcapngPacket.
+size_t              pcapngTake(pcapng_t *, const char **);
+
+#endif // __PCAPNG_H__
@@ -1,5 +1,10 @@
 #define _GNU_SOURCE
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "dbg.h"
+#include "fn.h"
 #include "os.h"
 #include "plattime.h"
 
@@ -8,10 +13,114 @@
 
 platform_time_t g_time = {0};
 
+// Two anchors, so one can be rewritten while a reader on another thread
+// uses the other.  They're a period apart, so a reader is long done.
+// Each carries the TSC rate measured since the one before it; 0 until
+// there's been one before it.
+static struct {
+    uint64_t tsc;
+    uint64_t ns;
+    double ns_per_tick;
+} g_wall[2];
+static unsigned g_wall_idx = 0;
+
+// Reading /proc/cpuinfo is one of the more expensive things a constructor
+// does.  What we learned from it is left in the environment, so children
+// of a scoped process (make -j spawning compilers, shells...) skip it.
+static int
+timeFromEnv(platform_time_t *cfg)
+{
+    char *val = getenv(SCOPE_TSC_ENV);
+    if (!val) return FALSE;
+
+    unsigned long long freq;
+    unsigned invariant, rdtscp;
+    if ((sscanf(val, "%llu:%u:%u", &freq, &invariant, &rdtscp) != 3) ||
+        !freq || (freq == (uint64_t)-1)) {
+        DBG("%s", val);
+        return FALSE;
+    }
+
+    cfg->freq = freq;
+    cfg->tsc_invariant = (invariant) ? TRUE : FALSE;
+    cfg->tsc_rdtscp = (rdtscp) ? TRUE : FALSE;
+    return TRUE;
+}
+
+static void
+timeToEnv(platform_time_t *cfg)
+{
+    if (!cfg->freq || (cfg->freq == (uint64_t)-1)) return;
+
+    char val[64];
+    snprintf(val, sizeof(val), "%llu:%u:%u", (unsigned long long)cfg->freq,
+             (cfg->tsc_invariant) ? 1 : 0, (cfg->tsc_rdtscp) ? 1 : 0);
+    if (!g_fn.setenv || g_fn.setenv(SCOPE_TSC_ENV, val, 1) == -1) {
+        DBG("g_fn.setenv=%p, %s=%s", g_fn.setenv, SCOPE_TSC_ENV, val);
+    }
+}
+
 platform_time_t *
 initTime(void)
 {
-    osInitTSC(&g_time);
+    if (!timeFromEnv(&g_time)) {
+        osInitTSC(&g_time);
+        timeToEnv(&g_time);
+    }
+    anchorWallTime();
     return &g_time;
 }
 
+static uint64_t
+realtimeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The cpu MHz osInitTSC reads is the core clock at that moment, in whole
+// MHz; it's fine for durations but not for a clock.  The rate used here
+// is the TSC against CLOCK_REALTIME over the last period.
+void
+anchorWallTime(void)
+{
+    unsigned prev = __atomic_load_n(&g_wall_idx, __ATOMIC_ACQUIRE);
+    unsigned next = !prev;
+    uint64_t tsc = getTime();
+    uint64_t ns = realtimeNs();
+
+    // A clock stepped back, or anchors taken too close together to
+    // measure anything, keep the rate we had
+    double rate = g_wall[prev].ns_per_tick;
+    if (g_wall[prev].ns && (ns > g_wall[prev].ns + 1000000ULL) &&
+        (tsc > g_wall[prev].tsc)) {
+        rate = (double)(ns - g_wall[prev].ns) / (double)(tsc - g_wall[prev].tsc);
+    }
+
+    g_wall[next].tsc = tsc;
+    g_wall[next].ns = ns;
+    g_wall[next].ns_per_tick = rate;
+    __atomic_store_n(&g_wall_idx, next, __ATOMIC_RELEASE);
+}
+
+uint64_t
+getWallTime(uint64_t tsc)
+{
+    unsigned idx = __atomic_load_n(&g_wall_idx, __ATOMIC_ACQUIRE);
+    uint64_t base_tsc = g_wall[idx].tsc;
+    uint64_t base_ns = g_wall[idx].ns;
+    double rate = g_wall[idx].ns_per_tick;
+
+    // Without a TSC that runs at a constant rate, or before a rate has been
+    // measured, ask the clock.  Events then get the time they're reported.
+    if (!g_time.tsc_invariant || !base_ns || (rate <= 0.0)) {
+        return realtimeNs();
+    }
+
+    if (!tsc) tsc = getTime();
+    if (tsc >= base_tsc) {
+        return base_ns + (uint64_t)((tsc - base_tsc) * rate);
+    }
+    return base_ns - (uint64_t)((base_tsc - tsc) * rate);
+}
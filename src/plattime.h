@@ -13,6 +13,15 @@ typedef struct {
 
 platform_time_t* initTime(void);
 
+// Wall clock time, in ns since the epoch, of a getTime() reading; 0 for
+// now.  It's worked out from a reading of CLOCK_REALTIME taken along with
+// one of the TSC, at the TSC rate measured between the last two such
+// readings.  anchorWallTime() takes the two again; it's done once a
+// period so that the conversion follows adjustments to the clock.  Until
+// there are two, or if the TSC isn't invariant, it's CLOCK_REALTIME now.
+void anchorWallTime(void);
+uint64_t getWallTime(uint64_t);
+
 
 // We haven't measured it, but there are concerns about performance
 // with calling getTime and getDuration as functions across modules.
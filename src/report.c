@@ -1,10 +1,12 @@
 #define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <syslog.h>
 #include <time.h>
 #include <fcntl.h>
 
@@ -20,6 +22,9 @@
 #include "state_private.h"
 #include "linklist.h"
 #include "dns.h"
+#include "epoch.h"
+#include "paystore.h"
+#include "pcapng.h"
 
 #ifndef AF_NETLINK
 #define AF_NETLINK 16
@@ -30,6 +35,7 @@
 #define UNIT_FIELD(val)         STRFIELD("unit",           (val), 1, TRUE)
 #define CLASS_FIELD(val)        STRFIELD("class",          (val), 2, TRUE)
 #define PROTO_FIELD(val)        STRFIELD("proto",          (val), 2, TRUE)
+#define TRANSPORT_FIELD(val)    STRFIELD("transport",      (val), 2, TRUE)
 #define OP_FIELD(val)           STRFIELD("op",             (val), 3, TRUE)
 #define PID_FIELD(val)          NUMFIELD("pid",            (val), 4, TRUE)
 #define PROC_UID(val)           NUMFIELD("proc.uid",       (val), 4, TRUE)
@@ -39,6 +45,8 @@
 #define PROC_FIELD(val)         STRFIELD("proc",           (val), 4, TRUE)
 #define HTTPSTAT_FIELD(val)     NUMFIELD("http_status",    (val), 4, TRUE)
 #define DOMAIN_FIELD(val)       STRFIELD("domain",         (val), 5, TRUE)
+#define RCODE_FIELD(val)        NUMFIELD("rcode",          (val), 5, TRUE)
+#define ANSWERS_FIELD(val)      NUMFIELD("answers",        (val), 8, TRUE)
 
 #define FILE_FIELD(val)      STRFIELD("file",              (val), 5, TRUE)
 #define FILE_EV_NAME(val)    STRFIELD("file.name",         (val), 5, TRUE)
@@ -66,6 +74,8 @@
 #define HREQ_FIELD(val)         STRFIELD("req",            (val), 8, TRUE)
 #define HRES_FIELD(val)         STRFIELD("resp",           (val), 8, TRUE)
 #define DETECT_PROTO(val)       STRFIELD("protocol",       (val), 8, TRUE)
+#define FACILITY_FIELD(val)     STRFIELD("facility",       (val), 8, TRUE)
+#define PRIORITY_FIELD(val)     STRFIELD("priority",       (val), 8, TRUE)
 
 #define EVENT_ONLY_ATTR (CFG_MAX_VERBOSITY+1)
 #define HTTP_MAX_FIELDS 30
@@ -108,6 +118,25 @@ int g_interval = DEFAULT_SUMMARY_PERIOD;
 static list_t *g_maplist;
 static search_t *g_http_status = NULL;
 static http_agg_t *g_http_agg;
+static paystore_t *g_paystore = NULL;
+static pcapng_t *g_pcapng = NULL;
+static uint64_t g_paystore_reported = 0;
+
+// What g_paystore and g_pcapng were made from.  They're made again when
+// any of this changes, so a new payload config takes effect.
+static struct {
+    unsigned enable;
+    char *dir;
+    unsigned long long maxsize;
+    unsigned maxage;
+    unsigned long long maxtotal;
+    cfg_pay_format_t format;
+} g_paycfg;
+
+// getTime() of the record doEvent() is reporting.  What's sent for it
+// carries the time the I/O happened, not when the record was drained.
+// It's 0 elsewhere, which means "now".
+static __thread uint64_t g_evt_tsc = 0;
 
 static void
 destroyHttpMap(void *data)
@@ -134,12 +163,67 @@ setReportingInterval(int seconds)
     g_interval = seconds;
 }
 
+// g_mtc can be replaced by a config change on the periodic thread; it's
+// only loaded and used while pinned, so the old one isn't freed under us
+int
+sendMetric(event_t *event)
+{
+    if (!event->tsc) event->tsc = g_evt_tsc;
+    unsigned pin = epochEnter();
+    int rc = cmdSendMetric(g_mtc, event);
+    epochExit(pin);
+    return rc;
+}
+
+unsigned
+metricsEnabled(void)
+{
+    unsigned pin = epochEnter();
+    unsigned rc = mtcEnabled(g_mtc);
+    epochExit(pin);
+    return rc;
+}
+
+// Whether a metric goes out to the metric transport.  Ones reported as
+// they happen only go out per fd; periodic ones go unless the metric is
+// off or only wanted as events.
+static int
+mtcReport(metric_t type, control_type_t source)
+{
+    unsigned char mode = g_mtc_mode[type];
+    if (source == EVENT_BASED) return (mode == MTC_MODE_FD);
+    return (mode >= MTC_MODE_SUMMARY);
+}
+
+static void
+sendCtlEvent(event_t *event, uint64_t uid)
+{
+    if (!event->tsc) event->tsc = g_evt_tsc;
+    cmdSendEvent(g_ctl, event, uid, &g_proc);
+}
+
+static void
+sendCtlHttp(event_t *event, uint64_t uid)
+{
+    if (!event->tsc) event->tsc = g_evt_tsc;
+    cmdSendHttp(g_ctl, event, uid, &g_proc);
+}
+
+// Metric events stop only when the metric is off
 static void
-sendEvent(mtc_t *mtc, event_t *event)
+sendMetricEvent(metric_t type, event_t *event, uint64_t uid)
 {
-    cmdSendEvent(g_ctl, event, getTime(), &g_proc);
+    if (g_mtc_mode[type] == MTC_MODE_OFF) return;
+    sendCtlEvent(event, uid);
+}
 
-    if (cmdSendMetric(mtc, event) == -1) {
+static void
+sendEvent(metric_t type, event_t *event)
+{
+    sendCtlEvent(event, getTime());
+
+    if (!mtcReport(type, PERIODIC)) return;
+    if (sendMetric(event) == -1) {
         scopeLog("ERROR: sendEvent:cmdSendMetric", -1, CFG_LOG_ERROR);
     }
 }
@@ -157,7 +241,7 @@ sendProcessStartMetric()
         FIELDEND
     };
     event_t evt = INT_EVENT("proc.start", 1, DELTA, fields);
-    cmdSendMetric(g_mtc, &evt);
+    sendMetric(&evt);
     if (urlEncodedCmd) free(urlEncodedCmd);
 }
 
@@ -546,7 +630,7 @@ doHttpHeader(protocol_info *proto)
             httpFieldEnd(fields, &hreport);
 
             event_t sendEvent = INT_EVENT("http-req", proto->len, SET, fields);
-            cmdSendHttp(g_ctl, &sendEvent, map->id, &g_proc);
+            sendCtlHttp(&sendEvent, map->id);
         }
     }
 
@@ -638,7 +722,7 @@ doHttpHeader(protocol_info *proto)
         httpFieldEnd(fields, &hreport);
 
         event_t hevent = INT_EVENT("http-resp", proto->len, SET, fields);
-        cmdSendHttp(g_ctl, &hevent, map->id, &g_proc);
+        sendCtlHttp(&hevent, map->id);
 
         // Are we doing a metric event?
         event_field_t mfields[] = {
@@ -653,10 +737,10 @@ doHttpHeader(protocol_info *proto)
         };
 
         event_t mevent = INT_EVENT("http-metrics", proto->len, SET, mfields);
-        cmdSendHttp(g_ctl, &mevent, map->id, &g_proc);
+        sendCtlHttp(&mevent, map->id);
 
         // emit statsd metrics, if enabled.
-        if (mtcEnabled(g_mtc)) {
+        if (metricsEnabled()) {
 
             char *mtx_name = (proto->isServer) ? "http.server.duration" : "http.client.duration";
             event_t http_dur = INT_EVENT(mtx_name, map->duration, DELTA, fields);
@@ -709,10 +793,45 @@ doDetection(protocol_info *proto)
     };
 
     event_t evt = INT_EVENT("remote_protocol", proto->fd, SET, fields);
-    cmdSendEvent(g_ctl, &evt, proto->uid, &g_proc);
+    sendCtlEvent(&evt, proto->uid);
     destroyProto(proto);
 }
 
+static const char *const syslogFacility[] = {
+    "kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news",
+    "uucp", "cron", "authpriv", "ftp", "ntp", "audit", "alert", "clock",
+    "local0", "local1", "local2", "local3", "local4", "local5", "local6", "local7",
+};
+
+static const char *const syslogPriority[] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug",
+};
+
+static void
+doSyslogEvent(syslog_info *sys)
+{
+    int facility = LOG_FAC(sys->priority);
+    const char *facname = (facility < sizeof(syslogFacility) / sizeof(syslogFacility[0])) ?
+        syslogFacility[facility] : "unknown";
+
+    char name[32];
+    snprintf(name, sizeof(name), "syslog.%s", facname);
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        FACILITY_FIELD(facname),
+        PRIORITY_FIELD(syslogPriority[LOG_PRI(sys->priority)]),
+        DATA_FIELD(sys->msg),
+        FIELDEND
+    };
+
+    event_t evt = INT_EVENT(name, LOG_PRI(sys->priority), SET, fields);
+    evt.src = CFG_SRC_SYSLOG;
+    sendCtlEvent(&evt, sys->uid);
+}
+
 void
 doProtocolMetric(protocol_info *proto)
 {
@@ -795,19 +914,19 @@ doErrorMetric(metric_t type, control_type_t source,
         // Don't report zeros.
         if (value->evt != 0ULL) {
              event_t netErrMetric = INT_EVENT("net.error", value->evt, DELTA, fields);
-             cmdSendEvent(g_ctl, &netErrMetric, getTime(), &g_proc);
+             sendMetricEvent(type, &netErrMetric, getTime());
              atomicSwapU64(&value->evt, 0);
         }
 
         // Only report if enabled
-        if ((g_summary.net.error) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
         // Don't report zeros.
         if (value->mtc == 0) return;
 
         event_t netErrMetric = INT_EVENT("net.error", value->mtc, DELTA, fields);
-        if (cmdSendMetric(g_mtc, &netErrMetric)) {
+        if (sendMetric(&netErrMetric)) {
             scopeLog("ERROR: doErrorMetric:NET:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
         atomicSwapU64(&value->mtc, 0);
@@ -823,7 +942,6 @@ doErrorMetric(metric_t type, control_type_t source,
         const char* metric = NULL;
         counters_element_t* value = NULL;
         const char* class = "UNKNOWN";
-        int* summarize = NULL;
         event_field_t file_field = FILE_FIELD(name);
         event_field_t domain_field = DOMAIN_FIELD(name);
         event_field_t* name_field;
@@ -832,28 +950,24 @@ doErrorMetric(metric_t type, control_type_t source,
                 metric = "fs.error";
                 value = &ctrs->fsOpenCloseErrors;
                 class = "open_close";
-                summarize = &g_summary.fs.error;
                 name_field = &file_field;
                 break;
             case FS_ERR_READ_WRITE:
                 metric = "fs.error";
                 value = &ctrs->fsRdWrErrors;
                 class = "read_write";
-                summarize = &g_summary.fs.error;
                 name_field = &file_field;
                 break;
             case FS_ERR_STAT:
                 metric = "fs.error";
                 value = &ctrs->fsStatErrors;
                 class = "stat";
-                summarize = &g_summary.fs.error;
                 name_field = &file_field;
                 break;
             case NET_ERR_DNS:
                 metric = "net.error";
                 value = &ctrs->netDNSErrors;
                 class = "dns";
-                summarize = &g_summary.net.dnserror;
                 name_field = &domain_field;
                 break;
             default:
@@ -875,19 +989,19 @@ doErrorMetric(metric_t type, control_type_t source,
         // Don't report zeros.
         if (value->evt != 0ULL) {
             event_t fsErrMetric = INT_EVENT(metric, value->evt, DELTA, fields);
-            cmdSendEvent(g_ctl, &fsErrMetric, getTime(), &g_proc);
+            sendMetricEvent(type, &fsErrMetric, getTime());
             atomicSwapU64(&value->evt, 0);
         }
 
         // Only report if enabled
-        if ((source == EVENT_BASED) && *summarize) {
+        if (!mtcReport(type, source)) {
             return;
         }
         // Don't report zeros.
         if (value->mtc == 0) return;
 
         event_t fsErrMetric = INT_EVENT(metric, value->mtc, DELTA, fields);
-        if (cmdSendMetric(g_mtc, &fsErrMetric)) {
+        if (sendMetric(&fsErrMetric)) {
             scopeLog("ERROR: doErrorMetric:FS_ERR:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
         atomicSwapU64(&value->mtc, 0);
@@ -922,7 +1036,7 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
                     FIELDEND
                 };
                 event_t dnsMetric = INT_EVENT("net.dns.resp", ctrs->numDNS.evt, DELTA, resp);
-                cmdSendEvent(g_ctl, &dnsMetric, getTime(), &g_proc);
+                sendMetricEvent(type, &dnsMetric, getTime());
 
                 // This creates a DNS event
                 event_field_t evfield[] = {
@@ -932,7 +1046,7 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
                 };
                 event_t dnsEvent = INT_EVENT("net.dns.resp", ctrs->numDNS.evt, DELTA, evfield);
                 dnsEvent.src = CFG_SRC_DNS;
-                cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+                sendCtlEvent(&dnsEvent, getTime());
             } else {
                 // This create a DNS raw event
                 event_field_t req[] = {
@@ -944,7 +1058,7 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
                     FIELDEND
                 };
                 event_t dnsMetric = INT_EVENT("net.dns.req", ctrs->numDNS.evt, DELTA, req);
-                cmdSendEvent(g_ctl, &dnsMetric, getTime(), &g_proc);
+                sendMetricEvent(type, &dnsMetric, getTime());
 
                 // This creates a DNS event
                 event_field_t evfield[] = {
@@ -953,12 +1067,12 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
                 };
                 event_t dnsEvent = INT_EVENT("net.dns.req", ctrs->numDNS.evt, DELTA, evfield);
                 dnsEvent.src = CFG_SRC_DNS;
-                cmdSendEvent(g_ctl, &dnsEvent, getTime(), &g_proc);
+                sendCtlEvent(&dnsEvent, getTime());
             }
         }
 
         // Only report if enabled
-        if (g_summary.net.dns) {
+        if (g_mtc_mode[type] != MTC_MODE_FD) {
             return;
         }
 
@@ -975,7 +1089,7 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
             FIELDEND
         };
         event_t dnsMetric = INT_EVENT("net.dns", ctrs->numDNS.mtc, DELTA, fields);
-        if (cmdSendMetric(g_mtc, &dnsMetric)) {
+        if (sendMetric(&dnsMetric)) {
             scopeLog("ERROR: doDNSMetricName:DNS:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
         break;
@@ -1009,13 +1123,13 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
             };
 
             event_t dnsDurMetric = INT_EVENT("net.dns.duration", dur, DELTA_MS, fields);
-            cmdSendEvent(g_ctl, &dnsDurMetric, getTime(), &g_proc);
+            sendMetricEvent(type, &dnsDurMetric, getTime());
             atomicSwapU64(&ctrs->dnsDurationNum.evt, 0);
             atomicSwapU64(&ctrs->dnsDurationTotal.evt, 0);
         }
 
         // Only report if enabled
-        if (g_summary.net.dns) {
+        if (g_mtc_mode[type] != MTC_MODE_FD) {
             return;
         }
 
@@ -1041,7 +1155,7 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
             FIELDEND
         };
         event_t dnsDurMetric = INT_EVENT("net.dns.duration", dur, DELTA_MS, fields);
-        if (cmdSendMetric(g_mtc, &dnsDurMetric)) {
+        if (sendMetric(&dnsDurMetric)) {
             scopeLog("ERROR: doDNSMetricName:DNS_DURATION:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
         atomicSwapU64(&ctrs->dnsDurationNum.mtc, 0);
@@ -1055,9 +1169,55 @@ doDNSMetricName(metric_t type, const char *domain, counters_element_t *duration,
 
 }
 
+static void
+doDNSQueryMetric(net_info *net)
+{
+    if (!net || !net->dnsName[0]) return;
+
+    // factor of 1000000 converts ns to ms.
+    uint64_t dur = net->totalDuration.evt / 1000000;
+    // default to at least 1ms as opposed to reporting nothing
+    if (dur == 0) dur = 1;
+
+    // This creates a DNS event
+    event_field_t evfield[] = {
+        DOMAIN_FIELD(net->dnsName),
+        DURATION_FIELD(dur),
+        RCODE_FIELD(net->dnsRcode),
+        ANSWERS_FIELD(net->dnsAnswers),
+        FIELDEND
+    };
+    event_t dnsEvent = INT_EVENT("net.dns.resp", 1, DELTA, evfield);
+    dnsEvent.src = CFG_SRC_DNS;
+    sendCtlEvent(&dnsEvent, net->uid);
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        DOMAIN_FIELD(net->dnsName),
+        RCODE_FIELD(net->dnsRcode),
+        ANSWERS_FIELD(net->dnsAnswers),
+        NUMOPS_FIELD(1),
+        UNIT_FIELD("millisecond"),
+        FIELDEND
+    };
+    event_t dnsDurMetric = INT_EVENT("net.dns.duration", dur, DELTA_MS, fields);
+    sendMetricEvent(DNS_QUERY_DURATION, &dnsDurMetric, net->uid);
+
+    // Only report if enabled
+    if (g_mtc_mode[DNS_QUERY_DURATION] != MTC_MODE_FD) return;
+
+    if (sendMetric(&dnsDurMetric)) {
+        scopeLog("ERROR: doDNSQueryMetric:cmdSendMetric", -1, CFG_LOG_ERROR);
+    }
+}
+
 void
 doProcMetric(metric_t type, long long measurement)
 {
+    if (g_mtc_mode[type] == MTC_MODE_OFF) return;
+
     switch (type) {
     case PROC_CPU:
     {
@@ -1070,7 +1230,7 @@ doProcMetric(metric_t type, long long measurement)
                 FIELDEND
             };
             event_t event = INT_EVENT("proc.cpu", measurement, DELTA, fields);
-            sendEvent(g_mtc, &event);
+            sendEvent(type, &event);
         }
 
         // Avoid div by zero
@@ -1091,7 +1251,7 @@ doProcMetric(metric_t type, long long measurement)
             // TBD: switch from using the configured to a measured interval
             double val = measurement * 100.0 / (interval*1000000.0);
             event_t event = FLT_EVENT("proc.cpu_perc", val, CURRENT, fields);
-            sendEvent(g_mtc, &event);
+            sendEvent(type, &event);
         }
         break;
     }
@@ -1106,7 +1266,7 @@ doProcMetric(metric_t type, long long measurement)
             FIELDEND
         };
         event_t event = INT_EVENT("proc.mem", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        sendEvent(type, &event);
         break;
     }
 
@@ -1120,7 +1280,7 @@ doProcMetric(metric_t type, long long measurement)
             FIELDEND
         };
         event_t event = INT_EVENT("proc.thread", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        sendEvent(type, &event);
         break;
     }
 
@@ -1134,7 +1294,7 @@ doProcMetric(metric_t type, long long measurement)
             FIELDEND
         };
         event_t event = INT_EVENT("proc.fd", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        sendEvent(type, &event);
         break;
     }
 
@@ -1148,7 +1308,7 @@ doProcMetric(metric_t type, long long measurement)
             FIELDEND
         };
         event_t event = INT_EVENT("proc.child", measurement, CURRENT, fields);
-        sendEvent(g_mtc, &event);
+        sendEvent(type, &event);
         break;
     }
 
@@ -1175,11 +1335,11 @@ doStatMetric(const char *op, const char *pathname, void* ctr)
 
     if (ctrs->numStat.evt != 0) {
         event_t evt = INT_EVENT("fs.op.stat", ctrs->numStat.evt, DELTA, fields);
-        cmdSendEvent(g_ctl, &evt, getTime(), &g_proc);
+        sendMetricEvent(FS_STAT, &evt, getTime());
     }
 
     // Only report if enabled
-    if (g_summary.fs.stat) {
+    if (g_mtc_mode[FS_STAT] != MTC_MODE_FD) {
         return;
     }
 
@@ -1187,7 +1347,7 @@ doStatMetric(const char *op, const char *pathname, void* ctr)
     if (ctrs->numStat.mtc == 0) return;
 
     event_t evt = INT_EVENT("fs.op.stat", ctrs->numStat.mtc, DELTA, fields);
-    if (cmdSendMetric(g_mtc, &evt)) {
+    if (sendMetric(&evt)) {
         scopeLog("doStatMetric", -1, CFG_LOG_ERROR);
     }
 }
@@ -1285,7 +1445,7 @@ doNetOpenEvent(net_info *net)
 
     event_t evt = INT_EVENT(metric, g_ctrs.openPorts.evt, CURRENT, nevent);
     evt.src = CFG_SRC_NET;
-    cmdSendEvent(g_ctl, &evt, net->uid, &g_proc);
+    sendCtlEvent(&evt, net->uid);
 }
 
 /*
@@ -1364,7 +1524,7 @@ doNetCloseEvent(net_info *net, uint64_t dur)
 
     event_t evt = INT_EVENT(metric, g_ctrs.openPorts.evt, CURRENT, nevent);
     evt.src = CFG_SRC_NET;
-    cmdSendEvent(g_ctl, &evt, net->uid, &g_proc);
+    sendCtlEvent(&evt, net->uid);
 }
 
 /* Example FS Events
@@ -1435,7 +1595,7 @@ doFSOpenEvent(fs_info *fs, const char *op)
 
         event_t evt = INT_EVENT(metric, numops->evt, DELTA, fevent);
         evt.src = CFG_SRC_FS;
-        cmdSendEvent(g_ctl, &evt, fs->uid, &g_proc);
+        sendCtlEvent(&evt, fs->uid);
     }
 }
 
@@ -1467,7 +1627,7 @@ doFSCloseEvent(fs_info *fs, const char *op)
 
         event_t evt = INT_EVENT(metric, fs->numClose.evt, DELTA, fevent);
         evt.src = CFG_SRC_FS;
-        cmdSendEvent(g_ctl, &evt, fs->uid, &g_proc);
+        sendCtlEvent(&evt, fs->uid);
     }
 }
 
@@ -1503,7 +1663,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             };
 
             event_t evt = INT_EVENT("fs.duration", dur, HISTOGRAM, fields);
-            cmdSendEvent(g_ctl, &evt, fs->uid, &g_proc);
+            sendMetricEvent(type, &evt, fs->uid);
             //atomicSwapU64(&fs->numDuration.evt, 0);
             //atomicSwapU64(&fs->totalDuration.evt, 0);
             ////atomicSwapU64(&g_ctrs.fsDurationNum.evt, 0);
@@ -1521,7 +1681,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         if (dur == 0ULL) return;
 
         // Only report if enabled
-        if ((g_summary.fs.read_write) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
@@ -1537,7 +1697,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             FIELDEND
         };
         event_t evt = INT_EVENT("fs.duration", dur, HISTOGRAM, fields);
-        if (cmdSendMetric(g_mtc, &evt)) {
+        if (sendMetric(&evt)) {
             scopeLog("ERROR: doFSMetric:FS_DURATION:cmdSendMetric", fs->fd, CFG_LOG_ERROR);
         }
 
@@ -1592,14 +1752,14 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
             };
 
             event_t rwMetric = INT_EVENT(metric, sizebytes->evt, HISTOGRAM, fields);
-            cmdSendEvent(g_ctl, &rwMetric, fs->uid, &g_proc);
+            sendMetricEvent(type, &rwMetric, fs->uid);
             //atomicSwapU64(&numops->evt, 0);
             //atomicSwapU64(&sizebytes->evt, 0);
             ////atomicSwapU64(global_counter->evt, 0);
         }
 
         // Only report if enabled
-        if ((g_summary.fs.read_write) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
@@ -1620,7 +1780,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
 
         event_t rwMetric = INT_EVENT(metric, sizebytes->mtc, HISTOGRAM, fields);
 
-        if (cmdSendMetric(g_mtc, &rwMetric)) {
+        if (sendMetric(&rwMetric)) {
             scopeLog(err_str, fs->fd, CFG_LOG_ERROR);
         }
         subFromInterfaceCounts(global_counter, sizebytes->mtc);
@@ -1637,28 +1797,24 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         const char* metric = "UNKNOWN";
         counters_element_t* numops = NULL;
         counters_element_t* global_counter = NULL;
-        int* summarize = NULL;
         const char* err_str = "UNKNOWN";
         switch (type) {
             case FS_OPEN:
                 metric = "fs.op.open";
                 numops = &fs->numOpen;
                 global_counter = &g_ctrs.numOpen;
-                summarize = &g_summary.fs.open_close;
                 err_str = "ERROR: doFSMetric:FS_OPEN:cmdSendMetric";
                 break;
             case FS_CLOSE:
                 metric = "fs.op.close";
                 numops = &fs->numClose;
                 global_counter = &g_ctrs.numClose;
-                summarize = &g_summary.fs.open_close;
                 err_str = "ERROR: doFSMetric:FS_CLOSE:cmdSendMetric";
                 break;
             case FS_SEEK:
                 metric = "fs.op.seek";
                 numops = &fs->numSeek;
                 global_counter = &g_ctrs.numSeek;
-                summarize = &g_summary.fs.seek;
                 err_str = "ERROR: doFSMetric:FS_SEEK:cmdSendMetric";
                 break;
             default:
@@ -1680,7 +1836,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         // Don't report zeros.
         if (ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) && (numops->evt != 0ULL)) {
             event_t evt = INT_EVENT(metric, numops->evt, DELTA, fields);
-            cmdSendEvent(g_ctl, &evt, fs->uid, &g_proc);
+            sendMetricEvent(type, &evt, fs->uid);
             reported = TRUE;
         }
 
@@ -1703,7 +1859,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         if (reported == TRUE) atomicSwapU64(&numops->evt, 0);
 
         // Only report if enabled
-        if (*summarize && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
@@ -1711,7 +1867,7 @@ doFSMetric(metric_t type, fs_info *fs, control_type_t source,
         if (numops->mtc == 0ULL) return;
 
         event_t evt = INT_EVENT(metric, numops->mtc, DELTA, fields);
-        if (cmdSendMetric(g_mtc, &evt)) {
+        if (sendMetric(&evt)) {
             scopeLog(err_str, fs->fd, CFG_LOG_ERROR);
         }
         subFromInterfaceCounts(global_counter, numops->mtc);
@@ -1762,7 +1918,7 @@ doTotalNetRxTx(metric_t type)
         // Don't report zeros.
         if ((*value)[bucket].mtc == 0) continue;
 
-        if (g_summary.net.rx_tx) {
+        if (g_mtc_mode[type] == MTC_MODE_SUMMARY) {
 
             event_field_t fields[] = {
                 PROC_FIELD(g_proc.procname),
@@ -1773,7 +1929,7 @@ doTotalNetRxTx(metric_t type)
                 FIELDEND
             };
             event_t evt = INT_EVENT(metric, (*value)[bucket].mtc, DELTA, fields);
-            if (cmdSendMetric(g_mtc, &evt)) {
+            if (sendMetric(&evt)) {
                 scopeLog(err_str, -1, CFG_LOG_ERROR);
             }
         }
@@ -1872,6 +2028,12 @@ doTotal(metric_t type)
     // Don't report zeros.
     if (value->mtc == 0) return;
 
+    // Only report if enabled
+    if (!mtcReport(type, PERIODIC)) {
+        if (aggregation_type != CURRENT) atomicSwapU64(&value->mtc, 0);
+        return;
+    }
+
     event_field_t fields[] = {
         PROC_FIELD(g_proc.procname),
         PID_FIELD(g_proc.pid),
@@ -1881,7 +2043,7 @@ doTotal(metric_t type)
         FIELDEND
     };
     event_t evt = INT_EVENT(metric, value->mtc, aggregation_type, fields);
-    if (cmdSendMetric(g_mtc, &evt)) {
+    if (sendMetric(&evt)) {
         scopeLog(err_str, -1, CFG_LOG_ERROR);
     }
 
@@ -1942,6 +2104,13 @@ doTotalDuration(metric_t type)
     // Don't report zeros.
     if (dur == 0) return;
 
+    // Only report if enabled
+    if (!mtcReport(type, PERIODIC)) {
+        atomicSwapU64(&value->mtc, 0);
+        atomicSwapU64(&num->mtc, 0);
+        return;
+    }
+
     event_field_t fields[] = {
         PROC_FIELD(g_proc.procname),
         PID_FIELD(g_proc.pid),
@@ -1951,7 +2120,7 @@ doTotalDuration(metric_t type)
         FIELDEND
     };
     event_t evt = INT_EVENT(metric, dur, aggregation_type, fields);
-    if (cmdSendMetric(g_mtc, &evt)) {
+    if (sendMetric(&evt)) {
         scopeLog(err_str, -1, CFG_LOG_ERROR);
     }
 
@@ -1960,6 +2129,270 @@ doTotalDuration(metric_t type)
     atomicSwapU64(&num->mtc, 0);
 }
 
+const char *waitName[WAIT_NUM_BUCKETS] = {
+    "nanosleep",       //    WAIT_NANOSLEEP,
+    "select",          //    WAIT_SELECT,
+    "sigsuspend",      //    WAIT_SIGSUSPEND,
+    "epoll_wait",      //    WAIT_EPOLL_WAIT,
+    "poll",            //    WAIT_POLL,
+    "pause",           //    WAIT_PAUSE,
+    "sigwaitinfo",     //    WAIT_SIGWAITINFO,
+    "sigtimedwait",    //    WAIT_SIGTIMEDWAIT,
+    "epoll_pwait",     //    WAIT_EPOLL_PWAIT,
+    "ppoll",           //    WAIT_PPOLL,
+    "pselect",         //    WAIT_PSELECT,
+    "msgsnd",          //    WAIT_MSGSND,
+    "msgrcv",          //    WAIT_MSGRCV,
+    "semop",           //    WAIT_SEMOP,
+    "semtimedop",      //    WAIT_SEMTIMEDOP,
+    "clock_nanosleep", //    WAIT_CLOCK_NANOSLEEP,
+    "usleep",          //    WAIT_USLEEP,
+    "io_getevents"     //    WAIT_IO_GETEVENTS,
+};
+
+static void
+doWaitMetric(const char *op, int fd, counters_element_t *time,
+             counters_element_t *num, counters_element_t *ready)
+{
+    // Don't report zeros.
+    if (num->mtc == 0) return;
+
+    {
+        // scale from ns to microseconds
+        uint64_t dur = time->mtc / 1000;
+        event_field_t summary_fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            OP_FIELD(op),
+            NUMOPS_FIELD(num->mtc),
+            UNIT_FIELD("microsecond"),
+            CLASS_FIELD("summary"),
+            FIELDEND
+        };
+        event_field_t fd_fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            OP_FIELD(op),
+            FD_FIELD(fd),
+            NUMOPS_FIELD(num->mtc),
+            UNIT_FIELD("microsecond"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT("proc.wait_time", dur, DELTA,
+                                (fd < 0) ? summary_fields : fd_fields);
+        if (sendMetric(&evt)) {
+            scopeLog("ERROR: doWaitMetric:proc.wait_time:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+    }
+
+    if (ready->mtc) {
+        event_field_t summary_fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            OP_FIELD(op),
+            UNIT_FIELD("event"),
+            CLASS_FIELD("summary"),
+            FIELDEND
+        };
+        event_field_t fd_fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            OP_FIELD(op),
+            FD_FIELD(fd),
+            UNIT_FIELD("event"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT("proc.wait_ready", ready->mtc, DELTA,
+                                (fd < 0) ? summary_fields : fd_fields);
+        if (sendMetric(&evt)) {
+            scopeLog("ERROR: doWaitMetric:proc.wait_ready:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+    }
+
+    // Reset the info we tried to report
+    atomicSwapU64(&time->mtc, 0);
+    atomicSwapU64(&num->mtc, 0);
+    atomicSwapU64(&ready->mtc, 0);
+}
+
+void
+doTotalWait(void)
+{
+    wait_func_t func;
+    for (func = WAIT_NANOSLEEP; func < WAIT_NUM_BUCKETS; func++) {
+        if (!mtcReport(PROC_WAIT, PERIODIC)) {
+            resetInterfaceCounts(&g_waitctrs.waitTime[func]);
+            resetInterfaceCounts(&g_waitctrs.waitNum[func]);
+            resetInterfaceCounts(&g_waitctrs.waitReady[func]);
+            continue;
+        }
+        doWaitMetric(waitName[func], -1,
+                     &g_waitctrs.waitTime[func],
+                     &g_waitctrs.waitNum[func],
+                     &g_waitctrs.waitReady[func]);
+    }
+
+    int i;
+    for (i = 0; i < EPOLL_ENTRIES; i++) {
+        epoll_info *ep = &g_epinfo[i];
+        int key = ep->fd;
+        if (!key) continue;
+
+        // An epoll fd that saw no waits this period is given up so the
+        // entry can be reused if the descriptor has been closed.
+        if (ep->waitNum.mtc == 0) {
+            atomicCas32(&ep->fd, key, 0);
+            continue;
+        }
+
+        if (g_mtc_mode[PROC_WAIT] != MTC_MODE_FD) {
+            resetInterfaceCounts(&ep->waitTime);
+            resetInterfaceCounts(&ep->waitNum);
+            resetInterfaceCounts(&ep->waitReady);
+            continue;
+        }
+
+        doWaitMetric("epoll_wait", key - 1, &ep->waitTime,
+                     &ep->waitNum, &ep->waitReady);
+    }
+}
+
+// What's been counted so far for one transport's queue
+typedef struct {
+    uint64_t dropped;
+    uint64_t spilled;
+} queue_seen_t;
+
+static void
+doQueueMetric(const char *name, uint64_t queued, uint64_t dropped,
+              uint64_t spilled, queue_seen_t *seen)
+{
+    // A new transport (after a config change) counts from zero again
+    if ((dropped < seen->dropped) || (spilled < seen->spilled)) {
+        seen->dropped = seen->spilled = 0;
+    }
+    uint64_t new_dropped = dropped - seen->dropped;
+    uint64_t new_spilled = spilled - seen->spilled;
+    seen->dropped = dropped;
+    seen->spilled = spilled;
+
+    // The log has its own transport, so this gets out
+    if (new_dropped) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "WARN: %s destination is behind; %" PRIu64 " bytes dropped",
+                 name, new_dropped);
+        scopeLog(msg, -1, CFG_LOG_WARN);
+    }
+
+    if (g_mtc_mode[PROC_TRANSPORT] == MTC_MODE_OFF) return;
+
+    event_field_t fields[] = {
+        PROC_FIELD(g_proc.procname),
+        PID_FIELD(g_proc.pid),
+        HOST_FIELD(g_proc.hostname),
+        TRANSPORT_FIELD(name),
+        UNIT_FIELD("byte"),
+        FIELDEND
+    };
+    event_t evt = INT_EVENT("proc.transport.queued", queued, CURRENT, fields);
+    sendEvent(PROC_TRANSPORT, &evt);
+
+    // Do not report zeros
+    if (new_spilled) {
+        event_t spill = INT_EVENT("proc.transport.spilled", new_spilled, DELTA, fields);
+        sendEvent(PROC_TRANSPORT, &spill);
+    }
+    if (new_dropped) {
+        event_t drop = INT_EVENT("proc.transport.dropped", new_dropped, DELTA, fields);
+        sendEvent(PROC_TRANSPORT, &drop);
+    }
+}
+
+// Only tcp transports have a queue.  The stats are read under the
+// transport's lock either way.  g_mtc is pinned since a config change
+// can replace it; g_ctl's transport is only replaced by doConfig(),
+// which runs on this same thread.
+void
+doTotalTransport(void)
+{
+    static queue_seen_t mtc_seen, ctl_seen;
+    uint64_t queued, dropped, spilled;
+
+    unsigned pin = epochEnter();
+    int rc = mtcQueueStats(g_mtc, &queued, &dropped, &spilled);
+    epochExit(pin);
+    if (!rc) doQueueMetric("metric", queued, dropped, spilled, &mtc_seen);
+
+    if (!ctlQueueStats(g_ctl, &queued, &dropped, &spilled)) {
+        doQueueMetric("event", queued, dropped, spilled, &ctl_seen);
+    }
+}
+
+void
+doTotalGo(void)
+{
+    if (!g_goctrs.active) return;
+
+    // Each pause is a sample of the histogram
+    uint64_t i, num = atomicSwapU64(&g_goctrs.pauseNext, 0);
+    if (num > GO_PAUSE_SAMPLES) num = GO_PAUSE_SAMPLES;
+    for (i = 0; i < num; i++) {
+        uint64_t pause = atomicSwapU64(&g_goctrs.pause[i], 0);
+        if (!pause) continue;
+
+        // scale from ns to microseconds
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            UNIT_FIELD("microsecond"),
+            CLASS_FIELD("summary"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT("go.gc.pause", pause / 1000, HISTOGRAM, fields);
+        if (sendMetric(&evt)) {
+            scopeLog("ERROR: doTotalGo:go.gc.pause:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+    }
+
+    if (g_goctrs.gcCount.mtc) {
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            UNIT_FIELD("operation"),
+            CLASS_FIELD("summary"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT("go.gc.count", g_goctrs.gcCount.mtc, DELTA, fields);
+        if (sendMetric(&evt)) {
+            scopeLog("ERROR: doTotalGo:go.gc.count:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+        atomicSwapU64(&g_goctrs.gcCount.mtc, 0);
+    }
+
+    // The runtime never frees a goroutine, it reuses them.  So the number
+    // it has allocated is the most that have existed at once.
+    if (g_goctrs.allglen) {
+        event_field_t fields[] = {
+            PROC_FIELD(g_proc.procname),
+            PID_FIELD(g_proc.pid),
+            HOST_FIELD(g_proc.hostname),
+            UNIT_FIELD("goroutine"),
+            CLASS_FIELD("summary"),
+            FIELDEND
+        };
+        event_t evt = INT_EVENT("go.goroutine.peak", *g_goctrs.allglen, CURRENT, fields);
+        if (sendMetric(&evt)) {
+            scopeLog("ERROR: doTotalGo:go.goroutine.peak:cmdSendMetric", -1, CFG_LOG_ERROR);
+        }
+    }
+}
+
 void
 doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 {
@@ -2020,18 +2453,18 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
 
         {
             event_t evt = INT_EVENT(metric, value->evt, CURRENT, fields);
-            cmdSendEvent(g_ctl, &evt, net->uid, &g_proc);
+            sendMetricEvent(type, &evt, net->uid);
             // Don't reset the info if we tried to report.  It's a gauge.
             //atomicSwapU64(value->evt, 0ULL);
         }
 
         // Only report if enabled
-        if ((g_summary.net.open_close) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
         event_t evt = INT_EVENT(metric, value->mtc, CURRENT, fields);
-        if (cmdSendMetric(g_mtc, &evt)) {
+        if (sendMetric(&evt)) {
             scopeLog(err_str, net->fd, CFG_LOG_ERROR);
         }
         // Don't reset the info if we tried to report.  It's a gauge.
@@ -2069,7 +2502,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
                 FIELDEND
             };
             event_t evt = INT_EVENT("net.conn_duration", dur, DELTA_MS, fields);
-            cmdSendEvent(g_ctl, &evt, net->uid, &g_proc);
+            sendMetricEvent(type, &evt, net->uid);
             atomicSwapU64(&net->numDuration.evt, 0);
             atomicSwapU64(&net->totalDuration.evt, 0);
          }
@@ -2079,7 +2512,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
         }
 
         // Only report if enabled
-        if ((g_summary.net.open_close) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
@@ -2105,7 +2538,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
             FIELDEND
         };
         event_t evt = INT_EVENT("net.conn_duration", dur, DELTA_MS, fields);
-        if (cmdSendMetric(g_mtc, &evt)) {
+        if (sendMetric(&evt)) {
             scopeLog("ERROR: doNetMetric:CONNECTION_DURATION:cmdSendMetric", net->fd, CFG_LOG_ERROR);
         }
         atomicSwapU64(&net->numDuration.mtc, 0);
@@ -2216,25 +2649,25 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
         // Don't report zeros.
         if (net->rxBytes.evt != 0ULL) {
 
-             cmdSendEvent(g_ctl, &rxMetric, net->uid, &g_proc);
+             sendMetricEvent(NETRX, &rxMetric, net->uid);
              atomicSwapU64(&net->numRX.evt, 0);
              atomicSwapU64(&net->rxBytes.evt, 0);
         }
 
-        if ((g_summary.net.rx_tx) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
         // Don't report zeros.
         if (net->rxBytes.mtc == 0ULL) return;
 
-        if ((g_summary.net.rx_tx) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
         event_t rxNetMetric = INT_EVENT("net.rx", net->rxBytes.mtc, DELTA, rxFields);
         memmove(&rxMetric, &rxNetMetric, sizeof(event_t));
-        if (cmdSendMetric(g_mtc, &rxMetric)) {
+        if (sendMetric(&rxMetric)) {
             scopeLog("ERROR: doNetMetric:NETRX:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
 
@@ -2347,7 +2780,7 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
         // Don't report zeros.
         if (net->txBytes.evt != 0ULL) {
 
-            cmdSendEvent(g_ctl, &txMetric, net->uid, &g_proc);
+            sendMetricEvent(NETTX, &txMetric, net->uid);
             //atomicSwapU64(&net->numTX.evt, 0);
             //atomicSwapU64(&net->txBytes.evt, 0);
         }
@@ -2355,13 +2788,13 @@ doNetMetric(metric_t type, net_info *net, control_type_t source, ssize_t size)
         // Don't report zeros.
         if (net->txBytes.mtc == 0ULL) return;
 
-        if ((g_summary.net.rx_tx) && (source == EVENT_BASED)) {
+        if (!mtcReport(type, source)) {
             return;
         }
 
         event_t txNetMetric = INT_EVENT("net.tx", net->txBytes.mtc, DELTA, txFields);
         memmove(&txMetric, &txNetMetric, sizeof(event_t));
-        if (cmdSendMetric(g_mtc, &txMetric)) {
+        if (sendMetric(&txMetric)) {
             scopeLog("ERROR: doNetMetric:NETTX:cmdSendMetric", -1, CFG_LOG_ERROR);
         }
 
@@ -2407,147 +2840,300 @@ doEvent()
 
             if (event->evtype == EVT_NET) {
                 net = (net_info *)data;
+                g_evt_tsc = net->tsc;
                 doNetMetric(net->data_type, net, EVENT_BASED, 0);
             } else if (event->evtype == EVT_FS) {
                 fs = (fs_info *)data;
+                g_evt_tsc = fs->tsc;
                 doFSMetric(fs->data_type, fs, EVENT_BASED, fs->funcop, 0, fs->path);
             } else if (event->evtype == EVT_ERR) {
                 staterr = (stat_err_info *)data;
+                g_evt_tsc = staterr->tsc;
                 doErrorMetric(staterr->data_type, EVENT_BASED, staterr->funcop, staterr->name, &staterr->counters);
             } else if (event->evtype == EVT_STAT) {
                 staterr = (stat_err_info *)data;
+                g_evt_tsc = staterr->tsc;
                 doStatMetric(staterr->funcop, staterr->name, &staterr->counters);
             } else if (event->evtype == EVT_DNS) {
                 net = (net_info *)data;
-                doDNSMetricName(net->data_type, net->dnsName, &net->totalDuration, &net->counters);
+                g_evt_tsc = net->tsc;
+                if (net->data_type == DNS_QUERY_DURATION) {
+                    doDNSQueryMetric(net);
+                } else {
+                    doDNSMetricName(net->data_type, net->dnsName, &net->totalDuration, &net->counters);
+                }
             } else if (event->evtype == EVT_PROTO) {
                 proto = (protocol_info *)data;
+                g_evt_tsc = proto->tsc;
                 doProtocolMetric(proto);
+            } else if (event->evtype == EVT_SYSLOG) {
+                g_evt_tsc = ((syslog_info *)data)->tsc;
+                doSyslogEvent((syslog_info *)data);
             } else {
                 DBG(NULL);
                 return;
             }
 
+            g_evt_tsc = 0;
             free(event);
         }
     }
+    unsigned pin = epochEnter();
     httpAggSendReport(g_http_agg, g_mtc);
+    epochExit(pin);
     httpAggReset(g_http_agg);
     ctlFlushLog(g_ctl);
     ctlFlush(g_ctl);
 }
 
-void
-doPayload()
+static void
+payloadToFile(void *arg, const void *hdr, size_t hlen, const void *data, size_t len)
 {
     bool lsbin = FALSE;
-    bool filebin = TRUE;
-    uint64_t data;
+    paystore_t *ps = (paystore_t *)arg;
+    payload_info pinfo;
+    char *srcstr = NULL, rx[]="rx", tx[]="tx", none[]="none";
 
-    while ((data = msgPayloadGet(g_ctl)) != -1) {
-        if (data) {
-            payload_info *pinfo = (payload_info *)data;
-            net_info *net = &pinfo->net;
-            size_t hlen = 1024;
-            char pay[hlen];
-            char *srcstr = NULL, rx[]="rx", tx[]="tx", none[]="none";
-
-            switch (pinfo->src) {
-            case NETTX:
-            case TLSTX:
-                srcstr = tx;
-                break;
+    if (hlen != sizeof(payload_info)) {
+        DBG(NULL);
+        return;
+    }
+    memmove(&pinfo, hdr, sizeof(payload_info));
 
-            case NETRX:
-            case TLSRX:
-                srcstr = rx;
-                break;
+    switch (pinfo.src) {
+    case NETTX:
+    case TLSTX:
+        srcstr = tx;
+        break;
 
-            default:
-                srcstr = none;
-                break;
-            }
+    case NETRX:
+    case TLSRX:
+        srcstr = rx;
+        break;
 
-            char lport[8], rport[8];
-            char lip[INET6_ADDRSTRLEN];
-            char rip[INET6_ADDRSTRLEN];
+    default:
+        srcstr = none;
+        break;
+    }
 
-            if (net) {
-                if (getConn(&net->localConn, lip, sizeof(lip), lport, sizeof(lport)) == FALSE) {
-                    strncpy(lip, "af_int_err", sizeof(lip));
-                    strncpy(lport, "0", sizeof(lport));
-                }
+    char lport[8], rport[8];
+    char lip[INET6_ADDRSTRLEN];
+    char rip[INET6_ADDRSTRLEN];
 
-                if (getConn(&net->remoteConn, rip, sizeof(rip), rport, sizeof(rport)) == FALSE) {
-                    strncpy(rip, "af_int_err", sizeof(rip));
-                    strncpy(rport, "0", sizeof(rport));
-                }
-            }
+    if (getConn(&pinfo.localConn, lip, sizeof(lip), lport, sizeof(lport)) == FALSE) {
+        strncpy(lip, "af_int_err", sizeof(lip));
+        strncpy(lport, "0", sizeof(lport));
+    }
 
-            uint64_t netid = (net != NULL) ? net->uid : 0;
-            int rc = snprintf(pay, hlen,
-                              "{\"id\":\"%s\",\"pid\":%d,\"ppid\":%d,\"fd\":%d,\"src\":\"%s\",\"_channel\":%ld,\"len\":%ld,\"localip\":\"%s\",\"localp\":%s,\"remoteip\":\"%s\",\"remotep\":%s}",
-                              g_proc.id, g_proc.pid, g_proc.ppid, pinfo->sockfd, srcstr, netid, pinfo->len, lip, lport, rip, rport);
-            if (rc < 0) {
-                // unlikley
-                if (pinfo->data) free(pinfo->data);
-                if (pinfo) free(pinfo);
-                DBG(NULL);
-                return;
-            }
+    if (getConn(&pinfo.remoteConn, rip, sizeof(rip), rport, sizeof(rport)) == FALSE) {
+        strncpy(rip, "af_int_err", sizeof(rip));
+        strncpy(rport, "0", sizeof(rport));
+    }
 
-            if (rc < hlen) {
-                hlen = rc + 1;
-            } else {
-                hlen--;
-                scopeLog("WARN: payload header was truncated", pinfo->sockfd, CFG_LOG_WARN);
-            }
+    if (lsbin == TRUE) {
+        size_t plen = 1024;
+        char pay[plen];
+        int rc = snprintf(pay, plen,
+                          "{\"id\":\"%s\",\"pid\":%d,\"ppid\":%d,\"fd\":%d,\"src\":\"%s\",\"_channel\":%ld,\"len\":%ld,\"localip\":\"%s\",\"localp\":%s,\"remoteip\":\"%s\",\"remotep\":%s}",
+                          g_proc.id, g_proc.pid, g_proc.ppid, pinfo.sockfd, srcstr, pinfo.uid, len, lip, lport, rip, rport);
+        if (rc < 0) {
+            // unlikley
+            DBG(NULL);
+            return;
+        }
 
-            char *bdata = NULL;
+        if (rc < plen) {
+            plen = rc + 1;
+        } else {
+            plen--;
+            scopeLog("WARN: payload header was truncated", pinfo.sockfd, CFG_LOG_WARN);
+        }
 
-            if (lsbin == TRUE) {
-                bdata = calloc(1, hlen + pinfo->len);
-                if (bdata) {
-                    memmove(bdata, pay, hlen);
-                    strncat(bdata, "\n", hlen);
-                    memmove(&bdata[hlen], pinfo->data, pinfo->len);
-                    cmdSendPayload(g_ctl, bdata, hlen + pinfo->len);
-                }
-            }
+        char *bdata = calloc(1, plen + len);
+        if (bdata) {
+            memmove(bdata, pay, plen);
+            strncat(bdata, "\n", plen);
+            memmove(&bdata[plen], data, len);
+            cmdSendPayload(g_ctl, bdata, plen + len);
+            free(bdata);
+        }
+    }
 
-            if (filebin == TRUE && ctlPayDir(g_ctl)) {
-                int fd;
-                char path[PATH_MAX];
-
-                ///tmp/<splunk-pid>/<src_host:src_port:dst_port>.in
-                switch (pinfo->src) {
-                case NETTX:
-                case TLSTX:
-                    snprintf(path, PATH_MAX, "%s/%d_%s:%s:%s.out",
-                             ctlPayDir(g_ctl), g_proc.pid, rip, lport, rport);
-                    break;
-
-                case NETRX:
-                case TLSRX:
-                    snprintf(path, PATH_MAX, "%s/%d_%s:%s:%s.in",
-                             ctlPayDir(g_ctl), g_proc.pid, rip, rport, lport);
-                    break;
-
-                default:
-                    snprintf(path, PATH_MAX, "%s/%d.na",
-                             ctlPayDir(g_ctl), g_proc.pid);
-                    break;
-                }
+    if (ps) {
+        char name[PATH_MAX];
 
-                if ((fd = g_fn.open(path, O_WRONLY | O_CREAT | O_APPEND, 0666)) != -1) {
-                    g_fn.write(fd, pinfo->data, pinfo->len);
-                    g_fn.close(fd);
-                }
-            }
+        //<splunk-pid>_<src_host:src_port:dst_port>.in in the payload dir
+        switch (pinfo.src) {
+        case NETTX:
+        case TLSTX:
+            snprintf(name, sizeof(name), "%d_%s:%s:%s.out",
+                     g_proc.pid, rip, lport, rport);
+            break;
 
-            if (bdata) free(bdata);
-            if (pinfo->data) free(pinfo->data);
-            if (pinfo) free(pinfo);
+        case NETRX:
+        case TLSRX:
+            snprintf(name, sizeof(name), "%d_%s:%s:%s.in",
+                     g_proc.pid, rip, rport, lport);
+            break;
+
+        default:
+            snprintf(name, sizeof(name), "%d.na", g_proc.pid);
+            break;
         }
+
+        paystoreWrite(ps, name, data, len);
+    }
+}
+
+static void
+pcapFlush(paystore_t *ps)
+{
+    const char *buf;
+    char name[64];
+    size_t len = pcapngTake(g_pcapng, &buf);
+
+    if (!len || !ps) return;
+
+    // The buffer is reused right away, so this can't wait for the end
+    snprintf(name, sizeof(name), "%d.pcapng", g_proc.pid);
+    paystoreWrite(ps, name, buf, len);
+    paystoreFlush(ps);
+}
+
+static void
+payloadToPcap(void *arg, const void *hdr, size_t hlen, const void *data, size_t len)
+{
+    payload_info pinfo;
+
+    if (hlen != sizeof(payload_info)) {
+        DBG(NULL);
+        return;
+    }
+    memmove(&pinfo, hdr, sizeof(payload_info));
+
+    pcapng_pkt_t pkt = {
+        .ns = getWallTime(pinfo.tsc),
+        .tx = ((pinfo.src == NETTX) || (pinfo.src == TLSTX)),
+        .proto = pinfo.proto,
+        .seq = pinfo.seq,
+        .ack = pinfo.ack,
+        .local = &pinfo.localConn,
+        .remote = &pinfo.remoteConn,
+    };
+
+    while (len) {
+        size_t n = pcapngPacket(g_pcapng, &pkt, data, len);
+        data = (const char *)data + n;
+        len -= n;
+        if (len) pcapFlush((paystore_t *)arg);
+    }
+}
+
+static void
+payloadStoreCreate(void)
+{
+    g_paystore = paystoreCreate(ctlPayDir(g_ctl), DEFAULT_PAYLOAD_FILES,
+                                ctlPayMaxSize(g_ctl), ctlPayMaxAge(g_ctl));
+    paystoreMaxTotalSet(g_paystore, ctlPayMaxTotal(g_ctl));
+    if (!g_paystore || (ctlPayFormat(g_ctl) != CFG_PAYLOAD_PCAPNG)) return;
+
+    // One interface per process, so it's made again after a fork.
+    // Room for the whole name, a colon and any pid.
+    char ifname[sizeof(g_proc.procname) + 12];
+    const char *hdr;
+    snprintf(ifname, sizeof(ifname), "%s:%d", g_proc.procname, g_proc.pid);
+    if (!(g_pcapng = pcapngCreate(DEFAULT_PAYLOAD_PCAP_BUF, ifname))) return;
+
+    size_t hlen = pcapngHeader(g_pcapng, &hdr);
+    if (paystoreHeaderSet(g_paystore, hdr, hlen)) pcapngDestroy(&g_pcapng);
+}
+
+static void
+payloadStoreDestroy(int discard)
+{
+    if (discard) {
+        paystoreDiscard(&g_paystore);
+    } else {
+        if (g_pcapng) pcapFlush(g_paystore);
+        paystoreDestroy(&g_paystore);
+    }
+    pcapngDestroy(&g_pcapng);
+    g_paystore_reported = 0;
+}
+
+static int
+payloadConfigChanged(void)
+{
+    const char *dir = ctlPayDir(g_ctl);
+
+    if ((!dir != !g_paycfg.dir) || (dir && strcmp(dir, g_paycfg.dir))) return TRUE;
+    return (g_paycfg.enable != ctlPayEnable(g_ctl)) ||
+           (g_paycfg.maxsize != ctlPayMaxSize(g_ctl)) ||
+           (g_paycfg.maxage != ctlPayMaxAge(g_ctl)) ||
+           (g_paycfg.maxtotal != ctlPayMaxTotal(g_ctl)) ||
+           (g_paycfg.format != ctlPayFormat(g_ctl));
+}
+
+static void
+payloadConfigSave(void)
+{
+    const char *dir = ctlPayDir(g_ctl);
+
+    if (g_paycfg.dir) free(g_paycfg.dir);
+    g_paycfg.dir = (dir) ? strdup(dir) : NULL;
+    g_paycfg.enable = ctlPayEnable(g_ctl);
+    g_paycfg.maxsize = ctlPayMaxSize(g_ctl);
+    g_paycfg.maxage = ctlPayMaxAge(g_ctl);
+    g_paycfg.maxtotal = ctlPayMaxTotal(g_ctl);
+    g_paycfg.format = ctlPayFormat(g_ctl);
+}
+
+void
+payloadReset(void)
+{
+    // The files, and the bytes counted against maxtotal, are the parent's.
+    // What's queued is too; the parent writes it.  The pcapng interface
+    // carries the parent's pid; the next doPayload() makes our own.
+    payloadStoreDestroy(TRUE);
+    if (g_paycfg.dir) free(g_paycfg.dir);
+    memset(&g_paycfg, 0, sizeof(g_paycfg));
+}
+
+void
+doPayload()
+{
+    static uint64_t reported = 0;
+    uint64_t dropped;
+
+    if (payloadConfigChanged()) {
+        payloadStoreDestroy(FALSE);
+        payloadConfigSave();
+        if (g_paycfg.enable && g_paycfg.dir) payloadStoreCreate();
+    }
+
+    // Whether or not anything got into the arena this time
+    if ((dropped = ctlPayDropped(g_ctl)) != reported) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "WARN: payload buffer full; %" PRIu64 " payloads dropped",
+                 dropped - reported);
+        scopeLog(msg, -1, CFG_LOG_WARN);
+        reported = dropped;
+    }
+    if ((dropped = paystoreDropped(g_paystore)) != g_paystore_reported) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "WARN: payload directory at maxtotal; %" PRIu64 " writes dropped",
+                 dropped - g_paystore_reported);
+        scopeLog(msg, -1, CFG_LOG_WARN);
+        g_paystore_reported = dropped;
+    }
+
+    if (g_pcapng) {
+        if (!msgPayloadDrain(g_ctl, payloadToPcap, g_paystore)) return;
+        pcapFlush(g_paystore);
+    } else {
+        if (!msgPayloadDrain(g_ctl, payloadToFile, g_paystore)) return;
+
+        // Queued writes point into the arena; it's intact until the next drain
+        paystoreFlush(g_paystore);
     }
 }
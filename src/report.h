@@ -25,10 +25,13 @@ typedef enum {
     PROC_THREAD,
     PROC_FD,
     PROC_CHILD,
+    PROC_TRANSPORT,
+    PROC_WAIT,
     NETRX,
     NETTX,
     DNS,
     DNS_DURATION,
+    DNS_QUERY_DURATION,
     FS_DURATION,
     FS_READ,
     FS_WRITE,
@@ -68,8 +71,10 @@ typedef enum {
     EVT_HRES,
     EVT_DETECT,
     EVT_PAYLOAD,
+    EVT_SYSLOG,
     TLSRX,
-    TLSTX
+    TLSTX,
+    METRIC_NUM_TYPES
 } metric_t;
 
 // File types: stream or fd
@@ -78,6 +83,29 @@ typedef enum {
     STREAM,
 } fs_type_t;
 
+// Blocking calls that contribute to proc.wait_time
+typedef enum {
+    WAIT_NANOSLEEP,
+    WAIT_SELECT,
+    WAIT_SIGSUSPEND,
+    WAIT_EPOLL_WAIT,
+    WAIT_POLL,
+    WAIT_PAUSE,
+    WAIT_SIGWAITINFO,
+    WAIT_SIGTIMEDWAIT,
+    WAIT_EPOLL_PWAIT,
+    WAIT_PPOLL,
+    WAIT_PSELECT,
+    WAIT_MSGSND,
+    WAIT_MSGRCV,
+    WAIT_SEMOP,
+    WAIT_SEMTIMEDOP,
+    WAIT_CLOCK_NANOSLEEP,
+    WAIT_USLEEP,
+    WAIT_IO_GETEVENTS,
+    WAIT_NUM_BUCKETS
+} wait_func_t;
+
 
 // Interfaces
 extern mtc_t *g_mtc;
@@ -86,12 +114,18 @@ extern ctl_t *g_ctl;
 void initReporting(void);
 void setReportingInterval(int);
 void sendProcessStartMetric();
+int sendMetric(event_t *);
+unsigned metricsEnabled(void);
 void doErrorMetric(metric_t, control_type_t, const char *, const char *, void *);
 void doProcMetric(metric_t, long long);
 void doStatMetric(const char *, const char *, void *);
 void doTotal(metric_t);
 void doTotalDuration(metric_t);
+void doTotalWait(void);
+void doTotalGo(void);
+void doTotalTransport(void);
 void doEvent(void);
 void doPayload(void);
+void payloadReset(void);
 
 #endif // __REPORT_H__
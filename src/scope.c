@@ -20,6 +20,7 @@
 #include <sys/utsname.h>
 #include <limits.h>
 #include <errno.h>
+#include <sys/statvfs.h>
 
 #include "fn.h"
 #include "dbg.h"
@@ -36,6 +37,8 @@
 #define GO_ENV_VAR "GODEBUG"
 #define GO_ENV_SERVER_VALUE "http2server"
 #define GO_ENV_CLIENT_VALUE "http2client"
+#define LIB_CACHE_ENV "SCOPE_LIB_CACHE_DIR"
+#define LIB_CACHE_DEFAULT "/dev/shm"
 
 extern unsigned char _binary___lib_linux_libscope_so_start;
 extern unsigned char _binary___lib_linux_libscope_so_end;
@@ -122,39 +125,158 @@ release_libscope(libscope_info_t **info_ptr) {
     *info_ptr = NULL;
 }
 
-static libscope_info_t *
-setup_libscope()
+// Identifies the embedded library by the build id the linker put in it,
+// or by a hash of its contents when there isn't one.
+static void
+libscope_id(const unsigned char *lib, size_t len, char *id, size_t idlen)
 {
-    libscope_info_t *info = NULL;
-    int everything_successful = FALSE;
+    Elf64_Ehdr ehdr;
+    int i;
+
+    if ((len >= sizeof(ehdr)) && !memcmp(lib, ELFMAG, SELFMAG)) {
+        memcpy(&ehdr, lib, sizeof(ehdr));
+        if ((ehdr.e_shentsize == sizeof(Elf64_Shdr)) &&
+            (ehdr.e_shoff + (size_t)ehdr.e_shnum * sizeof(Elf64_Shdr) <= len)) {
+            for (i = 0; i < ehdr.e_shnum; i++) {
+                Elf64_Shdr shdr;
+                memcpy(&shdr, lib + ehdr.e_shoff + i * sizeof(shdr), sizeof(shdr));
+                if ((shdr.sh_type != SHT_NOTE) || (shdr.sh_offset + shdr.sh_size > len)) continue;
+
+                size_t off = shdr.sh_offset;
+                size_t end = shdr.sh_offset + shdr.sh_size;
+                while (off + sizeof(Elf64_Nhdr) <= end) {
+                    Elf64_Nhdr nhdr;
+                    memcpy(&nhdr, lib + off, sizeof(nhdr));
+                    size_t name = off + sizeof(nhdr);
+                    size_t desc = name + ((nhdr.n_namesz + 3) & ~3);
+                    off = desc + ((nhdr.n_descsz + 3) & ~3);
+                    if (off > end) break;
+                    if ((nhdr.n_type != NT_GNU_BUILD_ID) || (nhdr.n_namesz != 4) ||
+                        memcmp(lib + name, "GNU", 4) || !nhdr.n_descsz ||
+                        (nhdr.n_descsz * 2 >= idlen)) continue;
+
+                    int j;
+                    for (j = 0; j < nhdr.n_descsz; j++) {
+                        snprintf(&id[j * 2], 3, "%02x", lib[desc + j]);
+                    }
+                    return;
+                }
+            }
+        }
+    }
 
-    if (!(info = calloc(1, sizeof(libscope_info_t)))) {
-        perror("setup_libscope:calloc");
-        goto err;
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    size_t n;
+    for (n = 0; n < len; n++) {
+        hash ^= lib[n];
+        hash *= 1099511628211ULL;
     }
+    snprintf(id, idlen, "%016llx", (unsigned long long)hash);
+}
 
-    info->fd = -1;
+// Whoever can write the cached copy can make us preload anything,
+// so only one written by us or root, and by nobody else, is used.
+static int
+cached_libscope_ok(const char *path, size_t libsize)
+{
+    struct stat sb;
+
+    if (lstat(path, &sb) == -1) return FALSE;
+    return S_ISREG(sb.st_mode) && (sb.st_size == libsize) &&
+           ((sb.st_uid == geteuid()) || (sb.st_uid == 0)) &&
+           !(sb.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static int
+write_all(int fd, const unsigned char *buf, size_t len)
+{
+    while (len) {
+        ssize_t rc = write(fd, buf, len);
+        if (rc == -1) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return TRUE;
+}
+
+// Points info->path at <cache dir>/libscope-<version>-<id>.so, creating it
+// the first time.  Every process started with it then maps the same pages
+// of one file, where a private copy per launch costs a write of the whole
+// library and memory that can't be shared.  The file is written under a
+// temporary name and renamed into place, so it's never seen half written.
+static int
+cache_libscope(libscope_info_t *info, const unsigned char *lib, size_t libsize)
+{
+    const char *dir = getenv(LIB_CACHE_ENV);
+    if (!dir) dir = LIB_CACHE_DEFAULT;
+    if (!*dir) return FALSE;
+
+    // The loader can't map a library from a noexec mount
+    struct statvfs vfs;
+    if ((statvfs(dir, &vfs) == -1) || (vfs.f_flag & ST_NOEXEC)) return FALSE;
+
+    char id[64] = {0};
+    libscope_id(lib, libsize, id, sizeof(id));
+
+    char *path = NULL;
+    if (asprintf(&path, "%s/libscope-%s-%s.so", dir, SCOPE_VER, id) == -1) return FALSE;
+    if (cached_libscope_ok(path, libsize)) {
+        info->path = path;
+        return TRUE;
+    }
+
+    char *tmp = NULL;
+    if (asprintf(&tmp, "%s.XXXXXX", path) == -1) {
+        free(path);
+        return FALSE;
+    }
+
+    int fd = mkstemp(tmp);
+    int rv = (fd != -1) && (fchmod(fd, 0755) != -1) &&
+             write_all(fd, lib, libsize);
+    if (fd != -1) close(fd);
+
+    // If another ldscope got there first, its copy is the same as ours
+    if (rv && (rename(tmp, path) == -1)) rv = FALSE;
+    if (!rv && (fd != -1)) unlink(tmp);
+    free(tmp);
+
+    if (!rv || !cached_libscope_ok(path, libsize)) {
+        free(path);
+        return FALSE;
+    }
+    info->path = path;
+    return TRUE;
+}
+
+// A copy of the library that goes away with this process
+static int
+copy_libscope(libscope_info_t *info, const unsigned char *lib, size_t libsize)
+{
     info->use_memfd = check_kernel_version();
-    
+
     if (info->use_memfd) {
         info->fd = _memfd_create(SHM_NAME, _MFD_CLOEXEC);
     } else {
         if (asprintf(&info->shm_name, "%s%i", SHM_NAME, getpid()) == -1) {
             perror("setup_libscope:shm_name");
             info->shm_name = NULL; // failure leaves info->shm_name undefined
-            goto err;
+            return FALSE;
         }
         info->fd = shm_open(info->shm_name, O_RDWR | O_CREAT, S_IRWXU);
     }
     if (info->fd == -1) {
         perror(info->use_memfd ? "setup_libscope:memfd_create" : "setup_libscope:shm_open");
-        goto err;
+        return FALSE;
     }
-    
-    size_t libsize = (size_t) (&_binary___lib_linux_libscope_so_end - &_binary___lib_linux_libscope_so_start);
-    if (write(info->fd, &_binary___lib_linux_libscope_so_start, libsize) != libsize) {
+
+    if (write(info->fd, lib, libsize) != libsize) {
         perror("setup_libscope:write");
-        goto err;
+        return FALSE;
     }
 
     int rv;
@@ -166,6 +288,28 @@ setup_libscope()
     if (rv == -1) {
         perror("setup_libscope:path");
         info->path = NULL; // failure leaves info->path undefined
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static libscope_info_t *
+setup_libscope()
+{
+    libscope_info_t *info = NULL;
+    int everything_successful = FALSE;
+
+    if (!(info = calloc(1, sizeof(libscope_info_t)))) {
+        perror("setup_libscope:calloc");
+        goto err;
+    }
+
+    info->fd = -1;
+
+    const unsigned char *lib = &_binary___lib_linux_libscope_so_start;
+    size_t libsize = (size_t) (&_binary___lib_linux_libscope_so_end - &_binary___lib_linux_libscope_so_start);
+    if (!cache_libscope(info, lib, libsize) &&
+        !copy_libscope(info, lib, libsize)) {
         goto err;
     }
 
@@ -260,20 +260,15 @@ getElfEntries(struct link_map *lm, Elf64_Rela **rel, Elf64_Sym **sym, char **str
     return 0;
 }
 
-void *
-getSymbol(const char *buf, char *sname)
+static void
+findSymtab(const char *buf, Elf64_Sym **symtab, int *nsyms, const char **strtab)
 {
-    int i, nsyms = 0;
-    Elf64_Addr symaddr = 0;
+    int i;
     Elf64_Ehdr *ehdr;
     Elf64_Shdr *sections;
-    Elf64_Sym *symtab = NULL;
     const char *section_strtab = NULL;
-    const char *strtab = NULL;
     const char *sec_name = NULL;
 
-    if (!buf || !sname) return NULL;
-
     ehdr = (Elf64_Ehdr *)buf;
     sections = (Elf64_Shdr *)((char *)buf + ehdr->e_shoff);
     section_strtab = (char *)buf + sections[ehdr->e_shstrndx].sh_offset;
@@ -282,13 +277,13 @@ getSymbol(const char *buf, char *sname)
         sec_name = section_strtab + sections[i].sh_name;
 
         if (sections[i].sh_type == SHT_SYMTAB) {
-            symtab = (Elf64_Sym *)((char *)buf + sections[i].sh_offset);
-            nsyms = sections[i].sh_size / sections[i].sh_entsize;
+            *symtab = (Elf64_Sym *)((char *)buf + sections[i].sh_offset);
+            *nsyms = sections[i].sh_size / sections[i].sh_entsize;
         } else if (sections[i].sh_type == SHT_STRTAB && strcmp(sec_name, ".strtab") == 0) {
-            strtab = (const char *)(buf + sections[i].sh_offset);
+            *strtab = (const char *)(buf + sections[i].sh_offset);
         }
 
-        if ((strtab != NULL) && (symtab != NULL)) break;
+        if ((*strtab != NULL) && (*symtab != NULL)) break;
         /*printf("section %s type = %d flags = 0x%lx addr = 0x%lx-0x%lx, size = 0x%lx off = 0x%lx\n",
                sec_name,
                sections[i].sh_type,
@@ -298,18 +293,73 @@ getSymbol(const char *buf, char *sname)
                sections[i].sh_size,
                sections[i].sh_offset);*/
     }
+}
+
+// The first two bytes of a name, as an index into a bitmap
+static uint16_t
+namePrefix(const char *name)
+{
+    if (!name[0]) return 0;
+    return (unsigned char)name[0] | ((unsigned char)name[1] << 8);
+}
+
+/*
+ * Looks up a list of symbols in a single pass over .symtab.  Go apps can
+ * have 100k+ symbols and we need a couple dozen of them, so rather than a
+ * scan per symbol, a bitmap of the first two bytes of each name we want
+ * rules out most entries with a single lookup and only the rest are
+ * compared.  addrs[i] is set to the address of names[i], or NULL if it
+ * wasn't found.  Returns the number of symbols found.
+ */
+int
+getSymbols(const char *buf, const char **names, void **addrs, int count)
+{
+    int i, j, nsyms = 0, found = 0;
+    Elf64_Sym *symtab = NULL;
+    const char *strtab = NULL;
+    uint64_t prefixes[(1 << 16) / 64] = {0};
+
+    if (!buf || !names || !addrs || (count <= 0)) return 0;
+
+    for (j = 0; j < count; j++) {
+        addrs[j] = NULL;
+        if (!names[j]) continue;
+        uint16_t prefix = namePrefix(names[j]);
+        prefixes[prefix / 64] |= 1ULL << (prefix % 64);
+    }
 
-    for (i=0; i < nsyms; i++) {
-        if (strcmp(sname, strtab + symtab[i].st_name) == 0) {
-            symaddr = symtab[i].st_value;
+    findSymtab(buf, &symtab, &nsyms, &strtab);
+    if (!symtab || !strtab) return 0;
+
+    for (i = 0; (i < nsyms) && (found < count); i++) {
+        const char *name = strtab + symtab[i].st_name;
+        uint16_t prefix = namePrefix(name);
+        if (!(prefixes[prefix / 64] & (1ULL << (prefix % 64)))) continue;
+
+        for (j = 0; j < count; j++) {
+            // The first of any duplicates wins
+            if (addrs[j] || !names[j] || strcmp(name, names[j])) continue;
+
+            addrs[j] = (void *)symtab[i].st_value;
+            if (addrs[j]) found++;
             char buf[256];
-            snprintf(buf, sizeof(buf), "symbol found %s = 0x%08lx\n", strtab + symtab[i].st_name, symtab[i].st_value);
+            snprintf(buf, sizeof(buf), "symbol found %s = 0x%08lx\n", name, symtab[i].st_value);
             scopeLog(buf, -1, CFG_LOG_TRACE);
-            break;
         }
     }
 
-    return (void *)symaddr;
+    return found;
+}
+
+void *
+getSymbol(const char *buf, char *sname)
+{
+    void *symaddr = NULL;
+
+    if (!buf || !sname) return NULL;
+
+    getSymbols(buf, (const char **)&sname, &symaddr, 1);
+    return symaddr;
 }
 
 bool
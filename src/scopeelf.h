@@ -25,6 +25,7 @@ elf_buf_t * getElf(char *);
 int doGotcha(struct link_map *, got_list_t *, Elf64_Rela *, Elf64_Sym *, char *, int);
 int getElfEntries(struct link_map *, Elf64_Rela **, Elf64_Sym **, char **, int *rsz);
 void * getSymbol(const char *, char *);
+int getSymbols(const char *, const char **, void **, int);
 bool is_static(char *);
 bool is_go(char *);
 
@@ -5,6 +5,7 @@
 
 typedef enum {CFG_FMT_STATSD,
               CFG_FMT_NDJSON,
+              CFG_FMT_BINARY,
               CFG_FORMAT_MAX} cfg_mtc_format_t;
 typedef enum {CFG_UDP, CFG_UNIX, CFG_FILE, CFG_SYSLOG, CFG_SHM, CFG_TCP} cfg_transport_t;
 typedef enum {CFG_MTC, CFG_CTL, CFG_LOG, CFG_WHICH_MAX} which_transport_t;
@@ -15,6 +16,10 @@ typedef enum {CFG_LOG_TRACE,
               CFG_LOG_ERROR,
               CFG_LOG_NONE} cfg_log_level_t;
 typedef enum {CFG_BUFFER_FULLY, CFG_BUFFER_LINE} cfg_buffer_t;
+typedef enum {CFG_COMPRESS_NONE, CFG_COMPRESS_LZ4} cfg_compress_t;
+typedef enum {CFG_PAYLOAD_RAW, CFG_PAYLOAD_PCAPNG} cfg_pay_format_t;
+typedef enum {CFG_AGG_PROCESS, CFG_AGG_CONTAINER} cfg_mtc_aggregate_t;
+typedef enum {CFG_PREFORK_OFF, CFG_PREFORK_ON, CFG_PREFORK_FUNNEL} cfg_prefork_t;
 typedef enum {CFG_SRC_FILE,
               CFG_SRC_CONSOLE,
               CFG_SRC_SYSLOG,
@@ -33,6 +38,8 @@ typedef enum {CFG_SRC_FILE,
 #define DEFAULT_CMD_SIZE 32
 #define MAX_ID 512
 #define MAX_CGROUP 512
+#define MAX_CONTAINER_ID 65
+#define MAX_POD_UID 37
 #define MODE_STR 16
 
 typedef struct
@@ -46,6 +53,8 @@ typedef struct
     char *cmd;
     char id[MAX_ID];
     char cgroup[MAX_CGROUP];
+    char container[MAX_CONTAINER_ID]; // empty when not in one
+    char pod[MAX_POD_UID];
 } proc_id_t;
 
 #define TRUE 1
@@ -65,7 +74,11 @@ typedef unsigned int bool;
 #define DEFAULT_STATSD_PREFIX ""
 #define DEFAULT_CUSTOM_TAGS NULL
 #define DEFAULT_MTC_VERBOSITY 4
+#define DEFAULT_MTC_CARDINALITY 4096
+#define DEFAULT_MTC_AGGREGATE CFG_AGG_PROCESS
+#define DEFAULT_MTC_MODE ""
 #define DEFAULT_COMMAND_DIR "/tmp"
+#define DEFAULT_PREFORK CFG_PREFORK_OFF
 #define DEFAULT_LOG_LEVEL CFG_LOG_ERROR
 #define DEFAULT_SUMMARY_PERIOD 10
 #define DEFAULT_FD 999
@@ -112,9 +125,25 @@ typedef unsigned int bool;
 #define DEFAULT_PORTBLOCK 0
 #define DEFAULT_METRIC_CBUF_SIZE 50 * 1024
 #define DEFAULT_LOG_PATH "/tmp/scope.log"
+#define DEFAULT_SYSLOG_PATH "/dev/log"
 #define DEFAULT_PROCESS_START_MSG TRUE
 #define DEFAULT_PAYLOAD_ENABLE FALSE
 #define DEFAULT_PAYLOAD_DIR "/tmp"
+#define DEFAULT_PAYLOAD_LIMIT 0
+#define DEFAULT_PAYLOAD_HEAD FALSE
+#define DEFAULT_PAYLOAD_MAXSIZE 0
+#define DEFAULT_PAYLOAD_MAXAGE 0
+#define DEFAULT_PAYLOAD_MAXTOTAL 0
+#define DEFAULT_PAYLOAD_FORMAT CFG_PAYLOAD_RAW
+#define DEFAULT_COMPRESS CFG_COMPRESS_NONE
+#define DEFAULT_COMPRESS_BLOCK (64 * 1024)
+#define DEFAULT_COMPRESS_BLOCK_MIN 1024
+#define DEFAULT_QUEUE_SIZE (1024 * 1024)
+#define DEFAULT_QUEUE_SIZE_MIN 4096
+#define DEFAULT_QUEUE_SIZE_MAX (1024 * 1024 * 1024)
+#define DEFAULT_SPILL_DIR NULL
+#define DEFAULT_SPILL_SIZE (64ULL * 1024 * 1024)
+#define DEFAULT_QUEUE_EXIT_WAIT 500 // ms an exiting process gives queued output
 
 /*
  * This calculation is not what we need in the long run.
@@ -124,13 +153,16 @@ typedef unsigned int bool;
  * of as requirements. SO, we'll extend this over time.
  */
 #define DEFAULT_CBUF_SIZE (DEFAULT_MAXEVENTSPERSEC * DEFAULT_SUMMARY_PERIOD)
-#define DEFAULT_PAYLOAD_RING_SIZE 10000
+#define DEFAULT_PAYLOAD_BUF_SIZE (4 * 1024 * 1024)
+#define DEFAULT_PAYLOAD_FILES 64
+#define DEFAULT_PAYLOAD_PCAP_BUF (1024 * 1024)
 #define DEFAULT_CONFIG_SIZE 30 * 1024
 
 // we should start moving env var constants to one place
 #define THREAD_DELAY_LIST "SCOPE_THREAD_DELAY"
 #define SCOPE_PID_ENV "SCOPE_PID"
 #define PRESERVE_PERF_REPORTING "SCOPE_PERF_PRESERVE"
+#define SCOPE_TSC_ENV "SCOPE_TSC"
 
 #endif // __SCOPETYPES_H__
 
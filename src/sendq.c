@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dbg.h"
+#include "scopetypes.h"
+#include "sendq.h"
+
+// Each record is its length followed by its bytes, in memory and spilled
+typedef uint32_t rec_len_t;
+#define HDR_LEN sizeof(rec_len_t)
+
+struct _sendq_t
+{
+    size_t budget;
+    char *buf;                  // budget bytes; allocated when first needed
+    uint64_t head;              // bytes ever put in buf
+    uint64_t tail;              // bytes ever taken out of it
+    size_t partial;             // of the oldest record, already written
+
+    char *spilldir;             // NULL if there's to be no spill file
+    size_t spillmax;
+    int spill;                  // -1 until something spills
+    off_t spill_rd;
+    off_t spill_wr;
+    uint64_t spill_queued;      // record bytes in the spill file
+
+    uint64_t queued;            // record bytes, in memory and spilled
+    uint64_t dropped;
+    uint64_t spilled;
+    int lost;                   // accepted records were thrown away
+
+    int (*close)(int);
+    int (*fcntl)(int, int, ...);
+    int (*unlink)(const char *);
+    int (*ftruncate)(int, off_t);
+    ssize_t (*pread)(int, void *, size_t, off_t);
+    ssize_t (*pwrite)(int, const void *, size_t, off_t);
+};
+
+sendq_t *
+sendqCreate(size_t budget, const char *spilldir, size_t spillmax)
+{
+    if (!budget) return NULL;
+
+    sendq_t *q = calloc(1, sizeof(sendq_t));
+    if (!q) {
+        DBG(NULL);
+        return NULL;
+    }
+
+    // The spill file is ours; don't let it show up as the app's file i/o
+    if (((q->close = dlsym(RTLD_NEXT, "close")) == NULL) ||
+        ((q->fcntl = dlsym(RTLD_NEXT, "fcntl")) == NULL) ||
+        ((q->unlink = dlsym(RTLD_NEXT, "unlink")) == NULL) ||
+        ((q->ftruncate = dlsym(RTLD_NEXT, "ftruncate")) == NULL) ||
+        ((q->pread = dlsym(RTLD_NEXT, "pread")) == NULL) ||
+        ((q->pwrite = dlsym(RTLD_NEXT, "pwrite")) == NULL)) {
+        DBG(NULL);
+        free(q);
+        return NULL;
+    }
+
+    q->budget = budget;
+    q->spill = -1;
+    if (spilldir && spilldir[0] && spillmax) {
+        q->spilldir = strdup(spilldir);
+        q->spillmax = spillmax;
+    }
+    return q;
+}
+
+void
+sendqDestroy(sendq_t **queue)
+{
+    if (!queue || !*queue) return;
+
+    sendq_t *q = *queue;
+    if (q->spill != -1) q->close(q->spill);
+    if (q->spilldir) free(q->spilldir);
+    if (q->buf) free(q->buf);
+    free(q);
+    *queue = NULL;
+}
+
+uint64_t
+sendqQueued(sendq_t *q)
+{
+    return (q) ? q->queued : 0;
+}
+
+uint64_t
+sendqDropped(sendq_t *q)
+{
+    return (q) ? q->dropped : 0;
+}
+
+uint64_t
+sendqSpilled(sendq_t *q)
+{
+    return (q) ? q->spilled : 0;
+}
+
+int
+sendqTakeLoss(sendq_t *q)
+{
+    if (!q || !q->lost) return FALSE;
+
+    q->lost = FALSE;
+    return TRUE;
+}
+
+static void
+ringCopyIn(sendq_t *q, uint64_t pos, const void *src, size_t len)
+{
+    size_t off = pos % q->budget;
+    size_t first = (len < q->budget - off) ? len : q->budget - off;
+    memcpy(&q->buf[off], src, first);
+    if (len > first) memcpy(q->buf, (const char *)src + first, len - first);
+}
+
+static void
+ringCopyOut(sendq_t *q, uint64_t pos, void *dst, size_t len)
+{
+    size_t off = pos % q->budget;
+    size_t first = (len < q->budget - off) ? len : q->budget - off;
+    memcpy(dst, &q->buf[off], first);
+    if (len > first) memcpy((char *)dst + first, q->buf, len - first);
+}
+
+static int
+ringHasRoom(sendq_t *q, size_t need)
+{
+    if (q->head - q->tail + need > q->budget) return FALSE;
+    if (!q->buf && !(q->buf = malloc(q->budget))) {
+        DBG("%zu", q->budget);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Placed out of the way of the app's descriptors, like the transports'
+static int
+spillOpen(sendq_t *q)
+{
+    if (q->spill != -1) return TRUE;
+    if (!q->spilldir) return FALSE;
+
+    char path[PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s/scope_spill.%d.XXXXXX",
+                     q->spilldir, getpid());
+    if ((n < 0) || (n >= sizeof(path))) {
+        DBG("%s", q->spilldir);
+        return FALSE;
+    }
+
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        DBG("%s %d", path, errno);
+        return FALSE;
+    }
+    q->unlink(path);
+
+    int placed = q->fcntl(fd, F_DUPFD_CLOEXEC, DEFAULT_MIN_FD);
+    q->close(fd);
+    if (placed == -1) {
+        DBG(NULL);
+        return FALSE;
+    }
+
+    q->spill = placed;
+    q->spill_rd = q->spill_wr = 0;
+    return TRUE;
+}
+
+static void
+spillReset(sendq_t *q)
+{
+    if (q->spill != -1 && q->spill_wr && q->ftruncate(q->spill, 0)) {
+        DBG(NULL);
+    }
+    q->spill_rd = q->spill_wr = 0;
+    q->queued -= q->spill_queued;
+    q->spill_queued = 0;
+}
+
+static int
+spillPut(sendq_t *q, const char *msg, size_t len)
+{
+    size_t need = HDR_LEN + len;
+    if (q->spill_wr + need > q->spillmax) return -1;
+    if (!spillOpen(q)) return -1;
+
+    // Nothing counts until all of it is there; a short write is
+    // written over by the next one
+    rec_len_t hdr = len;
+    if ((q->pwrite(q->spill, &hdr, HDR_LEN, q->spill_wr) != HDR_LEN) ||
+        (q->pwrite(q->spill, msg, len, q->spill_wr + HDR_LEN) != len)) {
+        DBG("%d", errno);
+        return -1;
+    }
+
+    q->spill_wr += need;
+    q->spill_queued += len;
+    q->queued += len;
+    q->spilled += len;
+    return 0;
+}
+
+// Moves spilled records back into memory while they fit
+static void
+spillRefill(sendq_t *q)
+{
+    while (q->spill_rd < q->spill_wr) {
+        rec_len_t len;
+        if (q->pread(q->spill, &len, HDR_LEN, q->spill_rd) != HDR_LEN) goto err;
+        if (!ringHasRoom(q, HDR_LEN + len)) return;
+
+        // Read straight into the ring, in two pieces if it wraps
+        uint64_t pos = q->head + HDR_LEN;
+        size_t off = pos % q->budget;
+        size_t first = (len < q->budget - off) ? len : q->budget - off;
+        off_t from = q->spill_rd + HDR_LEN;
+        if (q->pread(q->spill, &q->buf[off], first, from) != first) goto err;
+        if ((len > first) &&
+            (q->pread(q->spill, q->buf, len - first, from + first) != len - first)) goto err;
+
+        ringCopyIn(q, q->head, &len, HDR_LEN);
+        q->head += HDR_LEN + len;
+        q->spill_rd += HDR_LEN + len;
+        q->spill_queued -= len;
+    }
+
+    // All of it's back in memory; give the disk back
+    spillReset(q);
+    return;
+
+  err:
+    // Can't trust any of what's left in the file
+    DBG("%d", errno);
+    q->dropped += q->spill_queued;
+    q->lost = TRUE;
+    spillReset(q);
+}
+
+int
+sendqPut(sendq_t *q, const char *msg, size_t len)
+{
+    if (!q || !msg) return -1;
+    if (!len) return 0;
+
+    size_t need = HDR_LEN + len;
+    if ((len <= UINT32_MAX) && (need <= q->budget)) {
+        // Once anything has spilled, the rest goes after it
+        if (!q->spill_queued && ringHasRoom(q, need)) {
+            rec_len_t hdr = len;
+            ringCopyIn(q, q->head, &hdr, HDR_LEN);
+            ringCopyIn(q, q->head + HDR_LEN, msg, len);
+            q->head += need;
+            q->queued += len;
+            return 0;
+        }
+        if (!spillPut(q, msg, len)) return 0;
+    }
+
+    q->dropped += len;
+    return -1;
+}
+
+static rec_len_t
+oldestLen(sendq_t *q)
+{
+    rec_len_t len;
+    ringCopyOut(q, q->tail, &len, HDR_LEN);
+    return len;
+}
+
+static void
+oldestDone(sendq_t *q, rec_len_t len)
+{
+    q->tail += HDR_LEN + len;
+    q->queued -= len;
+    q->partial = 0;
+}
+
+int
+sendqDrain(sendq_t *q, sendq_fn fn, void *arg)
+{
+    if (!q || !fn) return -1;
+
+    while (1) {
+        if (q->spill_queued) spillRefill(q);
+        if (q->head == q->tail) return 0;
+
+        // Up to the end of the record, or the end of the ring
+        rec_len_t len = oldestLen(q);
+        uint64_t pos = q->tail + HDR_LEN + q->partial;
+        size_t off = pos % q->budget;
+        size_t left = len - q->partial;
+        size_t chunk = (left < q->budget - off) ? left : q->budget - off;
+
+        ssize_t rc = fn(arg, &q->buf[off], chunk);
+        if (rc < 0) return -1;
+        if (rc == 0) return 1;
+
+        q->partial += rc;
+        if (q->partial >= len) oldestDone(q, len);
+    }
+}
+
+void
+sendqRestart(sendq_t *q)
+{
+    if (!q || !q->partial || (q->head == q->tail)) return;
+
+    rec_len_t len = oldestLen(q);
+    q->dropped += len - q->partial;
+    oldestDone(q, len);
+}
+
+void
+sendqClear(sendq_t *q, int count)
+{
+    if (!q) return;
+
+    if (count) {
+        q->dropped += q->queued - q->partial;
+        spillReset(q);
+    } else if (q->spill != -1) {
+        // The parent is still using the file; make our own if we need one
+        q->close(q->spill);
+        q->spill = -1;
+        q->spill_rd = q->spill_wr = 0;
+        q->spill_queued = 0;
+    }
+
+    q->head = q->tail = 0;
+    q->partial = 0;
+    q->queued = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef __SENDQ_H__
+#define __SENDQ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// What a tcp transport has been given but the socket hasn't taken yet.
+//
+// Records are kept whole, in order, in at most budget bytes of memory.
+// When that's full they're appended to a spill file, if there is one, and
+// read back into memory as it empties; once anything has spilled, new
+// records go after it so the order holds.  What doesn't fit in either is
+// dropped and counted.  A record bigger than the budget is always dropped.
+//
+// A record can go out in pieces.  If the connection is lost part way
+// through one, the rest of it is dropped (sendqRestart) so that the next
+// connection starts on a record boundary.
+//
+// The spill file is made in the given directory and unlinked straight
+// away, so it never outlives the process.
+//
+// Not thread safe; the transport's lock is held around all of it.
+
+typedef struct _sendq_t sendq_t;
+
+// Writes up to len bytes.  Returns how many were taken, 0 if the
+// write would block, or -1 if the connection is broken.
+typedef ssize_t (*sendq_fn)(void *, const char *, size_t);
+
+// Constructors Destructors
+sendq_t *           sendqCreate(size_t, const char *, size_t);
+void                sendqDestroy(sendq_t **);
+
+// Accessors
+uint64_t            sendqQueued(sendq_t *);     // bytes, in memory and spilled
+uint64_t            sendqDropped(sendq_t *);    // bytes, ever
+uint64_t            sendqSpilled(sendq_t *);    // bytes, ever
+
+// TRUE if records that had been accepted, and so may have been counted
+// as sent, were thrown away since the last call; the spill file couldn't
+// be read back.  A connection's binary dictionary needs to start over.
+int                 sendqTakeLoss(sendq_t *);
+
+// Returns 0, or -1 if the record was dropped
+int                 sendqPut(sendq_t *, const char *, size_t);
+
+// Writes out as much as the callback takes.  Returns 0 when the queue is
+// empty, 1 if the callback would block, -1 if it failed.
+int                 sendqDrain(sendq_t *, sendq_fn, void *);
+
+// Drops what's left of a record that was partly written
+void                sendqRestart(sendq_t *);
+
+// Drops everything, counting it.  With FALSE, it isn't counted and the
+// spill file is replaced; for a child that has its parent's queue.
+void                sendqClear(sendq_t *, int);
+
+#endif // __SENDQ_H__
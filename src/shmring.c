@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "atomic.h"
+#include "dbg.h"
+#include "shmring.h"
+
+#define SHMRING_PUT_TRIES 64         // before a put gives up on the lock
+#define SHMRING_DRAIN_TRIES 4096     // before a drain leaves it for next time
+#define SHMRING_OWNER_CHECK 1024     // tries between checks that the owner lives
+
+typedef struct {
+    uint32_t len;                    // of the data, not counting the NUL
+    uint32_t chan;
+} rec_hdr_t;
+
+// All of it is in the shared mapping
+struct _shmring_t
+{
+    int lock;                        // pid of the holder, or 0
+    int stuck;                       // holder at the last drain that gave up
+    size_t size;                     // of data
+    size_t mapped;
+    uint64_t head;                   // bytes ever put
+    uint64_t tail;                   // bytes ever drained
+    uint64_t dropped;
+    char data[];
+};
+
+shmring_t *
+shmringCreate(size_t size)
+{
+    if (size < sizeof(rec_hdr_t) * 2) return NULL;
+
+    size_t mapped = ROUND_UP(sizeof(shmring_t) + size, sysconf(_SC_PAGESIZE));
+    shmring_t *ring = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        DBG(NULL);
+        return NULL;
+    }
+    ring->size = size;
+    ring->mapped = mapped;
+    return ring;
+}
+
+void
+shmringDestroy(shmring_t **ring)
+{
+    if (!ring || !*ring) return;
+
+    munmap(*ring, (*ring)->mapped);
+    *ring = NULL;
+}
+
+size_t
+shmringUsed(shmring_t *ring)
+{
+    if (!ring) return 0;
+    return atomicLoadU64(&ring->head) - atomicLoadU64(&ring->tail);
+}
+
+uint64_t
+shmringDropped(shmring_t *ring)
+{
+    return (ring) ? atomicLoadU64(&ring->dropped) : 0;
+}
+
+static int
+ringLock(shmring_t *ring, int tries)
+{
+    int self = getpid();
+    int i;
+    for (i = 0; i < tries; i++) {
+        if (atomicCas32(&ring->lock, 0, self)) return TRUE;
+
+        // A worker can be killed while it holds the lock
+        if (!((i + 1) % SHMRING_OWNER_CHECK)) {
+            int owner = ring->lock;
+            if (owner && (kill(owner, 0) == -1) && (errno == ESRCH) &&
+                atomicCas32(&ring->lock, owner, self)) return TRUE;
+        }
+        sched_yield();
+    }
+    return FALSE;
+}
+
+static void
+ringUnlock(shmring_t *ring)
+{
+    atomicSwap32(&ring->lock, 0);
+}
+
+// Copies in or out at a byte offset, wrapping at the end
+static void
+ringWrite(shmring_t *ring, uint64_t at, const void *src, size_t len)
+{
+    size_t off = at % ring->size;
+    size_t first = (len < ring->size - off) ? len : ring->size - off;
+    memcpy(&ring->data[off], src, first);
+    if (len > first) memcpy(ring->data, (const char *)src + first, len - first);
+}
+
+static void
+ringRead(shmring_t *ring, uint64_t at, void *dst, size_t len)
+{
+    size_t off = at % ring->size;
+    size_t first = (len < ring->size - off) ? len : ring->size - off;
+    memcpy(dst, &ring->data[off], first);
+    if (len > first) memcpy((char *)dst + first, ring->data, len - first);
+}
+
+int
+shmringPut(shmring_t *ring, unsigned chan, const void *data, size_t len)
+{
+    if (!ring || !data) return -1;
+
+    size_t need = sizeof(rec_hdr_t) + len + 1;
+    if ((len > UINT32_MAX) || (need > ring->size) ||
+        !ringLock(ring, SHMRING_PUT_TRIES)) {
+        atomicAddU64(&ring->dropped, 1);
+        return -1;
+    }
+
+    int rc = -1;
+    if (ring->size - (ring->head - ring->tail) >= need) {
+        rec_hdr_t hdr = {.len = len, .chan = chan};
+        ringWrite(ring, ring->head, &hdr, sizeof(hdr));
+        ringWrite(ring, ring->head + sizeof(hdr), data, len);
+        ringWrite(ring, ring->head + sizeof(hdr) + len, "", 1);
+        atomicStoreU64(&ring->head, ring->head + need);
+        rc = 0;
+    } else {
+        atomicAddU64(&ring->dropped, 1);
+    }
+
+    ringUnlock(ring);
+    return rc;
+}
+
+int
+shmringDrain(shmring_t *ring, shmring_fn fn, void *arg)
+{
+    if (!ring || !fn) return 0;
+
+    if (!ringLock(ring, SHMRING_DRAIN_TRIES)) {
+        // A put holds the lock for a copy.  The same pid holding it a
+        // period later is stopped, or died and its pid was reused, so
+        // kill() can't tell; either way it isn't letting go.
+        int owner = ring->lock;
+        if (!owner || (owner != ring->stuck) ||
+            !atomicCas32(&ring->lock, owner, getpid())) {
+            ring->stuck = owner;
+            return 0;
+        }
+        DBG("%d", owner);
+    }
+    ring->stuck = 0;
+
+    size_t used = ring->head - ring->tail;
+    char *buf = (used) ? malloc(used) : NULL;
+    if (buf) {
+        ringRead(ring, ring->tail, buf, used);
+        atomicStoreU64(&ring->tail, ring->head);
+    }
+    ringUnlock(ring);
+
+    if (!buf) {
+        // Leave it for next time
+        if (used) DBG(NULL);
+        return 0;
+    }
+
+    int count = 0;
+    size_t off = 0;
+    while (off + sizeof(rec_hdr_t) <= used) {
+        rec_hdr_t hdr;
+        memcpy(&hdr, &buf[off], sizeof(hdr));
+        off += sizeof(hdr);
+        if (off + hdr.len + 1 > used) break;
+        fn(arg, hdr.chan, &buf[off], hdr.len);
+        off += hdr.len + 1;
+        count++;
+    }
+
+    free(buf);
+    return count;
+}
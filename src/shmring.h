@@ -0,0 +1,40 @@
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A ring of records in memory shared with the children we fork.
+//
+// Pre-fork workers put what they would have sent on their own connections
+// here; the parent drains it once a period and sends it on its own.  Each
+// record carries a channel number, so the parent knows which of its
+// transports it belongs on.
+//
+// The lock is held by pid, so a worker that dies holding it doesn't stop
+// everyone else.  Puts never wait long; a record that doesn't fit, or that
+// can't get the lock, is dropped and counted.  A drain doesn't wait long
+// either; one that finds the same pid holding the lock as the last drain
+// did takes it.
+
+typedef struct _shmring_t shmring_t;
+
+// Called once per record.  The record is NUL terminated.
+typedef void (*shmring_fn)(void *, unsigned, const char *, size_t);
+
+// Constructors Destructors
+shmring_t *         shmringCreate(size_t);
+void                shmringDestroy(shmring_t **);
+
+// Accessors
+size_t              shmringUsed(shmring_t *);
+uint64_t            shmringDropped(shmring_t *);
+
+// Returns 0, or -1 if the record was dropped
+int                 shmringPut(shmring_t *, unsigned, const void *, size_t);
+
+// Takes everything that's there and hands it to the callback outside
+// of the lock; returns how many records went to it.
+int                 shmringDrain(shmring_t *, shmring_fn, void *);
+
+#endif // __SHMRING_H__
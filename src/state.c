@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <netinet/in.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
@@ -15,6 +16,7 @@
 #include "dbg.h"
 #include "dns.h"
 #include "httpstate.h"
+#include "linebuf.h"
 #include "mtcformat.h"
 #include "plattime.h"
 #include "search.h"
@@ -28,6 +30,8 @@
 #define FS_ENTRIES 1024
 #define NUM_ATTEMPTS 100
 #define MAX_CONVERT (size_t)256
+#define LOG_LINE_MAX (8 * 1024)                 // longest log event
+#define LOG_LINE_AGE_NS (250 * 1000000ULL)      // how long a partial line waits
 
 extern rtconfig g_cfg;
 
@@ -36,17 +40,28 @@ int g_numFSinfo = FS_ENTRIES;
 int g_http_guard_enabled = TRUE;
 uint64_t g_http_guard[NET_ENTRIES];
 
+// Outlives the fs_info it goes with, so the periodic thread can flush it
+// without racing a close; allocated the first time an fd is a log
+static linebuf_t *g_logbuf[FS_ENTRIES];
+static int g_logbufs = 0;
+
 // These would all be declared static, but the some functions that need
 // this data have been moved into report.c.  This is managed with the
 // include of state_private.h above.
-summary_t g_summary = {{0}};
+unsigned char g_mtc_mode[METRIC_NUM_TYPES] = {[0 ... METRIC_NUM_TYPES - 1] = MTC_MODE_FD};
 net_info *g_netinfo;
 fs_info *g_fsinfo;
 metric_counters g_ctrs = {{0}};
+wait_counters g_waitctrs = {{{0}}};
+epoll_info g_epinfo[EPOLL_ENTRIES];
+go_counters g_goctrs = {0};
 int g_mtc_addr_output = TRUE;
 static search_t* g_http_redirect = NULL;
 static list_t *g_protlist;
 static unsigned int g_prot_sequence = 0;
+static uint64_t g_prot_loaded = 0;      // 0 not yet, 1 loading, 2 loaded
+static unsigned g_verbosity = CFG_MAX_VERBOSITY;
+static unsigned char g_mtc_mode_set[METRIC_NUM_TYPES];   // configured mode + 1; 0 if unset
 
 // interfaces
 mtc_t *g_mtc = NULL;
@@ -128,8 +143,8 @@ get_port_net(net_info *net, int type, control_type_t which) {
     return htons(port);
 }
 
-bool
-delProtocol(request_t *req)
+static bool
+protocolDel(request_t *req)
 {
     unsigned int ptype;
     protocol_def_t *protoreq, *protolist;
@@ -152,8 +167,8 @@ delProtocol(request_t *req)
     return TRUE;
 }
 
-bool
-addProtocol(request_t *req)
+static bool
+protocolAdd(request_t *req)
 {
     int errornumber;
     PCRE2_SIZE erroroffset;
@@ -207,7 +222,7 @@ initProtocolDetection()
             request_t req;
 
             req.protocol = prot;
-            addProtocol(&req);
+            protocolAdd(&req);
         } else {
             break;
         }
@@ -217,29 +232,139 @@ initProtocolDetection()
     lstDestroy(&plist);
 }
 
+// Finding scope_protocol.yml, parsing it and compiling its regexes is
+// left until a payload or a command needs them.  Most short-lived
+// processes never get that far.  Returns TRUE once they're loaded;
+// FALSE while another thread, or this one below a signal handler, is
+// still at it.
+static bool
+loadProtocols(void)
+{
+    if (atomicLoadU64(&g_prot_loaded) == 2) return TRUE;
+
+    if (atomicCasU64(&g_prot_loaded, 0, 1)) {
+        initProtocolDetection();
+        atomicStoreU64(&g_prot_loaded, 2);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool
+delProtocol(request_t *req)
+{
+    if (!req) return FALSE;
+
+    // Commands come on the periodic thread, which no signal interrupts;
+    // the load it waits for is on another thread and finishes
+    while (!loadProtocols()) sched_yield();
+    return protocolDel(req);
+}
+
+bool
+addProtocol(request_t *req)
+{
+    if (!req) return FALSE;
+
+    // After the ones from the file, as if they'd been loaded in init
+    while (!loadProtocols()) sched_yield();
+    return protocolAdd(req);
+}
+
+#define MODE_END METRIC_NUM_TYPES
+#define MODE_NEVER_FD (CFG_MAX_VERBOSITY + 1)
+
+// The metric_t behind each name in metric.format.mode, and the verbosity
+// from which it's reported per fd rather than only in the totals
+typedef struct {
+    const char *name;
+    unsigned verbosity;
+    metric_t type[5];
+} mtc_mode_map_t;
+
+static const mtc_mode_map_t mtcModeMap[] = {
+    {"fs.error",          5, {FS_ERR_OPEN_CLOSE, FS_ERR_READ_WRITE, FS_ERR_STAT, MODE_END}},
+    {"fs.open",           6, {FS_OPEN, TOT_OPEN, MODE_END}},
+    {"fs.close",          6, {FS_CLOSE, TOT_CLOSE, MODE_END}},
+    {"fs.stat",           7, {FS_STAT, EVT_STAT, TOT_STAT, MODE_END}},
+    {"fs.seek",           8, {FS_SEEK, TOT_SEEK, MODE_END}},
+    {"fs.read",           9, {FS_READ, TOT_READ, MODE_END}},
+    {"fs.write",          9, {FS_WRITE, TOT_WRITE, MODE_END}},
+    {"fs.duration",       9, {FS_DURATION, TOT_FS_DURATION, MODE_END}},
+    {"net.error",         5, {NET_ERR_CONN, NET_ERR_RX_TX, NET_ERR_DNS, MODE_END}},
+    {"net.dns",           6, {DNS, TOT_DNS, MODE_END}},
+    {"net.dns.duration",  6, {DNS_DURATION, DNS_QUERY_DURATION, TOT_DNS_DURATION, MODE_END}},
+    {"net.port",          7, {OPEN_PORTS, TOT_PORTS, MODE_END}},
+    {"net.conn",          7, {NET_CONNECTIONS, TOT_TCP_CONN, TOT_UDP_CONN, TOT_OTHER_CONN, MODE_END}},
+    {"net.conn_duration", 7, {CONNECTION_DURATION, TOT_NET_DURATION, MODE_END}},
+    {"net.rx",            9, {NETRX, TOT_RX, MODE_END}},
+    {"net.tx",            9, {NETTX, TOT_TX, MODE_END}},
+    {"proc.cpu",          MODE_NEVER_FD, {PROC_CPU, MODE_END}},
+    {"proc.mem",          MODE_NEVER_FD, {PROC_MEM, MODE_END}},
+    {"proc.thread",       MODE_NEVER_FD, {PROC_THREAD, MODE_END}},
+    {"proc.fd",           MODE_NEVER_FD, {PROC_FD, MODE_END}},
+    {"proc.child",        MODE_NEVER_FD, {PROC_CHILD, MODE_END}},
+    {"proc.transport",    MODE_NEVER_FD, {PROC_TRANSPORT, MODE_END}},
+    {"proc.wait",         7, {PROC_WAIT, MODE_END}},
+};
+
+static const char *const mtcModeName[] = {
+    [MTC_MODE_OFF] =     "off",
+    [MTC_MODE_EVENT] =   "event",
+    [MTC_MODE_SUMMARY] = "summary",
+    [MTC_MODE_FD] =      "fd",
+};
+
+static void
+compileMetricModes(void)
+{
+    unsigned char mode[METRIC_NUM_TYPES];
+    memset(mode, MTC_MODE_SUMMARY, sizeof(mode));
+
+    int i, j;
+    for (i = 0; i < sizeof(mtcModeMap) / sizeof(mtcModeMap[0]); i++) {
+        const mtc_mode_map_t *map = &mtcModeMap[i];
+        for (j = 0; map->type[j] != MODE_END; j++) {
+            metric_t type = map->type[j];
+            if (g_mtc_mode_set[type]) {
+                mode[type] = g_mtc_mode_set[type] - 1;
+            } else if (g_verbosity >= map->verbosity) {
+                mode[type] = MTC_MODE_FD;
+            }
+        }
+    }
+
+    // Readers only ever see a whole byte change
+    for (i = 0; i < METRIC_NUM_TYPES; i++) {
+        __atomic_store_n(&g_mtc_mode[i], mode[i], __ATOMIC_RELAXED);
+    }
+}
+
 void
 initState()
 {
     net_info *netinfoLocal;
     fs_info *fsinfoLocal;
-    if ((netinfoLocal = (net_info *)malloc(sizeof(struct net_info_t) * NET_ENTRIES)) == NULL) {
+
+    // These tables are several MB.  calloc gets them as untouched zero
+    // pages from mmap, so a page is only faulted in when an fd that lands
+    // on it is tracked.  A memset here would touch all of it on every exec.
+    if ((netinfoLocal = (net_info *)calloc(NET_ENTRIES, sizeof(struct net_info_t))) == NULL) {
         scopeLog("ERROR: Constructor:Malloc", -1, CFG_LOG_ERROR);
     }
 
-    if (netinfoLocal) memset(netinfoLocal, 0, sizeof(struct net_info_t) * NET_ENTRIES);
-
     // Per a Read Update & Change (RUC) model; now that the object is ready assign the global
     g_netinfo = netinfoLocal;
 
-    if ((fsinfoLocal = (fs_info *)malloc(sizeof(struct fs_info_t) * FS_ENTRIES)) == NULL) {
+    if ((fsinfoLocal = (fs_info *)calloc(FS_ENTRIES, sizeof(struct fs_info_t))) == NULL) {
         scopeLog("ERROR: Constructor:Malloc", -1, CFG_LOG_ERROR);
     }
 
-    if (fsinfoLocal) memset(fsinfoLocal, 0, sizeof(struct fs_info_t) * FS_ENTRIES);
-
     // Per RUC...
     g_fsinfo = fsinfoLocal;
 
+    compileMetricModes();
+
     initHttpState();
     // the http guard array is static while the net fs array is dynamically allocated
     // will need to change if we want to re-size at runtime
@@ -254,7 +379,7 @@ initState()
     g_http_redirect = searchComp(REDIRECTURL);
 
     g_protlist = lstCreate(destroyProtEntry);
-    initProtocolDetection();
+    g_prot_loaded = 0;
 
     initReporting();
 }
@@ -262,7 +387,20 @@ initState()
 void
 resetState()
 {
+    // A load that was under way in one of the parent's threads never
+    // finishes here.  The list may be mid-insert; leave it and start over.
+    if (atomicLoadU64(&g_prot_loaded) == 1) {
+        g_protlist = lstCreate(destroyProtEntry);
+        g_prot_sequence = 0;
+        g_prot_loaded = 0;
+    }
+
     memset(&g_ctrs, 0, sizeof(struct metric_counters_t));
+    memset(&g_waitctrs, 0, sizeof(struct wait_counters_t));
+    memset(g_epinfo, 0, sizeof(g_epinfo));
+    memset(&g_goctrs.gcCount, 0, sizeof(g_goctrs.gcCount));
+    g_goctrs.pauseNext = 0;
+    memset(g_goctrs.pause, 0, sizeof(g_goctrs.pause));
 }
 
 // DEBUG
@@ -325,33 +463,12 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
     // something passed in a param that is not a viable address; ltp does this
     if ((stat_err == EVT_ERR) && (errno == EFAULT)) return FALSE;
 
-    int *summarize = NULL;
-    switch (type) {
-        case NET_ERR_CONN:
-        case NET_ERR_RX_TX:
-            summarize = &g_summary.net.error;
-            break;
-        case FS_ERR_OPEN_CLOSE:
-        case FS_ERR_READ_WRITE:
-        case FS_ERR_STAT:
-            summarize = &g_summary.fs.error;
-            break;
-        case NET_ERR_DNS:
-            summarize = &g_summary.net.dnserror;
-            break;
-        case EVT_STAT:
-        case FS_STAT:
-            summarize = &g_summary.fs.stat;
-            break;
-        default:
-            break;
-    }
-
     // Bail if we don't need to post
-    int mtc_needs_reporting = summarize && !*summarize;
+    unsigned char mode = g_mtc_mode[type];
+    int mtc_needs_reporting = (mode == MTC_MODE_FD);
     int need_to_post =
-        ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
-        (mtcEnabled(g_mtc) && mtc_needs_reporting);
+        ((mode != MTC_MODE_OFF) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC)) ||
+        (metricsEnabled() && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
     size_t len = sizeof(struct stat_err_info_t);
@@ -360,6 +477,7 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
 
     sep->evtype = stat_err;
     sep->data_type = type;
+    sep->tsc = getTime();
 
     if (pathname) {
         strncpy(sep->name, pathname, strnlen(pathname, sizeof(sep->name)));
@@ -379,30 +497,13 @@ postStatErrState(metric_t stat_err, metric_t type, const char *funcop, const cha
 static int
 postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *pathname)
 {
-    int *summarize = NULL;
-    switch (type) {
-        case FS_READ:
-        case FS_WRITE:
-        case FS_DURATION:
-            summarize = &g_summary.fs.read_write;
-            break;
-        case FS_OPEN:
-        case FS_CLOSE:
-            summarize = &g_summary.fs.open_close;
-            break;
-        case FS_SEEK:
-            summarize = &g_summary.fs.seek;
-            break;
-        default:
-            break;
-    }
-
     // Bail if we don't need to post
-    int mtc_needs_reporting = summarize && !*summarize;
+    unsigned char mode = g_mtc_mode[type];
+    int mtc_needs_reporting = (mode == MTC_MODE_FD);
     int need_to_post =
-        ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
+        ((mode != MTC_MODE_OFF) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC)) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) ||
-        (mtcEnabled(g_mtc) && mtc_needs_reporting);
+        (metricsEnabled() && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
     size_t len = sizeof(struct fs_info_t);
@@ -413,6 +514,7 @@ postFSState(int fd, metric_t type, fs_info *fs, const char *funcop, const char *
     fsp->fd = fd;
     fsp->evtype = EVT_FS;
     fsp->data_type = type;
+    fsp->tsc = getTime();
 
     if (pathname && (fs->path[0] == '\0')) {
         strncpy(fsp->path, pathname, strnlen(pathname, sizeof(fsp->path)));
@@ -431,11 +533,12 @@ static int
 postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char *domain)
 {
     // Bail if we don't need to post
-    int mtc_needs_reporting = !g_summary.net.dns;
+    unsigned char mode = g_mtc_mode[type];
+    int mtc_needs_reporting = (mode == MTC_MODE_FD);
     int need_to_post =
-        ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
+        ((mode != MTC_MODE_OFF) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC)) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_DNS) ||
-        (mtcEnabled(g_mtc) && mtc_needs_reporting);
+        (metricsEnabled() && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
     size_t len = sizeof(struct net_info_t);
@@ -446,13 +549,17 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
     netp->fd = fd;
     netp->evtype = EVT_DNS;
     netp->data_type = type;
+    netp->tsc = getTime();
+
+    // The copy carries the connection's duration; report only this query's
+    if (type == DNS_QUERY_DURATION) resetInterfaceCounts(&netp->totalDuration);
 
     if (duration > 0) {
         addToInterfaceCounts(&netp->totalDuration, duration);
     }
 
     if (domain) {
-        strncpy(netp->dnsName, domain, strnlen(domain, sizeof(netp->dnsName)));
+        strncpy(netp->dnsName, domain, sizeof(netp->dnsName) - 1);
     }
 
     memmove(&netp->counters, &g_ctrs, sizeof(g_ctrs));
@@ -465,27 +572,13 @@ postDNSState(int fd, metric_t type, net_info *net, uint64_t duration, const char
 static int
 postNetState(int fd, metric_t type, net_info *net)
 {
-    int *summarize = NULL;
-    switch (type) {
-        case OPEN_PORTS:
-        case NET_CONNECTIONS:
-        case CONNECTION_DURATION:
-            summarize = &g_summary.net.open_close;
-            break;
-        case NETRX:
-        case NETTX:
-            summarize = &g_summary.net.rx_tx;
-            break;
-        default:
-            break;
-    }
-
     // Bail if we don't need to post
-    int mtc_needs_reporting = summarize && !*summarize;
+    unsigned char mode = g_mtc_mode[type];
+    int mtc_needs_reporting = (mode == MTC_MODE_FD);
     int need_to_post =
-        ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
+        ((mode != MTC_MODE_OFF) && ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC)) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) ||
-        (mtcEnabled(g_mtc) && mtc_needs_reporting);
+        (metricsEnabled() && mtc_needs_reporting);
     if (!need_to_post) return FALSE;
 
     size_t len = sizeof(struct net_info_t);
@@ -496,11 +589,76 @@ postNetState(int fd, metric_t type, net_info *net)
     netp->fd = fd;
     netp->evtype = EVT_NET;
     netp->data_type = type;
+    netp->tsc = getTime();
 
     cmdPostEvent(g_ctl, (char *)netp);
     return mtc_needs_reporting;
 }
 
+static epoll_info *
+getEpollEntry(int epfd)
+{
+    int i;
+    int key = epfd + 1;
+
+    for (i = 0; i < EPOLL_ENTRIES; i++) {
+        if (g_epinfo[i].fd == key) return &g_epinfo[i];
+    }
+
+    // Not found; claim a free entry.  Two threads racing on the same epfd
+    // can each claim one, which only splits the reported time across them.
+    for (i = 0; i < EPOLL_ENTRIES; i++) {
+        if (atomicCas32(&g_epinfo[i].fd, 0, key)) return &g_epinfo[i];
+    }
+
+    return NULL;
+}
+
+void
+doWait(wait_func_t func, int epfd, uint64_t duration, int nready)
+{
+    if (func >= WAIT_NUM_BUCKETS) return;
+
+    addToInterfaceCounts(&g_waitctrs.waitTime[func], duration);
+    addToInterfaceCounts(&g_waitctrs.waitNum[func], 1);
+    if (nready > 0) addToInterfaceCounts(&g_waitctrs.waitReady[func], nready);
+
+    // Only epoll_wait and epoll_pwait are broken down by descriptor
+    if (epfd < 0) return;
+
+    epoll_info *ep = getEpollEntry(epfd);
+    if (!ep) return;
+
+    addToInterfaceCounts(&ep->waitTime, duration);
+    addToInterfaceCounts(&ep->waitNum, 1);
+    if (nready > 0) addToInterfaceCounts(&ep->waitReady, nready);
+}
+
+void
+doGoRuntime(uint64_t *allglen)
+{
+    g_goctrs.allglen = allglen;
+    g_goctrs.active = TRUE;
+}
+
+void
+doGoGC(void)
+{
+    addToInterfaceCounts(&g_goctrs.gcCount, 1);
+}
+
+// Called with the world stopped, so keep it short.  Past GO_PAUSE_SAMPLES
+// in a period, pauses are dropped rather than aggregated.
+void
+doGoPause(uint64_t duration)
+{
+    uint64_t i = __sync_fetch_and_add(&g_goctrs.pauseNext, 1);
+    if (i >= GO_PAUSE_SAMPLES) return;
+
+    // zero marks a sample that has been reported
+    atomicSwapU64(&g_goctrs.pause[i], (duration) ? duration : 1);
+}
+
 void
 doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const char *pathname)
 {
@@ -669,6 +827,17 @@ doUpdateState(metric_t type, int fd, ssize_t size, const char *funcop, const cha
         break;
     }
 
+    case DNS_QUERY_DURATION:
+    {
+        addToInterfaceCounts(&g_ctrs.dnsDurationNum, 1);
+        addToInterfaceCounts(&g_ctrs.dnsDurationTotal, size);
+
+        if (checkNetEntry(fd)) {
+            postDNSState(fd, type, &g_netinfo[fd], size, pathname);
+        }
+        break;
+    }
+
     case FS_DURATION:
     {
         if (!checkFSEntry(fd)) break;
@@ -895,6 +1064,7 @@ setProtocol(int sockfd, protocol_def_t *pre, net_info *net, char *buf, size_t le
         proto->len = sizeof(protocol_def_t);
         proto->fd = sockfd;
         proto->uid = net->uid;
+        proto->tsc = getTime();
         proto->data = (char *)strdup(pre->protname);
         cmdPostEvent(g_ctl, (char *)proto);
     } else {
@@ -908,34 +1078,105 @@ setProtocol(int sockfd, protocol_def_t *pre, net_info *net, char *buf, size_t le
     return TRUE;
 }
 
+#define PAY_DIR_TX 1
+#define PAY_DIR_RX 2
+
+static void
+postPayload(payload_info *pinfo, net_info *net, const void *buf, size_t len)
+{
+    unsigned long long limit = ctlPayLimit(g_ctl);
+
+    if (!buf || !len) return;
+
+    // Past the per connection limit; keep only what fits under it
+    if (net && limit) {
+        if (net->payBytes >= limit) return;
+        if (len > limit - net->payBytes) len = limit - net->payBytes;
+        net->payBytes += len;
+    }
+
+    // A record has to fit in the arena; bigger buffers go in pieces
+    size_t max = ctlPayMaxLen(g_ctl, sizeof(payload_info));
+    if (!max) return;
+
+    const char *data = buf;
+    while (len) {
+        size_t n = MIN(len, max);
+
+        // Sequence numbers for the synthetic tcp headers of pcapng output
+        if (net) {
+            int tx = ((pinfo->src == NETTX) || (pinfo->src == TLSTX));
+            pinfo->seq = net->paySeq[tx];
+            pinfo->ack = net->paySeq[!tx];
+            net->paySeq[tx] += n;
+        }
+
+        cmdPostPayload(g_ctl, pinfo, sizeof(payload_info), data, n);
+        data += n;
+        len -= n;
+    }
+}
+
 static int
 extractPayload(int sockfd, net_info *net, void *buf, size_t len, metric_t src, src_data_t dtype)
 {
     if (!buf || (len <= 0)) return -1;
 
-    payload_info *pinfo = calloc(1, sizeof(struct payload_info_t));
-    if (!pinfo) {
-        return -1;
-    }
+    // Head only keeps the first buffer after the connection changes
+    // direction; for most protocols that's the start of each message.
+    if (net && ctlPayHead(g_ctl)) {
+        int dir = ((src == NETTX) || (src == TLSTX)) ? PAY_DIR_TX : PAY_DIR_RX;
+        if (net->payDir == dir) return 0;
+        net->payDir = dir;
+    }
+
+    payload_info pinfo;
+    memset(&pinfo, 0, sizeof(pinfo));
+    pinfo.src = src;
+    pinfo.sockfd = sockfd;
+    pinfo.tsc = getTime();
+    pinfo.proto = IPPROTO_TCP;
+    if (net) {
+        if (net->type == SOCK_DGRAM) pinfo.proto = IPPROTO_UDP;
+        pinfo.uid = net->uid;
+        memmove(&pinfo.localConn, &net->localConn, sizeof(struct sockaddr_storage));
+        memmove(&pinfo.remoteConn, &net->remoteConn, sizeof(struct sockaddr_storage));
+    }
+
+    switch (dtype) {
+    case BUF:
+        postPayload(&pinfo, net, buf, len);
+        break;
 
-    pinfo->data = calloc(1, len);
-    if (!pinfo->data) {
-        free(pinfo);
-        return -1;
+    case MSG:
+    {
+        // len is the number of bytes sent or received
+        int i;
+        struct msghdr *msg = (struct msghdr *)buf;
+
+        for (i = 0; (i < msg->msg_iovlen) && len; i++) {
+            struct iovec *iov = &msg->msg_iov[i];
+            size_t n = MIN(iov->iov_len, len);
+            postPayload(&pinfo, net, iov->iov_base, n);
+            len -= n;
+        }
+        break;
     }
 
-    memmove(pinfo->data, buf, len);
-    if (net) memmove(&pinfo->net, net, sizeof(net_info));
+    case IOV:
+    {
+        // len is an iovcnt
+        int i;
+        struct iovec *iov = (struct iovec *)buf;
 
-    pinfo->evtype = EVT_PAYLOAD;
-    pinfo->src = src;
-    pinfo->sockfd = sockfd;
-    pinfo->len = len;
+        for (i = 0; i < len; i++) {
+            postPayload(&pinfo, net, iov[i].iov_base, iov[i].iov_len);
+        }
+        break;
+    }
 
-    if (cmdPostPayload(g_ctl, (char *)pinfo) == -1) {
-        if (pinfo->data) free(pinfo->data);
-        if (pinfo) free(pinfo);
-        return -1;
+    default:
+        break;
     }
 
     return 0;
@@ -950,6 +1191,9 @@ detectProtocol(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
     // check once per connection
     if (!buf || !net || (net->protocol != 0)) return;
 
+    // Not yet; a later payload on the connection is checked
+    if (!loadProtocols()) return;
+
     for (ptype = 0; ptype <= g_prot_sequence; ptype++) {
         if ((pre = lstFind(g_protlist, ptype)) != NULL) {
             switch (dtype) {
@@ -995,6 +1239,15 @@ detectProtocol(int sockfd, net_info *net, void *buf, size_t len, metric_t src, s
     }
 }
 
+// True if doProtocol() would do anything with the data it's given
+int
+doProtocolEnabled(void)
+{
+    return ctlPayEnable(g_ctl) ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_HTTP) ||
+        ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC);
+}
+
 int
 doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_data_t dtype)
 {
@@ -1024,20 +1277,50 @@ doProtocol(uint64_t id, int sockfd, void *buf, size_t len, metric_t src, src_dat
 void
 setVerbosity(unsigned verbosity)
 {
-    summary_t *summarize = &g_summary;
     g_mtc_addr_output = verbosity >= DEFAULT_MTC_IPPORT_VERBOSITY;
+    g_verbosity = verbosity;
+    compileMetricModes();
+}
+
+// modes is a comma separated list of name:mode, e.g. "net.rx:fd,fs.read:off".
+// Names not given follow the verbosity.
+void
+setMetricModes(const char *modes)
+{
+    memset(g_mtc_mode_set, 0, sizeof(g_mtc_mode_set));
+
+    char *copy = (modes) ? strdup(modes) : NULL;
+    char *last = NULL;
+    char *tok = (copy) ? strtok_r(copy, ", ", &last) : NULL;
+    for (; tok; tok = strtok_r(NULL, ", ", &last)) {
+        char *val = strchr(tok, ':');
+        if (!val) continue;
+        *val++ = '\0';
+
+        int mode;
+        for (mode = MTC_MODE_OFF; mode <= MTC_MODE_FD; mode++) {
+            if (!strcmp(val, mtcModeName[mode])) break;
+        }
+
+        int i, j;
+        for (i = 0; i < sizeof(mtcModeMap) / sizeof(mtcModeMap[0]); i++) {
+            if (strcmp(tok, mtcModeMap[i].name)) continue;
+            if (mode > MTC_MODE_FD) break;
+            for (j = 0; mtcModeMap[i].type[j] != MODE_END; j++) {
+                g_mtc_mode_set[mtcModeMap[i].type[j]] = mode + 1;
+            }
+            break;
+        }
 
-    summarize->fs.error =       (verbosity < 5);
-    summarize->fs.open_close =  (verbosity < 6);
-    summarize->fs.stat =        (verbosity < 7);
-    summarize->fs.seek =        (verbosity < 8);
-    summarize->fs.read_write =  (verbosity < 9);
+        if ((i == sizeof(mtcModeMap) / sizeof(mtcModeMap[0])) || (mode > MTC_MODE_FD)) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "WARN: metric mode %s:%s ignored", tok, val);
+            scopeLog(buf, -1, CFG_LOG_WARN);
+        }
+    }
+    if (copy) free(copy);
 
-    summarize->net.error =      (verbosity < 5);
-    summarize->net.dnserror =   (verbosity < 5);
-    summarize->net.dns =        (verbosity < 6);
-    summarize->net.open_close = (verbosity < 7);
-    summarize->net.rx_tx =      (verbosity < 9);
+    compileMetricModes();
 }
 
 bool
@@ -1240,7 +1523,7 @@ doSetAddrs(int sockfd)
     int need_to_track_addrs =
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_METRIC) ||
         ctlEvtSourceEnabled(g_ctl, CFG_SRC_NET) ||
-        (mtcEnabled(g_mtc) && g_mtc_addr_output) ||
+        (metricsEnabled() && g_mtc_addr_output) ||
         ctlPayEnable(g_ctl);
     if (!need_to_track_addrs) return 0;
 
@@ -1346,6 +1629,108 @@ isLegalLabelChar(char x)
  * See RFC 1035 for details.
  */
 
+/*
+ * Convert a DNS format name starting at dname into dotted form.
+ * Returns the number of bytes used in dnsName including the
+ * terminating null, or -1 if the name is malformed.
+ */
+static int
+parseDNSName(const char *dname, const char *pkt_end, char *dnsName, size_t len)
+{
+    int dnsNameBytesUsed = 0;
+
+    while ((dname < pkt_end) && (*dname != '\0')) {
+        // handle one label
+
+        int label_len = (int)*dname++;
+        if (label_len > 63) return -1; // labels must be 63 chars or less
+        if (&dname[label_len] >= pkt_end) return -1; // honor packet end
+        // Ensure we don't overrun the size of dnsName
+        if ((dnsNameBytesUsed + label_len) >= len) return -1;
+
+        for ( ; (label_len > 0); label_len--) {
+            if (!isLegalLabelChar(*dname)) return -1;
+            dnsName[dnsNameBytesUsed++] = *dname++;
+        }
+        dnsName[dnsNameBytesUsed++] = '.';
+    }
+
+    if (dnsNameBytesUsed == 0) return -1;
+
+    dnsName[dnsNameBytesUsed-1] = '\0'; // overwrite the last period
+    return dnsNameBytesUsed;
+}
+
+static void
+dnsTxnStart(net_info *net, uint16_t id)
+{
+    int i;
+    dns_txn *slot = &net->dnsTxn[0];
+
+    // Reuse an entry for a retransmitted id, else take a free entry,
+    // else displace the oldest outstanding query.
+    for (i = 0; i < DNS_TXN_ENTRIES; i++) {
+        dns_txn *txn = &net->dnsTxn[i];
+        if (txn->startTime && (txn->id == id)) {
+            slot = txn;
+            break;
+        }
+        if (!txn->startTime) {
+            slot = txn;
+        } else if (slot->startTime && (txn->startTime < slot->startTime)) {
+            slot = txn;
+        }
+    }
+
+    slot->id = id;
+    slot->startTime = getTime();
+}
+
+static uint64_t
+dnsTxnEnd(net_info *net, uint16_t id)
+{
+    int i;
+    for (i = 0; i < DNS_TXN_ENTRIES; i++) {
+        dns_txn *txn = &net->dnsTxn[i];
+        if (txn->startTime && (txn->id == id)) {
+            uint64_t start = txn->startTime;
+            txn->startTime = 0;
+            return start;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Match a DNS response received on sd against the query
+ * recorded by getDNSName() and report the time it took.
+ * Returns TRUE if the response matched an outstanding query.
+ */
+static int
+doDNSResponse(int sd, const void *pkt, size_t pktlen)
+{
+    net_info *net = getNetEntry(sd);
+    if (!net || !pkt || (pktlen < sizeof(struct dns_header))) return FALSE;
+
+    const unsigned char *hdr = (const unsigned char *)pkt;
+    if (!(hdr[2] & DNS_QR_MASK)) return FALSE;
+
+    uint64_t start = dnsTxnEnd(net, (hdr[0] << 8) | hdr[1]);
+    if (!start) return FALSE;
+    uint64_t duration = getDuration(start);
+
+    char dnsName[MAX_HOSTNAME+1];
+    const char *dname = (const char *)pkt + sizeof(struct dns_header);
+    if (parseDNSName(dname, (const char *)pkt + pktlen,
+                     dnsName, sizeof(dnsName)) <= 0) return FALSE;
+
+    net->dnsRcode = hdr[3] & DNS_RCODE_MASK;
+    net->dnsAnswers = (hdr[6] << 8) | hdr[7];
+
+    doUpdateState(DNS_QUERY_DURATION, sd, (ssize_t)duration, NULL, dnsName);
+    return TRUE;
+}
+
 int
 getDNSName(int sd, void *pkt, int pktlen)
 {
@@ -1426,24 +1811,17 @@ getDNSName(int sd, void *pkt, int pktlen)
     // We think we have a direct DNS request
     char *pkt_end = (char *)pkt + pktlen;
 
-    while ((*dname != '\0') && (dname < pkt_end)) {
-        // handle one label
+    dnsNameBytesUsed = parseDNSName(dname, pkt_end, dnsName, sizeof(dnsName));
+    if (dnsNameBytesUsed <= 0) return -1;
 
-        int label_len = (int)*dname++;
-        if (label_len > 63) return -1; // labels must be 63 chars or less
-        if (&dname[label_len] >= pkt_end) return -1; // honor packet end
-        // Ensure we don't overrun the size of dnsName
-        if ((dnsNameBytesUsed + label_len) >= sizeof(dnsName)) return -1;
-
-        for ( ; (label_len > 0); label_len--) {
-            if (!isLegalLabelChar(*dname)) return -1;
-            dnsName[dnsNameBytesUsed++] = *dname++;
+    // Remember when this query left so the response can be timed
+    if (pktlen >= sizeof(struct dns_header)) {
+        unsigned char *hdr = (unsigned char *)pkt;
+        if (!(hdr[2] & DNS_QR_MASK)) {
+            dnsTxnStart(&g_netinfo[sd], (hdr[0] << 8) | hdr[1]);
         }
-        dnsName[dnsNameBytesUsed++] = '.';
     }
 
-    dnsName[dnsNameBytesUsed-1] = '\0'; // overwrite the last period
-
     if (strncmp(dnsName, g_netinfo[sd].dnsName, dnsNameBytesUsed) == 0) {
         // Already sent this from an interposed function
         g_netinfo[sd].dnsSend = FALSE;
@@ -1510,8 +1888,22 @@ doRecv(int sockfd, ssize_t rc, const void *buf, size_t len, src_data_t src)
 
         doUpdateState(NETRX, sockfd, rc, NULL, NULL);
 
-        if (remotePortIsDNS(sockfd) && (g_netinfo[sockfd].dnsName[0])) {
-            doUpdateState(DNS, sockfd, (ssize_t)1, NULL, g_netinfo[sockfd].dnsName);
+        if (remotePortIsDNS(sockfd)) {
+            int matched = FALSE;
+            if (buf && (src == MSG)) {
+                const struct msghdr *msg = (const struct msghdr *)buf;
+                if (msg->msg_iov && msg->msg_iovlen) {
+                    matched = doDNSResponse(sockfd, msg->msg_iov[0].iov_base,
+                                            MIN(msg->msg_iov[0].iov_len, len));
+                }
+            } else if (buf && (src == BUF)) {
+                matched = doDNSResponse(sockfd, buf, len);
+            }
+
+            // A matched response has already been reported with its latency
+            if (!matched && g_netinfo[sockfd].dnsName[0]) {
+                doUpdateState(DNS, sockfd, (ssize_t)1, NULL, g_netinfo[sockfd].dnsName);
+            }
         }
 
         if ((sockfd != -1) && buf) {
@@ -1577,28 +1969,20 @@ reportFD(int fd, control_type_t source)
     struct net_info_t *ninfo = getNetEntry(fd);
     if (ninfo) {
         ninfo->fd = fd;
-        if (!g_summary.net.rx_tx) {
-            doNetMetric(NETTX, ninfo, source, 0);
-            doNetMetric(NETRX, ninfo, source, 0);
-        }
-        if (!g_summary.net.open_close) {
-            doNetMetric(OPEN_PORTS, ninfo, source, 0);
-            doNetMetric(NET_CONNECTIONS, ninfo, source, 0);
-            doNetMetric(CONNECTION_DURATION, ninfo, source, 0);
-        }
+        if (g_mtc_mode[NETTX] == MTC_MODE_FD) doNetMetric(NETTX, ninfo, source, 0);
+        if (g_mtc_mode[NETRX] == MTC_MODE_FD) doNetMetric(NETRX, ninfo, source, 0);
+        if (g_mtc_mode[OPEN_PORTS] == MTC_MODE_FD) doNetMetric(OPEN_PORTS, ninfo, source, 0);
+        if (g_mtc_mode[NET_CONNECTIONS] == MTC_MODE_FD) doNetMetric(NET_CONNECTIONS, ninfo, source, 0);
+        if (g_mtc_mode[CONNECTION_DURATION] == MTC_MODE_FD) doNetMetric(CONNECTION_DURATION, ninfo, source, 0);
     }
 
     struct fs_info_t *finfo = getFSEntry(fd);
     if (finfo) {
         finfo->fd = fd;
-        if (!g_summary.fs.read_write) {
-            doFSMetric(FS_DURATION, finfo, source, "read/write", 0, NULL);
-            doFSMetric(FS_READ, finfo, source, "read", 0, NULL);
-            doFSMetric(FS_WRITE, finfo, source, "write", 0, NULL);
-        }
-        if (!g_summary.fs.seek) {
-            doFSMetric(FS_SEEK, finfo, source, "seek", 0, NULL);
-        }
+        if (g_mtc_mode[FS_DURATION] == MTC_MODE_FD) doFSMetric(FS_DURATION, finfo, source, "read/write", 0, NULL);
+        if (g_mtc_mode[FS_READ] == MTC_MODE_FD) doFSMetric(FS_READ, finfo, source, "read", 0, NULL);
+        if (g_mtc_mode[FS_WRITE] == MTC_MODE_FD) doFSMetric(FS_WRITE, finfo, source, "write", 0, NULL);
+        if (g_mtc_mode[FS_SEEK] == MTC_MODE_FD) doFSMetric(FS_SEEK, finfo, source, "seek", 0, NULL);
     }
 }
 
@@ -1645,6 +2029,98 @@ doRead(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes
     }
 }
 
+// Classifies the path once per config, rather than once per write
+static watch_t
+getLogType(fs_info *fs)
+{
+    unsigned gen = ctlEvtGen(g_ctl);
+    if (fs->logGen != gen) {
+        fs->logType = ctlLogType(g_ctl, fs->path);
+        fs->logGen = gen;
+    }
+    return fs->logType;
+}
+
+static void
+sendLogLine(void *arg, const char *line, size_t len)
+{
+    fs_info *fs = (fs_info *)arg;
+    ctlSendLog(g_ctl, fs->logType, fs->path, line, len, fs->uid, &g_proc);
+}
+
+static void
+doLog(int fd, fs_info *fs, const void *buf, size_t len)
+{
+    if (getLogType(fs) == CFG_SRC_MAX) return;
+
+    // g_fsinfo can grow past the fds that have a buffer; those go unbuffered
+    if (fd >= FS_ENTRIES) {
+        sendLogLine(fs, buf, len);
+        return;
+    }
+
+    linebuf_t *lb = g_logbuf[fd];
+    if (!lb && (lb = linebufCreate(LOG_LINE_MAX))) {
+        if (atomicCasU64((uint64_t *)&g_logbuf[fd], 0ULL, (uint64_t)lb)) {
+            atomicAdd32(&g_logbufs, 1);
+        } else {
+            // Another thread got there first
+            linebufDestroy(&lb);
+            lb = g_logbuf[fd];
+        }
+    }
+
+    if (linebufAdd(lb, buf, len, getTime(), sendLogLine, fs) == -1) {
+        // Busy (or no buffer); send it as it is
+        sendLogLine(fs, buf, len);
+    }
+}
+
+void
+doFlushLogs(int force)
+{
+    if (!g_logbufs) return;
+
+    uint64_t before = ~0ULL;
+    if (!force) {
+        uint64_t now = getTime();
+        uint64_t age = (LOG_LINE_AGE_NS * g_time.freq) / 1000ULL;
+        before = (now > age) ? now - age : 0ULL;
+    }
+
+    int fd;
+    for (fd = 0; fd < FS_ENTRIES; fd++) {
+        linebuf_t *lb = g_logbuf[fd];
+        if (!lb || !linebufPending(lb)) continue;
+        linebufFlush(lb, before, sendLogLine, &g_fsinfo[fd]);
+    }
+}
+
+void
+doSyslog(int priority, const char *msg, size_t len)
+{
+    if (!msg || !ctlEvtSourceEnabled(g_ctl, CFG_SRC_SYSLOG)) return;
+
+    // syslog() adds the newline itself; some callers add one anyway
+    while (len && (msg[len - 1] == '\n')) len--;
+    if (!len) return;
+
+    syslog_info *sys = malloc(sizeof(syslog_info) + len + 1);
+    if (!sys) {
+        DBG(NULL);
+        return;
+    }
+
+    sys->evtype = EVT_SYSLOG;
+    sys->priority = priority;
+    sys->uid = getTime();
+    sys->tsc = sys->uid;
+    memcpy(sys->msg, msg, len);
+    sys->msg[len] = '\0';
+
+    cmdPostEvent(g_ctl, (char *)sys);
+}
+
 void
 doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t bytes,
         const char *func, src_data_t src, size_t cnt)
@@ -1676,14 +2152,14 @@ doWrite(int fd, uint64_t initialTime, int success, const void *buf, ssize_t byte
 
                 for (i = 0; i < cnt; i++) {
                     if (iov[i].iov_base) {
-                        ctlSendLog(g_ctl, fs->path, iov[i].iov_base, iov[i].iov_len, fs->uid, &g_proc);
+                        doLog(fd, fs, iov[i].iov_base, iov[i].iov_len);
                     }
                 }
 
                 return;
             }
 
-            ctlSendLog(g_ctl, fs->path, buf, bytes, fs->uid, &g_proc);
+            doLog(fd, fs, buf, bytes);
         }
     } else {
         if (fs) {
@@ -1853,6 +2329,11 @@ doClose(int fd, const char *func)
     // report everything before the info is lost
     reportFD(fd, EVENT_BASED);
 
+    // Send what's left of a log line, as nothing else will finish it
+    if (fsinfo && (fd < FS_ENTRIES) && g_logbuf[fd]) {
+        linebufFlush(g_logbuf[fd], ~0ULL, sendLogLine, fsinfo);
+    }
+
     if (ninfo) memset(ninfo, 0, sizeof(struct net_info_t));
     if (fsinfo) memset(fsinfo, 0, sizeof(struct fs_info_t));
 
@@ -1901,6 +2382,8 @@ doOpen(int fd, const char *path, fs_type_t type, const char *func)
         g_fsinfo[fd].type = type;
         g_fsinfo[fd].uid = getTime();
         strncpy(g_fsinfo[fd].path, path, sizeof(g_fsinfo[fd].path));
+        g_fsinfo[fd].logType = CFG_SRC_MAX;
+        getLogType(&g_fsinfo[fd]);
 
         if (ctlEvtSourceEnabled(g_ctl, CFG_SRC_FS) && ctlEnhanceFs(g_ctl)) {
             struct stat sbuf;
@@ -26,6 +26,7 @@ void initState();
 void resetState();
 
 void setVerbosity(unsigned);
+void setMetricModes(const char *);
 void addSock(int, int, int);
 int doBlockConnection(int, const struct sockaddr *);
 void doSetConnection(int, const struct sockaddr *, socklen_t, control_type_t);
@@ -52,9 +53,18 @@ void doOpen(int, const char *, fs_type_t, const char *);
 void doSendFile(int, int, uint64_t, int, const char *);
 void doCloseAndReportFailures(int, int, const char *);
 void doCloseAllStreams();
+void doFlushLogs(int);
+void doSyslog(int, const char *, size_t);
 int remotePortIsDNS(int);
 int sockIsTCP(int);
 void doUpdateState(metric_t, int, ssize_t, const char *, const char *);
+void doWait(wait_func_t, int, uint64_t, int);
+// At most this many go gc pauses are reported per period
+#define GO_PAUSE_SAMPLES 64
+void doGoRuntime(uint64_t *);
+void doGoGC(void);
+void doGoPause(uint64_t);
+int doProtocolEnabled(void);
 int doProtocol(uint64_t, int, void *, size_t, metric_t, src_data_t);
 int doSSL(uint64_t, int, void *, size_t, metric_t, src_data_t, char *);
 bool addProtocol(request_t *);
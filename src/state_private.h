@@ -3,10 +3,13 @@
 
 #include <limits.h>
 #include <sys/socket.h>
+#include "state.h"
 
 #define PROTOCOL_STR 16
 #define FUNC_MAX 24
 #define HDRTYPE_MAX 16
+#define EPOLL_ENTRIES 64
+#define DNS_TXN_ENTRIES 8
 
 //
 // This file contains implementation details for state.c and reporting.c.
@@ -57,22 +60,35 @@ typedef struct metric_counters_t {
     counters_element_t  fsStatErrors;
 } metric_counters;
 
-typedef struct {
-    struct {
-        int open_close;
-        int read_write;
-        int stat;
-        int seek;
-        int error;
-    } fs;
-    struct {
-        int open_close;
-        int rx_tx;
-        int dns;
-        int error;
-        int dnserror;
-    } net;
-} summary_t;
+typedef struct wait_counters_t {
+    counters_element_t  waitTime[WAIT_NUM_BUCKETS];
+    counters_element_t  waitNum[WAIT_NUM_BUCKETS];
+    counters_element_t  waitReady[WAIT_NUM_BUCKETS];
+} wait_counters;
+
+typedef struct epoll_info_t {
+    int fd;             // epoll fd + 1; zero means the entry is free
+    counters_element_t waitTime;
+    counters_element_t waitNum;
+    counters_element_t waitReady;
+} epoll_info;
+
+typedef struct go_counters_t {
+    int active;                         // set once a go app is hooked
+    uint64_t *allglen;                  // runtime.allglen in the go app
+    counters_element_t gcCount;
+    uint64_t pauseNext;                 // pauses recorded this period
+    uint64_t pause[GO_PAUSE_SAMPLES];   // in ns; zeroed once reported
+} go_counters;
+
+// How each metric_t is reported.  setVerbosity() and setMetricModes()
+// compile these into g_mtc_mode, so the interposed path does one lookup.
+typedef enum {
+    MTC_MODE_OFF,       // not reported; state isn't posted for it
+    MTC_MODE_EVENT,     // only as metric events
+    MTC_MODE_SUMMARY,   // in the totals sent each period
+    MTC_MODE_FD,        // per fd or per operation, as well as the totals
+} mtc_mode_t;
 
 typedef struct evt_type_t {
     metric_t evtype;
@@ -102,11 +118,20 @@ typedef struct http_map_t {
 typedef struct stat_err_info_t {
     metric_t evtype;
     metric_t data_type;
+    uint64_t tsc;                       // getTime() when it was posted
     char name[PATH_MAX];
     char funcop[FUNC_MAX];
     metric_counters counters;
 } stat_err_info;
 
+typedef struct syslog_info_t {
+    metric_t evtype;
+    int priority;
+    uint64_t uid;
+    uint64_t tsc;                       // getTime() when it was posted
+    char msg[];
+} syslog_info;
+
 typedef enum {
     HTTP_NONE,
     HTTP_HDR,
@@ -129,6 +154,7 @@ typedef struct protocol_info_t {
     size_t len;
     int fd;
     uint64_t uid;
+    uint64_t tsc;                       // getTime() when it was posted
     char *data;
     int sock_type;
     struct sockaddr_storage localConn;
@@ -144,6 +170,12 @@ typedef struct {
     httpId_t id;
 } http_state_t;
 
+// An outstanding DNS query, matched to its response by transaction id
+typedef struct {
+    uint64_t startTime;     // zero means the entry is free
+    uint16_t id;
+} dns_txn;
+
 typedef struct net_info_t {
     metric_t evtype;
     metric_t data_type;
@@ -165,13 +197,20 @@ typedef struct net_info_t {
     counters_element_t numDuration;
     counters_element_t totalDuration;
     uint64_t uid;
+    uint64_t tsc;                       // getTime() when it was posted
     uint64_t lnode;
     uint64_t rnode;
     char dnsName[MAX_HOSTNAME];
+    dns_txn dnsTxn[DNS_TXN_ENTRIES];
+    int dnsRcode;
+    int dnsAnswers;
     struct sockaddr_storage localConn;
     struct sockaddr_storage remoteConn;
     metric_counters counters;
     unsigned int protocol;
+    uint64_t payBytes;
+    int payDir;
+    uint32_t paySeq[2];                 // bytes captured; rx, tx
 } net_info;
 
 typedef struct fs_info_t {
@@ -190,20 +229,27 @@ typedef struct fs_info_t {
     counters_element_t numDuration;
     counters_element_t totalDuration;
     uint64_t uid;
+    uint64_t tsc;                       // getTime() when it was posted
     uid_t fuid;
     gid_t fgid;
     mode_t mode;
     char path[PATH_MAX];
     char funcop[FUNC_MAX];
+    watch_t logType;                    // CFG_SRC_MAX if not a log
+    unsigned logGen;                    // ctlEvtGen() when logType was set
 } fs_info;
 
+// Copied into the payload arena ahead of the data it describes
 typedef struct payload_info_t {
-    metric_t evtype;
     metric_t src;
     int sockfd;
-    net_info net;
-    size_t len;
-    char *data;
+    int proto;
+    uint64_t uid;
+    uint64_t tsc;
+    uint32_t seq;
+    uint32_t ack;
+    struct sockaddr_storage localConn;
+    struct sockaddr_storage remoteConn;
 } payload_info;
 
 // Accessor functions defined in state.c, but used in report.c too.
@@ -226,9 +272,12 @@ void addToInterfaceCounts(counters_element_t *, uint64_t);
 void subFromInterfaceCounts(counters_element_t *, uint64_t);
 
 // Data that lives in state.c, but is used in report.c too.
-extern summary_t g_summary;
+extern unsigned char g_mtc_mode[METRIC_NUM_TYPES];
 extern net_info *g_netinfo;
 extern fs_info *g_fsinfo;
 extern metric_counters g_ctrs;
+extern wait_counters g_waitctrs;
+extern epoll_info g_epinfo[EPOLL_ENTRIES];
+extern go_counters g_goctrs;
 
 #endif // __STATE_PRIVATE_H__
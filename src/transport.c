@@ -5,15 +5,25 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
 #include <unistd.h>
+#include "atomic.h"
+#include "compress.h"
 #include "dbg.h"
 #include "scopetypes.h"
+#include "sendq.h"
 #include "transport.h"
 
+#define SYSLOG_BATCH 32                 // records per sendmmsg()
+#define SYSLOG_BUF_SIZE (32 * 1024)     // and the bytes they share
+#define SYSLOG_PRI (LOG_USER | LOG_INFO)
+
 struct _transport_t
 {
     cfg_transport_t type;
@@ -34,6 +44,9 @@ struct _transport_t
     int (*fclose)(FILE*);
     FILE *(*fdopen)(int, const char *);
     int (*select)(int, fd_set *, fd_set *, fd_set *, struct timeval *);
+#ifdef __LINUX__
+    int (*sendmmsg)(int, struct mmsghdr *, unsigned int, int);
+#endif
     union {
         struct {
             int sock;
@@ -41,6 +54,8 @@ struct _transport_t
             char *host;
             char *port;
             struct sockaddr_storage gai_addr;
+            sendq_t *queue;             // tcp only; what the socket hasn't taken
+            int restart;                // the queue starts on a new connection
         } net;
         struct {
             char *path;
@@ -49,7 +64,22 @@ struct _transport_t
             int stderr;  // Flag to indicate that stream is stderr
             cfg_buffer_t buf_policy;
         } file;
+        struct {
+            int sock;
+            char *path;
+            pid_t pid;
+            char *buf;                  // records waiting to be sent
+            size_t used;
+            unsigned count;
+            struct iovec rec[SYSLOG_BATCH];
+        } syslog;
+        struct {
+            shmring_t *ring;            // not ours; shared with the parent
+            unsigned chan;
+        } shm;
     };
+    compress_t *compress;    // tcp and file only
+    unsigned lock;           // held while compressing or batching syslog
 };
 
 // This is *not* realtime safe; it's shared between all transports in a
@@ -81,6 +111,10 @@ newTransport()
     if ((t->fclose = dlsym(RTLD_NEXT, "fclose")) == NULL) goto out;
     if ((t->fdopen = dlsym(RTLD_NEXT, "fdopen")) == NULL) goto out;
     if ((t->select = dlsym(RTLD_NEXT, "select")) == NULL) goto out;
+#ifdef __LINUX__
+    // Optional; records are sent one at a time without it
+    t->sendmmsg = dlsym(RTLD_NEXT, "sendmmsg");
+#endif
     return t;
 
   out:
@@ -169,8 +203,9 @@ transportConnection(transport_t *trans)
             } else {
                 return -1;
             }
-        case CFG_UNIX:
         case CFG_SYSLOG:
+            return trans->syslog.sock;
+        case CFG_UNIX:
         case CFG_SHM:
             break;
         default:
@@ -198,9 +233,11 @@ transportNeedsConnection(transport_t *trans)
                 transportDisconnect(trans);
             }
             return (trans->file.stream == NULL);
-        case CFG_UNIX:
         case CFG_SYSLOG:
+            return (trans->syslog.sock == -1);
         case CFG_SHM:
+            return (trans->shm.ring == NULL);
+        case CFG_UNIX:
             break;
         default:
             DBG(NULL);
@@ -217,6 +254,8 @@ transportDisconnect(transport_t *trans)
         case CFG_TCP:
             if (trans->net.sock != -1) trans->close(trans->net.sock);
             trans->net.sock = -1;
+            // The queue is left to whoever holds the lock
+            if (trans->net.queue) atomicSwap32(&trans->net.restart, 1);
             int i;
             for (i=0; i<FD_SETSIZE; i++) {
                 if (!FD_ISSET(i, &trans->net.pending_connect)) continue;
@@ -230,8 +269,11 @@ transportDisconnect(transport_t *trans)
             }
             trans->file.stream = NULL;
             break;
-        case CFG_UNIX:
         case CFG_SYSLOG:
+            if (trans->syslog.sock != -1) trans->close(trans->syslog.sock);
+            trans->syslog.sock = -1;
+            break;
+        case CFG_UNIX:
         case CFG_SHM:
             break;
         default:
@@ -329,6 +371,11 @@ transportReconnect(transport_t *trans)
 {
     if (!trans) return 0;
 
+    // Any of the parent's threads that held the lock aren't here to
+    // release it, and what it had gathered into a block is its to send
+    trans->lock = 0;
+    compressDiscard(trans->compress);
+
     switch (trans->type) {
         case CFG_TCP:
             // Since TCP is connection-oriented, we want to disconnect
@@ -341,16 +388,23 @@ transportReconnect(transport_t *trans)
 
             g_cached_addr = getExistingConnectionAddr(trans);
             transportDisconnect(trans);          // Never keep the parents connection.
+            sendqClear(trans->net.queue, FALSE); // Nor what the parent had queued.
+            trans->net.restart = 0;              // Nor a record it had partly sent.
             if (g_cached_addr) {
                 trans->getaddrinfo = scopeGetaddrinfo;
                 transportConnect(trans);         // Will use g_cached_addr
                 trans->getaddrinfo = trans->origGetaddrinfo;
             }
 
+            break;
+        case CFG_SYSLOG:
+            // The socket can be shared, but what the parent had batched
+            // up is the parent's to send, and records carry our pid
+            trans->syslog.used = trans->syslog.count = 0;
+            trans->syslog.pid = getpid();
             break;
         case CFG_UDP:
         case CFG_FILE:
-        case CFG_SYSLOG:
         case CFG_SHM:
             // Everything else is a no-op.  These can all share
             // the parent's transport.
@@ -642,6 +696,41 @@ transportConnectFile(transport_t *t)
     return (t->file.stream != NULL);
 }
 
+static int
+transportConnectSyslog(transport_t *t)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(t->syslog.path) >= sizeof(addr.sun_path)) {
+        DBG("%s", t->syslog.path);
+        return 0;
+    }
+    strcpy(addr.sun_path, t->syslog.path);
+
+    int sock = t->socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        DBG(NULL);
+        return 0;
+    }
+
+    // Not an error; there may be no syslog daemon (yet)
+    if (t->connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        scopeLog("connect to syslog failed", sock, CFG_LOG_INFO);
+        t->close(sock);
+        return 0;
+    }
+
+    // Move this descriptor up out of the way
+    if ((sock = placeDescriptor(sock, t)) == -1) return 0;
+
+    // Never hold up the app when the daemon falls behind; drop instead
+    if (!setSocketBlocking(t, sock, FALSE)) {
+        DBG("%d %s", sock, t->syslog.path);
+    }
+
+    t->syslog.sock = sock;
+    return 1;
+}
+
 int
 transportConnect(transport_t *trans)
 {
@@ -662,6 +751,8 @@ transportConnect(transport_t *trans)
             return checkPendingSocketStatus(trans);
         case CFG_FILE:
             return transportConnectFile(trans);
+        case CFG_SYSLOG:
+            return transportConnectSyslog(trans);
         default:
             DBG(NULL);
     }
@@ -766,21 +857,32 @@ transportCreateUnix(const char* path)
 }
 
 transport_t*
-transportCreateSyslog(void)
+transportCreateSyslog(const char *path)
 {
-    transport_t* t = calloc(1, sizeof(transport_t));
-    if (!t) {
-        DBG(NULL);
-        return NULL;
-    }
+    transport_t *t;
+
+    if (!path) return NULL;
+    t = newTransport();
+    if (!t) return NULL;
 
     t->type = CFG_SYSLOG;
+    t->syslog.sock = -1;
+    t->syslog.pid = getpid();
+    t->syslog.path = strdup(path);
+    t->syslog.buf = malloc(SYSLOG_BUF_SIZE);
+    if (!t->syslog.path || !t->syslog.buf) {
+        DBG("%s", path);
+        transportDestroy(&t);
+        return t;
+    }
+
+    transportConnect(t);
 
     return t;
 }
 
 transport_t*
-transportCreateShm()
+transportCreateShm(shmring_t *ring, unsigned chan)
 {
     transport_t* t = calloc(1, sizeof(transport_t));
     if (!t) {
@@ -789,19 +891,61 @@ transportCreateShm()
     }
 
     t->type = CFG_SHM;
+    t->shm.ring = ring;
+    t->shm.chan = chan;
 
     return t;
 }
 
+void
+transportCompressSet(transport_t *trans, cfg_compress_t type, size_t block)
+{
+    if (!trans) return;
+    if (trans->type != CFG_TCP && trans->type != CFG_FILE) return;
+
+    // Not meant to be changed on a transport that is already in use
+    if (trans->compress) {
+        DBG(NULL);
+        return;
+    }
+    trans->compress = compressCreate(type, block);
+}
+
+void
+transportQueueSet(transport_t *trans, size_t budget, const char *spilldir, size_t spillmax)
+{
+    if (!trans || trans->type != CFG_TCP) return;
+
+    // Not meant to be changed on a transport that is already in use
+    if (trans->net.queue) {
+        DBG(NULL);
+        return;
+    }
+
+    // Compressed output arrives a frame at a time; make room for a couple
+    size_t block = (trans->compress) ? compressBlockSize(trans->compress) : 0;
+    if (budget < 2 * block) budget = 2 * block;
+
+    trans->net.queue = sendqCreate(budget, spilldir, spillmax);
+}
+
 void
 transportDestroy(transport_t** transport)
 {
     if (!transport || !*transport) return;
 
     transport_t* t = *transport;
+    if (t->compress) {
+        transportFlush(t);
+        compressDestroy(&t->compress);
+    }
     switch (t->type) {
         case CFG_UDP:
         case CFG_TCP:
+            if (t->net.queue) {
+                transportFlush(t);
+                sendqDestroy(&t->net.queue);
+            }
             transportDisconnect(t);
             if (t->net.host) free (t->net.host);
             if (t->net.port) free (t->net.port);
@@ -816,6 +960,12 @@ transportDestroy(transport_t** transport)
             }
             break;
         case CFG_SYSLOG:
+            if (t->syslog.buf) {
+                transportFlush(t);
+                free(t->syslog.buf);
+            }
+            transportDisconnect(t);
+            if (t->syslog.path) free(t->syslog.path);
             break;
         case CFG_SHM:
             break;
@@ -826,11 +976,53 @@ transportDestroy(transport_t** transport)
     *transport = NULL;
 }
 
-int
-transportSend(transport_t *trans, const char *msg, size_t len)
+// Takes what the socket will without blocking
+static ssize_t
+tcpSendSome(void *arg, const char *buf, size_t len)
 {
-    if (!trans || !msg) return -1;
+    transport_t *trans = arg;
+    if (trans->net.sock == -1) return 0;
+
+    int flags = MSG_DONTWAIT;
+#ifdef __LINUX__
+    flags |= MSG_NOSIGNAL;
+#endif
+    ssize_t rc = trans->send(trans->net.sock, buf, len, flags);
+    if (rc >= 0) return rc;
+
+    switch (errno) {
+        case EWOULDBLOCK:
+        case EINTR:
+            return 0;
+        case EBADF:
+        case EPIPE:
+        case ECONNRESET:
+            // Leave connecting again to ctlConnect() and mtcConnect(),
+            // which know whether what's queued can go on a new connection
+            DBG(NULL);
+            transportDisconnect(trans);
+            return -1;
+        default:
+            DBG("%d", errno);
+            return -1;
+    }
+}
+
+// Sends what's queued until the socket is full.  A record cut short by
+// a lost connection isn't finished on the next one.
+// Called with the lock held.
+static int
+tcpDrain(transport_t *trans)
+{
+    if (atomicSwap32(&trans->net.restart, 0)) sendqRestart(trans->net.queue);
+    int rc = sendqDrain(trans->net.queue, tcpSendSome, trans);
+    if (atomicSwap32(&trans->net.restart, 0)) sendqRestart(trans->net.queue);
+    return (rc == -1) ? -1 : 0;
+}
 
+static int
+transportWrite(transport_t *trans, const char *msg, size_t len)
+{
     switch (trans->type) {
         case CFG_UDP:
             if (trans->net.sock != -1) {
@@ -857,6 +1049,13 @@ transportSend(transport_t *trans, const char *msg, size_t len)
             }
             break;
         case CFG_TCP:
+            if (trans->net.queue) {
+                // Everything goes through the queue, so that what's
+                // already waiting goes first
+                int rc = sendqPut(trans->net.queue, msg, len);
+                if (tcpDrain(trans)) rc = -1;
+                return rc;
+            }
             if (trans->net.sock != -1) {
                 if (!trans->send) {
                     DBG(NULL);
@@ -913,9 +1112,10 @@ transportSend(transport_t *trans, const char *msg, size_t len)
                 }
             }
             break;
+        case CFG_SHM:
+            return shmringPut(trans->shm.ring, trans->shm.chan, msg, len);
         case CFG_UNIX:
         case CFG_SYSLOG:
-        case CFG_SHM:
             return -1;
         default:
             DBG("%d", trans->type);
@@ -924,28 +1124,259 @@ transportSend(transport_t *trans, const char *msg, size_t len)
      return 0;
 }
 
+static void
+transportLock(transport_t *trans)
+{
+    while (!atomicCas32((int *)&trans->lock, 0, 1)) {
+        sched_yield();
+    }
+}
+
+static void
+transportUnlock(transport_t *trans)
+{
+    atomicSwap32((int *)&trans->lock, 0);
+}
+
+// Hands whatever is buffered to the transport as one frame.
+// Called with the lock held.
+static int
+compressEmit(transport_t *trans)
+{
+    const char *frame;
+    size_t len = compressFrame(trans->compress, &frame);
+    if (!len) return 0;
+    return transportWrite(trans, frame, len);
+}
+
+// Sends the batched records, all in one call where sendmmsg() is around.
+// Records that can't be sent are dropped.  Called with the lock held.
+static int
+syslogEmit(transport_t *trans)
+{
+    unsigned count = trans->syslog.count;
+    unsigned sent = 0;
+    int rc = 0;
+
+    trans->syslog.used = trans->syslog.count = 0;
+    if (!count || (trans->syslog.sock == -1)) return 0;
+
+#ifdef __LINUX__
+    if (trans->sendmmsg) {
+        struct mmsghdr msgs[SYSLOG_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        unsigned i;
+        for (i = 0; i < count; i++) {
+            msgs[i].msg_hdr.msg_iov = &trans->syslog.rec[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (sent < count) {
+            rc = trans->sendmmsg(trans->syslog.sock, &msgs[sent], count - sent, 0);
+            if (rc <= 0) break;
+            sent += rc;
+        }
+    } else
+#endif
+    {
+        while (sent < count) {
+            rc = trans->send(trans->syslog.sock, trans->syslog.rec[sent].iov_base,
+                             trans->syslog.rec[sent].iov_len, 0);
+            if (rc < 0) break;
+            sent++;
+        }
+    }
+    if (sent == count) return 0;
+
+    switch (errno) {
+        case EAGAIN:
+            // The daemon is behind; these are dropped
+            DBG("%u of %u", count - sent, count);
+            break;
+        case EBADF:
+        case ECONNREFUSED:
+        case ENOTCONN:
+            // The daemon went away; connect again next period
+            DBG(NULL);
+            transportDisconnect(trans);
+            break;
+        default:
+            DBG("%d", errno);
+    }
+    return -1;
+}
+
+// Each line of msg becomes a record of its own, as syslog expects
+static int
+syslogSend(transport_t *trans, const char *msg, size_t len)
+{
+    char hdr[64];
+    int hlen = snprintf(hdr, sizeof(hdr), "<%d>scope[%d]: ",
+                        SYSLOG_PRI, trans->syslog.pid);
+    if ((hlen < 0) || (hlen >= sizeof(hdr))) return -1;
+
+    int rc = 0;
+    transportLock(trans);
+    while (len) {
+        const char *nl = memchr(msg, '\n', len);
+        size_t line = (nl) ? nl - msg : len;
+        size_t next = (nl) ? line + 1 : line;
+
+        if (line) {
+            // A line too long for the buffer is cut short
+            size_t max = SYSLOG_BUF_SIZE - hlen;
+            size_t take = (line < max) ? line : max;
+
+            if ((trans->syslog.count == SYSLOG_BATCH) ||
+                (trans->syslog.used + hlen + take > SYSLOG_BUF_SIZE)) {
+                if (syslogEmit(trans)) rc = -1;
+            }
+
+            char *rec = &trans->syslog.buf[trans->syslog.used];
+            memcpy(rec, hdr, hlen);
+            memcpy(&rec[hlen], msg, take);
+            trans->syslog.rec[trans->syslog.count].iov_base = rec;
+            trans->syslog.rec[trans->syslog.count].iov_len = hlen + take;
+            trans->syslog.used += hlen + take;
+            trans->syslog.count++;
+        }
+
+        msg += next;
+        len -= next;
+    }
+    transportUnlock(trans);
+    return rc;
+}
+
+int
+transportSend(transport_t *trans, const char *msg, size_t len)
+{
+    if (!trans || !msg) return -1;
+
+    if (trans->type == CFG_SYSLOG) return syslogSend(trans, msg, len);
+
+    if (!trans->compress) {
+        if ((trans->type != CFG_TCP) || !trans->net.queue) {
+            return transportWrite(trans, msg, len);
+        }
+
+        // Any thread can be sending; the queue is shared
+        transportLock(trans);
+        int rc = transportWrite(trans, msg, len);
+        transportUnlock(trans);
+        return rc;
+    }
+
+    // Messages are gathered into blocks, which only reach the
+    // wire when a block fills or the transport is flushed.
+    int rc = 0;
+    transportLock(trans);
+    while (len) {
+        size_t taken = compressWrite(trans->compress, msg, len);
+        msg += taken;
+        len -= taken;
+        if (len && compressEmit(trans)) rc = -1;
+    }
+    transportUnlock(trans);
+    return rc;
+}
+
+// Binary records can't follow the definitions they need to a new
+// connection, so what's queued is dropped when one is made
+void
+transportQueueDiscard(transport_t *trans)
+{
+    if (!trans || trans->type != CFG_TCP || !trans->net.queue) return;
+
+    transportLock(trans);
+    sendqClear(trans->net.queue, TRUE);
+    atomicSwap32(&trans->net.restart, 0);
+    transportUnlock(trans);
+}
+
+int
+transportQueueStats(transport_t *trans, uint64_t *queued,
+                    uint64_t *dropped, uint64_t *spilled)
+{
+    if (!trans || trans->type != CFG_TCP || !trans->net.queue) return -1;
+
+    // Counted by whichever thread is sending; read them all at one time
+    transportLock(trans);
+    if (queued) *queued = sendqQueued(trans->net.queue);
+    if (dropped) *dropped = sendqDropped(trans->net.queue);
+    if (spilled) *spilled = sendqSpilled(trans->net.queue);
+    transportUnlock(trans);
+    return 0;
+}
+
+// Gives a queue that's behind up to ms to go out, for when the process
+// is exiting.  Returns 0 once it's empty.
+int
+transportDrain(transport_t *trans, unsigned ms)
+{
+    if (!trans || trans->type != CFG_TCP || !trans->net.queue) return 0;
+
+    unsigned waited = 0;
+    while (1) {
+        transportLock(trans);
+        int rc = tcpDrain(trans);
+        uint64_t queued = sendqQueued(trans->net.queue);
+        int sock = trans->net.sock;
+        transportUnlock(trans);
+
+        if (!queued) return 0;
+        if (rc || (sock == -1) || (waited >= ms)) return -1;
+
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(sock, &writable);
+        struct timeval tv = {.tv_sec = 0, .tv_usec = 10 * 1000};
+        trans->select(sock + 1, NULL, &writable, NULL, &tv);
+        waited += 10;
+    }
+}
+
 int
 transportFlush(transport_t* t)
 {
     if (!t) return -1;
 
+    int rc = 0;
+    if (t->compress) {
+        transportLock(t);
+        rc = compressEmit(t);
+        transportUnlock(t);
+    }
+
     switch (t->type) {
         case CFG_UDP:
+            break;
         case CFG_TCP:
+            if (t->net.queue) {
+                // Lost records may have carried definitions; tell the caller
+                transportLock(t);
+                if (tcpDrain(t) || sendqTakeLoss(t->net.queue)) rc = -1;
+                transportUnlock(t);
+            }
             break;
         case CFG_FILE:
             if (fflush(t->file.stream) == EOF) {
                 DBG(NULL);
             }
             break;
-        case CFG_UNIX:
         case CFG_SYSLOG:
+            transportLock(t);
+            rc = syslogEmit(t);
+            transportUnlock(t);
+            break;
         case CFG_SHM:
+            // Records go in the ring as they're sent
+            break;
+        case CFG_UNIX:
             return -1;
         default:
             DBG("%d", t->type);
             return -1;
     }
-    return 0;
+    return rc;
 }
 
@@ -1,6 +1,7 @@
 #ifndef __TRANSPORT_H__
 #define __TRANSPORT_H__
 #include "scopetypes.h"
+#include "shmring.h"
 
 typedef struct _transport_t transport_t;
 
@@ -9,13 +10,18 @@ transport_t*        transportCreateUdp(const char *, const char *);
 transport_t*        transportCreateTCP(const char *, const char *);
 transport_t*        transportCreateFile(const char *, cfg_buffer_t);
 transport_t*        transportCreateUnix(const char *);
-transport_t*        transportCreateSyslog(void);
-transport_t*        transportCreateShm(void);
+transport_t*        transportCreateSyslog(const char *);
+transport_t*        transportCreateShm(shmring_t *, unsigned);
 void                transportDestroy(transport_t **);
+void                transportCompressSet(transport_t *, cfg_compress_t, size_t);
+void                transportQueueSet(transport_t *, size_t, const char *, size_t);
 
 // Accessors
 int                 transportSend(transport_t *, const char *, size_t);
 int                 transportFlush(transport_t *);
+int                 transportDrain(transport_t *, unsigned);
+void                transportQueueDiscard(transport_t *);
+int                 transportQueueStats(transport_t *, uint64_t *, uint64_t *, uint64_t *);
 int                 transportNeedsConnection(transport_t *);
 int                 transportConnect(transport_t *);
 int                 transportConnection(transport_t *);
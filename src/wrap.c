@@ -10,20 +10,24 @@
 #endif
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include <syslog.h>
 #include <libgen.h>
 
 #include "atomic.h"
 #include "cfg.h"
 #include "cfgutils.h"
 #include "com.h"
+#include "container.h"
 #include "dbg.h"
 #include "dns.h"
+#include "epoch.h"
 #include "fn.h"
 #include "os.h"
 #include "plattime.h"
 #include "report.h"
 #include "scopeelf.h"
 #include "scopetypes.h"
+#include "shmring.h"
 #include "state.h"
 #include "utils.h"
 #include "wrap.h"
@@ -37,8 +41,6 @@ rtconfig g_cfg = {0};
 
 static thread_timing g_thread = {0};
 static config_t *g_staticfg = NULL;
-static log_t *g_prevlog = NULL;
-static mtc_t *g_prevmtc = NULL;
 static bool g_replacehandler = FALSE;
 static const char *g_cmddir;
 static unsigned g_sendprocessstart;
@@ -50,10 +52,30 @@ typedef int (*ssl_wrfunc_t)(SSL *, const void *, int);
 
 __thread int g_getdelim = 0;
 
+// Pre-fork workers in funnel mode put what they send in a ring that the
+// parent drains; the channel says which of the parent's transports it's for
+#define PREFORK_RING_SIZE (4 * 1024 * 1024)
+enum {PREFORK_MTC, PREFORK_CTL};
+static shmring_t *g_prefork_ring = NULL;
+static unsigned g_workers = 0;           // forked with prefork on
+static unsigned g_worker = 0;            // our index, if we're a worker
+
+// What fork() needs from the config.  It runs on the app's threads without
+// a pin on g_staticfg, which a config change retires, so doConfig copies
+// these out of each config it applies.
+static cfg_prefork_t g_prefork = DEFAULT_PREFORK;
+static bool g_prefork_binary = FALSE;    // either format is binary
+
+// syslog() messages are formatted here once, for the event and for libc
+#define SYSLOG_MSG_MAX 1024
+static __thread char g_syslog_msg[SYSLOG_MSG_MAX];
+static int g_syslog_facility = LOG_USER;
+
 // Forward declaration
 static void *periodic(void *);
 static void doConfig(config_t *);
 static void reportProcessStart(void);
+static const char *captureSyslog(int, const char *, va_list);
 static void threadNow(int);
 
 #ifdef __LINUX__
@@ -230,6 +252,27 @@ fileModTime(const char *path)
     return STATMODTIME(statbuf);
 }
 
+static void
+freeMtc(void *mtc)
+{
+    mtc_t *m = mtc;
+    mtcDestroy(&m);
+}
+
+static void
+freeLog(void *log)
+{
+    log_t *l = log;
+    logDestroy(&l);
+}
+
+static void
+freeCfg(void *cfg)
+{
+    config_t *c = cfg;
+    cfgDestroy(&c);
+}
+
 static void
 remoteConfig()
 {
@@ -353,7 +396,11 @@ remoteConfig()
                     if (req->cfg) {
                         // Apply the config
                         doConfig(req->cfg);
+                        epochRetire(g_staticfg, freeCfg);
                         g_staticfg = req->cfg;
+
+                        // It's ours now; don't let destroyReq free it
+                        req->cfg = NULL;
                     } else {
                         DBG(NULL);
                     }
@@ -408,12 +455,37 @@ remoteConfig()
     unlink(path);
 }
 
+// Tags metrics with the container and pod we're in, unless the
+// configuration already says what those tags should be
+static void
+setContainerTags(config_t *cfg)
+{
+    if (g_proc.container[0] && !cfgCustomTagValue(cfg, "container_id")) {
+        cfgCustomTagAdd(cfg, "container_id", g_proc.container);
+    }
+    if (g_proc.pod[0] && !cfgCustomTagValue(cfg, "pod_uid")) {
+        cfgCustomTagAdd(cfg, "pod_uid", g_proc.pod);
+    }
+}
+
+// Tags a prefork worker's metrics with its index, so they can be told
+// from its siblings'
+static void
+setWorkerTag(config_t *cfg)
+{
+    if (!g_worker) return;
+
+    char index[16];
+    snprintf(index, sizeof(index), "%u", g_worker);
+    cfgCustomTagAdd(cfg, "worker", index);
+}
+
 static void
 doConfig(config_t *cfg)
 {
     // Save the current objects to get cleaned up on the periodic thread
-    g_prevmtc = g_mtc;
-    g_prevlog = g_log;
+    mtc_t *prevmtc = g_mtc;
+    log_t *prevlog = g_log;
 
     g_thread.interval = cfgMtcPeriod(cfg);
     setReportingInterval(cfgMtcPeriod(cfg));
@@ -422,16 +494,30 @@ doConfig(config_t *cfg)
     }
 
     setVerbosity(cfgMtcVerbosity(cfg));
+    setMetricModes(cfgMtcMode(cfg));
     g_cmddir = cfgCmdDir(cfg);
     g_sendprocessstart = cfgSendProcessStartMsg(cfg);
+    g_prefork = cfgPrefork(cfg);
+    g_prefork_binary = (cfgMtcFormat(cfg) == CFG_FMT_BINARY) ||
+                       (cfgEventFormat(cfg) == CFG_FMT_BINARY);
 
     g_log = initLog(cfg);
-    g_mtc = initMtc(cfg);
+    setContainerTags(cfg);
+    setWorkerTag(cfg);
+    if (g_worker && g_prefork_ring) {
+        // A worker sends through the parent; it has no connection of its own
+        g_mtc = initMtcWithTransport(cfg,
+                     transportCreateShm(g_prefork_ring, PREFORK_MTC));
+    } else {
+        g_mtc = initMtc(cfg);
+    }
     ctlEvtSet(g_ctl, initEvtFormat(cfg));
+    ctlFormatSet(g_ctl, cfgEventFormat(cfg));
 
-    // Disconnect the old interfaces that were just replaced
-    mtcDisconnect(g_prevmtc);
-    logDisconnect(g_prevlog);
+    // Other threads may still be sending on the old interfaces, so they're
+    // disconnected and freed once those threads are done with them
+    epochRetire(prevmtc, freeMtc);
+    epochRetire(prevlog, freeLog);
 }
 
 // Process dynamic config change if they are available
@@ -643,18 +729,40 @@ setProcId(proc_id_t *proc)
     if (osGetCgroup(proc->pid, proc->cgroup, MAX_CGROUP) == FALSE) {
         proc->cgroup[0] = '\0';
     }
+
+    char cgroups[4096];
+    if (osGetCgroups(proc->pid, cgroups, sizeof(cgroups)) == FALSE) {
+        cgroups[0] = '\0';
+    }
+    containerParse(cgroups, proc->container, sizeof(proc->container),
+                   proc->pod, sizeof(proc->pod));
 }
 
+// What every forked child starts over.  Only the pids are new; names,
+// command line, cgroup and container are the parent's, which fork copied,
+// so /proc isn't read for them again.  Only the forking thread is left in
+// the child, so there's nobody else using what's changed here.
 static void
-doReset()
+resetChild(void)
 {
-    setProcId(&g_proc);
+    g_proc.pid = getpid();
+    g_proc.ppid = getppid();
     setPidEnv(g_proc.pid);
 
     g_thread.once = 0;
     g_thread.startTime = time(NULL) + g_thread.interval;
 
     resetState();
+    payloadReset();
+
+    // Readers that were pinned in the parent's other threads are gone
+    epochReset();
+}
+
+static void
+doReset()
+{
+    resetChild();
 
     logReconnect(g_log);
     mtcReconnect(g_mtc);
@@ -666,6 +774,100 @@ doReset()
     threadInit();
 }
 
+// A worker's view of the process is the parent's, but for its pids and
+// its index
+static void
+doPreforkReset(unsigned worker)
+{
+    resetChild();
+    g_worker = worker;
+
+    setWorkerTag(g_staticfg);
+    mtcFormatCustomTagsSet(mtcFormat(g_mtc), cfgCustomTags(g_staticfg));
+
+    logReconnect(g_log);
+    if (g_prefork_ring) {
+        // Close our copies of the parent's connections; the parent
+        // sends what we put in the ring on the originals
+        mtcDisconnect(g_mtc);
+        mtcTransportSet(g_mtc, transportCreateShm(g_prefork_ring, PREFORK_MTC));
+        mtcReconnect(g_mtc);
+        ctlClose(g_ctl);
+        ctlTransportSet(g_ctl, transportCreateShm(g_prefork_ring, PREFORK_CTL));
+        ctlReconnect(g_ctl);
+    } else {
+        mtcReconnect(g_mtc);
+        ctlReconnect(g_ctl);
+    }
+
+    atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
+
+    if (g_prefork_ring) {
+        // The parent has identified itself on the connection we share
+        sendProcessStartMetric();
+    } else {
+        reportProcessStart();
+    }
+    threadInit();
+}
+
+static void
+forwardRecord(void *arg, unsigned chan, const char *buf, size_t len)
+{
+    switch (chan) {
+        case PREFORK_MTC:
+            mtcSend(g_mtc, buf);
+            break;
+        case PREFORK_CTL:
+            ctlSendBin(g_ctl, (char *)buf, len);
+            break;
+        default:
+            DBG("%u", chan);
+    }
+}
+
+// Sends what our workers have put in the ring
+static void
+drainWorkers(void)
+{
+    if (!g_prefork_ring || g_worker || !shmringUsed(g_prefork_ring)) return;
+
+    unsigned pin = epochEnter();
+    shmringDrain(g_prefork_ring, forwardRecord, NULL);
+    epochExit(pin);
+
+    static uint64_t dropped = 0;
+    uint64_t now = shmringDropped(g_prefork_ring);
+    if (now != dropped) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "prefork: %llu records from workers dropped",
+                 (unsigned long long)(now - dropped));
+        scopeLog(msg, -1, CFG_LOG_WARN);
+        dropped = now;
+    }
+}
+
+// The ring carries whole messages; the binary formats describe what
+// follows on the same connection, so workers can't share one with them
+static shmring_t *
+preforkRing(void)
+{
+    if (g_prefork_ring) return g_prefork_ring;
+
+    if (g_prefork_binary) {
+        scopeLog("prefork: funnel doesn't work with the binary format; "
+                 "workers will make their own connections", -1, CFG_LOG_INFO);
+        return NULL;
+    }
+
+    shmring_t *ring = shmringCreate(PREFORK_RING_SIZE);
+    if (ring && !atomicCasU64((uint64_t *)&g_prefork_ring, 0ULL, (uint64_t)ring)) {
+        // Another thread forking at the same time got there first
+        shmringDestroy(&ring);
+    }
+    return g_prefork_ring;
+}
+
 static void
 reportPeriodicStuff(void)
 {
@@ -716,6 +918,15 @@ reportPeriodicStuff(void)
     doTotalDuration(TOT_NET_DURATION);
     doTotalDuration(TOT_DNS_DURATION);
 
+    // report time spent blocked in wait functions
+    doTotalWait();
+
+    // go runtime gc and goroutines
+    doTotalGo();
+
+    // output that's waiting on, or was lost to, a slow destination
+    doTotalTransport();
+
     // Report errors
     doErrorMetric(NET_ERR_CONN, PERIODIC, "summary", "summary", NULL);
     doErrorMetric(NET_ERR_RX_TX, PERIODIC, "summary", "summary", NULL);
@@ -744,14 +955,22 @@ handleExit(void)
         while (!atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
             sigSafeNanosleep(&ts);
         }
+        doFlushLogs(TRUE);
+        drainWorkers();
         doEvent();
     } else {
+        doFlushLogs(TRUE);
+        drainWorkers();
         reportPeriodicStuff();
     }
 
+    unsigned pin = epochEnter();
     mtcFlush(g_mtc);
+    mtcDrain(g_mtc, DEFAULT_QUEUE_EXIT_WAIT);
     logFlush(g_log);
+    epochExit(pin);
     ctlFlush(g_ctl);
+    ctlDrain(g_ctl, DEFAULT_QUEUE_EXIT_WAIT);
 }
 
 static void *
@@ -779,10 +998,13 @@ periodic(void *arg)
             // Process dynamic config changes, if any
             dynConfig();
 
-            // TODO: need to ensure that the previous object is no longer in use
-            // Clean up previous objects if they exist.
-            //if (g_prevmtc) mtcDestroy(&g_prevmtc);
-            //if (g_prevlog) logDestroy(&g_prevlog);
+            // Clean up objects replaced by config changes, if they're no
+            // longer in use
+            epochReclaim();
+
+            // Event times are worked out from the tsc; keep them in step
+            // with the system clock
+            anchorWallTime();
 
             // Q: What does it mean to connect transports we expect to be
             // "connectionless"?  A: We've observed some processes close all
@@ -801,6 +1023,8 @@ periodic(void *arg)
             }
 
             if (atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
+                doFlushLogs(FALSE);
+                drainWorkers();
                 reportPeriodicStuff();
                 atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
             }
@@ -808,6 +1032,8 @@ periodic(void *arg)
             summaryTime = time(NULL) + g_thread.interval;
         } else if (perf == FALSE) {
             if (atomicCasU64(&reentrancy_guard, 0ULL, 1ULL)) {
+                doFlushLogs(FALSE);
+                drainWorkers();
                 doEvent();
                 doPayload();
                 atomicCasU64(&reentrancy_guard, 1ULL, 0ULL);
@@ -1198,66 +1424,138 @@ freopen(const char *pathname, const char *mode, FILE *orig_stream)
 EXPORTON int
 nanosleep(const struct timespec *req, struct timespec *rem)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(nanosleep, -1);
-    return g_fn.nanosleep(req, rem);
+    time.initial = getTime();
+    rc = g_fn.nanosleep(req, rem);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_NANOSLEEP, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(select, -1);
-    return g_fn.select(nfds, readfds, writefds, exceptfds, timeout);
+    time.initial = getTime();
+    rc = g_fn.select(nfds, readfds, writefds, exceptfds, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SELECT, -1, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
 sigsuspend(const sigset_t *mask)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(sigsuspend, -1);
-    return g_fn.sigsuspend(mask);
+    time.initial = getTime();
+    rc = g_fn.sigsuspend(mask);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SIGSUSPEND, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(epoll_wait, -1);
-    return g_fn.epoll_wait(epfd, events, maxevents, timeout);
+    time.initial = getTime();
+    rc = g_fn.epoll_wait(epfd, events, maxevents, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_EPOLL_WAIT, epfd, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
 poll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
-    WRAP_CHECK(epoll_wait, -1);
-    return g_fn.poll(fds, nfds, timeout);
+    WRAP_CHECK(poll, -1);
+    time.initial = getTime();
+    rc = g_fn.poll(fds, nfds, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_POLL, -1, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
 pause(void)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(pause, -1);
-    return g_fn.pause();
+    time.initial = getTime();
+    rc = g_fn.pause();
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_PAUSE, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 sigwaitinfo(const sigset_t *set, siginfo_t *info)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(sigwaitinfo, -1);
-    return g_fn.sigwaitinfo(set, info);
+    time.initial = getTime();
+    rc = g_fn.sigwaitinfo(set, info);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SIGWAITINFO, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 sigtimedwait(const sigset_t *set, siginfo_t *info,
              const struct timespec *timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(sigtimedwait, -1);
-    return g_fn.sigtimedwait(set, info, timeout);
+    time.initial = getTime();
+    rc = g_fn.sigtimedwait(set, info, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SIGTIMEDWAIT, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
@@ -1265,18 +1563,36 @@ epoll_pwait(int epfd, struct epoll_event *events,
             int maxevents, int timeout,
             const sigset_t *sigmask)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(epoll_pwait, -1);
-    return g_fn.epoll_pwait(epfd, events, maxevents, timeout, sigmask);
+    time.initial = getTime();
+    rc = g_fn.epoll_pwait(epfd, events, maxevents, timeout, sigmask);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_EPOLL_PWAIT, epfd, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
 ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p,
       const sigset_t *sigmask)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(ppoll, -1);
-    return g_fn.ppoll(fds, nfds, tmo_p, sigmask);
+    time.initial = getTime();
+    rc = g_fn.ppoll(fds, nfds, tmo_p, sigmask);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_PPOLL, -1, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
@@ -1284,42 +1600,87 @@ pselect(int nfds, fd_set *readfds, fd_set *writefds,
         fd_set *exceptfds, const struct timespec *timeout,
         const sigset_t *sigmask)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(pselect, -1);
-    return g_fn.pselect(nfds, readfds, writefds, exceptfds, timeout, sigmask);
+    time.initial = getTime();
+    rc = g_fn.pselect(nfds, readfds, writefds, exceptfds, timeout, sigmask);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_PSELECT, -1, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
 msgsnd(int msqid, const void *msgp, size_t msgsz, int msgflg)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(msgsnd, -1);
-    return g_fn.msgsnd(msqid, msgp, msgsz, msgflg);
+    time.initial = getTime();
+    rc = g_fn.msgsnd(msqid, msgp, msgsz, msgflg);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_MSGSND, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON ssize_t
 msgrcv(int msqid, void *msgp, size_t msgsz, long msgtyp, int msgflg)
 {
+    ssize_t rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(msgrcv, -1);
-    return g_fn.msgrcv(msqid, msgp, msgsz, msgtyp, msgflg);
+    time.initial = getTime();
+    rc = g_fn.msgrcv(msqid, msgp, msgsz, msgtyp, msgflg);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_MSGRCV, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 semop(int semid, struct sembuf *sops, size_t nsops)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(semop, -1);
-    return g_fn.semop(semid, sops, nsops);
+    time.initial = getTime();
+    rc = g_fn.semop(semid, sops, nsops);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SEMOP, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 semtimedop(int semid, struct sembuf *sops, size_t nsops,
            const struct timespec *timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(semtimedop, -1);
-    return g_fn.semtimedop(semid, sops, nsops, timeout);
+    time.initial = getTime();
+    rc = g_fn.semtimedop(semid, sops, nsops, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_SEMTIMEDOP, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
@@ -1327,26 +1688,53 @@ clock_nanosleep(clockid_t clockid, int flags,
                 const struct timespec *request,
                 struct timespec *remain)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(clock_nanosleep, -1);
-    return g_fn.clock_nanosleep(clockid, flags, request, remain);
+    time.initial = getTime();
+    rc = g_fn.clock_nanosleep(clockid, flags, request, remain);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_CLOCK_NANOSLEEP, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 usleep(useconds_t usec)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(usleep, -1);
-    return g_fn.usleep(usec);
+    time.initial = getTime();
+    rc = g_fn.usleep(usec);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_USLEEP, -1, time.duration, 0);
+
+    return rc;
 }
 
 EXPORTON int
 io_getevents(io_context_t ctx_id, long min_nr, long nr,
              struct io_event *events, struct timespec *timeout)
 {
+    int rc;
+    elapsed_t time = {0};
+
     stopTimer();
     WRAP_CHECK(io_getevents, -1);
-    return g_fn.io_getevents(ctx_id, min_nr, nr, events, timeout);
+    time.initial = getTime();
+    rc = g_fn.io_getevents(ctx_id, min_nr, nr, events, timeout);
+    time.duration = getDuration(time.initial);
+
+    doWait(WAIT_IO_GETEVENTS, -1, time.duration, rc);
+
+    return rc;
 }
 
 EXPORTON int
@@ -1550,6 +1938,28 @@ __pread_chk(int fd, void *buf, size_t nbytes, off_t offset, size_t buflen)
     return rc;
 }
 
+// What syslog() and vsyslog() become with _FORTIFY_SOURCE
+EXPORTON void
+__vsyslog_chk(int priority, int flag, const char *format, va_list ap)
+{
+    WRAP_CHECK_VOID(__vsyslog_chk);
+    const char *msg = captureSyslog(priority, format, ap);
+    if (msg && g_fn.syslog) {
+        g_fn.syslog(priority, "%s", msg);
+    } else {
+        g_fn.__vsyslog_chk(priority, flag, format, ap);
+    }
+}
+
+EXPORTON void
+__syslog_chk(int priority, int flag, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    __vsyslog_chk(priority, flag, format, ap);
+    va_end(ap);
+}
+
 EXPORTOFF ssize_t
 __read_chk(int fd, void *buf, size_t nbytes, size_t buflen)
 {
@@ -3544,13 +3954,57 @@ dup3(int oldfd, int newfd, int flags)
     return rc;
 }
 
-EXPORTOFF void
+// Formats the message into this thread's buffer and reports it.  Returns
+// the message if all of it fit, so it can be passed on as it is rather
+// than formatted again; NULL otherwise.
+static const char *
+captureSyslog(int priority, const char *format, va_list ap)
+{
+    if (!format || !ctlEvtSourceEnabled(g_ctl, CFG_SRC_SYSLOG)) return NULL;
+
+    // %m is errno; keep it for libc too
+    int err = errno;
+    va_list aq;
+    va_copy(aq, ap);
+    int len = vsnprintf(g_syslog_msg, sizeof(g_syslog_msg), format, aq);
+    va_end(aq);
+    errno = err;
+    if (len < 0) return NULL;
+
+    if (!(priority & LOG_FACMASK)) priority |= g_syslog_facility;
+    size_t size = (len < sizeof(g_syslog_msg)) ? len : sizeof(g_syslog_msg) - 1;
+    doSyslog(priority, g_syslog_msg, size);
+
+    return (len < sizeof(g_syslog_msg)) ? g_syslog_msg : NULL;
+}
+
+EXPORTON void
+openlog(const char *ident, int option, int facility)
+{
+    WRAP_CHECK_VOID(openlog);
+    if (facility && !(facility & ~LOG_FACMASK)) g_syslog_facility = facility;
+    g_fn.openlog(ident, option, facility);
+}
+
+EXPORTON void
 vsyslog(int priority, const char *format, va_list ap)
 {
     WRAP_CHECK_VOID(vsyslog);
-    scopeLog("vsyslog", -1, CFG_LOG_DEBUG);
-    g_fn.vsyslog(priority, format, ap);
-    return;
+    const char *msg = captureSyslog(priority, format, ap);
+    if (msg && g_fn.syslog) {
+        g_fn.syslog(priority, "%s", msg);
+    } else {
+        g_fn.vsyslog(priority, format, ap);
+    }
+}
+
+EXPORTON void
+syslog(int priority, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vsyslog(priority, format, ap);
+    va_end(ap);
 }
 
 EXPORTON pid_t
@@ -3560,10 +4014,22 @@ fork()
 
     WRAP_CHECK(fork, -1);
     scopeLog("fork", -1, CFG_LOG_DEBUG);
+
+    cfg_prefork_t prefork = g_prefork;
+    unsigned worker = 0;
+    if (prefork != CFG_PREFORK_OFF) {
+        if (prefork == CFG_PREFORK_FUNNEL) preforkRing();
+        worker = __atomic_add_fetch(&g_workers, 1, __ATOMIC_RELAXED);
+    }
+
     rc = g_fn.fork();
     if (rc == 0) {
         // We are the child proc
-        doReset();
+        if (worker) {
+            doPreforkReset(worker);
+        } else {
+            doReset();
+        }
     }
     
     return rc;
@@ -3983,10 +4449,16 @@ getaddrinfo(const char *node, const char *service,
 void
 scopeLog(const char *msg, int fd, cfg_log_level_t level)
 {
-    cfg_log_level_t cfg_level = logLevel(g_log);
+    // g_log can be replaced by a config change on the periodic thread
+    unsigned pin = epochEnter();
+    log_t *log = g_log;
+    cfg_log_level_t cfg_level = logLevel(log);
 
-    if ((cfg_level == CFG_LOG_NONE) || (cfg_level > level)) return;
-    if (!g_log || !msg || !g_proc.procname[0]) return;
+    if ((cfg_level == CFG_LOG_NONE) || (cfg_level > level) ||
+        !log || !msg || !g_proc.procname[0]) {
+        epochExit(pin);
+        return;
+    }
 
     char buf[strlen(msg) + 128];
     if (fd != -1) {
@@ -3994,5 +4466,6 @@ scopeLog(const char *msg, int fd, cfg_log_level_t level)
     } else {
         snprintf(buf, sizeof(buf), "Scope: %s(pid:%d): %s\n", g_proc.procname, g_proc.pid, msg);
     }
-    logSend(g_log, buf, level);
+    logSend(log, buf, level);
+    epochExit(pin);
 }
@@ -2,6 +2,7 @@
 #include <sys/mman.h>
 #include <asm/prctl.h>
 #include <sys/prctl.h>
+#include <sys/auxv.h>
 #include <signal.h>
 #include <pthread.h>
 
@@ -22,6 +23,16 @@
 #define SWITCH_USE_NO_THREAD "no_thread"
 #define SWITCH_USE_THREAD "thread"
 
+#ifndef HWCAP2_FSGSBASE
+#define HWCAP2_FSGSBASE (1 << 1)
+#endif
+
+// Go 'm' TLS to glibc TCB, in front of g_threadlist.  See threadFsFind().
+#define FS_CACHE_BITS 10
+#define FS_CACHE_SIZE (1 << FS_CACHE_BITS)
+#define FS_CACHE_PROBES 8
+#define FS_CACHE_PENDING 1ULL
+
 #ifdef ENABLE_CAS_IN_SYSEXEC
 #include "atomic.h"
 #else
@@ -41,6 +52,16 @@ atomicCasU64(uint64_t* ptr, uint64_t oldval, uint64_t newval)
 #define patchprint devnull
 
 #define UNDEF_OFFSET (-1)
+
+// Where initGoHook() finds the symbols it looks up; the ones for
+// g_go_tap follow GO_SYM_TAPS in order.
+enum {
+    GO_SYM_BUILD_VERSION,
+    GO_SYM_ASMCGOCALL,
+    GO_SYM_TLS_CONN,
+    GO_SYM_ALLGLEN,
+    GO_SYM_TAPS
+};
 go_offsets_t g_go = {.g_to_m=48,                   // 0x30
                      .m_to_tls=136,                // 0x88
                      .connReader_to_conn=0,        // 0x00
@@ -66,12 +87,20 @@ tap_t g_go_tap[] = {
     {"net/http.persistConnWriter.Write",     go_hook_pc_write,     NULL, 0},
     {"runtime.exit",                         go_hook_exit,         NULL, 0},
     {"runtime.dieFromSignal",                go_hook_die,          NULL, 0},
+    {"runtime.stopTheWorldWithSema",         go_hook_stw_stop,     NULL, 0},
+    {"runtime.startTheWorldWithSema",        go_hook_stw_start,    NULL, 0},
+    {"runtime.gcMarkTermination",            go_hook_gc_done,      NULL, 0},
     {"TAP_TABLE_END", NULL, NULL, 0}
 };
 
 uint64_t g_glibc_guard = 0LL;
 uint64_t g_go_static = 0LL;
 static list_t *g_threadlist;
+static bool g_fsgsbase;
+static struct {
+    uint64_t go_fs;
+    void *thread_fs;
+} g_fs_cache[FS_CACHE_SIZE];
 static void *g_stack;
 static bool g_switch_thread;
 static uint64_t go_tls_conn;
@@ -388,6 +417,10 @@ initGoHook(elf_buf_t *ebuf)
     g_stack = malloc(32 * 1024);
     g_threadlist = lstCreate(NULL);
 
+    // With a 5.9+ kernel on a cpu that has them, switching TCBs is an
+    // instruction rather than an arch_prctl syscall
+    g_fsgsbase = (getauxval(AT_HWCAP2) & HWCAP2_FSGSBASE) ? TRUE : FALSE;
+
     // A go app may need to expand stacks for some C functions
     g_need_stack_expand = TRUE;
 
@@ -421,8 +454,24 @@ initGoHook(elf_buf_t *ebuf)
         g_switch_thread = TRUE;
     }
 
+    // Everything we need from the symbol table, found in one pass over it
+    tap_t* tap = NULL;
+    int ntap = 0;
+    for (tap = g_go_tap; tap->assembly_fn; tap++) ntap++;
+
+    const char *sym_names[GO_SYM_TAPS + ntap];
+    void *sym_addrs[GO_SYM_TAPS + ntap];
+    sym_names[GO_SYM_BUILD_VERSION] = "runtime.buildVersion";
+    sym_names[GO_SYM_ASMCGOCALL] = "runtime.asmcgocall";
+    sym_names[GO_SYM_TLS_CONN] = "go.itab.*crypto/tls.Conn,net.Conn";
+    sym_names[GO_SYM_ALLGLEN] = "runtime.allglen";
+    for (tap = g_go_tap; tap->assembly_fn; tap++) {
+        sym_names[GO_SYM_TAPS + (tap - g_go_tap)] = tap->func_name;
+    }
+    getSymbols(ebuf->buf, sym_names, sym_addrs, GO_SYM_TAPS + ntap);
+
     int go_major_ver = UNKNOWN_GO_VER;
-    if ((go_ver=getSymbol(ebuf->buf, "runtime.buildVersion")) &&
+    if ((go_ver = sym_addrs[GO_SYM_BUILD_VERSION]) &&
         (go_runtime_version = c_str(go_ver))) {
 
         sysprint("go_runtime_version = %s\n", go_runtime_version);
@@ -447,20 +496,21 @@ initGoHook(elf_buf_t *ebuf)
      * are entering the Go func past the runtime stack check?
      * Need to investigate later.
      */
-    if ((go_runtime_cgocall = getSymbol(ebuf->buf, "runtime.asmcgocall")) == 0) {
+    if ((go_runtime_cgocall = sym_addrs[GO_SYM_ASMCGOCALL]) == 0) {
         sysprint("ERROR: can't get the address for runtime.cgocall\n");
         return; // don't install our hooks
     }
 
     // Get the interface type for a tls.Conn (set to 0 if not present)
-    go_tls_conn = (uint64_t)getSymbol(ebuf->buf, "go.itab.*crypto/tls.Conn,net.Conn");
+    go_tls_conn = (uint64_t)sym_addrs[GO_SYM_TLS_CONN];
 
+    // Report gc and goroutines from the periodic thread
+    doGoRuntime((uint64_t *)sym_addrs[GO_SYM_ALLGLEN]);
 
     adjustGoStructOffsetsForVersion(go_major_ver);
 
-    tap_t* tap = NULL;
     for (tap = g_go_tap; tap->assembly_fn; tap++) {
-        void* orig_func = getSymbol(ebuf->buf, tap->func_name);
+        void* orig_func = sym_addrs[GO_SYM_TAPS + (tap - g_go_tap)];
         if (!orig_func) {
             sysprint("ERROR: can't get the address for %s\n", tap->func_name);
             continue;
@@ -539,6 +589,72 @@ dumb_thread(void *arg)
     return NULL;
 }
 
+inline static int
+setFs(unsigned long fs)
+{
+    if (g_fsgsbase) {
+        __asm__ volatile ("wrfsbase %0" : : "r"(fs) : "memory");
+        return 0;
+    }
+    return arch_prctl(ARCH_SET_FS, fs);
+}
+
+inline static int
+getFs(unsigned long *fs)
+{
+    if (g_fsgsbase) {
+        __asm__ volatile ("rdfsbase %0" : "=r"(*fs));
+        return 0;
+    }
+    return arch_prctl(ARCH_GET_FS, (unsigned long)fs);
+}
+
+inline static uint64_t
+fsCacheSlot(unsigned long go_fs)
+{
+    return ((go_fs >> 3) * 0x9E3779B97F4A7C15ULL) >> (64 - FS_CACHE_BITS);
+}
+
+/*
+ * Each 'm' gets its own glibc TCB the first time it calls a hook, and
+ * every hooked call after that needs to find it again.  Rather than walk
+ * g_threadlist each time, they're also put in an insert only hash table.
+ * A slot is claimed with its key marked pending, then filled in, then the
+ * key is published; a reader never sees a key paired with another 'm's
+ * TCB.  Anything that doesn't fit is still found in the list.
+ */
+inline static void *
+threadFsFind(unsigned long go_fs)
+{
+    uint64_t slot = fsCacheSlot(go_fs);
+    int i;
+
+    for (i = 0; i < FS_CACHE_PROBES; i++, slot = (slot + 1) % FS_CACHE_SIZE) {
+        uint64_t key = atomicLoadU64(&g_fs_cache[slot].go_fs);
+        if (key == go_fs) return g_fs_cache[slot].thread_fs;
+        if (!key) break;
+    }
+    return lstFind(g_threadlist, go_fs);
+}
+
+static int
+threadFsInsert(unsigned long go_fs, void *thread_fs)
+{
+    uint64_t slot = fsCacheSlot(go_fs);
+    int i;
+
+    if (lstInsert(g_threadlist, go_fs, thread_fs) == FALSE) return FALSE;
+
+    for (i = 0; i < FS_CACHE_PROBES; i++, slot = (slot + 1) % FS_CACHE_SIZE) {
+        if (atomicCasU64(&g_fs_cache[slot].go_fs, 0ULL, go_fs | FS_CACHE_PENDING)) {
+            g_fs_cache[slot].thread_fs = thread_fs;
+            atomicStoreU64(&g_fs_cache[slot].go_fs, go_fs);
+            break;
+        }
+    }
+    return TRUE;
+}
+
 /*
  * There are 2 go_switch() functions that accomplish the
  * same thing. They take different approaches. We want to 
@@ -589,17 +705,17 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
             // apps do not have a go_g while they're exiting.
             // In this case we need to pull the TLS from the kernel
             scopeLog("go_switch:did not get a 'g'; using fs from the kernel", -1, CFG_LOG_DEBUG);
-            if (arch_prctl(ARCH_GET_FS, (unsigned long) &go_fs) == -1) {
-                scopeLog("arch_prctl get go", -1, CFG_LOG_ERROR);
+            if (getFs(&go_fs) == -1) {
+                scopeLog("getFs go", -1, CFG_LOG_ERROR);
                 goto out;
             }
         }
 
         void *thread_fs = NULL;
-        if ((thread_fs = lstFind(g_threadlist, go_fs)) == NULL) {
+        if ((thread_fs = threadFsFind(go_fs)) == NULL) {
             // Switch to the main thread TCB
-            if (arch_prctl(ARCH_SET_FS, scope_fs) == -1) {
-                scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
+            if (setFs(scope_fs) == -1) {
+                scopeLog("setFs scope", -1, CFG_LOG_ERROR);
                 goto out;
             }
             pthread_t thread;
@@ -619,8 +735,8 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
 
             thread_fs = (void *)thread;
 
-            if (arch_prctl(ARCH_SET_FS, (unsigned long) thread_fs) == -1) {
-                scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
+            if (setFs((unsigned long) thread_fs) == -1) {
+                scopeLog("setFs scope", -1, CFG_LOG_ERROR);
                 goto out;
             }
 
@@ -629,15 +745,15 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
                 goto out;
             }
 
-            if (lstInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
-                scopeLog("lstInsert failed", -1, CFG_LOG_ERROR);
+            if (threadFsInsert(go_fs, thread_fs) == FALSE) {
+                scopeLog("threadFsInsert failed", -1, CFG_LOG_ERROR);
                 goto out;
             }
 
             sysprint("New thread created for GO TLS = 0x%08lx\n", go_fs);
         } else {
-            if (arch_prctl(ARCH_SET_FS, (unsigned long) thread_fs) == -1) {
-                scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
+            if (setFs((unsigned long) thread_fs) == -1) {
+                scopeLog("setFs scope", -1, CFG_LOG_ERROR);
                 goto out;
             }
         }
@@ -658,8 +774,8 @@ go_switch_thread(char *stackptr, void *cfunc, void *gfunc)
 out:
     if (g_go_static && go_fs) {
         // Switch back to the 'm' TLS
-        if (arch_prctl(ARCH_SET_FS, go_fs) == -1) {
-            scopeLog("arch_prctl restore go ", -1, CFG_LOG_ERROR);
+        if (setFs(go_fs) == -1) {
+            scopeLog("setFs restore go", -1, CFG_LOG_ERROR);
         }
     }
     return return_addr(gfunc);
@@ -712,17 +828,17 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
             // apps do not have a go_g while they're exiting. 
             // In this case we need to pull the TLS from the kernel
             scopeLog("go_switch:did not get a 'g'; using fs from the kernel", -1, CFG_LOG_DEBUG);
-            if (arch_prctl(ARCH_GET_FS, (unsigned long) &go_fs) == -1) {
-                scopeLog("arch_prctl get go", -1, CFG_LOG_ERROR);
+            if (getFs(&go_fs) == -1) {
+                scopeLog("getFs go", -1, CFG_LOG_ERROR);
                 goto out;
             }
         }
 
         void *thread_fs = NULL;
-        if ((thread_fs = lstFind(g_threadlist, go_fs)) == NULL) {
+        if ((thread_fs = threadFsFind(go_fs)) == NULL) {
             // Switch to the main thread TCB
-            if (arch_prctl(ARCH_SET_FS, scope_fs) == -1) {
-                scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
+            if (setFs(scope_fs) == -1) {
+                scopeLog("setFs scope", -1, CFG_LOG_ERROR);
                 goto out;
             }
             pthread_t thread;
@@ -734,8 +850,8 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
             newThread = TRUE;            
         } 
 
-        if (arch_prctl(ARCH_SET_FS, (unsigned long) thread_fs) == -1) {
-            scopeLog("arch_prctl set scope", -1, CFG_LOG_ERROR);
+        if (setFs((unsigned long) thread_fs) == -1) {
+            scopeLog("setFs scope", -1, CFG_LOG_ERROR);
             goto out;
         }
 
@@ -768,8 +884,8 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
              
             atomicCasU64(&g_glibc_guard, 1ULL, 0ULL);
 
-            if (lstInsert(g_threadlist, go_fs, thread_fs) == FALSE) {
-                scopeLog("lstInsert failed", -1, CFG_LOG_ERROR);
+            if (threadFsInsert(go_fs, thread_fs) == FALSE) {
+                scopeLog("threadFsInsert failed", -1, CFG_LOG_ERROR);
                 goto out;
             }
         }
@@ -790,8 +906,8 @@ go_switch_no_thread(char *stackptr, void *cfunc, void *gfunc)
 out:
     if (g_go_static && go_fs) {
         // Switch back to the 'm' TLS
-        if (arch_prctl(ARCH_SET_FS, go_fs) == -1) {
-            scopeLog("arch_prctl restore go ", -1, CFG_LOG_ERROR);
+        if (setFs(go_fs) == -1) {
+            scopeLog("setFs restore go", -1, CFG_LOG_ERROR);
         }
     }
     return return_addr(gfunc);
@@ -1222,3 +1338,61 @@ go_die(char *stackptr)
 {
     return go_switch(stackptr, c_exit, go_hook_die);
 }
+
+/*
+  runtime.stopTheWorldWithSema
+  runtime.startTheWorldWithSema
+  /usr/local/go/src/runtime/proc.go
+
+  A stop the world pause, whether for gc or anything else, runs from the
+  return of the first to the return of the second. Only one can be in
+  progress at a time, and these run with every other 'm' stopped; all
+  the handlers do is note the time.
+ */
+static uint64_t g_go_stw_start;
+
+static void
+c_stw_stop(char *stackaddr)
+{
+    g_go_stw_start = getTime();
+}
+
+EXPORTON void *
+go_stw_stop(char *stackptr)
+{
+    return go_switch(stackptr, c_stw_stop, go_hook_stw_stop);
+}
+
+static void
+c_stw_start(char *stackaddr)
+{
+    uint64_t start = g_go_stw_start;
+    if (!start) return;
+
+    g_go_stw_start = 0;
+    doGoPause(getDuration(start));
+}
+
+EXPORTON void *
+go_stw_start(char *stackptr)
+{
+    return go_switch(stackptr, c_stw_start, go_hook_stw_start);
+}
+
+/*
+  runtime.gcMarkTermination
+  /usr/local/go/src/runtime/mgc.go
+
+  Runs once at the end of each gc cycle.
+ */
+static void
+c_gc_done(char *stackaddr)
+{
+    doGoGC();
+}
+
+EXPORTON void *
+go_gc_done(char *stackptr)
+{
+    return go_switch(stackptr, c_gc_done, go_hook_gc_done);
+}
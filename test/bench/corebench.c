@@ -0,0 +1,405 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "circbuf.h"
+#include "dbg.h"
+#include "evtformat.h"
+#include "fn.h"
+#include "httpstate.h"
+#include "linklist.h"
+#include "mtcformat.h"
+#include "plattime.h"
+#include "search.h"
+#include "state_private.h"
+
+//make -f os/linux/Makefile bench
+//test/linux/corebench [filter] > corebench.json
+
+
+/* Microbenchmarks for the structures and formatters on libscope's hot path.
+
+   Each benchmark is an operation that's run a fixed number of times in
+   total, split evenly across 1, 4, 16 and 64 threads that all start at
+   once.  For each thread count it reports:
+
+       ns_per_op      wall clock time per operation, as each thread saw it
+       allocs_per_op  calls to malloc, calloc, realloc and strdup
+       ops_per_sec    operations completed per second, all threads together
+
+   Allocations are counted by wrapping the allocator at link time (see the
+   bench target in os/linux/Makefile), so they include what cJSON and pcre2
+   allocate on our behalf.
+
+   The output is one JSON document on stdout, so runs of different commits
+   can be compared with jq or the like.  A filter argument runs only the
+   benchmarks whose names contain it.
+*/
+
+
+#define WARMUP_OPS 1000
+
+static const int thread_counts[] = {1, 4, 16, 64};
+
+// Allocation counting; per thread, so counting doesn't contend
+static __thread uint64_t t_allocs;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+char *__real_strdup(const char *);
+
+void *__wrap_malloc(size_t size) { t_allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { t_allocs++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t size) { t_allocs++; return __real_realloc(p, size); }
+char *__wrap_strdup(const char *s) { t_allocs++; return __real_strdup(s); }
+
+// What the library gets from wrap.c and friends
+rtconfig g_cfg = {0};
+
+// doHttp() posts what it finds; the periodic thread would free it
+int __real_cmdPostEvent(ctl_t *, char *);
+int
+__wrap_cmdPostEvent(ctl_t *ctl, char *event)
+{
+    protocol_info *proto = (protocol_info *)event;
+    http_post *post = (proto) ? (http_post *)proto->data : NULL;
+    if (post && post->hdr) free(post->hdr);
+    if (post) free(post);
+    if (proto) free(proto);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    uint64_t ops;                     // in total, across all threads
+    void (*setup)(void);
+    void (*op)(int thread, uint64_t i);
+    void (*teardown)(void);
+} bench_t;
+
+typedef struct {
+    const bench_t *bench;
+    int thread;
+    uint64_t ops;
+    uint64_t allocs;
+    pthread_barrier_t *start;
+} worker_t;
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *
+runWorker(void *arg)
+{
+    worker_t *w = arg;
+    uint64_t i;
+
+    pthread_barrier_wait(w->start);
+    uint64_t before = t_allocs;
+    for (i = 0; i < w->ops; i++) w->bench->op(w->thread, i);
+    w->allocs = t_allocs - before;
+    return NULL;
+}
+
+static void
+runBench(const bench_t *b, int first)
+{
+    if (b->setup) b->setup();
+
+    // Fault in pages and fill caches before anything is timed
+    uint64_t i;
+    for (i = 0; i < WARMUP_OPS; i++) b->op(0, i);
+
+    printf("%s    {\"name\": \"%s\", \"results\": [", (first) ? "" : ",\n", b->name);
+
+    int t;
+    for (t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int n = thread_counts[t];
+        worker_t w[n];
+        pthread_t tid[n];
+        pthread_barrier_t start;
+        pthread_barrier_init(&start, NULL, n + 1);
+
+        int j;
+        for (j = 0; j < n; j++) {
+            w[j] = (worker_t){.bench = b, .thread = j, .ops = b->ops / n, .start = &start};
+            pthread_create(&tid[j], NULL, runWorker, &w[j]);
+        }
+
+        pthread_barrier_wait(&start);
+        uint64_t begin = now_ns();
+        for (j = 0; j < n; j++) pthread_join(tid[j], NULL);
+        uint64_t elapsed = now_ns() - begin;
+        pthread_barrier_destroy(&start);
+
+        uint64_t ops = 0, allocs = 0;
+        for (j = 0; j < n; j++) {
+            ops += w[j].ops;
+            allocs += w[j].allocs;
+        }
+
+        printf("%s\n      {\"threads\": %d, \"ops\": %llu, \"ns_per_op\": %.1f, "
+               "\"allocs_per_op\": %.2f, \"ops_per_sec\": %.0f}",
+               (t) ? "," : "", n, (unsigned long long)ops,
+               (double)elapsed * n / ops, (double)allocs / ops,
+               ops / ((double)elapsed / 1e9));
+        fflush(stdout);
+    }
+    printf("\n    ]}");
+
+    if (b->teardown) b->teardown();
+}
+
+
+// cbufPut/cbufGet: each op puts one entry and takes one off a shared cbuf
+static cbuf_handle_t g_cbuf;
+
+static void
+cbufSetup(void)
+{
+    g_cbuf = cbufInit(1024);
+}
+
+static void
+cbufOp(int thread, uint64_t i)
+{
+    uint64_t data;
+    cbufPut(g_cbuf, i);
+    cbufGet(g_cbuf, &data);
+}
+
+static void
+cbufTeardown(void)
+{
+    cbufFree(g_cbuf);
+}
+
+
+// searchExec: find a header near the end of a 1k buffer
+static search_t *g_search;
+static char g_searchbuf[1024];
+
+static void
+searchSetup(void)
+{
+    g_search = searchComp("Content-Length:");
+    memset(g_searchbuf, 'x', sizeof(g_searchbuf));
+    memcpy(&g_searchbuf[sizeof(g_searchbuf) - 32], "Content-Length: 42\r\n", 20);
+}
+
+static void
+searchOp(int thread, uint64_t i)
+{
+    searchExec(g_search, g_searchbuf, sizeof(g_searchbuf));
+}
+
+static void
+searchTeardown(void)
+{
+    searchFree(&g_search);
+}
+
+
+// lstFind on a shared list of 1024 keys.  lstDelete() frees its node right
+// away, so inserts and deletes racing on one list can touch freed memory;
+// lstInsert/lstDelete gets a list of the same size for each thread.
+#define LIST_KEYS 1024
+static list_t *g_list;
+static list_t *g_lists[64];
+
+static void
+lstFill(list_t *list)
+{
+    list_key_t key;
+    for (key = 1; key <= LIST_KEYS; key++) lstInsert(list, key, (void *)key);
+}
+
+static void
+lstSetup(void)
+{
+    g_list = lstCreate(NULL);
+    lstFill(g_list);
+}
+
+static void
+lstFindOp(int thread, uint64_t i)
+{
+    lstFind(g_list, (i % LIST_KEYS) + 1);
+}
+
+static void
+lstTeardown(void)
+{
+    lstDestroy(&g_list);
+}
+
+static void
+lstEachSetup(void)
+{
+    int i;
+    for (i = 0; i < sizeof(g_lists) / sizeof(g_lists[0]); i++) {
+        g_lists[i] = lstCreate(NULL);
+        lstFill(g_lists[i]);
+    }
+}
+
+static void
+lstInsertDeleteOp(int thread, uint64_t i)
+{
+    // Past the last key, so both walk the whole list
+    list_key_t key = LIST_KEYS + 1 + i;
+    lstInsert(g_lists[thread], key, (void *)key);
+    lstDelete(g_lists[thread], key);
+}
+
+static void
+lstEachTeardown(void)
+{
+    int i;
+    for (i = 0; i < sizeof(g_lists) / sizeof(g_lists[0]); i++) {
+        lstDestroy(&g_lists[i]);
+    }
+}
+
+
+// mtcFormatEventForOutput and evtFormatMetric, with a typical fs metric
+static mtc_fmt_t *g_mtcfmt;
+static evt_fmt_t *g_evtfmt;
+static proc_id_t g_benchproc = {.pid = 4848, .ppid = 4847, .hostname = "host",
+                                .procname = "corebench", .cmd = "corebench",
+                                .id = "host-corebench-corebench"};
+
+static event_field_t g_fields[] = {
+    STRFIELD("proc",             "corebench",        4,  TRUE),
+    NUMFIELD("pid",              4848,               4,  TRUE),
+    NUMFIELD("fd",               7,                  7,  TRUE),
+    STRFIELD("host",             "host",             4,  TRUE),
+    STRFIELD("file",             "/var/log/app.log", 5,  TRUE),
+    STRFIELD("op",               "write",            3,  TRUE),
+    STRFIELD("unit",             "byte",             1,  TRUE),
+    FIELDEND
+};
+
+static void
+mtcStatsdSetup(void)
+{
+    g_mtcfmt = mtcFormatCreate(CFG_FMT_STATSD);
+    mtcFormatVerbositySet(g_mtcfmt, CFG_MAX_VERBOSITY);
+}
+
+static void
+mtcNdjsonSetup(void)
+{
+    g_mtcfmt = mtcFormatCreate(CFG_FMT_NDJSON);
+    mtcFormatVerbositySet(g_mtcfmt, CFG_MAX_VERBOSITY);
+}
+
+static void
+mtcOp(int thread, uint64_t i)
+{
+    event_t e = INT_EVENT("fs.write", i, DELTA, g_fields);
+    char *msg = mtcFormatEventForOutput(g_mtcfmt, &e, NULL);
+    free(msg);
+}
+
+static void
+mtcTeardown(void)
+{
+    mtcFormatDestroy(&g_mtcfmt);
+}
+
+static void
+evtSetup(void)
+{
+    g_evtfmt = evtFormatCreate();
+    evtFormatSourceEnabledSet(g_evtfmt, CFG_SRC_METRIC, 1);
+    evtFormatRateLimitSet(g_evtfmt, 0);
+}
+
+static void
+evtOp(int thread, uint64_t i)
+{
+    event_t e = INT_EVENT("fs.write", i, DELTA, g_fields);
+    cJSON *json = evtFormatMetric(g_evtfmt, &e, i, &g_benchproc);
+    cJSON_Delete(json);
+}
+
+static void
+evtTeardown(void)
+{
+    evtFormatDestroy(&g_evtfmt);
+}
+
+
+// doHttp: scan a whole request header, as if from a send() over tls
+static const char g_request[] =
+    "GET /api/v1/items?id=42 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/7.68.0\r\n"
+    "Accept: */*\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static void
+httpOp(int thread, uint64_t i)
+{
+    doHttp(i, 3 + thread, NULL, (char *)g_request, sizeof(g_request) - 1, TLSTX, BUF);
+}
+
+
+// addToInterfaceCounts: all threads on one counter, as with a busy fd
+static counters_element_t g_counter;
+
+static void
+countsOp(int thread, uint64_t i)
+{
+    addToInterfaceCounts(&g_counter, 1);
+}
+
+
+static const bench_t benches[] = {
+    {"cbufPut/cbufGet",                  10000000, cbufSetup,      cbufOp,            cbufTeardown},
+    {"searchExec",                        2000000, searchSetup,    searchOp,          searchTeardown},
+    {"lstFind",                           1000000, lstSetup,       lstFindOp,         lstTeardown},
+    {"lstInsert/lstDelete",                200000, lstEachSetup,   lstInsertDeleteOp, lstEachTeardown},
+    {"mtcFormatEventForOutput/statsd",    1000000, mtcStatsdSetup, mtcOp,             mtcTeardown},
+    {"mtcFormatEventForOutput/ndjson",     500000, mtcNdjsonSetup, mtcOp,             mtcTeardown},
+    {"evtFormatMetric",                    500000, evtSetup,       evtOp,             evtTeardown},
+    {"doHttp",                            1000000, NULL,           httpOp,            NULL},
+    {"addToInterfaceCounts",             10000000, NULL,           countsOp,          NULL},
+};
+
+int
+main(int argc, char *argv[])
+{
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+
+    initTime();
+    initFn();
+    initState();
+
+    printf("{\n  \"version\": \"%s\",\n  \"cpus\": %ld,\n  \"time\": %ld,\n"
+           "  \"benchmarks\": [\n",
+           SCOPE_VER, sysconf(_SC_NPROCESSORS_ONLN), (long)time(NULL));
+
+    int i, first = TRUE;
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (filter && !strstr(benches[i].name, filter)) continue;
+        runBench(&benches[i], first);
+        first = FALSE;
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
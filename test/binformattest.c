@@ -0,0 +1,407 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binformat.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define MAX_FRAMES 32
+
+typedef struct {
+    bin_frame_t type;
+    const unsigned char *body;    // after the type byte
+    size_t len;
+} frame_t;
+
+static uint64_t
+getVarint(const unsigned char **p)
+{
+    uint64_t val = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        val |= (uint64_t)(**p & 0x7f) << shift;
+        shift += 7;
+        (*p)++;
+    }
+    val |= (uint64_t)**p << shift;
+    (*p)++;
+    return val;
+}
+
+static long long
+getSigned(const unsigned char **p)
+{
+    uint64_t val = getVarint(p);
+    return (long long)(val >> 1) ^ -(long long)(val & 1);
+}
+
+static int
+getFrames(bin_msg_t *msg, frame_t *frames)
+{
+    const unsigned char *p = (const unsigned char *)msg->buf.data;
+    const unsigned char *end = p + msg->buf.len;
+    int n = 0;
+    while (p < end && n < MAX_FRAMES) {
+        size_t len = getVarint(&p);
+        frames[n].type = p[0];
+        frames[n].body = p + 1;
+        frames[n].len = len - 1;
+        p += len;
+        n++;
+    }
+    assert_ptr_equal(p, end);
+    return n;
+}
+
+static int
+countFrames(frame_t *frames, int n, bin_frame_t type)
+{
+    int i, count = 0;
+    for (i = 0; i < n; i++) {
+        if (frames[i].type == type) count++;
+    }
+    return count;
+}
+
+static int
+frameHasString(frame_t *f, const char *str)
+{
+    return memmem(f->body, f->len, str, strlen(str)) != NULL;
+}
+
+static void
+binFormatCreateAndDestroy(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    assert_non_null(bin);
+    binFormatDestroy(&bin);
+    assert_null(bin);
+
+    // Don't crash
+    binFormatDestroy(&bin);
+    binFormatDestroy(NULL);
+    binFormatReset(NULL);
+    binMsgFree(NULL);
+    binFormatSent(NULL, NULL, 0);
+}
+
+static void
+binFormatMetricHappyPath(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    event_field_t fields[] = {
+        STRFIELD("proc",             "ps",                  3,  TRUE),
+        NUMFIELD("pid",              -2,                    4,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("A", -300, DELTA, fields);
+
+    bin_msg_t msg;
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+
+    frame_t f[MAX_FRAMES];
+    int n = getFrames(&msg, f);
+
+    // HELLO, then DEFINEs for A, proc, ps, pid, then the METRIC itself
+    assert_int_equal(n, 6);
+    assert_int_equal(f[0].type, BIN_HELLO);
+    const unsigned char *p = f[0].body;
+    assert_int_equal(getVarint(&p), BIN_SCHEMA_VERSION);
+    assert_int_equal(countFrames(f, n, BIN_DEFINE), 4);
+    assert_int_equal(f[5].type, BIN_METRIC);
+
+    // Walk the metric
+    p = f[5].body + sizeof(double);
+    uint64_t name = getVarint(&p);
+    assert_true(name != 0);
+    assert_int_equal(*p++, DELTA);
+    assert_int_equal(*p++, BIN_FLD_INT);
+    assert_int_equal(getSigned(&p), -300);
+    assert_int_equal(*p++, BIN_FLD_STR);
+    assert_true(getVarint(&p) != 0);    // "proc"
+    assert_true(getVarint(&p) != 0);    // "ps" is low cardinality
+    assert_int_equal(*p++, BIN_FLD_INT);
+    assert_true(getVarint(&p) != 0);    // "pid"
+    assert_int_equal(getSigned(&p), -2);
+    assert_int_equal(*p++, BIN_FLD_END);
+    assert_ptr_equal(p, f[5].body + f[5].len);
+
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatDefinitionsAreSentOnce(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    event_field_t fields[] = {
+        STRFIELD("proc",             "ps",                  3,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("A", 1, CURRENT, fields);
+    frame_t f[MAX_FRAMES];
+    bin_msg_t msg;
+
+    // Not sent yet, so the same definitions go out again
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    assert_int_equal(getFrames(&msg, f), 5);
+    binMsgFree(&msg);
+
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    assert_int_equal(getFrames(&msg, f), 5);
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+
+    // Once delivered, only the metric remains
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    assert_int_equal(getFrames(&msg, f), 1);
+    assert_int_equal(f[0].type, BIN_METRIC);
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+
+    // A failed send starts over
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    binFormatSent(bin, &msg, -1);
+    binMsgFree(&msg);
+
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    int n = getFrames(&msg, f);
+    assert_int_equal(n, 5);
+    assert_int_equal(f[0].type, BIN_HELLO);
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+
+    // So does a reset; one that happens before the send completes too
+    binMsgInit(bin, &msg);
+    binFormatReset(bin);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    assert_int_equal(getFrames(&msg, f), 1);
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 4, NULL), 0);
+    assert_int_equal(getFrames(&msg, f), 5);
+    binMsgFree(&msg);
+
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatMetricHonorsVerbosityAndCustomTags(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    event_field_t fields[] = {
+        STRFIELD("low",              "lowvalue",            1,  TRUE),
+        STRFIELD("high",             "highvalue",           9,  TRUE),
+        FIELDEND
+    };
+    event_t e = FLT_EVENT("B", 2.5, HISTOGRAM, fields);
+    custom_tag_t t1 = {"tag", "tagvalue"};
+    custom_tag_t* tags[] = { &t1, NULL };
+
+    bin_msg_t msg;
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 5, tags), 0);
+
+    frame_t f[MAX_FRAMES];
+    int n = getFrames(&msg, f);
+    frame_t *metric = &f[n - 1];
+    assert_int_equal(metric->type, BIN_METRIC);
+
+    int i, low = 0, high = 0, tag = 0;
+    for (i = 0; i < n; i++) {
+        if (f[i].type != BIN_DEFINE) continue;
+        low += frameHasString(&f[i], "lowvalue");
+        high += frameHasString(&f[i], "high");
+        tag += frameHasString(&f[i], "tagvalue");
+    }
+    assert_int_equal(low, 1);
+    assert_int_equal(high, 0);
+    assert_int_equal(tag, 1);
+
+    const unsigned char *p = metric->body + sizeof(double);
+    getVarint(&p);
+    assert_int_equal(*p++, HISTOGRAM);
+    assert_int_equal(*p++, BIN_FLD_FLT);
+    double val;
+    memcpy(&val, p, sizeof(val));
+    assert_true(val == 2.5);
+
+    binMsgFree(&msg);
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatEventSendsProcAndHonorsFilters(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    proc_id_t proc = {.pid = 1234,
+                      .ppid = 1,
+                      .hostname = "earl",
+                      .procname = "formattest",
+                      .cmd = "cmd",
+                      .id = "earl-formattest-cmd"};
+    event_field_t fields[] = {
+        STRFIELD("keep",             "yes",                 3,  TRUE),
+        STRFIELD("unused",           "no",                  3,  FALSE),
+        STRFIELD("filtered",         "no",                  3,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("C", 1, DELTA, fields);
+    regex_t re;
+    assert_int_equal(regcomp(&re, "^k", REG_EXTENDED), 0);
+
+    bin_msg_t msg;
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatEvent(bin, &msg, &e, &re, 1.5, 42, &proc, CFG_SRC_METRIC), 0);
+
+    frame_t f[MAX_FRAMES];
+    int n = getFrames(&msg, f);
+    assert_int_equal(countFrames(f, n, BIN_PROC), 1);
+    assert_int_equal(countFrames(f, n, BIN_EVENT), 1);
+
+    int i;
+    for (i = 0; i < n; i++) {
+        if (f[i].type == BIN_PROC) {
+            assert_true(frameHasString(&f[i], "earl-formattest-cmd"));
+        }
+        assert_false(frameHasString(&f[i], "unused"));
+        assert_false(frameHasString(&f[i], "filtered"));
+    }
+
+    frame_t *evt = &f[n - 1];
+    assert_int_equal(evt->type, BIN_EVENT);
+    double ts;
+    memcpy(&ts, evt->body, sizeof(ts));
+    assert_true(ts == 1.5);
+    const unsigned char *p = evt->body + sizeof(ts);
+    assert_int_equal(*p++, CFG_SRC_METRIC);
+    assert_int_equal(getVarint(&p), 42);
+
+    binFormatSent(bin, &msg, 0);
+    binMsgFree(&msg);
+
+    // The proc frame isn't repeated until the pid changes
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatEvent(bin, &msg, &e, &re, 1.5, 42, &proc, CFG_SRC_METRIC), 0);
+    n = getFrames(&msg, f);
+    assert_int_equal(n, 1);
+    binMsgFree(&msg);
+
+    proc.pid = 4321;
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatEvent(bin, &msg, &e, &re, 1.5, 42, &proc, CFG_SRC_METRIC), 0);
+    n = getFrames(&msg, f);
+    assert_int_equal(countFrames(f, n, BIN_PROC), 1);
+    binMsgFree(&msg);
+
+    regfree(&re);
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatNoticeAndJson(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    proc_id_t proc = {.pid = 1, .hostname = "h", .procname = "p", .cmd = "c", .id = "i"};
+    frame_t f[MAX_FRAMES];
+    bin_msg_t msg;
+
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatNotice(bin, &msg, "notice", "slow down", 2.0, &proc, CFG_SRC_METRIC), 0);
+    assert_int_equal(binFormatJson(bin, &msg, "{\"a\":1}", 7), 0);
+    int n = getFrames(&msg, f);
+
+    // One HELLO for the whole message
+    assert_int_equal(countFrames(f, n, BIN_HELLO), 1);
+    assert_int_equal(f[n - 2].type, BIN_EVENT);
+    assert_true(frameHasString(&f[n - 2], "slow down"));
+    assert_int_equal(f[n - 1].type, BIN_JSON);
+    assert_int_equal(f[n - 1].len, 7);
+    assert_memory_equal(f[n - 1].body, "{\"a\":1}", 7);
+    binMsgFree(&msg);
+
+    // Bad params
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatJson(bin, &msg, NULL, 0), -1);
+    assert_int_equal(binFormatJson(NULL, &msg, "{}", 2), -1);
+    assert_int_equal(binFormatMetric(bin, &msg, NULL, 4, NULL), -1);
+    assert_int_equal(binFormatEvent(bin, &msg, NULL, NULL, 0, 0, &proc, CFG_SRC_METRIC), -1);
+    assert_int_equal(binFormatNotice(bin, &msg, "notice", NULL, 0, &proc, CFG_SRC_METRIC), -1);
+    binMsgFree(&msg);
+
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatLongValuesGrowTheMessage(void** state)
+{
+    bin_fmt_t *bin = binFormatCreate();
+    char big[4 * BIN_MSG_STACK];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    event_field_t fields[] = {
+        STRFIELD("args",             big,                   7,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("D", 1, DELTA, fields);
+
+    bin_msg_t msg;
+    binMsgInit(bin, &msg);
+    assert_int_equal(binFormatMetric(bin, &msg, &e, 9, NULL), 0);
+    assert_true(msg.buf.len > sizeof(big));
+
+    frame_t f[MAX_FRAMES];
+    int n = getFrames(&msg, f);
+    assert_true(frameHasString(&f[n - 1], big));
+    binMsgFree(&msg);
+
+    binFormatDestroy(&bin);
+}
+
+static void
+binFormatMtcFormatCarriesDictionary(void** state)
+{
+    mtc_fmt_t* fmt = mtcFormatCreate(CFG_FMT_BINARY);
+    assert_non_null(fmt);
+    assert_non_null(mtcFormatBin(fmt));
+
+    // Binary isn't a string
+    event_t e = INT_EVENT("E", 1, DELTA, NULL);
+    assert_null(mtcFormatEventForOutput(fmt, &e, NULL));
+    mtcFormatDestroy(&fmt);
+
+    fmt = mtcFormatCreate(CFG_FMT_STATSD);
+    assert_null(mtcFormatBin(fmt));
+    mtcFormatDestroy(&fmt);
+    assert_null(mtcFormatBin(NULL));
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(binFormatCreateAndDestroy),
+        cmocka_unit_test(binFormatMetricHappyPath),
+        cmocka_unit_test(binFormatDefinitionsAreSentOnce),
+        cmocka_unit_test(binFormatMetricHonorsVerbosityAndCustomTags),
+        cmocka_unit_test(binFormatEventSendsProcAndHonorsFilters),
+        cmocka_unit_test(binFormatNoticeAndJson),
+        cmocka_unit_test(binFormatLongValuesGrowTheMessage),
+        cmocka_unit_test(binFormatMtcFormatCarriesDictionary),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -16,9 +16,13 @@ verifyDefaults(config_t* config)
     assert_string_equal    (cfgMtcStatsDPrefix(config), DEFAULT_STATSD_PREFIX);
     assert_int_equal       (cfgMtcStatsDMaxLen(config), DEFAULT_STATSD_MAX_LEN);
     assert_int_equal       (cfgMtcVerbosity(config), DEFAULT_MTC_VERBOSITY);
+    assert_int_equal       (cfgMtcCardinality(config), DEFAULT_MTC_CARDINALITY);
+    assert_int_equal       (cfgMtcAggregate(config), DEFAULT_MTC_AGGREGATE);
+    assert_string_equal    (cfgMtcMode(config), DEFAULT_MTC_MODE);
     assert_int_equal       (cfgMtcPeriod(config), DEFAULT_SUMMARY_PERIOD);
     assert_string_equal    (cfgCmdDir(config), DEFAULT_COMMAND_DIR);
     assert_int_equal       (cfgSendProcessStartMsg(config), DEFAULT_PROCESS_START_MSG);
+    assert_int_equal       (cfgPrefork(config), DEFAULT_PREFORK);
     assert_int_equal       (cfgEvtEnable(config), DEFAULT_EVT_ENABLE);
     assert_int_equal       (cfgEventFormat(config), DEFAULT_CTL_FORMAT);
     assert_int_equal       (cfgEvtRateLimit(config), DEFAULT_MAXEVENTSPERSEC);
@@ -70,11 +74,22 @@ verifyDefaults(config_t* config)
     assert_null            (cfgTransportPort(config, CFG_LOG));
     assert_string_equal    (cfgTransportPath(config, CFG_LOG), "/tmp/scope.log");
     assert_int_equal       (cfgTransportBuf(config, CFG_MTC), CFG_BUFFER_LINE);
+    assert_int_equal       (cfgTransportCompress(config, CFG_CTL), DEFAULT_COMPRESS);
+    assert_int_equal       (cfgTransportCompressBlock(config, CFG_CTL), DEFAULT_COMPRESS_BLOCK);
+    assert_int_equal       (cfgTransportQueueSize(config, CFG_CTL), DEFAULT_QUEUE_SIZE);
+    assert_null            (cfgTransportSpillDir(config, CFG_CTL));
+    assert_int_equal       (cfgTransportSpillSize(config, CFG_CTL), DEFAULT_SPILL_SIZE);
     assert_null            (cfgCustomTags(config));
     assert_null            (cfgCustomTagValue(config, "tagname"));
     assert_int_equal       (cfgLogLevel(config), DEFAULT_LOG_LEVEL);
     assert_int_equal       (cfgPayEnable(config), DEFAULT_PAYLOAD_ENABLE);
     assert_string_equal    (cfgPayDir(config), DEFAULT_PAYLOAD_DIR);
+    assert_int_equal       (cfgPayLimit(config), DEFAULT_PAYLOAD_LIMIT);
+    assert_int_equal       (cfgPayHead(config), DEFAULT_PAYLOAD_HEAD);
+    assert_int_equal       (cfgPayMaxSize(config), DEFAULT_PAYLOAD_MAXSIZE);
+    assert_int_equal       (cfgPayMaxAge(config), DEFAULT_PAYLOAD_MAXAGE);
+    assert_int_equal       (cfgPayMaxTotal(config), DEFAULT_PAYLOAD_MAXTOTAL);
+    assert_int_equal       (cfgPayFormat(config), DEFAULT_PAYLOAD_FORMAT);
 }
 
 static void
@@ -180,6 +195,47 @@ cfgMtcVerbositySetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgMtcCardinalitySetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgMtcCardinalitySet(config, 0);
+    assert_int_equal(cfgMtcCardinality(config), 0);
+    cfgMtcCardinalitySet(config, 100000);
+    assert_int_equal(cfgMtcCardinality(config), 100000);
+    cfgDestroy(&config);
+    assert_int_equal(cfgMtcCardinality(NULL), DEFAULT_MTC_CARDINALITY);
+}
+
+static void
+cfgMtcAggregateSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgMtcAggregateSet(config, CFG_AGG_CONTAINER);
+    assert_int_equal(cfgMtcAggregate(config), CFG_AGG_CONTAINER);
+
+    // Out of range is ignored
+    cfgMtcAggregateSet(config, CFG_AGG_CONTAINER + 1);
+    assert_int_equal(cfgMtcAggregate(config), CFG_AGG_CONTAINER);
+
+    cfgMtcAggregateSet(config, CFG_AGG_PROCESS);
+    assert_int_equal(cfgMtcAggregate(config), CFG_AGG_PROCESS);
+    cfgDestroy(&config);
+    assert_int_equal(cfgMtcAggregate(NULL), DEFAULT_MTC_AGGREGATE);
+}
+
+static void
+cfgMtcModeSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgMtcModeSet(config, "net.rx:fd,fs.read:off");
+    assert_string_equal(cfgMtcMode(config), "net.rx:fd,fs.read:off");
+    cfgMtcModeSet(config, NULL);
+    assert_string_equal(cfgMtcMode(config), DEFAULT_MTC_MODE);
+    cfgDestroy(&config);
+    assert_string_equal(cfgMtcMode(NULL), DEFAULT_MTC_MODE);
+}
+
 static void
 cfgMtcPeriodSetAndGet(void** state)
 {
@@ -219,6 +275,24 @@ cfgSendProcessStartMsgSetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgPreforkSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgPreforkSet(config, CFG_PREFORK_ON);
+    assert_int_equal(cfgPrefork(config), CFG_PREFORK_ON);
+
+    cfgPreforkSet(config, CFG_PREFORK_FUNNEL);
+    assert_int_equal(cfgPrefork(config), CFG_PREFORK_FUNNEL);
+
+    // outside of allowed range; should be ignored.
+    cfgPreforkSet(config, CFG_PREFORK_FUNNEL + 1);
+    assert_int_equal(cfgPrefork(config), CFG_PREFORK_FUNNEL);
+
+    cfgDestroy(&config);
+    assert_int_equal(cfgPrefork(config), DEFAULT_PREFORK);
+}
+
 static void
 cfgEvtEnableSetAndGet(void** state)
 {
@@ -486,6 +560,68 @@ cfgTransportBufSetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgTransportCompressSetAndGet(void** state)
+{
+    which_transport_t t = *(which_transport_t*)state[0];
+    config_t* config = cfgCreateDefault();
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_LZ4);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_LZ4);
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_NONE);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_NONE);
+    cfgTransportCompressBlockSet(config, t, 256 * 1024);
+    assert_int_equal(cfgTransportCompressBlock(config, t), 256 * 1024);
+
+    // Out of range values are ignored
+    cfgTransportCompressSet(config, t, CFG_COMPRESS_LZ4+1);
+    assert_int_equal(cfgTransportCompress(config, t), CFG_COMPRESS_NONE);
+    cfgTransportCompressBlockSet(config, t, 0);
+    cfgTransportCompressBlockSet(config, t, 8 * 1024 * 1024);
+    assert_int_equal(cfgTransportCompressBlock(config, t), 256 * 1024);
+
+    // Don't crash
+    cfgTransportCompressSet(NULL, t, CFG_COMPRESS_LZ4);
+    cfgTransportCompressBlockSet(NULL, t, DEFAULT_COMPRESS_BLOCK);
+    assert_int_equal(cfgTransportCompress(NULL, t), DEFAULT_COMPRESS);
+    assert_int_equal(cfgTransportCompressBlock(NULL, t), DEFAULT_COMPRESS_BLOCK);
+
+    cfgDestroy(&config);
+}
+
+static void
+cfgTransportQueueSetAndGet(void** state)
+{
+    which_transport_t t = *(which_transport_t*)state[0];
+    config_t* config = cfgCreateDefault();
+    cfgTransportQueueSizeSet(config, t, 8 * 1024 * 1024);
+    assert_int_equal(cfgTransportQueueSize(config, t), 8 * 1024 * 1024);
+    cfgTransportSpillDirSet(config, t, "/var/spool/scope");
+    assert_string_equal(cfgTransportSpillDir(config, t), "/var/spool/scope");
+    cfgTransportSpillSizeSet(config, t, 8ULL * 1024 * 1024 * 1024);
+    assert_true(cfgTransportSpillSize(config, t) == 8ULL * 1024 * 1024 * 1024);
+
+    // Out of range values are ignored
+    cfgTransportQueueSizeSet(config, t, 100);
+    cfgTransportQueueSizeSet(config, t, 2U * 1024 * 1024 * 1024);
+    assert_int_equal(cfgTransportQueueSize(config, t), 8 * 1024 * 1024);
+
+    // Zero turns the queue off, and empty the spill file
+    cfgTransportQueueSizeSet(config, t, 0);
+    assert_int_equal(cfgTransportQueueSize(config, t), 0);
+    cfgTransportSpillDirSet(config, t, "");
+    assert_null(cfgTransportSpillDir(config, t));
+
+    // Don't crash
+    cfgTransportQueueSizeSet(NULL, t, DEFAULT_QUEUE_SIZE);
+    cfgTransportSpillDirSet(NULL, t, "/tmp");
+    cfgTransportSpillSizeSet(NULL, t, DEFAULT_SPILL_SIZE);
+    assert_int_equal(cfgTransportQueueSize(NULL, t), DEFAULT_QUEUE_SIZE);
+    assert_null(cfgTransportSpillDir(NULL, t));
+    assert_true(cfgTransportSpillSize(NULL, t) == DEFAULT_SPILL_SIZE);
+
+    cfgDestroy(&config);
+}
+
 
 static void
 cfgCustomTagsSetAndGet(void** state)
@@ -575,6 +711,41 @@ cfgPayDirSetAndGet(void** state)
     cfgDestroy(&config);
 }
 
+static void
+cfgPayLimitsSetAndGet(void** state)
+{
+    config_t* config = cfgCreateDefault();
+    cfgPayLimitSet(config, 64 * 1024);
+    assert_int_equal(cfgPayLimit(config), 64 * 1024);
+    cfgPayHeadSet(config, TRUE);
+    assert_int_equal(cfgPayHead(config), TRUE);
+    cfgPayMaxSizeSet(config, 5000000000ULL);
+    assert_true(cfgPayMaxSize(config) == 5000000000ULL);
+    cfgPayMaxAgeSet(config, 3600);
+    assert_int_equal(cfgPayMaxAge(config), 3600);
+    cfgPayMaxTotalSet(config, 8000000000ULL);
+    assert_true(cfgPayMaxTotal(config) == 8000000000ULL);
+    cfgPayFormatSet(config, CFG_PAYLOAD_PCAPNG);
+    assert_int_equal(cfgPayFormat(config), CFG_PAYLOAD_PCAPNG);
+
+    // 2 is outside of allowed range; should be ignored.
+    cfgPayHeadSet(config, 2);
+    assert_int_equal(cfgPayHead(config), TRUE);
+    cfgPayFormatSet(config, CFG_PAYLOAD_PCAPNG + 1);
+    assert_int_equal(cfgPayFormat(config), CFG_PAYLOAD_PCAPNG);
+
+    cfgPayLimitSet(config, 0);
+    assert_int_equal(cfgPayLimit(config), 0);
+    cfgDestroy(&config);
+
+    assert_int_equal(cfgPayLimit(NULL), DEFAULT_PAYLOAD_LIMIT);
+    assert_int_equal(cfgPayHead(NULL), DEFAULT_PAYLOAD_HEAD);
+    assert_int_equal(cfgPayMaxSize(NULL), DEFAULT_PAYLOAD_MAXSIZE);
+    assert_int_equal(cfgPayMaxAge(NULL), DEFAULT_PAYLOAD_MAXAGE);
+    assert_int_equal(cfgPayMaxTotal(NULL), DEFAULT_PAYLOAD_MAXTOTAL);
+    assert_int_equal(cfgPayFormat(NULL), DEFAULT_PAYLOAD_FORMAT);
+}
+
 
 int
 main(int argc, char* argv[])
@@ -602,9 +773,13 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgMtcStatsDPrefixSetAndGet),
         cmocka_unit_test(cfgMtcStatsDMaxLenSetAndGet),
         cmocka_unit_test(cfgMtcVerbositySetAndGet),
+        cmocka_unit_test(cfgMtcCardinalitySetAndGet),
+        cmocka_unit_test(cfgMtcAggregateSetAndGet),
+        cmocka_unit_test(cfgMtcModeSetAndGet),
         cmocka_unit_test(cfgMtcPeriodSetAndGet),
         cmocka_unit_test(cfgCmdDirSetAndGet),
         cmocka_unit_test(cfgSendProcessStartMsgSetAndGet),
+        cmocka_unit_test(cfgPreforkSetAndGet),
         cmocka_unit_test(cfgEvtEnableSetAndGet),
         cmocka_unit_test(cfgEventFormatSetAndGet),
         cmocka_unit_test(cfgEvtRateLimitSetAndGet),
@@ -644,24 +819,31 @@ main(int argc, char* argv[])
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, mtc_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, mtc_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  mtc_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, mtc_state),
+        cmocka_unit_test_prestate(cfgTransportQueueSetAndGet, mtc_state),
 
         cmocka_unit_test_prestate(cfgTransportTypeSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportHostSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, evt_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  evt_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, evt_state),
+        cmocka_unit_test_prestate(cfgTransportQueueSetAndGet, evt_state),
 
         cmocka_unit_test_prestate(cfgTransportTypeSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportHostSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportPortSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportPathSetAndGet, log_state),
         cmocka_unit_test_prestate(cfgTransportBufSetAndGet,  log_state),
+        cmocka_unit_test_prestate(cfgTransportCompressSetAndGet, log_state),
+        cmocka_unit_test_prestate(cfgTransportQueueSetAndGet, log_state),
 
         cmocka_unit_test(cfgCustomTagsSetAndGet),
         cmocka_unit_test(cfgLoggingSetAndGet),
         cmocka_unit_test(cfgLogLevelSetAndGet),
         cmocka_unit_test(cfgPayEnableSetAndGet),
         cmocka_unit_test(cfgPayDirSetAndGet),
+        cmocka_unit_test(cfgPayLimitsSetAndGet),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
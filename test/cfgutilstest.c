@@ -189,6 +189,10 @@ cfgProcessEnvironmentMtcFormat(void** state)
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgMtcFormat(cfg), CFG_FMT_STATSD);
 
+    assert_int_equal(setenv("SCOPE_METRIC_FORMAT", "binary", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcFormat(cfg), CFG_FMT_BINARY);
+
     assert_int_equal(setenv("SCOPE_METRIC_FORMAT", "ndjson", 1), 0);
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgMtcFormat(cfg), CFG_FMT_NDJSON);
@@ -364,6 +368,37 @@ cfgProcessEnvironmentConfigEvent(void** state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentPrefork(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgPrefork(cfg), CFG_PREFORK_OFF);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_PREFORK", "funnel", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPrefork(cfg), CFG_PREFORK_FUNNEL);
+
+    assert_int_equal(setenv("SCOPE_PREFORK", "on", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPrefork(cfg), CFG_PREFORK_ON);
+
+    // if env is not defined, cfg should not be affected
+    assert_int_equal(unsetenv("SCOPE_PREFORK"), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPrefork(cfg), CFG_PREFORK_ON);
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(setenv("SCOPE_PREFORK", "hi!", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPrefork(cfg), CFG_PREFORK_ON);
+    assert_int_equal(unsetenv("SCOPE_PREFORK"), 0);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
 static void
 cfgProcessEnvironmentEvtEnable(void** state)
 {
@@ -407,6 +442,10 @@ cfgProcessEnvironmentEventFormat(void** state)
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgEventFormat(cfg), CFG_FMT_NDJSON);
 
+    assert_int_equal(setenv("SCOPE_EVENT_FORMAT", "binary", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgEventFormat(cfg), CFG_FMT_BINARY);
+
     assert_int_equal(setenv("SCOPE_EVENT_FORMAT", "statsd", 1), 0);
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgEventFormat(cfg), CFG_FMT_NDJSON);
@@ -426,6 +465,73 @@ cfgProcessEnvironmentEventFormat(void** state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentEventCompression(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgTransportCompress(cfg, CFG_CTL), CFG_COMPRESS_NONE);
+    assert_int_equal(cfgTransportCompressBlock(cfg, CFG_CTL), DEFAULT_COMPRESS_BLOCK);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_EVENT_COMPRESSION", "lz4", 1), 0);
+    assert_int_equal(setenv("SCOPE_EVENT_BLOCKSIZE", "1048576", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportCompress(cfg, CFG_CTL), CFG_COMPRESS_LZ4);
+    assert_int_equal(cfgTransportCompressBlock(cfg, CFG_CTL), 1048576);
+    assert_int_equal(cfgTransportCompress(cfg, CFG_MTC), CFG_COMPRESS_NONE);
+
+    // unrecognised values should not affect cfg
+    assert_int_equal(setenv("SCOPE_EVENT_COMPRESSION", "zip", 1), 0);
+    assert_int_equal(setenv("SCOPE_EVENT_BLOCKSIZE", "64k", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportCompress(cfg, CFG_CTL), CFG_COMPRESS_LZ4);
+    assert_int_equal(cfgTransportCompressBlock(cfg, CFG_CTL), 1048576);
+
+    assert_int_equal(setenv("SCOPE_EVENT_COMPRESSION", "none", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportCompress(cfg, CFG_CTL), CFG_COMPRESS_NONE);
+
+    assert_int_equal(unsetenv("SCOPE_EVENT_COMPRESSION"), 0);
+    assert_int_equal(unsetenv("SCOPE_EVENT_BLOCKSIZE"), 0);
+    cfgDestroy(&cfg);
+}
+
+static void
+cfgProcessEnvironmentMetricQueue(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgTransportQueueSize(cfg, CFG_MTC), DEFAULT_QUEUE_SIZE);
+    assert_null(cfgTransportSpillDir(cfg, CFG_MTC));
+    assert_true(cfgTransportSpillSize(cfg, CFG_MTC) == DEFAULT_SPILL_SIZE);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_QUEUESIZE", "65536", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_SPILLDIR", "/var/spool/scope", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_SPILLSIZE", "1048576", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportQueueSize(cfg, CFG_MTC), 65536);
+    assert_string_equal(cfgTransportSpillDir(cfg, CFG_MTC), "/var/spool/scope");
+    assert_true(cfgTransportSpillSize(cfg, CFG_MTC) == 1048576);
+    assert_int_equal(cfgTransportQueueSize(cfg, CFG_CTL), DEFAULT_QUEUE_SIZE);
+    assert_null(cfgTransportSpillDir(cfg, CFG_CTL));
+
+    // unrecognised values should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_QUEUESIZE", "1m", 1), 0);
+    assert_int_equal(setenv("SCOPE_METRIC_SPILLSIZE", "-", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportQueueSize(cfg, CFG_MTC), 65536);
+    assert_true(cfgTransportSpillSize(cfg, CFG_MTC) == 1048576);
+
+    assert_int_equal(setenv("SCOPE_METRIC_QUEUESIZE", "0", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportQueueSize(cfg, CFG_MTC), 0);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_QUEUESIZE"), 0);
+    assert_int_equal(unsetenv("SCOPE_METRIC_SPILLDIR"), 0);
+    assert_int_equal(unsetenv("SCOPE_METRIC_SPILLSIZE"), 0);
+    cfgDestroy(&cfg);
+}
+
 static void
 cfgProcessEnvironmentMaxEps(void** state)
 {
@@ -562,6 +668,69 @@ cfgProcessEnvironmentMtcVerbosity(void** state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentMtcCardinality(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgMtcCardinality(cfg), DEFAULT_MTC_CARDINALITY);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_CARDINALITY", "0", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcCardinality(cfg), 0);
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_CARDINALITY", "-1x", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcCardinality(cfg), 0);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_CARDINALITY"), 0);
+    cfgDestroy(&cfg);
+}
+
+static void
+cfgProcessEnvironmentMtcAggregate(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_int_equal(cfgMtcAggregate(cfg), CFG_AGG_PROCESS);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_AGGREGATE", "container", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcAggregate(cfg), CFG_AGG_CONTAINER);
+
+    // unrecognised value should not affect cfg
+    assert_int_equal(setenv("SCOPE_METRIC_AGGREGATE", "pod", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcAggregate(cfg), CFG_AGG_CONTAINER);
+
+    assert_int_equal(setenv("SCOPE_METRIC_AGGREGATE", "process", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgMtcAggregate(cfg), CFG_AGG_PROCESS);
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_AGGREGATE"), 0);
+    cfgDestroy(&cfg);
+}
+
+static void
+cfgProcessEnvironmentMtcMode(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_string_equal(cfgMtcMode(cfg), DEFAULT_MTC_MODE);
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_METRIC_MODE", "net.rx:fd,fs.read:summary", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_string_equal(cfgMtcMode(cfg), "net.rx:fd,fs.read:summary");
+
+    assert_int_equal(setenv("SCOPE_METRIC_MODE", "", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_string_equal(cfgMtcMode(cfg), "");
+
+    assert_int_equal(unsetenv("SCOPE_METRIC_MODE"), 0);
+    cfgDestroy(&cfg);
+}
+
 static void
 cfgProcessEnvironmentLogLevel(void** state)
 {
@@ -616,6 +785,10 @@ cfgProcessEnvironmentTransport(void** state)
     // test that our code doesn't modify the env variable directly
     assert_string_equal(getenv(data->env_name), "udp://host:234");
 
+    assert_int_equal(setenv(data->env_name, "syslog://", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgTransportType(cfg, data->transport), CFG_SYSLOG);
+
     assert_int_equal(setenv(data->env_name, "file:///some/path/somewhere", 1), 0);
     cfgProcessEnvironment(cfg);
     assert_int_equal(cfgTransportType(cfg, data->transport), CFG_FILE);
@@ -745,6 +918,57 @@ cfgProcessEnvironmentPayDir(void **state)
     cfgProcessEnvironment(cfg);
 }
 
+static void
+cfgProcessEnvironmentPayLimits(void **state)
+{
+    config_t* cfg = cfgCreateDefault();
+
+    // should override current cfg
+    assert_int_equal(setenv("SCOPE_PAYLOAD_LIMIT", "65536", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_HEAD", "true", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXSIZE", "10485760", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXAGE", "3600", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXTOTAL", "104857600", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_FORMAT", "pcapng", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPayLimit(cfg), 65536);
+    assert_int_equal(cfgPayHead(cfg), TRUE);
+    assert_int_equal(cfgPayMaxSize(cfg), 10485760);
+    assert_int_equal(cfgPayMaxAge(cfg), 3600);
+    assert_int_equal(cfgPayMaxTotal(cfg), 104857600);
+    assert_int_equal(cfgPayFormat(cfg), CFG_PAYLOAD_PCAPNG);
+
+    // unrecognised values should not affect cfg
+    assert_int_equal(setenv("SCOPE_PAYLOAD_LIMIT", "lots", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_HEAD", "blah", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXSIZE", "10MB", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXAGE", "99999999999", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_MAXTOTAL", "-", 1), 0);
+    assert_int_equal(setenv("SCOPE_PAYLOAD_FORMAT", "pcap", 1), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPayLimit(cfg), 65536);
+    assert_int_equal(cfgPayHead(cfg), TRUE);
+    assert_int_equal(cfgPayMaxSize(cfg), 10485760);
+    assert_int_equal(cfgPayMaxAge(cfg), 3600);
+    assert_int_equal(cfgPayMaxTotal(cfg), 104857600);
+    assert_int_equal(cfgPayFormat(cfg), CFG_PAYLOAD_PCAPNG);
+
+    // if env is not defined, cfg should not be affected
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_LIMIT"), 0);
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_HEAD"), 0);
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_MAXSIZE"), 0);
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_MAXAGE"), 0);
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_MAXTOTAL"), 0);
+    assert_int_equal(unsetenv("SCOPE_PAYLOAD_FORMAT"), 0);
+    cfgProcessEnvironment(cfg);
+    assert_int_equal(cfgPayLimit(cfg), 65536);
+    assert_int_equal(cfgPayHead(cfg), TRUE);
+
+    // Just don't crash on null cfg
+    cfgDestroy(&cfg);
+    cfgProcessEnvironment(cfg);
+}
+
 static void
 cfgProcessEnvironmentCmdDebugIsIgnored(void** state)
 {
@@ -1122,6 +1346,11 @@ cfgReadGoodYaml(void** state)
         "    statsdprefix : 'cribl.scope'    # prepends each statsd metric\n"
         "    statsdmaxlen : 1024             # max size of a formatted statsd string\n"
         "    verbosity: 3                    # 0-9 (0 is least verbose, 9 is most)\n"
+        "    cardinality: 500\n"
+        "    aggregate: container\n"
+        "    mode:\n"
+        "      net.rx: fd\n"
+        "      fs.read: off\n"
         "    tags:\n"
         "      name1 : value1\n"
         "      name2 : value2\n"
@@ -1136,6 +1365,11 @@ cfgReadGoodYaml(void** state)
         "    host: 127.0.0.2\n"
         "    port: 9009\n"
         "    buffering: line\n"
+        "    compression: lz4\n"
+        "    blocksize: 262144\n"
+        "    queuesize: 131072\n"
+        "    spilldir: /var/spool/scope\n"
+        "    spillsize: 33554432\n"
         "  format:\n"
         "    type : ndjson                   # ndjson\n"
         "    maxeventpersec : 989898         # max events per second.\n"
@@ -1155,10 +1389,17 @@ cfgReadGoodYaml(void** state)
         "payload:\n"
         "  enable: false\n"
         "  dir: '/my/dir'\n"
+        "  limit: 4096\n"
+        "  head: true\n"
+        "  maxsize: 1048576\n"
+        "  maxage: 600\n"
+        "  maxtotal: 268435456\n"
+        "  format: pcapng\n"
         "libscope:\n"
         "  configevent: true\n"
         "  summaryperiod: 11                 # in seconds\n"
         "  commanddir: /tmp\n"
+        "  prefork: funnel\n"
         "  log:\n"
         "    level: debug                      # debug, info, warning, error, none\n"
         "    transport:\n"
@@ -1174,9 +1415,13 @@ cfgReadGoodYaml(void** state)
     assert_string_equal(cfgMtcStatsDPrefix(config), "cribl.scope.");
     assert_int_equal(cfgMtcStatsDMaxLen(config), 1024);
     assert_int_equal(cfgMtcVerbosity(config), 3);
+    assert_int_equal(cfgMtcCardinality(config), 500);
+    assert_int_equal(cfgMtcAggregate(config), CFG_AGG_CONTAINER);
+    assert_string_equal(cfgMtcMode(config), "net.rx:fd,fs.read:off");
     assert_int_equal(cfgMtcPeriod(config), 11);
     assert_string_equal(cfgCmdDir(config), "/tmp");
     assert_int_equal(cfgSendProcessStartMsg(config), TRUE);
+    assert_int_equal(cfgPrefork(config), CFG_PREFORK_FUNNEL);
     assert_int_equal(cfgEvtEnable(config), TRUE);
     assert_int_equal(cfgEventFormat(config), CFG_FMT_NDJSON);
     assert_int_equal(cfgEvtRateLimit(config), 989898);
@@ -1202,6 +1447,13 @@ cfgReadGoodYaml(void** state)
     assert_string_equal(cfgTransportPort(config, CFG_CTL), "9009");
     assert_null(cfgTransportPath(config, CFG_CTL));
     assert_int_equal(cfgTransportBuf(config, CFG_CTL), CFG_BUFFER_LINE);
+    assert_int_equal(cfgTransportCompress(config, CFG_CTL), CFG_COMPRESS_LZ4);
+    assert_int_equal(cfgTransportCompressBlock(config, CFG_CTL), 262144);
+    assert_int_equal(cfgTransportCompress(config, CFG_MTC), CFG_COMPRESS_NONE);
+    assert_int_equal(cfgTransportQueueSize(config, CFG_CTL), 131072);
+    assert_string_equal(cfgTransportSpillDir(config, CFG_CTL), "/var/spool/scope");
+    assert_true(cfgTransportSpillSize(config, CFG_CTL) == 33554432);
+    assert_null(cfgTransportSpillDir(config, CFG_MTC));
     assert_int_equal(cfgTransportType(config, CFG_LOG), CFG_SYSLOG);
     assert_null(cfgTransportHost(config, CFG_LOG));
     assert_null(cfgTransportPort(config, CFG_LOG));
@@ -1213,6 +1465,12 @@ cfgReadGoodYaml(void** state)
     assert_int_equal(cfgLogLevel(config), CFG_LOG_DEBUG);
     assert_int_equal(cfgPayEnable(config), FALSE);
     assert_string_equal(cfgPayDir(config), "/my/dir");
+    assert_int_equal(cfgPayLimit(config), 4096);
+    assert_int_equal(cfgPayHead(config), TRUE);
+    assert_int_equal(cfgPayMaxSize(config), 1048576);
+    assert_int_equal(cfgPayMaxAge(config), 600);
+    assert_int_equal(cfgPayMaxTotal(config), 268435456);
+    assert_int_equal(cfgPayFormat(config), CFG_PAYLOAD_PCAPNG);
     cfgDestroy(&config);
     deleteFile(path);
 }
@@ -1354,11 +1612,14 @@ const char* jsonText =
     "  },\n"
     "  'payload': {\n"
     "    'enable': 'true',\n"
-    "    'dir': '/the/dir'\n"
+    "    'dir': '/the/dir',\n"
+    "    'maxage': '30',\n"
+    "    'format': 'raw'\n"
     "  },\n"
     "  'libscope': {\n"
     "    'configevent': 'true',\n"
     "    'summaryperiod': '13',\n"
+    "    'prefork': 'on',\n"
     "    'log': {\n"
     "      'level': 'debug',\n"
     "      'transport': {\n"
@@ -1381,6 +1642,7 @@ cfgReadGoodJson(void** state)
     assert_int_equal(cfgMtcStatsDMaxLen(config), 42);
     assert_int_equal(cfgMtcVerbosity(config), 0);
     assert_int_equal(cfgMtcPeriod(config), 13);
+    assert_int_equal(cfgPrefork(config), CFG_PREFORK_ON);
     assert_int_equal(cfgSendProcessStartMsg(config), TRUE);
     assert_int_equal(cfgEvtEnable(config), FALSE);
     assert_int_equal(cfgEventFormat(config), CFG_FMT_NDJSON);
@@ -1414,6 +1676,8 @@ cfgReadGoodJson(void** state)
     assert_int_equal(cfgLogLevel(config), CFG_LOG_DEBUG);
     assert_int_equal(cfgPayEnable(config), TRUE);
     assert_string_equal(cfgPayDir(config), "/the/dir");
+    assert_int_equal(cfgPayMaxAge(config), 30);
+    assert_int_equal(cfgPayFormat(config), CFG_PAYLOAD_RAW);
     cfgDestroy(&config);
     deleteFile(path);
 }
@@ -1788,6 +2052,21 @@ initMtcReturnsPtr(void** state)
     cfgDestroy(&cfg);
 }
 
+static void
+initMtcWithTransportUsesIt(void** state)
+{
+    config_t* cfg = cfgCreateDefault();
+    assert_non_null(cfg);
+
+    // Not the udp transport the config describes
+    mtc_t* mtc = initMtcWithTransport(cfg, transportCreateShm(NULL, CFG_MTC));
+    assert_non_null(mtc);
+    mtcDestroy(&mtc);
+
+    assert_null(initMtcWithTransport(cfg, NULL));
+    cfgDestroy(&cfg);
+}
+
 static void
 initEvtFormatReturnsPtr(void** state)
 {
@@ -1899,8 +2178,11 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgProcessEnvironmentMtcPeriod),
         cmocka_unit_test(cfgProcessEnvironmentCommandDir),
         cmocka_unit_test(cfgProcessEnvironmentConfigEvent),
+        cmocka_unit_test(cfgProcessEnvironmentPrefork),
         cmocka_unit_test(cfgProcessEnvironmentEvtEnable),
         cmocka_unit_test(cfgProcessEnvironmentEventFormat),
+        cmocka_unit_test(cfgProcessEnvironmentEventCompression),
+        cmocka_unit_test(cfgProcessEnvironmentMetricQueue),
         cmocka_unit_test(cfgProcessEnvironmentMaxEps),
         cmocka_unit_test(cfgProcessEnvironmentEnhanceFs),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &log),
@@ -1912,6 +2194,9 @@ main(int argc, char* argv[])
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &fs),
         cmocka_unit_test_prestate(cfgProcessEnvironmentEventSource, &dns),
         cmocka_unit_test(cfgProcessEnvironmentMtcVerbosity),
+        cmocka_unit_test(cfgProcessEnvironmentMtcCardinality),
+        cmocka_unit_test(cfgProcessEnvironmentMtcAggregate),
+        cmocka_unit_test(cfgProcessEnvironmentMtcMode),
         cmocka_unit_test(cfgProcessEnvironmentLogLevel),
         cmocka_unit_test_prestate(cfgProcessEnvironmentTransport, &dest_mtc),
         cmocka_unit_test_prestate(cfgProcessEnvironmentTransport, &dest_evt),
@@ -1919,6 +2204,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(cfgProcessEnvironmentStatsdTags),
         cmocka_unit_test(cfgProcessEnvironmentPayEnable),
         cmocka_unit_test(cfgProcessEnvironmentPayDir),
+        cmocka_unit_test(cfgProcessEnvironmentPayLimits),
         cmocka_unit_test(cfgProcessEnvironmentCmdDebugIsIgnored),
         cmocka_unit_test(cfgProcessCommandsCmdDebugIsProcessed),
         cmocka_unit_test(cfgProcessCommandsFromFile),
@@ -1935,6 +2221,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(jsonObjectFromCfgAndjsonStringFromCfgRoundTrip),
         cmocka_unit_test(initLogReturnsPtr),
         cmocka_unit_test(initMtcReturnsPtr),
+        cmocka_unit_test(initMtcWithTransportUsesIt),
         cmocka_unit_test(initEvtFormatReturnsPtr),
         cmocka_unit_test(initCtlReturnsPtr),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
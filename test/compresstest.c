@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compress.h"
+#include "dbg.h"
+
+#include "test.h"
+
+// Just enough of an lz4 frame decoder to check what compressFrame() makes.
+// Returns the decoded length, or -1 if the frame is malformed.
+static long
+lz4Decode(const unsigned char *src, size_t len, unsigned char *dst, size_t size)
+{
+    const unsigned char *end = src + len;
+    size_t out = 0;
+
+    if (len < 7 || src[0] != 0x04 || src[1] != 0x22 ||
+        src[2] != 0x4D || src[3] != 0x18) return -1;
+    if (src[4] != 0x60) return -1;
+    src += 7;
+
+    while (src + 4 <= end) {
+        uint32_t bsize = src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+        src += 4;
+        if (!bsize) return (src == end) ? out : -1;
+
+        if (bsize & 0x80000000) {
+            bsize &= 0x7FFFFFFF;
+            if (src + bsize > end || out + bsize > size) return -1;
+            memcpy(&dst[out], src, bsize);
+            out += bsize;
+            src += bsize;
+            continue;
+        }
+
+        const unsigned char *bend = src + bsize;
+        if (bend > end) return -1;
+        while (src < bend) {
+            unsigned token = *src++;
+            size_t lit = token >> 4;
+            if (lit == 15) {
+                unsigned char b;
+                do { b = *src++; lit += b; } while (b == 255 && src < bend);
+            }
+            if (src + lit > bend || out + lit > size) return -1;
+            memcpy(&dst[out], src, lit);
+            out += lit;
+            src += lit;
+            if (src == bend) break;   // last sequence
+
+            size_t offset = src[0] | src[1] << 8;
+            src += 2;
+            size_t mlen = (token & 0x0F);
+            if (mlen == 15) {
+                unsigned char b;
+                do { b = *src++; mlen += b; } while (b == 255 && src < bend);
+            }
+            mlen += 4;
+            if (!offset || offset > out || out + mlen > size) return -1;
+            size_t i;
+            for (i = 0; i < mlen; i++, out++) dst[out] = dst[out - offset];
+        }
+    }
+    return -1;
+}
+
+static void
+compressCreateReturnsNullForNone(void** state)
+{
+    assert_null(compressCreate(CFG_COMPRESS_NONE, DEFAULT_COMPRESS_BLOCK));
+    assert_int_equal(compressType(NULL), CFG_COMPRESS_NONE);
+    assert_int_equal(compressBlockSize(NULL), 0);
+    assert_int_equal(compressPending(NULL), 0);
+}
+
+static void
+compressCreateClampsBlockSize(void** state)
+{
+    compress_t *z = compressCreate(CFG_COMPRESS_LZ4, 0);
+    assert_non_null(z);
+    assert_int_equal(compressType(z), CFG_COMPRESS_LZ4);
+    assert_int_equal(compressBlockSize(z), DEFAULT_COMPRESS_BLOCK_MIN);
+    compressDestroy(&z);
+    assert_null(z);
+
+    z = compressCreate(CFG_COMPRESS_LZ4, 64 * 1024 * 1024);
+    assert_non_null(z);
+    assert_int_equal(compressBlockSize(z), LZ4_MAX_BLOCK);
+    compressDestroy(&z);
+
+    // Don't crash
+    compressDestroy(&z);
+    compressDestroy(NULL);
+}
+
+static void
+compressFrameHeaderMatchesBlockSize(void** state)
+{
+    struct {
+        size_t block;
+        unsigned char bd;
+        unsigned char hc;
+    } test[] = {
+        // HC is the second byte of xxh32 over FLG and BD
+        {64 * 1024,         0x40, 0x82},
+        {100 * 1024,        0x50, 0xFB},
+        {1024 * 1024,       0x60, 0x51},
+        {4 * 1024 * 1024,   0x70, 0x73},
+    };
+
+    int i;
+    for (i = 0; i < sizeof(test) / sizeof(test[0]); i++) {
+        compress_t *z = compressCreate(CFG_COMPRESS_LZ4, test[i].block);
+        assert_non_null(z);
+        assert_int_equal(compressWrite(z, "x", 1), 1);
+        const char *frame = NULL;
+        assert_int_equal(compressFrame(z, &frame), 7 + 4 + 1 + 4);
+        assert_int_equal((unsigned char)frame[5], test[i].bd);
+        assert_int_equal((unsigned char)frame[6], test[i].hc);
+        compressDestroy(&z);
+    }
+}
+
+static void
+compressFrameRoundTripsRepetitiveText(void** state)
+{
+    compress_t *z = compressCreate(CFG_COMPRESS_LZ4, DEFAULT_COMPRESS_BLOCK);
+    assert_non_null(z);
+
+    const char *frame = NULL;
+    assert_int_equal(compressFrame(z, &frame), 0);
+
+    char in[16 * 1024];
+    size_t len = 0;
+    int i = 0;
+    while (len < sizeof(in) - 200) {
+        len += snprintf(&in[len], sizeof(in) - len,
+            "{\"sourcetype\":\"net\",\"id\":\"host-proc-cmd\","
+            "\"_time\":%d.%03d,\"data\":{\"net_bytes\":%d}}\n",
+            1600000000 + i, i % 1000, i * 7);
+        i++;
+    }
+    assert_int_equal(compressWrite(z, in, len), len);
+    assert_int_equal(compressPending(z), len);
+
+    size_t flen = compressFrame(z, &frame);
+    assert_int_equal(compressPending(z), 0);
+    // ndjson like this should shrink by far more than half
+    assert_true(flen < len / 4);
+
+    unsigned char out[sizeof(in)];
+    assert_int_equal(lz4Decode((unsigned char *)frame, flen, out, sizeof(out)), len);
+    assert_memory_equal(in, out, len);
+
+    compressDestroy(&z);
+}
+
+static void
+compressFrameStoresIncompressibleDataAsIs(void** state)
+{
+    compress_t *z = compressCreate(CFG_COMPRESS_LZ4, DEFAULT_COMPRESS_BLOCK);
+    assert_non_null(z);
+
+    char in[4096];
+    uint32_t x = 2463534242U;
+    int i;
+    for (i = 0; i < sizeof(in); i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        in[i] = x;
+    }
+    assert_int_equal(compressWrite(z, in, sizeof(in)), sizeof(in));
+
+    const char *frame = NULL;
+    size_t flen = compressFrame(z, &frame);
+    assert_int_equal(flen, 7 + 4 + sizeof(in) + 4);
+    assert_int_equal((unsigned char)frame[10] & 0x80, 0x80);
+
+    unsigned char out[sizeof(in)];
+    assert_int_equal(lz4Decode((unsigned char *)frame, flen, out, sizeof(out)), sizeof(in));
+    assert_memory_equal(in, out, sizeof(in));
+
+    compressDestroy(&z);
+}
+
+static void
+compressWriteStopsAtBlockSize(void** state)
+{
+    compress_t *z = compressCreate(CFG_COMPRESS_LZ4, DEFAULT_COMPRESS_BLOCK_MIN);
+    assert_non_null(z);
+
+    char in[DEFAULT_COMPRESS_BLOCK_MIN + 100];
+    memset(in, 'a', sizeof(in));
+    assert_int_equal(compressWrite(z, in, sizeof(in)), DEFAULT_COMPRESS_BLOCK_MIN);
+    assert_int_equal(compressWrite(z, in, sizeof(in)), 0);
+
+    const char *frame = NULL;
+    size_t flen = compressFrame(z, &frame);
+    unsigned char out[sizeof(in)];
+    assert_int_equal(lz4Decode((unsigned char *)frame, flen, out, sizeof(out)),
+                     DEFAULT_COMPRESS_BLOCK_MIN);
+    assert_memory_equal(in, out, DEFAULT_COMPRESS_BLOCK_MIN);
+
+    assert_int_equal(compressWrite(z, in, 100), 100);
+
+    // Thrown away, not framed
+    compressDiscard(z);
+    assert_int_equal(compressPending(z), 0);
+    assert_int_equal(compressFrame(z, &frame), 0);
+    compressDiscard(NULL);
+    compressDestroy(&z);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(compressCreateReturnsNullForNone),
+        cmocka_unit_test(compressCreateClampsBlockSize),
+        cmocka_unit_test(compressFrameHeaderMatchesBlockSize),
+        cmocka_unit_test(compressFrameRoundTripsRepetitiveText),
+        cmocka_unit_test(compressFrameStoresIncompressibleDataAsIs),
+        cmocka_unit_test(compressWriteStopsAtBlockSize),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include "container.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define DOCKER_ID "4b2a1e6d0c3f8e9a7b5d2c1f0e9d8c7b6a5f4e3d2c1b0a9f8e7d6c5b4a3f2e1d"
+#define POD_UID "1f2e3d4c-5b6a-4789-8a0b-c1d2e3f4a5b6"
+
+static char id[CONTAINER_ID_LEN + 1];
+static char pod[POD_UID_LEN + 1];
+
+static void
+containerParseHandlesBadInput(void **state)
+{
+    assert_false(containerParse(NULL, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, "");
+    assert_string_equal(pod, "");
+
+    assert_false(containerParse("", id, sizeof(id), pod, sizeof(pod)));
+    assert_false(containerParse("garbage", id, sizeof(id), pod, sizeof(pod)));
+    assert_false(containerParse("0::", id, sizeof(id), pod, sizeof(pod)));
+
+    // Don't crash
+    assert_false(containerParse("0::/", NULL, 0, NULL, 0));
+    assert_false(containerParse("0::/", id, 0, pod, 0));
+
+    // Too small to hold an id isn't filled in
+    char small[8] = "x";
+    assert_false(containerParse("0::/docker/" DOCKER_ID, small, sizeof(small),
+                                pod, sizeof(pod)));
+    assert_string_equal(small, "");
+}
+
+static void
+containerParseFindsNothingOutsideContainers(void **state)
+{
+    const char *host =
+        "12:freezer:/\n"
+        "11:pids:/user.slice/user-1000.slice/user@1000.service\n"
+        "1:name=systemd:/user.slice/user-1000.slice/user@1000.service/gnome-launched-emacs.desktop-21457.scope\n"
+        "0::/user.slice/user-1000.slice/user@1000.service/gnome-launched-emacs.desktop-21457.scope\n";
+    assert_false(containerParse(host, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, "");
+    assert_string_equal(pod, "");
+}
+
+static void
+containerParseDockerV1(void **state)
+{
+    const char *cg =
+        "12:freezer:/docker/" DOCKER_ID "\n"
+        "11:pids:/docker/" DOCKER_ID "\n"
+        "1:name=systemd:/docker/" DOCKER_ID "\n";
+    assert_true(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+    assert_string_equal(pod, "");
+}
+
+static void
+containerParseDockerV2Systemd(void **state)
+{
+    const char *cg = "0::/system.slice/docker-" DOCKER_ID ".scope\n";
+    assert_true(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+    assert_string_equal(pod, "");
+}
+
+static void
+containerParseKubernetesCgroupfs(void **state)
+{
+    const char *cg =
+        "11:memory:/kubepods/burstable/pod" POD_UID "/" DOCKER_ID "\n"
+        "1:name=systemd:/kubepods/burstable/pod" POD_UID "/" DOCKER_ID "\n";
+    assert_true(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+    assert_string_equal(pod, POD_UID);
+}
+
+static void
+containerParseKubernetesSystemd(void **state)
+{
+    // The systemd driver has underscores in the pod uid
+    const char *cg =
+        "0::/kubepods.slice/kubepods-besteffort.slice/"
+        "kubepods-besteffort-pod1f2e3d4c_5b6a_4789_8a0b_c1d2e3f4a5b6.slice/"
+        "cri-containerd-" DOCKER_ID ".scope\n";
+    assert_true(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+    assert_string_equal(pod, POD_UID);
+
+    const char *crio =
+        "0::/kubepods.slice/kubepods-pod1f2e3d4c_5b6a_4789_8a0b_c1d2e3f4a5b6.slice/"
+        "crio-" DOCKER_ID ".scope";
+    assert_true(containerParse(crio, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+    assert_string_equal(pod, POD_UID);
+}
+
+static void
+containerParsePrefersV2ButFallsBackToV1(void **state)
+{
+    const char *other = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+
+    // A hybrid host; v2 has it, so v1 isn't used
+    const char *hybrid =
+        "4:pids:/docker/" "%s" "\n"
+        "0::/system.slice/docker-" DOCKER_ID ".scope\n";
+    char cg[512];
+    snprintf(cg, sizeof(cg), hybrid, other);
+    assert_true(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+
+    // With a cgroup namespace, v2 is just "/"
+    const char *ns =
+        "4:pids:/docker/" DOCKER_ID "\n"
+        "0::/\n";
+    assert_true(containerParse(ns, id, sizeof(id), pod, sizeof(pod)));
+    assert_string_equal(id, DOCKER_ID);
+}
+
+static void
+containerParseIgnoresConmonAndShortIds(void **state)
+{
+    const char *cg =
+        "0::/machine.slice/crio-conmon-" DOCKER_ID ".scope\n"
+        "1:name=systemd:/docker/4b2a1e6d0c3f\n"
+        "2:pids:/kubepods/podnotauid/x\n";
+    assert_false(containerParse(cg, id, sizeof(id), pod, sizeof(pod)));
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(containerParseHandlesBadInput),
+        cmocka_unit_test(containerParseFindsNothingOutsideContainers),
+        cmocka_unit_test(containerParseDockerV1),
+        cmocka_unit_test(containerParseDockerV2Systemd),
+        cmocka_unit_test(containerParseKubernetesCgroupfs),
+        cmocka_unit_test(containerParseKubernetesSystemd),
+        cmocka_unit_test(containerParsePrefersV2ButFallsBackToV1),
+        cmocka_unit_test(containerParseIgnoresConmonAndShortIds),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
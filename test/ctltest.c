@@ -600,7 +600,7 @@ ctlSendMsgForNullMessageDoesntCrash(void** state)
 {
     ctl_t* ctl = ctlCreate();
     assert_non_null(ctl);
-    transport_t* t = transportCreateSyslog();
+    transport_t* t = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
     assert_non_null(t);
     ctlTransportSet(ctl, t);
     ctlSendMsg(ctl, NULL);
@@ -615,8 +615,8 @@ ctlTransportSetAndMtcSend(void** state)
     assert_non_null(ctl);
     transport_t* t1 = transportCreateUdp("127.0.0.1", "12345");
     transport_t* t2 = transportCreateUnix("/var/run/scope.sock");
-    transport_t* t3 = transportCreateSyslog();
-    transport_t* t4 = transportCreateShm();
+    transport_t* t3 = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
+    transport_t* t4 = transportCreateShm(NULL, 0);
     transport_t* t5 = transportCreateFile(file_path, CFG_BUFFER_FULLY);
     ctlTransportSet(ctl, t1);
     ctlTransportSet(ctl, t2);
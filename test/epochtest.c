@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epoch.h"
+#include "dbg.h"
+
+#include "test.h"
+
+static int freed = 0;
+
+static void
+countFree(void *obj)
+{
+    freed++;
+    free(obj);
+}
+
+static void
+epochReclaimFreesWhenNoReaders(void **state)
+{
+    freed = 0;
+    assert_int_equal(epochReclaim(), 0);
+
+    epochRetire(malloc(8), countFree);
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(freed, 0);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 2);
+
+    // Don't crash
+    static char buf[8];
+    epochRetire(NULL, countFree);
+    epochRetire(buf, NULL);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 2);
+}
+
+static void
+epochReclaimWaitsForReaders(void **state)
+{
+    freed = 0;
+
+    unsigned pin = epochEnter();
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 1);
+    assert_int_equal(epochReclaim(), 1);
+    assert_int_equal(freed, 0);
+
+    epochExit(pin);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 1);
+}
+
+static void
+epochLaterReadersDontHoldUpReclaim(void **state)
+{
+    freed = 0;
+
+    unsigned old = epochEnter();
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 1);
+
+    // Entered after the flip, so it can't have seen what was retired
+    unsigned later = epochEnter();
+    epochExit(old);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 1);
+
+    // But it holds up what's retired after it entered
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 1);
+    epochExit(later);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 2);
+}
+
+static void
+epochRetiredDuringAGracePeriodWaitsForTheNext(void **state)
+{
+    freed = 0;
+
+    unsigned first = epochEnter();
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 1);
+
+    // Retired while the first is still waiting on a reader
+    unsigned second = epochEnter();
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 2);
+
+    epochExit(first);
+    assert_int_equal(epochReclaim(), 1);
+    assert_int_equal(freed, 1);
+
+    epochExit(second);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 2);
+}
+
+static void
+epochPinsNest(void **state)
+{
+    freed = 0;
+
+    unsigned outer = epochEnter();
+    unsigned inner = epochEnter();
+    epochRetire(malloc(8), countFree);
+    epochExit(inner);
+    assert_int_equal(epochReclaim(), 1);
+    epochExit(outer);
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 1);
+}
+
+static void
+epochResetForgetsReaders(void **state)
+{
+    freed = 0;
+
+    // As if a thread that's gone after a fork was pinned
+    epochEnter();
+    epochRetire(malloc(8), countFree);
+    assert_int_equal(epochReclaim(), 1);
+
+    epochReset();
+    assert_int_equal(epochReclaim(), 0);
+    assert_int_equal(freed, 1);
+}
+
+#define READERS 4
+#define SWAPS 20000
+#define LIVE 0x11223344
+
+typedef struct {
+    int magic;
+} obj_t;
+
+static obj_t *shared = NULL;
+static int done = 0;
+static int bad = 0;
+
+static void
+poisonFree(void *obj)
+{
+    ((obj_t *)obj)->magic = 0;
+    free(obj);
+}
+
+static void *
+reader(void *arg)
+{
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        unsigned pin = epochEnter();
+        obj_t *obj = __atomic_load_n(&shared, __ATOMIC_ACQUIRE);
+        if (obj->magic != LIVE) __atomic_add_fetch(&bad, 1, __ATOMIC_RELAXED);
+        epochExit(pin);
+    }
+    return NULL;
+}
+
+static void
+epochReadersNeverSeeFreedObjects(void **state)
+{
+    pthread_t tid[READERS];
+    int i;
+
+    shared = calloc(1, sizeof(obj_t));
+    shared->magic = LIVE;
+
+    for (i = 0; i < READERS; i++) {
+        assert_int_equal(pthread_create(&tid[i], NULL, reader, NULL), 0);
+    }
+
+    for (i = 0; i < SWAPS; i++) {
+        obj_t *obj = calloc(1, sizeof(obj_t));
+        obj->magic = LIVE;
+        obj_t *old = __atomic_exchange_n(&shared, obj, __ATOMIC_ACQ_REL);
+        epochRetire(old, poisonFree);
+        epochReclaim();
+    }
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < READERS; i++) pthread_join(tid[i], NULL);
+
+    assert_int_equal(bad, 0);
+    assert_int_equal(epochReclaim(), 0);
+    free(shared);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(epochReclaimFreesWhenNoReaders),
+        cmocka_unit_test(epochReclaimWaitsForReaders),
+        cmocka_unit_test(epochLaterReadersDontHoldUpReclaim),
+        cmocka_unit_test(epochRetiredDuringAGracePeriodWaitsForTheNext),
+        cmocka_unit_test(epochPinsNest),
+        cmocka_unit_test(epochResetForgetsReaders),
+        cmocka_unit_test(epochReadersNeverSeeFreedObjects),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
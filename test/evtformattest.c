@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include "dbg.h"
 #include "evtformat.h"
+#include "fn.h"
+#include "plattime.h"
 
 #include "test.h"
 
@@ -75,6 +77,51 @@ evtFormatMetricHappyPath(void** state)
     evtFormatDestroy(&evt);
 }
 
+static void
+evtFormatMetricTimeIsWhenItHappened(void** state)
+{
+    evt_fmt_t* evt = evtFormatCreate();
+    evtFormatSourceEnabledSet(evt, CFG_SRC_METRIC, 1);
+    proc_id_t proc = {.pid = 4848, .ppid = 4847, .hostname = "host",
+                      .procname = "evttest", .cmd = "cmd-4",
+                      .id = "host-evttest-cmd-4"};
+
+    // The TSC rate is measured between two anchors
+    initFn();
+    initTime();
+    if (!g_time.tsc_invariant) skip();
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t tsc0 = getTime();
+    double now0 = ts.tv_sec + ts.tv_nsec / 1e9;
+    usleep(50000);
+    anchorWallTime();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double now = ts.tv_sec + ts.tv_nsec / 1e9;
+    double ticks_per_sec = (getTime() - tsc0) / (now - now0);
+
+    // As if it had been captured 5 seconds before it's formatted
+    event_t e = INT_EVENT("A", 1, DELTA, NULL);
+    e.tsc = getTime() - (uint64_t)(ticks_per_sec * 5);
+
+    cJSON* json = evtFormatMetric(evt, &e, 12345, &proc);
+    assert_non_null(json);
+    double ts_evt = cJSON_GetObjectItem(json, "_time")->valuedouble;
+    assert_true(ts_evt > now - 5.5);
+    assert_true(ts_evt < now - 4.5);
+    cJSON_Delete(json);
+
+    // 0 is now
+    e.tsc = 0;
+    json = evtFormatMetric(evt, &e, 12345, &proc);
+    ts_evt = cJSON_GetObjectItem(json, "_time")->valuedouble;
+    assert_true(ts_evt > now - 0.5);
+    assert_true(ts_evt < now + 0.5);
+    cJSON_Delete(json);
+
+    evtFormatDestroy(&evt);
+}
+
 static void
 evtFormatMetricWithSourceDisabledReturnsNull(void** state)
 {
@@ -406,6 +453,44 @@ evtFormatLogWithAndWithoutMatchingNameFilter(void** state)
     evtFormatDestroy(&evt);
 }
 
+static void
+evtFormatLogTypeClassifiesByNameFilter(void** state)
+{
+    evt_fmt_t* evt = evtFormatCreate();
+    assert_non_null(evt);
+
+    proc_id_t proc = {.pid = 4848,
+                      .ppid = 4847,
+                      .hostname = "host",
+                      .procname = "evttest",
+                      .cmd = "cmd-log",
+                      .id = "host-evttest-cmd-4"};
+
+    // Neither source is enabled by default
+    assert_int_equal(evtFormatLogType(evt, "stdout"), CFG_SRC_MAX);
+    assert_int_equal(evtFormatLogType(evt, "/var/log/something.log"), CFG_SRC_MAX);
+
+    evtFormatSourceEnabledSet(evt, CFG_SRC_CONSOLE, 1);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_FILE, 1);
+    assert_int_equal(evtFormatLogType(evt, "stdout"), CFG_SRC_CONSOLE);
+    assert_int_equal(evtFormatLogType(evt, "/var/log/something.log"), CFG_SRC_FILE);
+    assert_int_equal(evtFormatLogType(evt, "/etc/passwd"), CFG_SRC_MAX);
+    assert_int_equal(evtFormatLogType(NULL, "stdout"), CFG_SRC_MAX);
+    assert_int_equal(evtFormatLogType(evt, NULL), CFG_SRC_MAX);
+
+    // A type worked out earlier doesn't get past a source disabled since
+    cJSON* json = evtFormatLogOfType(evt, CFG_SRC_CONSOLE, "stdout", "hey", 4, 12345, &proc);
+    assert_non_null(json);
+    cJSON_Delete(json);
+    evtFormatSourceEnabledSet(evt, CFG_SRC_CONSOLE, 0);
+    json = evtFormatLogOfType(evt, CFG_SRC_CONSOLE, "stdout", "hey", 4, 12345, &proc);
+    assert_null(json);
+    json = evtFormatLogOfType(evt, CFG_SRC_MAX, "stdout", "hey", 4, 12345, &proc);
+    assert_null(json);
+
+    evtFormatDestroy(&evt);
+}
+
 static void
 evtFormatLogWithAndWithoutMatchingValueFilter(void** state)
 {
@@ -844,6 +929,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(evtFormatCreateReturnsValidPtr),
         cmocka_unit_test(evtFormatDestroyNullMtcDoesntCrash),
         cmocka_unit_test(evtFormatMetricHappyPath),
+        cmocka_unit_test(evtFormatMetricTimeIsWhenItHappened),
         cmocka_unit_test(evtFormatMetricWithSourceDisabledReturnsNull),
         cmocka_unit_test(evtFormatMetricWithAndWithoutMatchingNameFilter),
         cmocka_unit_test(evtFormatMetricWithAndWithoutMatchingFieldFilter),
@@ -852,6 +938,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(evtFormatMetricRateLimitCanBeTurnedOff),
         cmocka_unit_test(evtFormatLogWithSourceDisabledReturnsNull),
         cmocka_unit_test(evtFormatLogWithAndWithoutMatchingNameFilter),
+        cmocka_unit_test(evtFormatLogTypeClassifiesByNameFilter),
         cmocka_unit_test(evtFormatLogWithAndWithoutMatchingValueFilter),
         cmocka_unit_test(fmtEventJsonValue),
         cmocka_unit_test(fmtEventJsonWithEmbeddedNulls),
@@ -65,11 +65,17 @@ declare -i ERR=0
 run_test test/${OS}/cfgutilstest
 run_test test/${OS}/cfgtest
 run_test test/${OS}/transporttest
+run_test test/${OS}/compresstest
+run_test test/${OS}/paybuftest
+run_test test/${OS}/epochtest
+run_test test/${OS}/paystoretest
+run_test test/${OS}/pcapngtest
 run_test test/${OS}/logtest
 run_test test/${OS}/mtctest
 run_test test/${OS}/evtformattest
 run_test test/${OS}/ctltest
 run_test test/${OS}/mtcformattest
+run_test test/${OS}/binformattest
 run_test test/${OS}/circbuftest
 run_test test/${OS}/linklisttest
 run_test test/${OS}/comtest
@@ -83,6 +89,11 @@ if [ "${OS}" = "linux" ]; then
     run_test test/${OS}/httpheadertest
 fi
 run_test test/${OS}/httpaggtest
+run_test test/${OS}/mtcaggtest
+run_test test/${OS}/linebuftest
+run_test test/${OS}/shmringtest
+run_test test/${OS}/containertest
+run_test test/${OS}/sendqtest
 run_test test/${OS}/selfinterposetest
 
 if [ "${OS}" = "linux" ]; then
@@ -227,23 +227,112 @@ javaBciInjectCode(void** state)
 
     int methodIndex = javaFindMethodIndex(classInfo, "print", "(Ljava/lang/String;)V");
 
-    //inject code into "print" method
-    uint8_t code[] = { 0 /*noop*/ };
-    javaInjectCode(classInfo, classInfo->methods[methodIndex], code, sizeof(code));
+    //replace the code of the "print" method
+    uint8_t code[] = { OP_RETURN };
+    javaInjectCode(classInfo, methodIndex, 1, 2, code, sizeof(code));
     
-    unsigned char *dest = malloc(classInfo->length);
+    uint32_t length = classInfo->length;
+    unsigned char *dest = malloc(length);
     javaWriteClass(dest, classInfo);
     javaDestroy(&classInfo);
 
     java_class_t *modClassInfo = javaReadClass(dest);
+    assert_non_null(modClassInfo);
+    assert_int_equal(modClassInfo->length, length);
 
     methodIndex = javaFindMethodIndex(modClassInfo, "print", "(Ljava/lang/String;)V");
     assert_int_equal(methodIndex, 1);
 
+    // The Code attribute holds just the new code; no exception table,
+    // line numbers or stack map frames
+    unsigned char *method = modClassInfo->methods[methodIndex];
+    assert_int_equal(be16toh(*((uint16_t *)(method + 6))), 1);
+    unsigned char *attr = method + 8;
+    char *attrName = javaGetUtf8String(modClassInfo, be16toh(*((uint16_t *)attr)));
+    assert_string_equal(attrName, "Code");
+    free(attrName);
+    assert_int_equal(be32toh(*((uint32_t *)(attr + 2))), 12 + sizeof(code));
+    assert_int_equal(be16toh(*((uint16_t *)(attr + 6))), 1);
+    assert_int_equal(be16toh(*((uint16_t *)(attr + 8))), 2);
+    assert_int_equal(be32toh(*((uint32_t *)(attr + 10))), sizeof(code));
+    assert_int_equal(attr[14], OP_RETURN);
+    assert_int_equal(be16toh(*((uint16_t *)(attr + 15))), 0);
+    assert_int_equal(be16toh(*((uint16_t *)(attr + 17))), 0);
+
+    // The rest of the class is unchanged
+    methodIndex = javaFindMethodIndex(modClassInfo, "main", "([Ljava/lang/String;)V");
+    assert_int_equal(methodIndex, 3);
+
     javaDestroy(&modClassInfo);
     free(dest);
 }
 
+static void
+javaBciFindFieldIndex(void** state)
+{
+    java_class_t *classInfo = javaReadClass(JavaTest_class);
+    assert_non_null(classInfo);
+
+    assert_int_equal(javaFindFieldIndex(classInfo, "field1", "Ljava/lang/String;"), 1);
+    assert_int_equal(javaFindFieldIndex(classInfo, "field1", NULL), 1);
+    assert_int_equal(javaFindFieldIndex(classInfo, "field1", "I"), -1);
+    assert_int_equal(javaFindFieldIndex(classInfo, "longField", NULL), 4);
+    assert_int_equal(javaFindFieldIndex(classInfo, "nothere", NULL), -1);
+
+    javaDestroy(&classInfo);
+}
+
+static void
+javaBciAddFieldRefAndClassTags(void** state)
+{
+    java_class_t *classInfo = javaReadClass(JavaTest_class);
+    assert_non_null(classInfo);
+
+    // An existing class is reused
+    int classIndex = javaFindClassIndex(classInfo, "io/cribl/scope/JavaTest");
+    assert_int_equal(javaAddClassTag(classInfo, "io/cribl/scope/JavaTest"), classIndex);
+
+    uint16_t bufferIdx = javaAddClassTag(classInfo, "java/nio/ByteBuffer");
+    uint16_t fieldNameAndTypeIdx = javaAddNameAndTypeTag(classInfo, "field1", "Ljava/lang/String;");
+    uint16_t fieldRefIdx = javaAddFieldRefTag(classInfo, classIndex, fieldNameAndTypeIdx);
+
+    unsigned char *dest = malloc(classInfo->length);
+    javaWriteClass(dest, classInfo);
+    javaDestroy(&classInfo);
+
+    java_class_t *modClassInfo = javaReadClass(dest);
+    assert_non_null(modClassInfo);
+
+    assert_int_equal(javaFindClassIndex(modClassInfo, "java/nio/ByteBuffer"), bufferIdx);
+    unsigned char *tag = modClassInfo->constant_pool[fieldRefIdx - 1];
+    assert_int_equal(tag[0], CONSTANT_Fieldref);
+    assert_int_equal(be16toh(*((uint16_t *)(tag + 1))), classIndex);
+    assert_int_equal(be16toh(*((uint16_t *)(tag + 3))), fieldNameAndTypeIdx);
+
+    javaDestroy(&modClassInfo);
+    free(dest);
+}
+
+static void
+javaBciFindClassIndexSkipsEmptySlots(void** state)
+{
+    java_class_t *classInfo = javaReadClass(JavaTest_class);
+    assert_non_null(classInfo);
+
+    // JavaTest has a double at #8 and a long at #12; the slot after each is empty
+    assert_int_equal(*classInfo->constant_pool[7], CONSTANT_Double);
+    assert_null(classInfo->constant_pool[8]);
+    assert_int_equal(*classInfo->constant_pool[11], CONSTANT_Long);
+    assert_null(classInfo->constant_pool[12]);
+
+    // Found past the empty slots, and not found after walking all of them
+    assert_true(classInfo->super_class > 13);
+    assert_int_equal(javaFindClassIndex(classInfo, "java/lang/Object"), classInfo->super_class);
+    assert_int_equal(javaFindClassIndex(classInfo, "java/nio/ByteBuffer"), -1);
+
+    javaDestroy(&classInfo);
+}
+
 static void
 javaBciAddStringTag(void** state)
 {
@@ -277,6 +366,9 @@ main(int argc, char* argv[])
         cmocka_unit_test(javaBciAddMethod),
         cmocka_unit_test(javaBciConvertMethodToNative),
         cmocka_unit_test(javaBciInjectCode),
+        cmocka_unit_test(javaBciFindFieldIndex),
+        cmocka_unit_test(javaBciAddFieldRefAndClassTags),
+        cmocka_unit_test(javaBciFindClassIndexSkipsEmptySlots),
         cmocka_unit_test(javaBciAddStringTag),
         cmocka_unit_test(dbgHasNoUnexpectedFailures)
     };
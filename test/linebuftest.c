@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "linebuf.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define MAX_LINES 16
+
+static char lines[MAX_LINES][64];
+static size_t lens[MAX_LINES];
+static int count = 0;
+
+static void
+saveLine(void *arg, const char *line, size_t len)
+{
+    assert_true(count < MAX_LINES);
+    assert_true(len < sizeof(lines[0]));
+    memcpy(lines[count], line, len);
+    lines[count][len] = '\0';
+    lens[count] = len;
+    count++;
+}
+
+static int
+setup(void **state)
+{
+    count = 0;
+    memset(lines, 0, sizeof(lines));
+    return 0;
+}
+
+static void
+linebufCreateReturnsNullForZeroMax(void **state)
+{
+    assert_null(linebufCreate(0));
+
+    linebuf_t *lb = linebufCreate(16);
+    assert_non_null(lb);
+    assert_int_equal(linebufPending(lb), 0);
+    linebufDestroy(&lb);
+    assert_null(lb);
+
+    // Don't crash
+    linebufDestroy(NULL);
+    linebufDestroy(&lb);
+    assert_int_equal(linebufAdd(NULL, "a\n", 2, 0, saveLine, NULL), -1);
+    assert_int_equal(linebufFlush(NULL, 0, saveLine, NULL), 0);
+    assert_int_equal(linebufPending(NULL), 0);
+}
+
+static void
+linebufAddSplitsOnNewlines(void **state)
+{
+    linebuf_t *lb = linebufCreate(32);
+
+    const char *data = "one\ntwo\n\nthree\n";
+    assert_int_equal(linebufAdd(lb, data, strlen(data), 1, saveLine, NULL), 3);
+    assert_int_equal(count, 3);
+    assert_string_equal(lines[0], "one");
+    assert_string_equal(lines[1], "two");
+    assert_string_equal(lines[2], "three");
+    assert_int_equal(linebufPending(lb), 0);
+
+    linebufDestroy(&lb);
+}
+
+static void
+linebufAddJoinsPartialLines(void **state)
+{
+    linebuf_t *lb = linebufCreate(32);
+
+    // A character at a time, as from an unbuffered stderr
+    const char *data = "hello\nwor";
+    int i;
+    for (i = 0; i < strlen(data); i++) {
+        linebufAdd(lb, &data[i], 1, 1, saveLine, NULL);
+    }
+    assert_int_equal(count, 1);
+    assert_string_equal(lines[0], "hello");
+    assert_int_equal(linebufPending(lb), 3);
+
+    assert_int_equal(linebufAdd(lb, "ld\nmore", 7, 2, saveLine, NULL), 1);
+    assert_int_equal(count, 2);
+    assert_string_equal(lines[1], "world");
+    assert_int_equal(linebufPending(lb), 4);
+
+    linebufDestroy(&lb);
+}
+
+static void
+linebufAddCapsLineLength(void **state)
+{
+    linebuf_t *lb = linebufCreate(4);
+
+    const char *data = "abcdefghij\nxy";
+    assert_int_equal(linebufAdd(lb, data, strlen(data), 1, saveLine, NULL), 3);
+    assert_int_equal(count, 3);
+    assert_string_equal(lines[0], "abcd");
+    assert_string_equal(lines[1], "efgh");
+    assert_string_equal(lines[2], "ij");
+    assert_int_equal(linebufPending(lb), 2);
+
+    // A pending partial line is filled up to the cap, then sent
+    assert_int_equal(linebufAdd(lb, "zzzz", 4, 2, saveLine, NULL), 1);
+    assert_int_equal(count, 4);
+    assert_string_equal(lines[3], "xyzz");
+    assert_int_equal(linebufPending(lb), 2);
+
+    linebufDestroy(&lb);
+}
+
+static void
+linebufFlushSendsOnlyOldPartialLines(void **state)
+{
+    linebuf_t *lb = linebufCreate(32);
+
+    assert_int_equal(linebufFlush(lb, 100, saveLine, NULL), 0);
+
+    assert_int_equal(linebufAdd(lb, "partial", 7, 50, saveLine, NULL), 0);
+    assert_int_equal(count, 0);
+
+    // Started at 50; not old enough yet
+    assert_int_equal(linebufFlush(lb, 49, saveLine, NULL), 0);
+    assert_int_equal(count, 0);
+
+    // More data doesn't make it any younger
+    assert_int_equal(linebufAdd(lb, " line", 5, 60, saveLine, NULL), 0);
+    assert_int_equal(linebufFlush(lb, 55, saveLine, NULL), 1);
+    assert_int_equal(count, 1);
+    assert_string_equal(lines[0], "partial line");
+    assert_int_equal(linebufPending(lb), 0);
+
+    // And it's usable afterwards
+    assert_int_equal(linebufAdd(lb, "next\n", 5, 70, saveLine, NULL), 1);
+    assert_string_equal(lines[1], "next");
+
+    linebufDestroy(&lb);
+}
+
+static void
+linebufDestroyDropsPendingData(void **state)
+{
+    linebuf_t *lb = linebufCreate(32);
+    assert_int_equal(linebufAdd(lb, "left over", 9, 1, saveLine, NULL), 0);
+    linebufDestroy(&lb);
+    assert_null(lb);
+    assert_int_equal(count, 0);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(linebufCreateReturnsNullForZeroMax, setup),
+        cmocka_unit_test_setup(linebufAddSplitsOnNewlines, setup),
+        cmocka_unit_test_setup(linebufAddJoinsPartialLines, setup),
+        cmocka_unit_test_setup(linebufAddCapsLineLength, setup),
+        cmocka_unit_test_setup(linebufFlushSendsOnlyOldPartialLines, setup),
+        cmocka_unit_test_setup(linebufDestroyDropsPendingData, setup),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -34,7 +34,7 @@ logSendForNullMessageDoesntCrash(void** state)
 {
     log_t* log = logCreate();
     assert_non_null(log);
-    transport_t* t = transportCreateSyslog();
+    transport_t* t = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
     assert_non_null(t);
     logTransportSet(log, t);
     assert_int_equal(logSend(log, NULL, DEFAULT_LOG_LEVEL), -1);
@@ -68,8 +68,8 @@ logTranportSetAndLogSend(void** state)
     assert_non_null(log);
     transport_t* t1 = transportCreateUdp("127.0.0.1", "12345");
     transport_t* t2 = transportCreateUnix("/var/run/scope.sock");
-    transport_t* t3 = transportCreateSyslog();
-    transport_t* t4 = transportCreateShm();
+    transport_t* t3 = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
+    transport_t* t4 = transportCreateShm(NULL, 0);
     transport_t* t5 = transportCreateFile(file_path, CFG_BUFFER_FULLY);
     logTransportSet(log, t1);
     logTransportSet(log, t2);
@@ -0,0 +1,65 @@
+// Measures the latency scope adds to each request of a Go http server.
+//
+// A server and a keep-alive client run in the same process, and the client
+// times a run of sequential requests.  Build it static, so that hooked
+// calls go through the go_switch() TCB switch, and compare:
+//
+//	CGO_ENABLED=0 go build -o httpbench httpbench.go
+//	./httpbench -n 20000
+//	ldscope ./httpbench -n 20000
+package main
+
+import (
+	"flag"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"net"
+	"net/http"
+	"sort"
+	"time"
+)
+
+func main() {
+	n := flag.Int("n", 10000, "number of requests")
+	size := flag.Int("size", 1024, "bytes in each response")
+	flag.Parse()
+
+	body := make([]byte, *size)
+	ln, err := net.Listen("tcp", "127.0.0.1:0")
+	if err != nil {
+		panic(err)
+	}
+	go http.Serve(ln, http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		w.Write(body)
+	}))
+
+	url := "http://" + ln.Addr().String() + "/"
+	client := &http.Client{Transport: &http.Transport{MaxIdleConnsPerHost: 1}}
+	get := func() {
+		resp, err := client.Get(url)
+		if err != nil {
+			panic(err)
+		}
+		io.Copy(ioutil.Discard, resp.Body)
+		resp.Body.Close()
+	}
+
+	// Warm up the connection, and the per thread state scope sets up
+	for i := 0; i < 100; i++ {
+		get()
+	}
+
+	times := make([]time.Duration, *n)
+	start := time.Now()
+	for i := range times {
+		t := time.Now()
+		get()
+		times[i] = time.Since(t)
+	}
+	total := time.Since(start)
+
+	sort.Slice(times, func(i, j int) bool { return times[i] < times[j] })
+	fmt.Printf("%d requests: mean %v, median %v, p99 %v\n", *n,
+		total/time.Duration(*n), times[*n/2], times[*n*99/100])
+}
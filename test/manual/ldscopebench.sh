@@ -0,0 +1,77 @@
+#! /bin/bash
+
+# Compares ldscope sharing one cached copy of libscope.so (the default,
+# SCOPE_LIB_CACHE_DIR=/dev/shm) with writing a private copy per launch
+# (SCOPE_LIB_CACHE_DIR=).
+#
+#   test/manual/ldscopebench.sh [concurrent processes] [ldscope]
+#
+# For each, it reports the mean latency of launching /bin/true, then starts
+# that many scoped sleeps at once and reports the memory they take: the
+# growth in Shmem (where private copies live) and the sum of their Pss.
+
+COUNT=${1:-1000}
+LDSCOPE=${2:-./bin/linux/ldscope}
+LAUNCHES=200
+SLEEP=30
+
+if [ ! -x "$LDSCOPE" ]; then
+    echo "can't execute $LDSCOPE"
+    exit 1
+fi
+
+# Keep the scoped processes from reporting anywhere
+export SCOPE_METRIC_DEST=file:///dev/null
+export SCOPE_EVENT_DEST=file:///dev/null
+export SCOPE_LOG_DEST=file:///dev/null
+
+shmem_kb() {
+    awk '/^Shmem:/ {print $2}' /proc/meminfo
+}
+
+pss_kb() {
+    local total=0 pid kb
+    for pid in "$@"; do
+        kb=$(awk '/^Pss:/ {print $2}' /proc/$pid/smaps_rollup 2>/dev/null)
+        total=$((total + ${kb:-0}))
+    done
+    echo $total
+}
+
+run() {
+    local label=$1 i pids children start end before after
+
+    export SCOPE_LIB_CACHE_DIR=$2
+    "$LDSCOPE" /bin/true
+
+    start=$(date +%s%N)
+    for ((i = 0; i < LAUNCHES; i++)); do
+        "$LDSCOPE" /bin/true
+    done
+    end=$(date +%s%N)
+    echo "$label: launch latency $(( (end - start) / LAUNCHES / 1000 )) us"
+
+    before=$(shmem_kb)
+    pids=()
+    for ((i = 0; i < COUNT; i++)); do
+        "$LDSCOPE" sleep $SLEEP &
+        pids+=($!)
+    done
+
+    # Wait for every ldscope to have started its sleep
+    children=()
+    while [ ${#children[@]} -lt $COUNT ]; do
+        sleep 1
+        children=($(pgrep -P "$(IFS=,; echo "${pids[*]}")" sleep))
+    done
+    after=$(shmem_kb)
+
+    echo "$label: $COUNT processes, Shmem +$(( (after - before) / 1024 )) MB," \
+         "Pss $(( $(pss_kb "${pids[@]}" "${children[@]}") / 1024 )) MB"
+
+    kill "${children[@]}" 2>/dev/null
+    wait
+}
+
+run "cached " /dev/shm
+run "private" ""
@@ -0,0 +1,618 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+//gcc -g -O2 test/manual/overheadbench.c -lpthread -o overheadbench
+//./overheadbench [seconds] [path to libscope.so] [path to ldscope] [workload]
+//./overheadbench 5 ./lib/linux/libscope.so ./bin/linux/ldscope
+
+
+/* Measures what libscope.so costs a handful of ordinary workloads.
+
+   Each workload runs in a child process that's started once per mode:
+
+       unscoped    without the library
+       metrics     LD_PRELOAD, metrics only
+       events      LD_PRELOAD, metrics plus fs and net events
+       http        LD_PRELOAD, as events plus http events
+       payloads    LD_PRELOAD, as http plus payloads
+       ldscope     started by ldscope, metrics only
+
+   and the workloads are:
+
+       http        an HTTP/1.1 server on loopback, with keep-alive
+                   connections from a load generator in this process
+       udp         a UDP echo server on loopback, driven the same way
+       file        a loop that writes, then reads back, a small file
+       forkexec    a loop that forks and execs /bin/true, and waits
+
+   The load generators run here, without scope, so what they see is only
+   what the library adds to the server.  The file and fork/exec loops time
+   themselves.  For each it reports throughput, p50 and p99 latency, and
+   the cpu (user + sys) the child used per operation, then how far each
+   mode is from unscoped.
+
+   Everything the library would send goes to /dev/null, so the numbers are
+   what it costs to observe, not to deliver.  Payloads go to a temporary
+   directory that's removed at the end.
+*/
+
+
+#define LOAD_THREADS 4
+#define FILE_SIZE 4096
+#define HTTP_REQUEST "GET /index.html HTTP/1.1\r\nHost: localhost\r\n" \
+                     "User-Agent: overheadbench\r\nAccept: */*\r\n\r\n"
+#define HTTP_RESPONSE "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n" \
+                      "Content-Length: 13\r\n\r\nHello, world\n"
+
+extern char **environ;
+
+static const char *metrics_env[] = {
+    "SCOPE_METRIC_ENABLE=true", "SCOPE_EVENT_ENABLE=false", NULL};
+static const char *events_env[] = {
+    "SCOPE_METRIC_ENABLE=true", "SCOPE_EVENT_ENABLE=true",
+    "SCOPE_EVENT_FS=true", "SCOPE_EVENT_NET=true", "SCOPE_EVENT_HTTP=false",
+    "SCOPE_EVENT_MAXEPS=0", NULL};
+static const char *http_env[] = {
+    "SCOPE_METRIC_ENABLE=true", "SCOPE_EVENT_ENABLE=true",
+    "SCOPE_EVENT_FS=true", "SCOPE_EVENT_NET=true", "SCOPE_EVENT_HTTP=true",
+    "SCOPE_EVENT_MAXEPS=0", NULL};
+static const char *payloads_env[] = {
+    "SCOPE_METRIC_ENABLE=true", "SCOPE_EVENT_ENABLE=true",
+    "SCOPE_EVENT_FS=true", "SCOPE_EVENT_NET=true", "SCOPE_EVENT_HTTP=true",
+    "SCOPE_EVENT_MAXEPS=0", "SCOPE_PAYLOAD_ENABLE=true", NULL};
+
+typedef struct {
+    const char *name;
+    int preload;
+    int ldscope;
+    const char **env;
+} run_mode_t;
+
+static const run_mode_t modes[] = {
+    {"unscoped", 0, 0, NULL},
+    {"metrics",  1, 0, metrics_env},
+    {"events",   1, 0, events_env},
+    {"http",     1, 0, http_env},
+    {"payloads", 1, 0, payloads_env},
+    {"ldscope",  0, 1, metrics_env},
+};
+
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+typedef struct {
+    long long *t;
+    size_t n;
+    size_t cap;
+} samples_t;
+
+typedef struct {
+    double ops_per_sec;
+    double p50_us;
+    double p99_us;
+    double cpu_us_per_op;
+    int ok;
+} result_t;
+
+static long long
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+sampleAdd(samples_t *s, long long t)
+{
+    if (s->n == s->cap) {
+        size_t cap = (s->cap) ? s->cap * 2 : 4096;
+        long long *t = realloc(s->t, cap * sizeof(*t));
+        if (!t) return;
+        s->t = t;
+        s->cap = cap;
+    }
+    s->t[s->n++] = t;
+}
+
+static int
+cmpll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+percentiles(samples_t *s, long long *p50, long long *p99)
+{
+    *p50 = *p99 = 0;
+    if (!s->n) return;
+    qsort(s->t, s->n, sizeof(*s->t), cmpll);
+    *p50 = s->t[s->n / 2];
+    *p99 = s->t[(s->n * 99) / 100];
+}
+
+static int
+writeAll(int fd, const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t rc = write(fd, buf, len);
+        if (rc == -1 && errno == EINTR) continue;
+        if (rc <= 0) return -1;
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+
+/*
+ * The child side.  Servers tell the parent their port, then serve until
+ * stdin is closed.  Loops run for the time they're given and tell the
+ * parent how it went.
+ */
+
+static void *
+exitOnEof(void *arg)
+{
+    char c;
+    while (read(STDIN_FILENO, &c, 1) > 0);
+    exit(0);
+}
+
+static int
+listenOn(int type)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+
+    int sd = socket(AF_INET, type, 0);
+    if (sd == -1 ||
+        bind(sd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        (type == SOCK_STREAM && listen(sd, 128)) ||
+        getsockname(sd, (struct sockaddr *)&addr, &len)) {
+        perror("listenOn");
+        exit(1);
+    }
+
+    printf("port %d\n", ntohs(addr.sin_port));
+    fflush(stdout);
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, exitOnEof, NULL);
+    return sd;
+}
+
+static void *
+serveHttpConnection(void *arg)
+{
+    int sd = (int)(long)arg;
+    char buf[4096];
+    size_t have = 0;
+
+    for (;;) {
+        ssize_t rc = read(sd, &buf[have], sizeof(buf) - have - 1);
+        if (rc <= 0) break;
+        have += rc;
+        buf[have] = '\0';
+
+        // One response for each complete request header
+        char *end;
+        while ((end = strstr(buf, "\r\n\r\n"))) {
+            if (writeAll(sd, HTTP_RESPONSE, sizeof(HTTP_RESPONSE) - 1)) goto out;
+            end += 4;
+            have -= end - buf;
+            memmove(buf, end, have + 1);
+        }
+        if (have == sizeof(buf) - 1) break;
+    }
+out:
+    close(sd);
+    return NULL;
+}
+
+static void
+serveHttp(void)
+{
+    int sd = listenOn(SOCK_STREAM);
+    for (;;) {
+        int cd = accept(sd, NULL, NULL);
+        if (cd == -1) continue;
+        pthread_t tid;
+        pthread_create(&tid, NULL, serveHttpConnection, (void *)(long)cd);
+        pthread_detach(tid);
+    }
+}
+
+static void
+serveUdp(void)
+{
+    int sd = listenOn(SOCK_DGRAM);
+    char buf[2048];
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t rc = recvfrom(sd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+        if (rc < 0) continue;
+        sendto(sd, buf, rc, 0, (struct sockaddr *)&from, len);
+    }
+}
+
+static void
+reportLoop(samples_t *s, long long elapsed)
+{
+    long long p50, p99;
+    size_t ops = s->n;
+    percentiles(s, &p50, &p99);
+    printf("result %zu %lld %lld %lld\n", ops, elapsed, p50, p99);
+    fflush(stdout);
+}
+
+static void
+fileLoop(int seconds, const char *dir)
+{
+    char path[4096], buf[FILE_SIZE];
+    samples_t s = {0};
+    snprintf(path, sizeof(path), "%s/file.%d", dir, getpid());
+    memset(buf, 'f', sizeof(buf));
+
+    long long start = now_ns(), stop = start + seconds * 1000000000LL, t;
+    while ((t = now_ns()) < stop) {
+        int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd == -1 || writeAll(fd, buf, sizeof(buf))) exit(1);
+        close(fd);
+        fd = open(path, O_RDONLY);
+        if (fd == -1 || read(fd, buf, sizeof(buf)) != sizeof(buf)) exit(1);
+        close(fd);
+        sampleAdd(&s, now_ns() - t);
+    }
+
+    unlink(path);
+    reportLoop(&s, now_ns() - start);
+}
+
+static void
+forkExecLoop(int seconds)
+{
+    char *argv[] = {"/bin/true", NULL};
+    samples_t s = {0};
+
+    long long start = now_ns(), stop = start + seconds * 1000000000LL, t;
+    while ((t = now_ns()) < stop) {
+        pid_t pid = fork();
+        if (pid == -1) exit(1);
+        if (pid == 0) {
+            execve(argv[0], argv, environ);
+            _exit(127);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) == -1) exit(1);
+        sampleAdd(&s, now_ns() - t);
+    }
+
+    reportLoop(&s, now_ns() - start);
+}
+
+static int
+runWorkload(const char *workload, int seconds, const char *dir)
+{
+    if (!strcmp(workload, "http")) serveHttp();
+    if (!strcmp(workload, "udp")) serveUdp();
+    if (!strcmp(workload, "file")) fileLoop(seconds, dir);
+    if (!strcmp(workload, "forkexec")) forkExecLoop(seconds);
+    return 0;
+}
+
+
+/*
+ * The parent side: load generators, and starting and stopping the child
+ * under each mode.
+ */
+
+typedef struct {
+    const char *workload;
+    int port;
+    long long stop;
+    samples_t s;
+    int errors;
+} load_t;
+
+static int
+connectTo(int type, int port)
+{
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int sd = socket(AF_INET, type, 0);
+    if (sd == -1) return -1;
+    if (connect(sd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(sd);
+        return -1;
+    }
+    if (type == SOCK_STREAM) {
+        int on = 1;
+        setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    } else {
+        struct timeval tv = {.tv_sec = 1};
+        setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    return sd;
+}
+
+static void *
+generateLoad(void *arg)
+{
+    load_t *load = arg;
+    int http = !strcmp(load->workload, "http");
+    int sd = connectTo((http) ? SOCK_STREAM : SOCK_DGRAM, load->port);
+    char buf[4096];
+    long long t;
+
+    if (sd == -1) {
+        load->errors++;
+        return NULL;
+    }
+
+    while ((t = now_ns()) < load->stop) {
+        if (http) {
+            if (writeAll(sd, HTTP_REQUEST, sizeof(HTTP_REQUEST) - 1)) break;
+            size_t have = 0;
+            while (have < sizeof(HTTP_RESPONSE) - 1) {
+                ssize_t rc = read(sd, &buf[have], sizeof(buf) - have);
+                if (rc <= 0) goto out;
+                have += rc;
+            }
+        } else {
+            memset(buf, 'u', 64);
+            if (send(sd, buf, 64, 0) != 64) break;
+            if (recv(sd, buf, sizeof(buf), 0) != 64) {
+                load->errors++;
+                continue;
+            }
+        }
+        sampleAdd(&load->s, now_ns() - t);
+    }
+out:
+    close(sd);
+    return NULL;
+}
+
+static char **
+buildEnv(const run_mode_t *mode, const char *lib, const char *dir)
+{
+    static char conf_path[4200], payload_dir[4200];
+    int n, extra = 8;
+    for (n = 0; environ[n]; n++);
+    if (mode->env) {
+        const char **e;
+        for (e = mode->env; *e; e++) extra++;
+    }
+
+    char **env = calloc(n + extra, sizeof(char *));
+    if (!env) return NULL;
+
+    // Nothing of the caller's scope settings leaks in
+    int i, j = 0;
+    for (i = 0; i < n; i++) {
+        if (strncmp(environ[i], "LD_PRELOAD=", 11) &&
+            strncmp(environ[i], "SCOPE_", 6)) env[j++] = environ[i];
+    }
+    if (!mode->env) return env;
+
+    if (mode->preload && asprintf(&env[j++], "LD_PRELOAD=%s", lib) == -1) return NULL;
+    snprintf(conf_path, sizeof(conf_path), "SCOPE_CONF_PATH=%s/scope.yml", dir);
+    env[j++] = conf_path;
+    env[j++] = "SCOPE_METRIC_DEST=file:///dev/null";
+    env[j++] = "SCOPE_EVENT_DEST=file:///dev/null";
+    env[j++] = "SCOPE_LOG_DEST=file:///dev/null";
+    snprintf(payload_dir, sizeof(payload_dir), "SCOPE_PAYLOAD_DIR=%s", dir);
+    env[j++] = payload_dir;
+    const char **e;
+    for (e = mode->env; *e; e++) env[j++] = (char *)*e;
+    return env;
+}
+
+static void
+runMode(const run_mode_t *mode, const char *workload, int seconds,
+        const char *self, const char *lib, const char *ldscope,
+        const char *dir, result_t *res)
+{
+    int in[2], out[2];
+    char secs[16];
+    memset(res, 0, sizeof(*res));
+    snprintf(secs, sizeof(secs), "%d", seconds);
+
+    char *argv[] = {(char *)ldscope, (char *)self, "--workload", (char *)workload,
+                    secs, (char *)dir, NULL};
+    char **cmd = (mode->ldscope) ? argv : &argv[1];
+    char **env = buildEnv(mode, lib, dir);
+    if (!env || pipe(in) || pipe(out)) {
+        perror("runMode");
+        exit(1);
+    }
+
+    long long begin = now_ns();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        execve(cmd[0], cmd, env);
+        perror("execve");
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    FILE *from = fdopen(out[0], "r");
+
+    char line[256];
+    size_t ops = 0;
+    long long elapsed = 0, p50 = 0, p99 = 0;
+    int port;
+    while (fgets(line, sizeof(line), from)) {
+        if (sscanf(line, "port %d", &port) == 1) {
+            load_t load[LOAD_THREADS];
+            pthread_t tid[LOAD_THREADS];
+            samples_t all = {0};
+            int i, errors = 0;
+            long long start = now_ns();
+            for (i = 0; i < LOAD_THREADS; i++) {
+                load[i] = (load_t){.workload = workload, .port = port,
+                                   .stop = start + seconds * 1000000000LL};
+                pthread_create(&tid[i], NULL, generateLoad, &load[i]);
+            }
+            for (i = 0; i < LOAD_THREADS; i++) {
+                pthread_join(tid[i], NULL);
+                size_t k;
+                for (k = 0; k < load[i].s.n; k++) sampleAdd(&all, load[i].s.t[k]);
+                free(load[i].s.t);
+                errors += load[i].errors;
+            }
+            elapsed = now_ns() - start;
+            ops = all.n;
+            percentiles(&all, &p50, &p99);
+            free(all.t);
+            if (errors) fprintf(stderr, "%s/%s: %d errors\n", workload, mode->name, errors);
+            break;
+        }
+        if (sscanf(line, "result %zu %lld %lld %lld", &ops, &elapsed, &p50, &p99) == 4) break;
+    }
+
+    // Closing its stdin tells a server to exit
+    close(in[1]);
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) == -1 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) || !ops || !elapsed) {
+        fprintf(stderr, "%s/%s: failed after %.1f s\n", workload, mode->name,
+                (now_ns() - begin) / 1e9);
+        fclose(from);
+        return;
+    }
+    fclose(from);
+
+    double cpu_us = ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec +
+                    ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+    res->ops_per_sec = ops / (elapsed / 1e9);
+    res->p50_us = p50 / 1000.0;
+    res->p99_us = p99 / 1000.0;
+    res->cpu_us_per_op = cpu_us / ops;
+    res->ok = 1;
+}
+
+static double
+delta(double val, double base)
+{
+    return (base) ? (val - base) * 100.0 / base : 0.0;
+}
+
+static void
+report(const char *workload, result_t *res)
+{
+    printf("%s\n", workload);
+    printf("  %-10s %12s %10s %10s %12s %9s %9s %9s %9s\n", "mode", "ops/s",
+           "p50 us", "p99 us", "cpu us/op", "ops/s", "p50", "p99", "cpu");
+    int m;
+    for (m = 0; m < NUM_MODES; m++) {
+        if (!res[m].ok) {
+            printf("  %-10s %12s\n", modes[m].name, "failed");
+            continue;
+        }
+        printf("  %-10s %12.0f %10.1f %10.1f %12.2f", modes[m].name,
+               res[m].ops_per_sec, res[m].p50_us, res[m].p99_us, res[m].cpu_us_per_op);
+        if (m && res[0].ok) {
+            printf(" %+8.1f%% %+8.1f%% %+8.1f%% %+8.1f%%",
+                   delta(res[m].ops_per_sec, res[0].ops_per_sec),
+                   delta(res[m].p50_us, res[0].p50_us),
+                   delta(res[m].p99_us, res[0].p99_us),
+                   delta(res[m].cpu_us_per_op, res[0].cpu_us_per_op));
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc == 5 && !strcmp(argv[1], "--workload")) {
+        return runWorkload(argv[2], atoi(argv[3]), argv[4]);
+    }
+
+    int seconds = (argc > 1) ? atoi(argv[1]) : 5;
+    char *lib = (argc > 2) ? argv[2] : "./lib/linux/libscope.so";
+    char *ldscope = (argc > 3) ? argv[3] : "./bin/linux/ldscope";
+    char *only = (argc > 4) ? argv[4] : NULL;
+    const char *workloads[] = {"http", "udp", "file", "forkexec"};
+
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [seconds] [libscope.so] [ldscope] [workload]\n", argv[0]);
+        return 1;
+    }
+    if (access(lib, R_OK) || access(ldscope, X_OK)) {
+        fprintf(stderr, "%s: can't use %s or %s\n", argv[0], lib, ldscope);
+        return 1;
+    }
+
+    char self[4096], dir[] = "/tmp/overheadbench.XXXXXX";
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len <= 0 || !mkdtemp(dir)) {
+        fprintf(stderr, "%s: can't set up\n", argv[0]);
+        return 1;
+    }
+    self[len] = '\0';
+
+    // So that no scope.yml lying around changes the modes
+    char conf[4200];
+    snprintf(conf, sizeof(conf), "%s/scope.yml", dir);
+    FILE *f = fopen(conf, "w");
+    if (!f || fputs("metric:\n  enable: true\n", f) == EOF || fclose(f)) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], conf);
+        return 1;
+    }
+
+    // The child may not run where we do
+    char libpath[4096];
+    if (!realpath(lib, libpath)) strncpy(libpath, lib, sizeof(libpath) - 1);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%d s per run, %d load threads, deltas are from unscoped\n\n",
+           seconds, LOAD_THREADS);
+
+    int w;
+    for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        if (only && strcmp(only, workloads[w])) continue;
+        result_t res[NUM_MODES];
+        int m;
+        for (m = 0; m < NUM_MODES; m++) {
+            runMode(&modes[m], workloads[w], seconds, self, libpath, ldscope, dir, &res[m]);
+        }
+        report(workloads[w], res);
+    }
+
+    char rm[4200];
+    snprintf(rm, sizeof(rm), "rm -rf %s", dir);
+    if (system(rm)) fprintf(stderr, "%s: can't remove %s\n", argv[0], dir);
+    return 0;
+}
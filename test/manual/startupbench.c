@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+//gcc -g -O2 test/manual/startupbench.c -o startupbench
+//./startupbench [iterations] [path to libscope.so] [command...]
+//./startupbench 1000 ./lib/linux/libscope.so /bin/true
+
+
+/* Measures what libscope.so adds to the start up of short lived processes.
+
+   The same command is spawned (and waited for) over and over, first
+   without and then with LD_PRELOAD of the library.  The mean and median
+   wall clock time from spawn to exit of each are reported, along with the
+   difference between the two.  This is the cost a build system, or a
+   shell script, pays for every command it runs under scope.
+
+   Alternating runs of each keeps cpu frequency changes and the like from
+   favoring one over the other.  The first few runs are thrown away so the
+   page cache is warm for both.
+*/
+
+
+#define WARMUP 10
+
+extern char **environ;
+
+static char **
+buildEnv(const char *preload)
+{
+    int n;
+    for (n = 0; environ[n]; n++);
+
+    char **env = calloc(n + 2, sizeof(char *));
+    if (!env) return NULL;
+
+    int i, j = 0;
+    for (i = 0; i < n; i++) {
+        if (strncmp(environ[i], "LD_PRELOAD=", 11)) env[j++] = environ[i];
+    }
+    if (preload && asprintf(&env[j++], "LD_PRELOAD=%s", preload) == -1) {
+        free(env);
+        return NULL;
+    }
+    return env;
+}
+
+static long long
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long
+spawnOnce(char **argv, char **env)
+{
+    pid_t pid;
+    int status;
+    long long start = now_ns();
+
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, env)) {
+        perror("posix_spawn");
+        exit(1);
+    }
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        exit(1);
+    }
+    return now_ns() - start;
+}
+
+static int
+cmpll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+report(const char *name, long long *t, int n, double *mean_us)
+{
+    long long sum = 0;
+    int i;
+    for (i = 0; i < n; i++) sum += t[i];
+    qsort(t, n, sizeof(*t), cmpll);
+
+    *mean_us = sum / (double)n / 1000.0;
+    printf("%-12s mean %9.1f us  median %9.1f us  p90 %9.1f us\n",
+           name, *mean_us, t[n / 2] / 1000.0, t[(n * 9) / 10] / 1000.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+    char *lib = (argc > 2) ? argv[2] : "./lib/linux/libscope.so";
+    char *deflt[] = {"/bin/true", NULL};
+    char **cmd = (argc > 3) ? &argv[3] : deflt;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations] [libscope.so] [command...]\n", argv[0]);
+        return 1;
+    }
+    if (access(lib, R_OK)) {
+        fprintf(stderr, "%s: can't read %s\n", argv[0], lib);
+        return 1;
+    }
+
+    char **plain = buildEnv(NULL);
+    char **scoped = buildEnv(lib);
+    long long *t_plain = calloc(iterations, sizeof(long long));
+    long long *t_scoped = calloc(iterations, sizeof(long long));
+    if (!plain || !scoped || !t_plain || !t_scoped) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    int i;
+    for (i = 0; i < WARMUP; i++) {
+        spawnOnce(cmd, plain);
+        spawnOnce(cmd, scoped);
+    }
+    for (i = 0; i < iterations; i++) {
+        t_plain[i] = spawnOnce(cmd, plain);
+        t_scoped[i] = spawnOnce(cmd, scoped);
+    }
+
+    printf("%s, %d iterations\n", cmd[0], iterations);
+    double mean_plain, mean_scoped;
+    report("unscoped", t_plain, iterations, &mean_plain);
+    report("scoped", t_scoped, iterations, &mean_scoped);
+    printf("overhead     mean %9.1f us  (%.1fx)\n",
+           mean_scoped - mean_plain, mean_scoped / mean_plain);
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mtcagg.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define MAX_SEEN 16
+
+typedef struct {
+    int count;
+    char name[MAX_SEEN][64];
+    value_t vtype[MAX_SEEN];
+    long long integer[MAX_SEEN];
+    double floating[MAX_SEEN];
+    int nfields[MAX_SEEN];
+} seen_t;
+
+static void
+record(void *arg, event_t *evt)
+{
+    seen_t *seen = arg;
+    if (seen->count >= MAX_SEEN) return;
+
+    int i = seen->count++;
+    strncpy(seen->name[i], evt->name, sizeof(seen->name[i]) - 1);
+    seen->vtype[i] = evt->value.type;
+    seen->integer[i] = evt->value.integer;
+    seen->floating[i] = evt->value.floating;
+
+    event_field_t *f;
+    for (f = evt->fields; f && f->value_type != FMT_END; f++) seen->nfields[i]++;
+}
+
+static void
+mtcAggCreateReturnsValidPtr(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+    assert_non_null(agg);
+    assert_int_equal(mtcAggEntries(agg), 0);
+    assert_int_equal(mtcAggFolded(agg), 0);
+    mtcAggDestroy(&agg);
+    assert_null(agg);
+
+    // Zero means off
+    assert_null(mtcAggCreate(0));
+}
+
+static void
+mtcAggNullDoesNotCrash(void **state)
+{
+    mtc_agg_t *agg = NULL;
+    mtcAggDestroy(&agg);
+    mtcAggDestroy(NULL);
+    assert_int_equal(mtcAggEntries(NULL), 0);
+    assert_int_equal(mtcAggFolded(NULL), 0);
+    assert_int_equal(mtcAggFlush(NULL, record, NULL), 0);
+
+    event_t e = INT_EVENT("A", 1, DELTA, NULL);
+    assert_int_equal(mtcAggAdd(NULL, &e, 4), -1);
+
+    agg = mtcAggCreate(10);
+    assert_int_equal(mtcAggAdd(agg, NULL, 4), -1);
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggSumsCountersWithTheSameTags(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+    seen_t seen = {0};
+
+    event_field_t fields[] = {
+        STRFIELD("proc", "ps", 3, TRUE),
+        NUMFIELD("pid", 2, 4, TRUE),
+        FIELDEND
+    };
+    event_t e1 = INT_EVENT("net.tx", 100, DELTA, fields);
+    event_t e2 = INT_EVENT("net.tx", 20, DELTA, fields);
+    event_t e3 = FLT_EVENT("net.tx", 0.5, DELTA, fields);
+    assert_int_equal(mtcAggAdd(agg, &e1, 4), 0);
+    assert_int_equal(mtcAggAdd(agg, &e2, 4), 0);
+    assert_int_equal(mtcAggEntries(agg), 1);
+    assert_int_equal(mtcAggAdd(agg, &e3, 4), 0);
+    assert_int_equal(mtcAggEntries(agg), 1);
+
+    assert_int_equal(mtcAggFlush(agg, record, &seen), 1);
+    assert_int_equal(seen.count, 1);
+    assert_string_equal(seen.name[0], "net.tx");
+    assert_int_equal(seen.vtype[0], FMT_FLT);
+    assert_true(seen.floating[0] == 120.5);
+    assert_int_equal(seen.nfields[0], 2);
+
+    // Flushing empties it
+    assert_int_equal(mtcAggEntries(agg), 0);
+    assert_int_equal(mtcAggFlush(agg, record, &seen), 0);
+    assert_int_equal(seen.count, 1);
+
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggKeepsTheLastGauge(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+    seen_t seen = {0};
+
+    event_t e1 = INT_EVENT("fs.open", 7, CURRENT, NULL);
+    event_t e2 = INT_EVENT("fs.open", 3, CURRENT, NULL);
+    // Same name, different type; kept apart
+    event_t e3 = INT_EVENT("fs.open", 5, DELTA, NULL);
+    assert_int_equal(mtcAggAdd(agg, &e1, 4), 0);
+    assert_int_equal(mtcAggAdd(agg, &e2, 4), 0);
+    assert_int_equal(mtcAggAdd(agg, &e3, 4), 0);
+    assert_int_equal(mtcAggEntries(agg), 2);
+
+    assert_int_equal(mtcAggFlush(agg, record, &seen), 2);
+    int i, gauge = 0, counter = 0;
+    for (i = 0; i < seen.count; i++) {
+        if (seen.integer[i] == 3) gauge++;
+        if (seen.integer[i] == 5) counter++;
+    }
+    assert_int_equal(gauge, 1);
+    assert_int_equal(counter, 1);
+
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggPassesSamplesThrough(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+
+    event_t timer = INT_EVENT("net.dns.duration", 12, DELTA_MS, NULL);
+    event_t hist = INT_EVENT("fs.seek", 1, HISTOGRAM, NULL);
+    event_t set = INT_EVENT("proc.fd", 3, SET, NULL);
+    assert_int_equal(mtcAggAdd(agg, &timer, 4), -1);
+    assert_int_equal(mtcAggAdd(agg, &hist, 4), -1);
+    assert_int_equal(mtcAggAdd(agg, &set, 4), -1);
+    assert_int_equal(mtcAggEntries(agg), 0);
+
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggVerbosityMergesTagSets(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+    seen_t seen = {0};
+
+    event_field_t fd3[] = {
+        STRFIELD("proc", "ps", 3, TRUE),
+        NUMFIELD("fd", 3, 7, TRUE),
+        FIELDEND
+    };
+    event_field_t fd4[] = {
+        STRFIELD("proc", "ps", 3, TRUE),
+        NUMFIELD("fd", 4, 7, TRUE),
+        FIELDEND
+    };
+    event_t e1 = INT_EVENT("fs.read", 10, DELTA, fd3);
+    event_t e2 = INT_EVENT("fs.read", 15, DELTA, fd4);
+
+    // fd is let through at 9, so these are kept apart
+    assert_int_equal(mtcAggAdd(agg, &e1, 9), 0);
+    assert_int_equal(mtcAggAdd(agg, &e2, 9), 0);
+    assert_int_equal(mtcAggEntries(agg), 2);
+    assert_int_equal(mtcAggFlush(agg, NULL, NULL), 2);
+
+    // but not at 5, so they're combined
+    assert_int_equal(mtcAggAdd(agg, &e1, 5), 0);
+    assert_int_equal(mtcAggAdd(agg, &e2, 5), 0);
+    assert_int_equal(mtcAggEntries(agg), 1);
+    assert_int_equal(mtcAggFlush(agg, record, &seen), 1);
+    assert_int_equal(seen.integer[0], 25);
+    assert_int_equal(seen.nfields[0], 1);
+
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggFoldsPastTheCap(void **state)
+{
+    // One per shard; room for 8 tag sets in all
+    mtc_agg_t *agg = mtcAggCreate(8);
+
+    int i, folded = 0;
+    for (i = 0; i < 200; i++) {
+        event_field_t fields[] = {
+            STRFIELD("proc", "ps", 3, TRUE),
+            NUMFIELD("fd", i, 7, TRUE),
+            FIELDEND
+        };
+        event_t e = INT_EVENT("fs.read", 1, DELTA, fields);
+        assert_int_equal(mtcAggAdd(agg, &e, 9), 0);
+    }
+    folded = mtcAggFolded(agg);
+    assert_true(folded > 0);
+    assert_true(folded <= 200 - 1);
+
+    // The full tag sets that fit, plus at most one folded entry per shard
+    unsigned entries = mtcAggEntries(agg);
+    assert_true(entries <= 8 + 8);
+
+    seen_t seen = {0};
+    assert_int_equal(mtcAggFlush(agg, record, &seen), entries);
+    long long total = 0;
+    for (i = 0; i < seen.count; i++) {
+        assert_string_equal(seen.name[i], "fs.read");
+        total += seen.integer[i];
+    }
+    assert_int_equal(total, 200);
+
+    mtcAggDestroy(&agg);
+}
+
+static void
+mtcAggTooLongKeyIsPassedThrough(void **state)
+{
+    mtc_agg_t *agg = mtcAggCreate(10);
+
+    char big[2048];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    event_field_t fields[] = {
+        STRFIELD("path", big, 3, TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("fs.read", 1, DELTA, fields);
+    assert_int_equal(mtcAggAdd(agg, &e, 9), -1);
+    assert_int_equal(mtcAggEntries(agg), 0);
+
+    mtcAggDestroy(&agg);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(mtcAggCreateReturnsValidPtr),
+        cmocka_unit_test(mtcAggNullDoesNotCrash),
+        cmocka_unit_test(mtcAggSumsCountersWithTheSameTags),
+        cmocka_unit_test(mtcAggKeepsTheLastGauge),
+        cmocka_unit_test(mtcAggPassesSamplesThrough),
+        cmocka_unit_test(mtcAggVerbosityMergesTagSets),
+        cmocka_unit_test(mtcAggFoldsPastTheCap),
+        cmocka_unit_test(mtcAggTooLongKeyIsPassedThrough),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -346,6 +346,102 @@ mtcFormatEventForOutputWithCustomAndStatsdFields(void** state)
     mtcFormatDestroy(&fmt);
 }
 
+static void
+mtcFormatEventForOutputCachedFieldsTrackChanges(void** state)
+{
+    mtc_fmt_t* fmt = mtcFormatCreate(CFG_FMT_STATSD);
+    assert_non_null(fmt);
+    mtcFormatVerbositySet(fmt, CFG_MAX_VERBOSITY);
+
+    custom_tag_t t1 = {"tag", "value"};
+    custom_tag_t* tags[] = { &t1, NULL };
+    mtcFormatCustomTagsSet(fmt, tags);
+
+    char host[16] = "host1";
+    event_field_t fields[] = {
+        STRFIELD("proc",   "test",  4,  TRUE),
+        NUMFIELD("pid",    1234,    4,  TRUE),
+        STRFIELD("host",   host,    4,  TRUE),
+        NUMFIELD("fd",     3,       7,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("fs.read", 3, DELTA, fields);
+
+    // The same output whether or not the leading fields come from the cache
+    int i;
+    for (i=0; i<3; i++) {
+        char* msg = mtcFormatEventForOutput(fmt, &e, NULL);
+        assert_non_null(msg);
+        assert_string_equal(msg, "fs.read:3|c|#tag:value,proc:test,pid:1234,host:host1,fd:3\n");
+        free(msg);
+    }
+
+    // Same pointer, new contents
+    strcpy(host, "host2");
+    char* msg = mtcFormatEventForOutput(fmt, &e, NULL);
+    assert_non_null(msg);
+    assert_string_equal(msg, "fs.read:3|c|#tag:value,proc:test,pid:1234,host:host2,fd:3\n");
+    free(msg);
+
+    // Verbosity changes are honored for the cached fields too
+    mtcFormatVerbositySet(fmt, 3);
+    msg = mtcFormatEventForOutput(fmt, &e, NULL);
+    assert_non_null(msg);
+    assert_string_equal(msg, "fs.read:3|c|#tag:value\n");
+    free(msg);
+
+    // As are custom tag changes
+    custom_tag_t t2 = {"other", "thing"};
+    custom_tag_t* tags2[] = { &t2, &t1, NULL };
+    mtcFormatCustomTagsSet(fmt, tags2);
+    msg = mtcFormatEventForOutput(fmt, &e, NULL);
+    assert_non_null(msg);
+    assert_string_equal(msg, "fs.read:3|c|#other:thing,tag:value\n");
+    free(msg);
+
+    // Fewer fields than are cached
+    mtcFormatCustomTagsSet(fmt, NULL);
+    mtcFormatVerbositySet(fmt, CFG_MAX_VERBOSITY);
+    event_field_t few[] = {
+        STRFIELD("proc",   "test",  4,  TRUE),
+        FIELDEND
+    };
+    event_t e2 = INT_EVENT("fs.read", 3, DELTA, few);
+    msg = mtcFormatEventForOutput(fmt, &e2, NULL);
+    assert_non_null(msg);
+    assert_string_equal(msg, "fs.read:3|c|#proc:test\n");
+    free(msg);
+
+    mtcFormatDestroy(&fmt);
+}
+
+static void
+mtcFormatEventIntoBufferHonorsFormatAndSize(void** state)
+{
+    event_field_t fields[] = {
+        STRFIELD("proc",   "test",  2,  TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("fs.read", 3, CURRENT, fields);
+
+    mtc_fmt_t* fmt = mtcFormatCreate(CFG_FMT_STATSD);
+    char buf[mtcFormatStatsDMaxLen(fmt) + 1];
+    assert_int_equal(mtcFormatEventIntoBuffer(fmt, &e, NULL, buf, sizeof(buf)),
+                     strlen("fs.read:3|g|#proc:test\n"));
+    assert_string_equal(buf, "fs.read:3|g|#proc:test\n");
+
+    // Too small a buffer, or bad args
+    assert_int_equal(mtcFormatEventIntoBuffer(fmt, &e, NULL, buf, sizeof(buf)-1), -1);
+    assert_int_equal(mtcFormatEventIntoBuffer(fmt, NULL, NULL, buf, sizeof(buf)), -1);
+    assert_int_equal(mtcFormatEventIntoBuffer(NULL, &e, NULL, buf, sizeof(buf)), -1);
+    mtcFormatDestroy(&fmt);
+
+    // Only statsd is supported
+    fmt = mtcFormatCreate(CFG_FMT_NDJSON);
+    assert_int_equal(mtcFormatEventIntoBuffer(fmt, &e, NULL, buf, sizeof(buf)), -1);
+    mtcFormatDestroy(&fmt);
+}
+
 static void
 mtcFormatEventForOutputReturnsNullIfSpaceIsInsufficient(void** state)
 {
@@ -633,6 +729,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(mtcFormatEventForOutputHappyPathFilteredFields),
         cmocka_unit_test(mtcFormatEventForOutputWithCustomFields),
         cmocka_unit_test(mtcFormatEventForOutputWithCustomAndStatsdFields),
+        cmocka_unit_test(mtcFormatEventForOutputCachedFieldsTrackChanges),
+        cmocka_unit_test(mtcFormatEventIntoBufferHonorsFormatAndSize),
         cmocka_unit_test(mtcFormatEventForOutputReturnsNullIfSpaceIsInsufficient),
         cmocka_unit_test(mtcFormatEventForOutputReturnsNullIfSpaceIsInsufficientMax),
         cmocka_unit_test(mtcFormatEventForOutputVerifyEachStatsDType),
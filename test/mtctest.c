@@ -51,7 +51,7 @@ mtcSendForNullMessageDoesntCrash(void** state)
 {
     mtc_t* mtc = mtcCreate();
     assert_non_null(mtc);
-    transport_t* t = transportCreateSyslog();
+    transport_t* t = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
     assert_non_null(t);
     mtcTransportSet(mtc, t);
     assert_int_equal(mtcSend(mtc, NULL), -1);
@@ -66,8 +66,8 @@ mtcTransportSetAndMtcSend(void** state)
     assert_non_null(mtc);
     transport_t* t1 = transportCreateUdp("127.0.0.1", "12345");
     transport_t* t2 = transportCreateUnix("/var/run/scope.sock");
-    transport_t* t3 = transportCreateSyslog();
-    transport_t* t4 = transportCreateShm();
+    transport_t* t3 = transportCreateSyslog(DEFAULT_SYSLOG_PATH);
+    transport_t* t4 = transportCreateShm(NULL, 0);
     transport_t* t5 = transportCreateFile(file_path, CFG_BUFFER_FULLY);
     mtcTransportSet(mtc, t1);
     mtcTransportSet(mtc, t2);
@@ -121,6 +121,111 @@ mtcFormatSetAndMtcSendEvent(void** state)
     mtcDestroy(&mtc);
 }
 
+static void
+mtcSendMetricPastTheDefaultMaxLen(void** state)
+{
+    const char* file_path = "/tmp/my.path";
+    unlink(file_path);
+    mtc_t* mtc = mtcCreate();
+    assert_non_null(mtc);
+    mtcTransportSet(mtc, transportCreateFile(file_path, CFG_BUFFER_LINE));
+    mtc_fmt_t* f = mtcFormatCreate(CFG_FMT_STATSD);
+    mtcFormatVerbositySet(f, CFG_MAX_VERBOSITY);
+    mtcFormatStatsDMaxLenSet(f, 4 * DEFAULT_STATSD_MAX_LEN);
+    mtcFormatSet(mtc, f);
+
+    // Longer than a default max_len line; it's all there
+    char value[2 * DEFAULT_STATSD_MAX_LEN];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    event_field_t fields[] = {
+        STRFIELD("long", value, 4, TRUE),
+        FIELDEND
+    };
+    event_t e = INT_EVENT("A", 1, DELTA, fields);
+    assert_int_equal(mtcSendMetric(mtc, &e), 0);
+
+    FILE* fs = fopen(file_path, "r");
+    assert_non_null(fs);
+    char line[4 * DEFAULT_STATSD_MAX_LEN] = {0};
+    assert_non_null(fgets(line, sizeof(line), fs));
+    assert_int_equal(strlen(line), strlen("A:1|c|#long:") + strlen(value) + 1);
+    fclose(fs);
+
+    if (unlink(file_path))
+        fail_msg("Couldn't delete file %s", file_path);
+
+    mtcDestroy(&mtc);
+}
+
+static void
+mtcAggregateByContainerSumsCountersAcrossPids(void** state)
+{
+    const char* file_path = "/tmp/my.path";
+    unlink(file_path);
+    mtc_t* mtc = mtcCreate();
+    assert_non_null(mtc);
+    mtcTransportSet(mtc, transportCreateFile(file_path, CFG_BUFFER_LINE));
+    mtc_fmt_t* f = mtcFormatCreate(CFG_FMT_STATSD);
+    mtcFormatVerbositySet(f, CFG_MAX_VERBOSITY);
+    mtcFormatSet(mtc, f);
+    mtcAggregateSet(mtc, 16);
+    mtcAggregateBySet(mtc, CFG_AGG_CONTAINER);
+
+    // Out of range is ignored
+    mtcAggregateBySet(mtc, CFG_AGG_CONTAINER + 1);
+
+    // As if from two processes in one container
+    event_field_t fields1[] = {
+        STRFIELD("proc", "nginx", 4, TRUE),
+        NUMFIELD("pid", 100, 7, TRUE),
+        STRFIELD("op", "read", 3, TRUE),
+        FIELDEND
+    };
+    event_field_t fields2[] = {
+        STRFIELD("proc", "php-fpm", 4, TRUE),
+        NUMFIELD("pid", 200, 7, TRUE),
+        STRFIELD("op", "read", 3, TRUE),
+        FIELDEND
+    };
+    event_t e1 = INT_EVENT("fs.ops", 2, DELTA, fields1);
+    event_t e2 = INT_EVENT("fs.ops", 3, DELTA, fields2);
+    assert_int_equal(mtcSendMetric(mtc, &e1), 0);
+    assert_int_equal(mtcSendMetric(mtc, &e2), 0);
+
+    // Gauges don't add up; each process keeps its own
+    event_t g1 = INT_EVENT("proc.fd", 10, CURRENT, fields1);
+    event_t g2 = INT_EVENT("proc.fd", 20, CURRENT, fields2);
+    assert_int_equal(mtcSendMetric(mtc, &g1), 0);
+    assert_int_equal(mtcSendMetric(mtc, &g2), 0);
+
+    // The caller's fields are left as they were
+    assert_int_equal(fields1[0].cardinality, 4);
+    assert_int_equal(fields1[1].cardinality, 7);
+
+    mtcFlush(mtc);
+
+    FILE* fs = fopen(file_path, "r");
+    assert_non_null(fs);
+    // In no particular order
+    char line[256] = {0};
+    char all[1024] = {0};
+    int lines = 0;
+    while (fgets(line, sizeof(line), fs)) {
+        strcat(all, line);
+        lines++;
+    }
+    assert_int_equal(lines, 3);
+    assert_non_null(strstr(all, "fs.ops:5|c|#op:read\n"));
+    assert_non_null(strstr(all, "proc.fd:10|g|#proc:nginx,pid:100,op:read\n"));
+    assert_non_null(strstr(all, "proc.fd:20|g|#proc:php-fpm,pid:200,op:read\n"));
+    fclose(fs);
+
+    if (unlink(file_path))
+        fail_msg("Couldn't delete file %s", file_path);
+
+    mtcDestroy(&mtc);
+}
 
 int
 main(int argc, char* argv[])
@@ -135,6 +240,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(mtcSendForNullMessageDoesntCrash),
         cmocka_unit_test(mtcTransportSetAndMtcSend),
         cmocka_unit_test(mtcFormatSetAndMtcSendEvent),
+        cmocka_unit_test(mtcSendMetricPastTheDefaultMaxLen),
+        cmocka_unit_test(mtcAggregateByContainerSumsCountersAcrossPids),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
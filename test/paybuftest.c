@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "paybuf.h"
+#include "dbg.h"
+
+#include "test.h"
+
+typedef struct {
+    int count;
+    size_t bytes;
+    char hdr[8][32];
+    char data[8][64];
+} drained_t;
+
+static void
+collect(void *arg, const void *hdr, size_t hlen, const void *data, size_t len)
+{
+    drained_t *d = (drained_t *)arg;
+
+    if (d->count < 8) {
+        memcpy(d->hdr[d->count], hdr, hlen);
+        memcpy(d->data[d->count], data, len);
+    }
+    d->count++;
+    d->bytes += hlen + len;
+}
+
+static void
+paybufCreateRoundsUpSize(void **state)
+{
+    assert_null(paybufCreate(0));
+
+    paybuf_t *pb = paybufCreate(1000);
+    assert_non_null(pb);
+    assert_int_equal(paybufSize(pb), 1000);
+    paybufDestroy(&pb);
+    assert_null(pb);
+
+    pb = paybufCreate(1001);
+    assert_int_equal(paybufSize(pb), 1008);
+    paybufDestroy(&pb);
+
+    // Don't crash
+    paybufDestroy(&pb);
+    paybufDestroy(NULL);
+    assert_int_equal(paybufSize(NULL), 0);
+    assert_int_equal(paybufDropped(NULL), 0);
+}
+
+static void
+paybufPutRejectsBadArgs(void **state)
+{
+    paybuf_t *pb = paybufCreate(1024);
+    char data[] = "data";
+
+    assert_int_equal(paybufPut(NULL, "h", 1, data, 4), -1);
+    assert_int_equal(paybufPut(pb, "h", 1, NULL, 4), -1);
+    assert_int_equal(paybufPut(pb, "h", 1, data, 0), -1);
+    assert_int_equal(paybufPut(pb, NULL, 1, data, 4), -1);
+    assert_int_equal(paybufDropped(pb), 0);
+
+    // A header is optional
+    assert_int_equal(paybufPut(pb, NULL, 0, data, 4), 0);
+    assert_int_equal(paybufDrain(NULL, collect, NULL), 0);
+    assert_int_equal(paybufDrain(pb, NULL, NULL), 0);
+
+    paybufDestroy(&pb);
+}
+
+static void
+paybufDrainReturnsRecordsInOrder(void **state)
+{
+    paybuf_t *pb = paybufCreate(1024);
+    drained_t d = {0};
+
+    assert_int_equal(paybufPut(pb, "hdr1", 5, "first", 6), 0);
+    assert_int_equal(paybufPut(pb, "h2", 3, "second one", 11), 0);
+    assert_int_equal(paybufPut(pb, NULL, 0, "third", 6), 0);
+
+    assert_int_equal(paybufDrain(pb, collect, &d), 3);
+    assert_string_equal(d.hdr[0], "hdr1");
+    assert_string_equal(d.data[0], "first");
+    assert_string_equal(d.hdr[1], "h2");
+    assert_string_equal(d.data[1], "second one");
+    assert_string_equal(d.data[2], "third");
+
+    // Nothing left, in either half
+    memset(&d, 0, sizeof(d));
+    assert_int_equal(paybufDrain(pb, collect, &d), 0);
+    assert_int_equal(paybufDrain(pb, collect, &d), 0);
+    assert_int_equal(d.count, 0);
+
+    paybufDestroy(&pb);
+}
+
+static void
+paybufPutDropsWhatDoesNotFit(void **state)
+{
+    // Each record is 8 bytes of length, 8 of header, 16 of data
+    paybuf_t *pb = paybufCreate(96);
+    char data[16] = "0123456789abcde";
+    drained_t d = {0};
+
+    assert_int_equal(paybufPut(pb, "header!", 8, data, 16), 0);
+    assert_int_equal(paybufPut(pb, "header!", 8, data, 16), 0);
+    assert_int_equal(paybufPut(pb, "header!", 8, data, 16), 0);
+    assert_int_equal(paybufPut(pb, "header!", 8, data, 16), -1);
+    assert_int_equal(paybufDropped(pb), 1);
+
+    // Bigger than a whole half
+    char big[128] = {0};
+    assert_int_equal(paybufPut(pb, NULL, 0, big, sizeof(big)), -1);
+    assert_int_equal(paybufDropped(pb), 2);
+
+    assert_int_equal(paybufDrain(pb, collect, &d), 3);
+    assert_int_equal(d.bytes, 3 * 24);
+
+    // There's room again now
+    assert_int_equal(paybufPut(pb, "header!", 8, data, 16), 0);
+    memset(&d, 0, sizeof(d));
+    assert_int_equal(paybufDrain(pb, collect, &d), 1);
+    assert_int_equal(paybufDropped(pb), 2);
+
+    // The most that fits in one record, and a byte more
+    assert_int_equal(paybufMaxLen(pb, 8), 80);
+    assert_int_equal(paybufMaxLen(pb, 88), 0);
+    assert_int_equal(paybufMaxLen(NULL, 0), 0);
+    assert_int_equal(paybufPut(pb, "header!", 8, big, 81), -1);
+    assert_int_equal(paybufPut(pb, "header!", 8, big, 80), 0);
+    assert_int_equal(paybufDropped(pb), 3);
+
+    paybufDestroy(&pb);
+}
+
+static void
+paybufDrainStopsAtEndOfPartlyFilledHalf(void **state)
+{
+    // The second record leaves 24 bytes free; a 32 byte one doesn't fit
+    // and marks the end for the drain.
+    paybuf_t *pb = paybufCreate(72);
+    drained_t d = {0};
+
+    assert_int_equal(paybufPut(pb, NULL, 0, "0123456789abcdef", 16), 0);
+    assert_int_equal(paybufPut(pb, NULL, 0, "0123456789abcdef", 16), 0);
+    assert_int_equal(paybufPut(pb, NULL, 0, "0123456789abcdef012345", 23), -1);
+    assert_int_equal(paybufPut(pb, NULL, 0, "short", 5), -1);
+
+    assert_int_equal(paybufDrain(pb, collect, &d), 2);
+    assert_int_equal(d.bytes, 32);
+
+    paybufDestroy(&pb);
+}
+
+#define WRITERS 4
+#define RECORDS 20000
+
+typedef struct {
+    paybuf_t *pb;
+    int id;
+} writer_arg_t;
+
+typedef struct {
+    int count[WRITERS];
+    int next[WRITERS];
+    int bad;
+} checked_t;
+
+static void *
+writer(void *arg)
+{
+    writer_arg_t *w = (writer_arg_t *)arg;
+    int i;
+
+    for (i = 0; i < RECORDS; i++) {
+        int rec[8];
+        int j;
+        for (j = 0; j < 8; j++) rec[j] = i;
+        while (paybufPut(w->pb, &w->id, sizeof(w->id), rec, sizeof(rec)) == -1) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void
+check(void *arg, const void *hdr, size_t hlen, const void *data, size_t len)
+{
+    checked_t *c = (checked_t *)arg;
+    int id, rec[8], j;
+
+    if ((hlen != sizeof(id)) || (len != sizeof(rec))) {
+        c->bad++;
+        return;
+    }
+    memcpy(&id, hdr, sizeof(id));
+    memcpy(rec, data, sizeof(rec));
+    if ((id < 0) || (id >= WRITERS)) {
+        c->bad++;
+        return;
+    }
+
+    // Every record intact, and each writer's in the order it put them
+    for (j = 0; j < 8; j++) {
+        if (rec[j] != c->next[id]) c->bad++;
+    }
+    c->next[id]++;
+    c->count[id]++;
+}
+
+static void
+paybufConcurrentWritersLoseNothing(void **state)
+{
+    paybuf_t *pb = paybufCreate(16 * 1024);
+    pthread_t tid[WRITERS];
+    writer_arg_t arg[WRITERS];
+    checked_t c = {0};
+    int i, total = 0;
+
+    for (i = 0; i < WRITERS; i++) {
+        arg[i].pb = pb;
+        arg[i].id = i;
+        assert_int_equal(pthread_create(&tid[i], NULL, writer, &arg[i]), 0);
+    }
+
+    while (total < WRITERS * RECORDS) {
+        total += paybufDrain(pb, check, &c);
+    }
+
+    for (i = 0; i < WRITERS; i++) {
+        pthread_join(tid[i], NULL);
+        assert_int_equal(c.count[i], RECORDS);
+    }
+    assert_int_equal(c.bad, 0);
+    assert_int_equal(paybufDrain(pb, check, &c), 0);
+
+    paybufDestroy(&pb);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(paybufCreateRoundsUpSize),
+        cmocka_unit_test(paybufPutRejectsBadArgs),
+        cmocka_unit_test(paybufDrainReturnsRecordsInOrder),
+        cmocka_unit_test(paybufPutDropsWhatDoesNotFit),
+        cmocka_unit_test(paybufDrainStopsAtEndOfPartlyFilledHalf),
+        cmocka_unit_test(paybufConcurrentWritersLoseNothing),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
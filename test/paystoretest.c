@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dbg.h"
+#include "fn.h"
+#include "paystore.h"
+
+#include "test.h"
+
+static char dir[] = "/tmp/paystoretestXXXXXX";
+
+static int
+storeSetup(void **state)
+{
+    initFn();
+    if (!mkdtemp(dir)) return -1;
+    return groupSetup(state);
+}
+
+static int
+storeTeardown(void **state)
+{
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd)) return -1;
+    return groupTeardown(state);
+}
+
+// Returns the contents of a file in the test dir, or "" if there's none
+static char *
+contents(const char *name)
+{
+    static char buf[256];
+    char path[128];
+
+    buf[0] = '\0';
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    if (!f) return buf;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+    return buf;
+}
+
+static void
+paystoreCreateAndDestroy(void **state)
+{
+    assert_null(paystoreCreate(NULL, 4, 0, 0));
+    assert_null(paystoreCreate(dir, 0, 0, 0));
+
+    paystore_t *ps = paystoreCreate(dir, 4, 0, 0);
+    assert_non_null(ps);
+    assert_int_equal(paystoreOpenFiles(ps), 0);
+    paystoreDestroy(&ps);
+    assert_null(ps);
+
+    // Don't crash
+    paystoreDestroy(&ps);
+    paystoreDestroy(NULL);
+    paystoreFlush(NULL);
+    assert_int_equal(paystoreWrite(NULL, "a", "x", 1), -1);
+    assert_int_equal(paystoreOpenFiles(NULL), 0);
+}
+
+static void
+paystoreWriteIsQueuedUntilFlush(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 0, 0);
+
+    assert_int_equal(paystoreWrite(ps, "queued", "abc", 3), 0);
+    assert_int_equal(paystoreWrite(ps, "queued", "def", 3), 0);
+    assert_int_equal(paystoreOpenFiles(ps), 1);
+    assert_string_equal(contents("queued"), "");
+
+    paystoreFlush(ps);
+    assert_string_equal(contents("queued"), "abcdef");
+
+    // Appends to what's there
+    assert_int_equal(paystoreWrite(ps, "queued", "ghi", 3), 0);
+    paystoreDestroy(&ps);
+    assert_string_equal(contents("queued"), "abcdefghi");
+}
+
+static void
+paystoreWriteFlushesAFullQueue(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 0, 0);
+    int i;
+
+    // More writes than fit in one writev
+    for (i = 0; i < 65; i++) {
+        assert_int_equal(paystoreWrite(ps, "full", "x", 1), 0);
+    }
+    assert_int_equal(strlen(contents("full")), 64);
+
+    paystoreFlush(ps);
+    assert_int_equal(strlen(contents("full")), 65);
+    paystoreDestroy(&ps);
+}
+
+static void
+paystoreClosesLeastRecentlyWritten(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 2, 0, 0);
+
+    assert_int_equal(paystoreWrite(ps, "lru_a", "a1", 2), 0);
+    assert_int_equal(paystoreWrite(ps, "lru_b", "b1", 2), 0);
+    assert_int_equal(paystoreWrite(ps, "lru_a", "a2", 2), 0);
+    assert_int_equal(paystoreOpenFiles(ps), 2);
+
+    // b was written longest ago, so it's flushed and closed to make room
+    assert_int_equal(paystoreWrite(ps, "lru_c", "c1", 2), 0);
+    assert_int_equal(paystoreOpenFiles(ps), 2);
+    assert_string_equal(contents("lru_b"), "b1");
+    assert_string_equal(contents("lru_a"), "");
+
+    // And reopened when it's written again
+    assert_int_equal(paystoreWrite(ps, "lru_b", "b2", 2), 0);
+    assert_string_equal(contents("lru_a"), "a1a2");
+    paystoreDestroy(&ps);
+    assert_string_equal(contents("lru_b"), "b1b2");
+    assert_string_equal(contents("lru_c"), "c1");
+}
+
+static void
+paystoreRotatesAtMaxSize(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 10, 0);
+
+    assert_int_equal(paystoreWrite(ps, "size", "123456", 6), 0);
+    assert_int_equal(paystoreWrite(ps, "size", "7890", 4), 0);
+    assert_int_equal(paystoreWrite(ps, "size", "abcdef", 6), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("size.1"), "1234567890");
+    assert_string_equal(contents("size"), "abcdef");
+
+    // A write bigger than maxsize still goes to a file of its own
+    assert_int_equal(paystoreWrite(ps, "size", "ABCDEFGHIJKL", 12), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("size.1"), "abcdef");
+    assert_string_equal(contents("size"), "ABCDEFGHIJKL");
+    paystoreDestroy(&ps);
+
+    // The size of what's already in a file counts once it's reopened
+    ps = paystoreCreate(dir, 4, 14, 0);
+    assert_int_equal(paystoreWrite(ps, "size", "xyz", 3), 0);
+    paystoreDestroy(&ps);
+    assert_string_equal(contents("size.1"), "ABCDEFGHIJKL");
+    assert_string_equal(contents("size"), "xyz");
+}
+
+static void
+paystoreRotatesAtMaxAge(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 0, 60);
+
+    assert_int_equal(paystoreWriteAt(ps, "age", "one", 3, 600), 0);
+    assert_int_equal(paystoreWriteAt(ps, "age", "two", 3, 659), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("age"), "onetwo");
+
+    assert_int_equal(paystoreWriteAt(ps, "age", "three", 5, 660), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("age.1"), "onetwo");
+    assert_string_equal(contents("age"), "three");
+
+    paystoreDestroy(&ps);
+}
+
+static void
+paystoreStartsEveryFileWithTheHeader(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 12, 0);
+    assert_int_equal(paystoreHeaderSet(NULL, "HDR", 3), -1);
+    assert_int_equal(paystoreHeaderSet(ps, "HDR", 3), 0);
+
+    assert_int_equal(paystoreWrite(ps, "hdr", "12345", 5), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("hdr"), "HDR12345");
+
+    // The header doesn't count as data; rotation only happens after some
+    assert_int_equal(paystoreWrite(ps, "hdr", "6789", 4), 0);
+    assert_int_equal(paystoreWrite(ps, "hdr", "abcdefghi", 9), 0);
+    paystoreFlush(ps);
+    assert_string_equal(contents("hdr.1"), "HDR123456789");
+    assert_string_equal(contents("hdr"), "HDRabcdefghi");
+    paystoreDestroy(&ps);
+
+    // Not repeated when a file that has one is reopened
+    ps = paystoreCreate(dir, 4, 0, 0);
+    assert_int_equal(paystoreHeaderSet(ps, "HDR", 3), 0);
+    assert_int_equal(paystoreWrite(ps, "hdr", "j", 1), 0);
+    paystoreDestroy(&ps);
+    assert_string_equal(contents("hdr"), "HDRabcdefghij");
+}
+
+static void
+paystoreStopsAtMaxTotal(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 10, 0);
+    paystoreMaxTotalSet(ps, 30);
+
+    assert_int_equal(paystoreWrite(ps, "total_a", "1234567890", 10), 0);
+    assert_int_equal(paystoreWrite(ps, "total_a", "abcdefghij", 10), 0);
+    assert_int_equal(paystoreWrite(ps, "total_b", "0123456789", 10), 0);
+
+    // All of the files count, rotated ones too
+    assert_int_equal(paystoreWrite(ps, "total_b", "x", 1), -1);
+    assert_int_equal(paystoreDropped(ps), 1);
+
+    // Replacing a rotated file gives its bytes back
+    assert_int_equal(paystoreWrite(ps, "total_a", "ABCDEFGHIJ", 10), 0);
+    assert_int_equal(paystoreDropped(ps), 1);
+    paystoreDestroy(&ps);
+    assert_string_equal(contents("total_a.1"), "abcdefghij");
+    assert_string_equal(contents("total_a"), "ABCDEFGHIJ");
+    assert_string_equal(contents("total_b.1"), "0123456789");
+    assert_string_equal(contents("total_b"), "");
+
+    // Don't crash
+    paystoreMaxTotalSet(NULL, 1);
+    assert_int_equal(paystoreDropped(NULL), 0);
+}
+
+static void
+paystoreDiscardDoesNotWrite(void **state)
+{
+    paystore_t *ps = paystoreCreate(dir, 4, 0, 0);
+    assert_int_equal(paystoreWrite(ps, "discard", "abc", 3), 0);
+    paystoreFlush(ps);
+    assert_int_equal(paystoreWrite(ps, "discard", "def", 3), 0);
+    paystoreDiscard(&ps);
+    assert_null(ps);
+    assert_string_equal(contents("discard"), "abc");
+
+    // Don't crash
+    paystoreDiscard(&ps);
+    paystoreDiscard(NULL);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(paystoreCreateAndDestroy),
+        cmocka_unit_test(paystoreWriteIsQueuedUntilFlush),
+        cmocka_unit_test(paystoreWriteFlushesAFullQueue),
+        cmocka_unit_test(paystoreClosesLeastRecentlyWritten),
+        cmocka_unit_test(paystoreRotatesAtMaxSize),
+        cmocka_unit_test(paystoreRotatesAtMaxAge),
+        cmocka_unit_test(paystoreStartsEveryFileWithTheHeader),
+        cmocka_unit_test(paystoreStopsAtMaxTotal),
+        cmocka_unit_test(paystoreDiscardDoesNotWrite),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, storeSetup, storeTeardown);
+}
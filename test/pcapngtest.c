@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "pcapng.h"
+
+#include "test.h"
+
+static uint32_t
+get32(const char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint16_t
+get16(const char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void
+setAddr4(struct sockaddr_storage *ss, const char *ip, int port)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+    memset(ss, 0, sizeof(*ss));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    inet_pton(AF_INET, ip, &sin->sin_addr);
+}
+
+static void
+setAddr6(struct sockaddr_storage *ss, const char *ip, int port)
+{
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+    memset(ss, 0, sizeof(*ss));
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    inet_pton(AF_INET6, ip, &sin6->sin6_addr);
+}
+
+// Checks the framing of the block at p and returns the next one
+static const char *
+checkBlock(const char *p, uint32_t type)
+{
+    uint32_t len = get32(p + 4);
+    assert_int_equal(get32(p), type);
+    assert_int_equal(len % 4, 0);
+    assert_int_equal(get32(p + len - 4), len);
+    return p + len;
+}
+
+static void
+pcapngHeaderHasSectionAndInterface(void **state)
+{
+    pcapng_t *pc = pcapngCreate(0, "curl:1234");
+    assert_non_null(pc);
+
+    const char *hdr = NULL;
+    size_t len = pcapngHeader(pc, &hdr);
+    assert_non_null(hdr);
+
+    const char *idb = checkBlock(hdr, 0x0A0D0D0A);
+    assert_int_equal(get32(hdr + 8), 0x1A2B3C4D);
+    assert_int_equal(get16(hdr + 12), 1);
+    assert_int_equal(get16(hdr + 14), 0);
+
+    const char *end = checkBlock(idb, 1);
+    assert_int_equal(end - hdr, len);
+    assert_int_equal(get16(idb + 8), 101);
+
+    // if_name, then if_tsresol of 9 (nanoseconds)
+    const char *opt = idb + 16;
+    assert_int_equal(get16(opt), 2);
+    assert_int_equal(get16(opt + 2), strlen("curl:1234"));
+    assert_memory_equal(opt + 4, "curl:1234", strlen("curl:1234"));
+    opt += 4 + 12;
+    assert_int_equal(get16(opt), 9);
+    assert_int_equal(get16(opt + 2), 1);
+    assert_int_equal((unsigned char)opt[4], 9);
+
+    assert_int_equal(pcapngHeader(NULL, &hdr), 0);
+    pcapngDestroy(&pc);
+    assert_null(pc);
+    pcapngDestroy(&pc);
+}
+
+static void
+pcapngPacketBuildsIpv4Tcp(void **state)
+{
+    pcapng_t *pc = pcapngCreate(0, NULL);
+    struct sockaddr_storage local, remote;
+    setAddr4(&local, "10.0.0.1", 43210);
+    setAddr4(&remote, "10.0.0.2", 80);
+
+    pcapng_pkt_t pkt = {
+        .ns = 1600000000123456789ULL, .tx = 1, .proto = IPPROTO_TCP,
+        .seq = 100, .ack = 7, .local = &local, .remote = &remote,
+    };
+    const char data[] = "GET / HTTP/1.1\r\n\r\n";
+    size_t dlen = strlen(data);
+
+    assert_int_equal(pcapngPacket(pc, &pkt, data, dlen), dlen);
+    assert_int_equal(pkt.seq, 100 + dlen);
+
+    const char *buf = NULL;
+    size_t len = pcapngTake(pc, &buf);
+    assert_int_equal(checkBlock(buf, 6) - buf, len);
+    assert_int_equal(get32(buf + 8), 0);
+    assert_true((((uint64_t)get32(buf + 12) << 32) | get32(buf + 16)) == pkt.ns);
+    assert_int_equal(get32(buf + 20), 20 + 20 + dlen);
+    assert_int_equal(get32(buf + 24), 20 + 20 + dlen);
+
+    const unsigned char *ip = (const unsigned char *)buf + 28;
+    assert_int_equal(ip[0], 0x45);
+    assert_int_equal(ntohs(get16((char *)ip + 2)), 20 + 20 + dlen);
+    assert_int_equal(ip[9], IPPROTO_TCP);
+
+    // Sent, so from local to remote; and the header checksums to zero
+    char addr[INET_ADDRSTRLEN];
+    assert_string_equal(inet_ntop(AF_INET, ip + 12, addr, sizeof(addr)), "10.0.0.1");
+    assert_string_equal(inet_ntop(AF_INET, ip + 16, addr, sizeof(addr)), "10.0.0.2");
+    uint32_t sum = 0;
+    int i;
+    for (i = 0; i < 20; i += 2) sum += (ip[i] << 8) | ip[i + 1];
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    assert_int_equal(sum, 0xFFFF);
+
+    const char *tcp = (const char *)ip + 20;
+    assert_int_equal(ntohs(get16(tcp)), 43210);
+    assert_int_equal(ntohs(get16(tcp + 2)), 80);
+    assert_int_equal(ntohl(get32(tcp + 4)), 100);
+    assert_int_equal(ntohl(get32(tcp + 8)), 7);
+    assert_int_equal((unsigned char)tcp[12], 0x50);
+    assert_int_equal((unsigned char)tcp[13], 0x18);
+    assert_memory_equal(tcp + 20, data, dlen);
+
+    // Taking it empties the buffer
+    assert_int_equal(pcapngTake(pc, &buf), 0);
+    pcapngDestroy(&pc);
+}
+
+static void
+pcapngPacketBuildsIpv6Udp(void **state)
+{
+    pcapng_t *pc = pcapngCreate(0, NULL);
+    struct sockaddr_storage local, remote;
+    setAddr6(&local, "fe80::1", 5353);
+    setAddr6(&remote, "fe80::2", 53);
+
+    pcapng_pkt_t pkt = {
+        .ns = 1, .tx = 0, .proto = IPPROTO_UDP,
+        .seq = 5, .local = &local, .remote = &remote,
+    };
+    assert_int_equal(pcapngPacket(pc, &pkt, "answer", 6), 6);
+    assert_int_equal(pkt.seq, 5);
+
+    const char *buf = NULL;
+    pcapngTake(pc, &buf);
+    assert_int_equal(get32(buf + 20), 40 + 8 + 6);
+
+    // Received, so from remote to local
+    const unsigned char *ip = (const unsigned char *)buf + 28;
+    char addr[INET6_ADDRSTRLEN];
+    assert_int_equal(ip[0] >> 4, 6);
+    assert_int_equal(ntohs(get16((char *)ip + 4)), 8 + 6);
+    assert_int_equal(ip[6], IPPROTO_UDP);
+    assert_string_equal(inet_ntop(AF_INET6, ip + 8, addr, sizeof(addr)), "fe80::2");
+    assert_string_equal(inet_ntop(AF_INET6, ip + 24, addr, sizeof(addr)), "fe80::1");
+
+    const char *udp = (const char *)ip + 40;
+    assert_int_equal(ntohs(get16(udp)), 53);
+    assert_int_equal(ntohs(get16(udp + 2)), 5353);
+    assert_int_equal(ntohs(get16(udp + 4)), 8 + 6);
+    assert_memory_equal(udp + 8, "answer", 6);
+
+    pcapngDestroy(&pc);
+}
+
+static void
+pcapngPacketSplitsLargeDataAndStopsWhenFull(void **state)
+{
+    pcapng_t *pc = pcapngCreate(0, NULL);
+    struct sockaddr_storage local, remote;
+    setAddr4(&local, "127.0.0.1", 1000);
+    setAddr4(&remote, "127.0.0.1", 2000);
+    pcapng_pkt_t pkt = {
+        .tx = 1, .proto = IPPROTO_TCP, .local = &local, .remote = &remote,
+    };
+
+    size_t big = PCAPNG_MAX_SEGMENT + 1000;
+    char *data = calloc(1, big);
+
+    // The smallest buffer holds one whole segment; the rest has to wait
+    assert_int_equal(pcapngPacket(pc, &pkt, data, big), PCAPNG_MAX_SEGMENT);
+    assert_int_equal(pkt.seq, PCAPNG_MAX_SEGMENT);
+
+    const char *buf = NULL;
+    size_t len = pcapngTake(pc, &buf);
+    assert_int_equal(checkBlock(buf, 6) - buf, len);
+    assert_int_equal(get32(buf + 20), 40 + PCAPNG_MAX_SEGMENT);
+
+    assert_int_equal(pcapngPacket(pc, &pkt, data + PCAPNG_MAX_SEGMENT, 1000), 1000);
+    assert_int_equal(pkt.seq, big);
+
+    // A big buffer takes both segments in one go
+    pcapng_t *pc2 = pcapngCreate(4 * big, NULL);
+    pkt.seq = 0;
+    assert_int_equal(pcapngPacket(pc2, &pkt, data, big), big);
+    len = pcapngTake(pc2, &buf);
+    const char *second = checkBlock(buf, 6);
+    assert_int_equal(checkBlock(second, 6) - buf, len);
+    assert_int_equal(ntohl(get32(second + 28 + 20 + 4)), PCAPNG_MAX_SEGMENT);
+
+    assert_int_equal(pcapngPacket(NULL, &pkt, data, big), 0);
+    free(data);
+    pcapngDestroy(&pc);
+    pcapngDestroy(&pc2);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(pcapngHeaderHasSectionAndInterface),
+        cmocka_unit_test(pcapngPacketBuildsIpv4Tcp),
+        cmocka_unit_test(pcapngPacketBuildsIpv6Udp),
+        cmocka_unit_test(pcapngPacketSplitsLargeDataAndStopsWhenFull),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -190,6 +190,8 @@ nothingCrashesBeforeAnyInit(void** state)
     doStatMetric("statFunc", "/the/path/to/something", NULL);
     doTotal(TOT_READ);
     doTotalDuration(TOT_DNS_DURATION);
+    doTotalWait();
+    doTotalGo();
     doEvent();
 
     // state.h
@@ -225,6 +227,9 @@ nothingCrashesBeforeAnyInit(void** state)
     remotePortIsDNS(31);
     sockIsTCP(32);
     doUpdateState(OPEN_PORTS, 3, 4, "something", "/path/to/something");
+    doWait(WAIT_EPOLL_WAIT, 33, 1000, 2);
+    doGoGC();
+    doGoPause(1000);
     clearTestData();
 }
 
@@ -1200,6 +1205,63 @@ doDNSSendNoDNSSummarization(void** state)
     if(addr_list) freeaddrinfo(addr_list);
 }
 
+static void
+doDNSQueryDuration(void** state)
+{
+    struct addrinfo* addr_list = NULL;
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (getaddrinfo("localhost", "53", &hints, &addr_list) || !addr_list) {
+        fail();
+    }
+
+    clearTestData();
+    setVerbosity(9);
+    doAccept(17, addr_list->ai_addr, &addr_list->ai_addrlen, "acceptFunc");
+
+    // A query to look up www.google.com with id 0xdeaf
+    uint8_t pkt[] = {
+	0xde, 0xaf, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x01, 0x03, 0x77, 0x77, 0x77,
+	0x06, 0x67, 0x6f, 0x6f, 0x67, 0x6c, 0x65, 0x03,
+	0x63, 0x6f, 0x6d, 0x00, 0x00, 0x01
+    };
+    getDNSName(17, pkt, sizeof(pkt));
+    doSend(17, sizeof(pkt), NULL, sizeof(pkt), BUF);
+
+    // A response with an id we never sent isn't timed
+    clearTestData();
+    uint8_t resp[sizeof(pkt)];
+    memcpy(resp, pkt, sizeof(resp));
+    resp[1] = 0xee;
+    resp[2] = 0x81;
+    resp[3] = 0x83;
+    doRecv(17, sizeof(resp), resp, sizeof(resp), BUF);
+    assert_int_equal(metricCalls("net.dns.duration"), 0);
+
+    // The matching response is reported
+    clearTestData();
+    resp[1] = 0xaf;
+    resp[7] = 0x02;
+    doRecv(17, sizeof(resp), resp, sizeof(resp), BUF);
+    assert_int_equal(metricCalls("net.dns.duration"), 1);
+    assert_true(metricValues("net.dns.duration") >= 1);
+    assert_int_equal(eventCalls("net.dns.duration"), 1);
+    assert_int_equal(eventCalls("net.dns.resp"), 1);
+
+
+    // The query has been answered; a duplicate response isn't timed
+    clearTestData();
+    doRecv(17, sizeof(resp), resp, sizeof(resp), BUF);
+    assert_int_equal(metricCalls("net.dns.duration"), 0);
+
+    doClose(17, "closeFunc");
+    clearTestData();
+    if(addr_list) freeaddrinfo(addr_list);
+}
+
 static void
 doDNSSendDNSSummarization(void** state)
 {
@@ -1634,6 +1696,188 @@ doDNSErrSummarization(void** state)
     assert_int_equal(eventCalls(NULL), 0);
 }
 
+static void
+doMetricModeOverridesVerbosity(void** state)
+{
+    char* buf = "hey.\n";
+
+    clearTestData();
+    setVerbosity(4);
+    setMetricModes("fs.write:fd");
+    doOpen(16, "/the/file/path", FD, "openFunc");
+    assert_int_equal(metricCalls("fs.op.open"), 0);
+    assert_int_equal(eventCalls("fs.op.open"), 1);
+
+    // fs.write is per fd, though read/write is summarized at 4
+    clearTestData();
+    doWrite(16, 987, 1, buf, sizeof(buf), "writeFunc", BUF, 0);
+    doWrite(16, 987, 1, buf, sizeof(buf), "writeFunc", BUF, 0);
+    assert_int_equal(metricCalls("fs.write"), 2);
+    assert_int_equal(metricValues("fs.write"), 2*sizeof(buf));
+
+    // and the rest of the verbosity still applies
+    clearTestData();
+    doClose(16, "closeFunc");
+    assert_int_equal(metricCalls("fs.op.close"), 0);
+    doTotal(TOT_OPEN);
+    doTotal(TOT_CLOSE);
+    assert_int_equal(metricCalls("fs.open"), 1);
+    assert_int_equal(metricCalls("fs.close"), 1);
+
+    // Setting the verbosity keeps the modes
+    setVerbosity(5);
+    clearTestData();
+    doOpen(16, "/the/file/path", FD, "openFunc");
+    doWrite(16, 987, 1, buf, sizeof(buf), "writeFunc", BUF, 0);
+    assert_int_equal(metricCalls("fs.write"), 1);
+    doClose(16, "closeFunc");
+
+    setMetricModes(NULL);
+    doTotal(TOT_OPEN);
+    doTotal(TOT_CLOSE);
+}
+
+static void
+doMetricModeOff(void** state)
+{
+    char* buf = "hey.\n";
+
+    clearTestData();
+    setVerbosity(9);
+    setMetricModes("fs.write:off, fs.open:event");
+    doOpen(16, "/the/file/path", FD, "openFunc");
+    assert_int_equal(metricCalls("fs.op.open"), 0);
+    assert_int_equal(eventCalls("fs.op.open"), 1);
+
+    // Neither metrics nor metric events
+    clearTestData();
+    doWrite(16, 987, 1, buf, sizeof(buf), "writeFunc", BUF, 0);
+    assert_int_equal(metricCalls("fs.write"), 0);
+    assert_int_equal(eventCalls("fs.write"), 0);
+
+    // Nor in the totals
+    clearTestData();
+    doTotal(TOT_WRITE);
+    doTotal(TOT_OPEN);
+    assert_int_equal(metricCalls(NULL), 0);
+
+    doClose(16, "closeFunc");
+    setMetricModes(NULL);
+    doTotal(TOT_CLOSE);
+}
+
+static void
+doMetricModeIgnoresUnknownNames(void** state)
+{
+    clearTestData();
+    setVerbosity(9);
+    setMetricModes("fs.nope:off,fs.write:loud,fs.read,:fd");
+
+    doOpen(16, "/the/file/path", FD, "openFunc");
+    assert_int_equal(metricCalls("fs.op.open"), 1);
+    doClose(16, "closeFunc");
+
+    setMetricModes(NULL);
+    doTotal(TOT_OPEN);
+    doTotal(TOT_CLOSE);
+}
+
+static void
+doWaitTimeNoSummarization(void** state)
+{
+    // Drain anything left over from previous tests
+    doTotalWait();
+    clearTestData();
+    setVerbosity(9);
+
+    doWait(WAIT_NANOSLEEP, -1, 3000, 0);
+    doWait(WAIT_EPOLL_WAIT, 7, 5000, 2);
+    doWait(WAIT_EPOLL_WAIT, 7, 4000, 1);
+    doWait(WAIT_POLL, -1, 2000, 3);
+
+    doTotalWait();
+    // nanosleep, epoll_wait, poll and epoll_wait for fd 7
+    assert_int_equal(metricCalls("proc.wait_time"), 4);
+    assert_int_equal(metricValues("proc.wait_time"), (3 + 9 + 2) + 9);
+    // epoll_wait, poll and epoll_wait for fd 7
+    assert_int_equal(metricCalls("proc.wait_ready"), 3);
+    assert_int_equal(metricValues("proc.wait_ready"), (3 + 3) + 3);
+
+    // Nothing new to report
+    clearTestData();
+    doTotalWait();
+    assert_int_equal(metricCalls(NULL), 0);
+}
+
+static void
+doWaitTimeSummarization(void** state)
+{
+    // Drain anything left over from previous tests
+    doTotalWait();
+    clearTestData();
+    setVerbosity(6);
+
+    doWait(WAIT_EPOLL_PWAIT, 8, 7000, 4);
+
+    doTotalWait();
+    // The per epoll fd breakdown is suppressed at this verbosity
+    assert_int_equal(metricCalls("proc.wait_time"), 1);
+    assert_int_equal(metricValues("proc.wait_time"), 7);
+    assert_int_equal(metricCalls("proc.wait_ready"), 1);
+    assert_int_equal(metricValues("proc.wait_ready"), 4);
+
+    clearTestData();
+    doTotalWait();
+    assert_int_equal(metricCalls(NULL), 0);
+}
+
+static void
+doGoRuntimeMetrics(void** state)
+{
+    uint64_t allglen = 0;
+
+    // Nothing is reported until a go app is hooked
+    doTotalGo();
+    clearTestData();
+    doGoGC();
+    doGoPause(5000);
+    doTotalGo();
+    assert_int_equal(metricCalls(NULL), 0);
+
+    // Drop what was counted before the app was hooked
+    allglen = 42;
+    doGoRuntime(&allglen);
+    doTotalGo();
+    clearTestData();
+
+    doGoGC();
+    doGoPause(250000);
+    doGoPause(1500000);
+    doTotalGo();
+    assert_int_equal(metricCalls("go.gc.pause"), 2);
+    assert_int_equal(metricValues("go.gc.pause"), 250 + 1500);
+    assert_int_equal(metricCalls("go.gc.count"), 1);
+    assert_int_equal(metricValues("go.gc.count"), 1);
+    assert_int_equal(metricCalls("go.goroutine.peak"), 1);
+    assert_int_equal(metricValues("go.goroutine.peak"), 42);
+
+    // Only the gauge is reported when nothing happened
+    clearTestData();
+    doTotalGo();
+    assert_int_equal(metricCalls(NULL), 1);
+    assert_int_equal(metricCalls("go.goroutine.peak"), 1);
+
+    // Pauses past what one period holds are dropped
+    clearTestData();
+    int i;
+    for (i = 0; i < GO_PAUSE_SAMPLES + 10; i++) doGoPause(1000);
+    doTotalGo();
+    assert_int_equal(metricCalls("go.gc.pause"), GO_PAUSE_SAMPLES);
+
+    doGoRuntime(NULL);
+    clearTestData();
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -1671,6 +1915,7 @@ main(int argc, char* argv[])
 #endif // __LINUX__
         cmocka_unit_test(doDNSSendNoDNSSummarization),
         cmocka_unit_test(doDNSSendDNSSummarization),
+        cmocka_unit_test(doDNSQueryDuration),
         cmocka_unit_test(doFSConnectionErrorNoSummarization),
         cmocka_unit_test(doFSConnectionErrorSummarization),
         cmocka_unit_test(doNetConnectionErrorNoSummarization),
@@ -1685,6 +1930,12 @@ main(int argc, char* argv[])
 #endif // __LINUX__
         cmocka_unit_test(doDNSErrNoSummarization),
         cmocka_unit_test(doDNSErrSummarization),
+        cmocka_unit_test(doMetricModeOverridesVerbosity),
+        cmocka_unit_test(doMetricModeOff),
+        cmocka_unit_test(doMetricModeIgnoresUnknownNames),
+        cmocka_unit_test(doWaitTimeNoSummarization),
+        cmocka_unit_test(doWaitTimeSummarization),
+        cmocka_unit_test(doGoRuntimeMetrics),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     int test_errors = cmocka_run_group_tests(tests, countTestSetup, countTestTeardown);
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sendq.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define SPILL_DIR "/tmp"
+
+// Stands in for a socket; takes up to per_call bytes a call,
+// until it has taken limit bytes, then would block
+static char out[4096];
+static size_t out_len;
+static size_t per_call;
+static size_t limit;
+static int broken;
+
+static ssize_t
+takeBytes(void *arg, const char *buf, size_t len)
+{
+    if (broken) return -1;
+    if (out_len >= limit) return 0;
+
+    size_t n = len;
+    if (n > per_call) n = per_call;
+    if (n > limit - out_len) n = limit - out_len;
+    if (n > sizeof(out) - out_len) n = sizeof(out) - out_len;
+    memcpy(&out[out_len], buf, n);
+    out_len += n;
+    return n;
+}
+
+static int
+setup(void **state)
+{
+    memset(out, 0, sizeof(out));
+    out_len = 0;
+    per_call = sizeof(out);
+    limit = sizeof(out);
+    broken = FALSE;
+    return 0;
+}
+
+static int
+spillFilesLeft(void)
+{
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "scope_spill.%d.", getpid());
+
+    int count = 0;
+    DIR *dir = opendir(SPILL_DIR);
+    if (!dir) return -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        if (!strncmp(ent->d_name, prefix, strlen(prefix))) count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static void
+sendqCreateReturnsNullForZeroBudget(void **state)
+{
+    assert_null(sendqCreate(0, NULL, 0));
+
+    sendq_t *q = sendqCreate(64, NULL, 0);
+    assert_non_null(q);
+    assert_int_equal(sendqQueued(q), 0);
+    assert_int_equal(sendqDropped(q), 0);
+    assert_int_equal(sendqSpilled(q), 0);
+    sendqDestroy(&q);
+    assert_null(q);
+
+    // Don't crash
+    sendqDestroy(NULL);
+    sendqDestroy(&q);
+    assert_int_equal(sendqPut(NULL, "a", 1), -1);
+    assert_int_equal(sendqDrain(NULL, takeBytes, NULL), -1);
+    sendqRestart(NULL);
+    sendqClear(NULL, TRUE);
+    assert_int_equal(sendqQueued(NULL), 0);
+}
+
+static void
+sendqDrainsInOrder(void **state)
+{
+    sendq_t *q = sendqCreate(64, NULL, 0);
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+
+    assert_int_equal(sendqPut(q, "one\n", 4), 0);
+    assert_int_equal(sendqPut(q, "two\n", 4), 0);
+    assert_int_equal(sendqPut(q, "three\n", 6), 0);
+    assert_int_equal(sendqQueued(q), 14);
+
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_string_equal(out, "one\ntwo\nthree\n");
+    assert_int_equal(sendqQueued(q), 0);
+    assert_int_equal(sendqDropped(q), 0);
+
+    // Around the end of the ring and back
+    int i;
+    for (i = 0; i < 20; i++) {
+        assert_int_equal(sendqPut(q, "abcdefghi\n", 10), 0);
+        assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    }
+    assert_int_equal(out_len, 14 + 20 * 10);
+    assert_memory_equal(&out[out_len - 10], "abcdefghi\n", 10);
+    sendqDestroy(&q);
+}
+
+static void
+sendqDropsWhatDoesNotFit(void **state)
+{
+    // Room for two 12 byte records (with their lengths)
+    sendq_t *q = sendqCreate(40, NULL, 0);
+
+    // Bigger than the budget, never queued
+    char big[64];
+    memset(big, 'x', sizeof(big));
+    assert_int_equal(sendqPut(q, big, sizeof(big)), -1);
+    assert_int_equal(sendqDropped(q), sizeof(big));
+
+    assert_int_equal(sendqPut(q, "aaaaaaaaaaa\n", 12), 0);
+    assert_int_equal(sendqPut(q, "bbbbbbbbbbb\n", 12), 0);
+    assert_int_equal(sendqPut(q, "ccccccccccc\n", 12), -1);
+    assert_int_equal(sendqDropped(q), sizeof(big) + 12);
+    assert_int_equal(sendqQueued(q), 24);
+
+    // Whole records only; the ones that went are the ones that fit
+    assert_int_equal(sendqPut(q, "dd\n", 3), 0);
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_string_equal(out, "aaaaaaaaaaa\nbbbbbbbbbbb\ndd\n");
+    assert_int_equal(sendqSpilled(q), 0);
+    sendqDestroy(&q);
+}
+
+static void
+sendqResumesPartialWrites(void **state)
+{
+    sendq_t *q = sendqCreate(64, NULL, 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 11), 0);
+    assert_int_equal(sendqPut(q, "abc\n", 4), 0);
+
+    per_call = 3;
+    limit = 5;
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 1);
+    assert_int_equal(out_len, 5);
+    assert_int_equal(sendqQueued(q), 15);
+
+    limit = sizeof(out);
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_string_equal(out, "0123456789\nabc\n");
+    sendqDestroy(&q);
+}
+
+static void
+sendqRestartDropsRestOfPartialRecord(void **state)
+{
+    sendq_t *q = sendqCreate(64, NULL, 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 11), 0);
+    assert_int_equal(sendqPut(q, "abc\n", 4), 0);
+
+    limit = 4;
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 1);
+
+    // The connection went; the next one starts with a whole record
+    broken = TRUE;
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), -1);
+    sendqRestart(q);
+    assert_int_equal(sendqDropped(q), 7);
+    assert_int_equal(sendqQueued(q), 4);
+
+    // Nothing partly written; nothing to drop
+    sendqRestart(q);
+    assert_int_equal(sendqDropped(q), 7);
+
+    broken = FALSE;
+    limit = sizeof(out);
+    out_len = 0;
+    memset(out, 0, sizeof(out));
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_string_equal(out, "abc\n");
+    sendqDestroy(&q);
+}
+
+static void
+sendqSpillsInOrderAndReplays(void **state)
+{
+    sendq_t *q = sendqCreate(32, SPILL_DIR, 1024);
+    char rec[16];
+    int i;
+
+    // The first two fit in memory, the rest spill
+    for (i = 0; i < 10; i++) {
+        snprintf(rec, sizeof(rec), "record %02d\n", i);
+        assert_int_equal(sendqPut(q, rec, 10), 0);
+    }
+    assert_int_equal(sendqQueued(q), 100);
+    assert_int_equal(sendqSpilled(q), 80);
+    assert_int_equal(sendqDropped(q), 0);
+
+    // Unlinked as soon as it's made
+    assert_int_equal(spillFilesLeft(), 0);
+
+    // Comes back a bit at a time, and in order
+    per_call = 7;
+    limit = 25;
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 1);
+    assert_int_equal(sendqPut(q, "record 10\n", 10), 0);
+    limit = sizeof(out);
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_int_equal(out_len, 110);
+    for (i = 0; i < 11; i++) {
+        snprintf(rec, sizeof(rec), "record %02d\n", i);
+        assert_memory_equal(&out[i * 10], rec, 10);
+    }
+    assert_int_equal(sendqQueued(q), 0);
+    assert_int_equal(sendqDropped(q), 0);
+
+    // Emptied; new records go to memory again
+    assert_int_equal(sendqPut(q, "again\n", 6), 0);
+    assert_int_equal(sendqSpilled(q), 90);
+    sendqDestroy(&q);
+}
+
+static void
+sendqSpillIsBounded(void **state)
+{
+    // Memory for one record, the file for two more
+    sendq_t *q = sendqCreate(16, SPILL_DIR, 28);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), -1);
+    assert_int_equal(sendqSpilled(q), 20);
+    assert_int_equal(sendqDropped(q), 10);
+    assert_int_equal(sendqQueued(q), 30);
+    sendqDestroy(&q);
+
+    // No directory that can be written to is the same as no spill file
+    q = sendqCreate(16, "/nonexistent/dir", 1024);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), 0);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), -1);
+    assert_int_equal(sendqSpilled(q), 0);
+    assert_int_equal(sendqDropped(q), 10);
+    sendqDestroy(&q);
+    assert_int_equal(dbgCountMatchingLines("src/sendq.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+}
+
+// Truncates our spill file out from under the queue
+static int
+truncateSpillFile(void)
+{
+    char link[PATH_MAX];
+    char path[64];
+    int truncated = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) return -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        snprintf(path, sizeof(path), "/proc/self/fd/%s", ent->d_name);
+        ssize_t n = readlink(path, link, sizeof(link) - 1);
+        if (n <= 0) continue;
+        link[n] = '\0';
+        if (!strstr(link, "scope_spill.")) continue;
+        if (!ftruncate(atoi(ent->d_name), 0)) truncated++;
+    }
+    closedir(dir);
+    return truncated;
+}
+
+static void
+sendqReportsLostSpill(void **state)
+{
+    sendq_t *q = sendqCreate(16, SPILL_DIR, 1024);
+    assert_int_equal(sendqPut(q, "0123456789\n", 10), 0);
+    assert_int_equal(sendqPut(q, "abcdefghij\n", 10), 0);
+    assert_int_equal(sendqSpilled(q), 10);
+    assert_false(sendqTakeLoss(q));
+
+    // What was spilled can't be read back
+    assert_int_equal(truncateSpillFile(), 1);
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_int_equal(out_len, 10);
+    assert_int_equal(sendqDropped(q), 10);
+    assert_int_equal(sendqQueued(q), 0);
+
+    // Said once
+    assert_true(sendqTakeLoss(q));
+    assert_false(sendqTakeLoss(q));
+    assert_false(sendqTakeLoss(NULL));
+    sendqDestroy(&q);
+    assert_int_equal(dbgCountMatchingLines("src/sendq.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+}
+
+static void
+sendqClearCountsOrNot(void **state)
+{
+    sendq_t *q = sendqCreate(16, SPILL_DIR, 1024);
+    assert_int_equal(sendqPut(q, "0123456789\n", 11), 0);
+    assert_int_equal(sendqPut(q, "abc\n", 4), 0);
+    limit = 3;
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 1);
+
+    // What was written isn't counted as dropped
+    sendqClear(q, TRUE);
+    assert_int_equal(sendqQueued(q), 0);
+    assert_int_equal(sendqDropped(q), 8 + 4);
+
+    // A child leaves the counts alone
+    assert_int_equal(sendqPut(q, "0123456789\n", 11), 0);
+    assert_int_equal(sendqPut(q, "abc\n", 4), 0);
+    sendqClear(q, FALSE);
+    assert_int_equal(sendqQueued(q), 0);
+    assert_int_equal(sendqDropped(q), 12);
+
+    // And spills to a file of its own
+    assert_int_equal(sendqPut(q, "0123456789\n", 11), 0);
+    assert_int_equal(sendqPut(q, "abc\n", 4), 0);
+    limit = sizeof(out);
+    out_len = 0;
+    memset(out, 0, sizeof(out));
+    assert_int_equal(sendqDrain(q, takeBytes, NULL), 0);
+    assert_string_equal(out, "0123456789\nabc\n");
+    sendqDestroy(&q);
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(sendqCreateReturnsNullForZeroBudget, setup),
+        cmocka_unit_test_setup(sendqDrainsInOrder, setup),
+        cmocka_unit_test_setup(sendqDropsWhatDoesNotFit, setup),
+        cmocka_unit_test_setup(sendqResumesPartialWrites, setup),
+        cmocka_unit_test_setup(sendqRestartDropsRestOfPartialRecord, setup),
+        cmocka_unit_test_setup(sendqSpillsInOrderAndReplays, setup),
+        cmocka_unit_test_setup(sendqSpillIsBounded, setup),
+        cmocka_unit_test_setup(sendqReportsLostSpill, setup),
+        cmocka_unit_test_setup(sendqClearCountsOrNot, setup),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
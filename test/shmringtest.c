@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "shmring.h"
+#include "dbg.h"
+
+#include "test.h"
+
+#define MAX_RECS 16
+
+static char recs[MAX_RECS][64];
+static unsigned chans[MAX_RECS];
+static int count = 0;
+
+static void
+saveRecord(void *arg, unsigned chan, const char *buf, size_t len)
+{
+    assert_true(count < MAX_RECS);
+    assert_true(len < sizeof(recs[0]));
+    // Records come NUL terminated
+    assert_int_equal(buf[len], '\0');
+    memcpy(recs[count], buf, len + 1);
+    chans[count] = chan;
+    count++;
+}
+
+static int
+setup(void **state)
+{
+    count = 0;
+    memset(recs, 0, sizeof(recs));
+    return 0;
+}
+
+static void
+shmringCreateReturnsNullForTinySize(void **state)
+{
+    assert_null(shmringCreate(0));
+    assert_null(shmringCreate(4));
+
+    shmring_t *ring = shmringCreate(1024);
+    assert_non_null(ring);
+    assert_int_equal(shmringUsed(ring), 0);
+    assert_int_equal(shmringDropped(ring), 0);
+    shmringDestroy(&ring);
+    assert_null(ring);
+
+    // Don't crash
+    shmringDestroy(NULL);
+    shmringDestroy(&ring);
+    assert_int_equal(shmringPut(NULL, 0, "a", 1), -1);
+    assert_int_equal(shmringDrain(NULL, saveRecord, NULL), 0);
+    assert_int_equal(shmringUsed(NULL), 0);
+    assert_int_equal(shmringDropped(NULL), 0);
+}
+
+static void
+shmringDrainReturnsRecordsInOrder(void **state)
+{
+    shmring_t *ring = shmringCreate(1024);
+
+    assert_int_equal(shmringPut(ring, 0, "first", 5), 0);
+    assert_int_equal(shmringPut(ring, 1, "second", 6), 0);
+    assert_int_equal(shmringPut(ring, 0, "third", 5), 0);
+    assert_true(shmringUsed(ring) > 0);
+
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 3);
+    assert_string_equal(recs[0], "first");
+    assert_int_equal(chans[0], 0);
+    assert_string_equal(recs[1], "second");
+    assert_int_equal(chans[1], 1);
+    assert_string_equal(recs[2], "third");
+    assert_int_equal(chans[2], 0);
+    assert_int_equal(shmringUsed(ring), 0);
+
+    // Nothing more
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 0);
+
+    shmringDestroy(&ring);
+}
+
+static void
+shmringPutDropsWhatDoesntFit(void **state)
+{
+    shmring_t *ring = shmringCreate(64);
+
+    char big[128];
+    memset(big, 'x', sizeof(big));
+    assert_int_equal(shmringPut(ring, 0, big, sizeof(big)), -1);
+    assert_int_equal(shmringDropped(ring), 1);
+
+    // Fill it, then one more
+    int puts = 0;
+    while (shmringPut(ring, 0, "0123456789", 10) == 0) puts++;
+    assert_true(puts > 0);
+    assert_int_equal(shmringDropped(ring), 2);
+
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), puts);
+    assert_string_equal(recs[puts - 1], "0123456789");
+
+    shmringDestroy(&ring);
+}
+
+static void
+shmringRecordsWrapAroundTheEnd(void **state)
+{
+    shmring_t *ring = shmringCreate(64);
+
+    // Each drain leaves the next record starting further along
+    int i;
+    for (i = 0; i < 10; i++) {
+        char msg[32];
+        int len = snprintf(msg, sizeof(msg), "record number %d", i);
+        assert_int_equal(shmringPut(ring, i, msg, len), 0);
+        assert_int_equal(shmringDrain(ring, saveRecord, NULL), 1);
+        assert_string_equal(recs[0], msg);
+        assert_int_equal(chans[0], i);
+        count = 0;
+    }
+
+    shmringDestroy(&ring);
+}
+
+static void
+shmringIsSharedWithChildren(void **state)
+{
+    shmring_t *ring = shmringCreate(1024);
+
+    pid_t pid = fork();
+    assert_true(pid != -1);
+    if (pid == 0) {
+        shmringPut(ring, 2, "from the child", 14);
+        _exit(0);
+    }
+
+    int status;
+    assert_int_equal(waitpid(pid, &status, 0), pid);
+
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 1);
+    assert_string_equal(recs[0], "from the child");
+    assert_int_equal(chans[0], 2);
+
+    shmringDestroy(&ring);
+}
+
+static void
+shmringDrainTakesALockThatIsNeverLetGo(void **state)
+{
+    shmring_t *ring = shmringCreate(1024);
+    assert_int_equal(shmringPut(ring, 0, "before", 6), 0);
+
+    // As if a worker died holding the lock and its pid went to our
+    // parent, which is alive; the lock is the first thing in the ring
+    *(int *)ring = getppid();
+    assert_int_equal(shmringPut(ring, 0, "dropped", 7), -1);
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 0);
+
+    // Still held by the same pid at the next drain
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 1);
+    assert_string_equal(recs[0], "before");
+    assert_int_equal(shmringPut(ring, 0, "after", 5), 0);
+    assert_int_equal(shmringDropped(ring), 1);
+
+    shmringDestroy(&ring);
+    assert_int_equal(dbgCountMatchingLines("src/shmring.c"), 1);
+    dbgInit(); // reset dbg for the rest of the tests
+}
+
+int
+main(int argc, char* argv[])
+{
+    printf("running %s\n", argv[0]);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(shmringCreateReturnsNullForTinySize, setup),
+        cmocka_unit_test_setup(shmringDrainReturnsRecordsInOrder, setup),
+        cmocka_unit_test_setup(shmringPutDropsWhatDoesntFit, setup),
+        cmocka_unit_test_setup(shmringRecordsWrapAroundTheEnd, setup),
+        cmocka_unit_test_setup(shmringIsSharedWithChildren, setup),
+        cmocka_unit_test_setup(shmringDrainTakesALockThatIsNeverLetGo, setup),
+        cmocka_unit_test(dbgHasNoUnexpectedFailures),
+    };
+    return cmocka_run_group_tests(tests, groupSetup, groupTeardown);
+}
@@ -0,0 +1,148 @@
+import java.io.*;
+import java.nio.ByteBuffer;
+import java.security.KeyStore;
+import javax.net.ssl.*;
+
+/*
+ * Measures SSLEngine throughput the way a JMH throughput benchmark would:
+ * a number of timed warmup iterations that are thrown away, then timed
+ * measurement iterations reported as ops/s with their spread.
+ *
+ * One op is a client engine wrapping a record of app data and a server
+ * engine unwrapping it, all in memory, so the wrap/unwrap hooks in the
+ * scope java agent are the only thing between two runs of it with and
+ * without libscope.so.
+ *
+ *   java SSLEngineBench <keystore.p12> <password> [heap|direct] [record size]
+ */
+public class SSLEngineBench {
+    static final int WARMUP = 5;
+    static final int MEASURE = 10;
+    static final long ITERATION_NS = 1000000000L;
+
+    static SSLEngine client;
+    static SSLEngine server;
+    static ByteBuffer clientOut, clientNet, serverIn, serverNet;
+
+    public static void main(String[] args) throws Exception {
+        if (args.length < 2) {
+            System.err.println("usage: java SSLEngineBench <keystore.p12> <password> [heap|direct] [record size]");
+            System.exit(1);
+        }
+        char[] pass = args[1].toCharArray();
+        boolean direct = args.length > 2 && args[2].equals("direct");
+        int size = (args.length > 3) ? Integer.parseInt(args[3]) : 1024;
+
+        KeyStore ks = KeyStore.getInstance("PKCS12");
+        ks.load(new FileInputStream(args[0]), pass);
+        KeyManagerFactory kmf = KeyManagerFactory.getInstance(KeyManagerFactory.getDefaultAlgorithm());
+        kmf.init(ks, pass);
+        TrustManagerFactory tmf = TrustManagerFactory.getInstance(TrustManagerFactory.getDefaultAlgorithm());
+        tmf.init(ks);
+        SSLContext ctx = SSLContext.getInstance("TLS");
+        ctx.init(kmf.getKeyManagers(), tmf.getTrustManagers(), null);
+
+        client = ctx.createSSLEngine("localhost", 8443);
+        client.setUseClientMode(true);
+        server = ctx.createSSLEngine();
+        server.setUseClientMode(false);
+
+        int net = Math.max(client.getSession().getPacketBufferSize(), server.getSession().getPacketBufferSize());
+        int app = Math.max(client.getSession().getApplicationBufferSize(), size);
+        clientOut = alloc(direct, size);
+        clientNet = alloc(direct, net);
+        serverIn = alloc(direct, app);
+        serverNet = alloc(direct, net);
+
+        // An http request, so there's something for the agent to detect
+        byte[] req = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n".getBytes("US-ASCII");
+        for (int i = 0; i < size; i++) clientOut.put(req[i % req.length]);
+        clientOut.flip();
+
+        handshake();
+
+        System.out.printf("SSLEngine wrap+unwrap, %s buffers, %d byte records%n",
+                          direct ? "direct" : "heap", size);
+        for (int i = 0; i < WARMUP; i++) {
+            System.out.printf("# Warmup Iteration %2d: %12.1f ops/s%n", i + 1, iteration());
+        }
+        double[] r = new double[MEASURE];
+        double sum = 0;
+        for (int i = 0; i < MEASURE; i++) {
+            r[i] = iteration();
+            sum += r[i];
+            System.out.printf("Iteration %2d: %12.1f ops/s%n", i + 1, r[i]);
+        }
+        double mean = sum / MEASURE;
+        double var = 0;
+        for (double x : r) var += (x - mean) * (x - mean);
+        System.out.printf("Result: %.1f ±(sd) %.1f ops/s, %.1f MB/s%n",
+                          mean, Math.sqrt(var / (MEASURE - 1)), mean * size / (1024 * 1024));
+    }
+
+    static ByteBuffer alloc(boolean direct, int size) {
+        return direct ? ByteBuffer.allocateDirect(size) : ByteBuffer.allocate(size);
+    }
+
+    static double iteration() throws SSLException {
+        long ops = 0;
+        long start = System.nanoTime();
+        long end = start + ITERATION_NS;
+        long now;
+        do {
+            for (int i = 0; i < 100; i++) op();
+            ops += 100;
+        } while ((now = System.nanoTime()) < end);
+        return ops * 1e9 / (now - start);
+    }
+
+    static void op() throws SSLException {
+        clientOut.rewind();
+        clientNet.clear();
+        client.wrap(clientOut, clientNet);
+        clientNet.flip();
+        serverIn.clear();
+        server.unwrap(clientNet, serverIn);
+    }
+
+    // Shuttle handshake records between the engines until both are done
+    static void handshake() throws Exception {
+        ByteBuffer empty = ByteBuffer.allocate(0);
+        ByteBuffer c2s = ByteBuffer.allocate(clientNet.capacity());
+        ByteBuffer s2c = ByteBuffer.allocate(serverNet.capacity());
+        ByteBuffer sink = ByteBuffer.allocate(serverIn.capacity());
+        client.beginHandshake();
+        server.beginHandshake();
+
+        while (!done(client) || !done(server)) {
+            step(client, empty, c2s, s2c, sink);
+            step(server, empty, s2c, c2s, sink);
+        }
+    }
+
+    static boolean done(SSLEngine e) {
+        SSLEngineResult.HandshakeStatus hs = e.getHandshakeStatus();
+        return hs == SSLEngineResult.HandshakeStatus.FINISHED ||
+               hs == SSLEngineResult.HandshakeStatus.NOT_HANDSHAKING;
+    }
+
+    static void step(SSLEngine e, ByteBuffer empty, ByteBuffer out, ByteBuffer in, ByteBuffer sink) throws Exception {
+        switch (e.getHandshakeStatus()) {
+            case NEED_WRAP:
+                e.wrap(empty, out);
+                break;
+            case NEED_UNWRAP:
+                in.flip();
+                e.unwrap(in, sink);
+                in.compact();
+                sink.clear();
+                break;
+            case NEED_TASK:
+                Runnable task;
+                while ((task = e.getDelegatedTask()) != null) task.run();
+                break;
+            default:
+                break;
+        }
+    }
+}
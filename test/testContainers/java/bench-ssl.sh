@@ -0,0 +1,30 @@
+#! /bin/bash
+
+# Runs SSLEngineBench without scope, then scoped with nothing to do with
+# the data (http and metric events off), then scoped with http events on.
+# Heap and direct buffers are each measured.
+
+LIB=${1:-/opt/test-runner/bin/libscope.so}
+BENCH="java -cp /opt/javabench SSLEngineBench /opt/javabench/bench.p12 changeit"
+
+if [ ! -f "$LIB" ]; then
+    echo "can't find $LIB"
+    exit 1
+fi
+
+for BUF in heap direct; do
+    echo "==============================================="
+    echo "             unscoped, $BUF buffers"
+    echo "==============================================="
+    $BENCH $BUF | tail -1
+
+    echo "==============================================="
+    echo "             scoped, http off, $BUF buffers"
+    echo "==============================================="
+    SCOPE_EVENT_HTTP=false SCOPE_EVENT_METRIC=false LD_PRELOAD=$LIB $BENCH $BUF | tail -1
+
+    echo "==============================================="
+    echo "             scoped, http on, $BUF buffers"
+    echo "==============================================="
+    SCOPE_EVENT_HTTP=true LD_PRELOAD=$LIB $BENCH $BUF | tail -1
+done
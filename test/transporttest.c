@@ -1,11 +1,16 @@
 #include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <syslog.h>
 #include <unistd.h>
+#include "compress.h"
 #include "dbg.h"
 #include "transport.h"
 
@@ -196,25 +201,131 @@ transportCreateUnixReturnsNullForInvalidPath(void** state)
 }
 
 
+#define SYSLOG_TEST_PATH "/tmp/scope-syslog-test.sock"
+
+// Stands in for syslogd
+static int
+syslogListener(const char* path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+    unlink(path);
+
+    int sd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sd == -1) fail_msg("Couldn't create socket");
+    if (bind(sd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+        fail_msg("Couldn't bind %s", path);
+    return sd;
+}
+
 static void
 transportCreateSyslogReturnsValidPtrInHappyPath(void** state)
 {
-    transport_t* t = transportCreateSyslog();
+    int sd = syslogListener(SYSLOG_TEST_PATH);
+
+    transport_t* t = transportCreateSyslog(SYSLOG_TEST_PATH);
     assert_non_null(t);
     assert_false(transportNeedsConnection(t));
     transportDestroy(&t);
     assert_null(t);
 
+    close(sd);
+    unlink(SYSLOG_TEST_PATH);
+}
+
+static void
+transportCreateSyslogReturnsUnconnectedForMissingPath(void** state)
+{
+    assert_null(transportCreateSyslog(NULL));
+
+    transport_t* t = transportCreateSyslog("/tmp/no-syslogd-here.sock");
+    assert_non_null(t);
+    assert_true(transportNeedsConnection(t));
+    transportDestroy(&t);
+}
+
+static void
+transportSendForSyslogSendsOneRecordPerLine(void** state)
+{
+    int sd = syslogListener(SYSLOG_TEST_PATH);
+
+    transport_t* t = transportCreateSyslog(SYSLOG_TEST_PATH);
+    assert_non_null(t);
+
+    const char* msg = "first line\nsecond line\n";
+    assert_int_equal(transportSend(t, msg, strlen(msg)), 0);
+    assert_int_equal(transportFlush(t), 0);
+
+    char expected[128];
+    char buf[128];
+    ssize_t len;
+
+    snprintf(expected, sizeof(expected), "<%d>scope[%d]: first line",
+             LOG_USER|LOG_INFO, getpid());
+    len = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
+    assert_int_equal(len, strlen(expected));
+    assert_memory_equal(buf, expected, len);
+
+    snprintf(expected, sizeof(expected), "<%d>scope[%d]: second line",
+             LOG_USER|LOG_INFO, getpid());
+    len = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
+    assert_int_equal(len, strlen(expected));
+    assert_memory_equal(buf, expected, len);
+
+    // Nothing more
+    assert_int_equal(recv(sd, buf, sizeof(buf), MSG_DONTWAIT), -1);
+
+    transportDestroy(&t);
+    close(sd);
+    unlink(SYSLOG_TEST_PATH);
 }
 
 static void
 transportCreateShmReturnsValidPtrInHappyPath(void** state)
 {
-    transport_t* t = transportCreateShm();
+    shmring_t* ring = shmringCreate(4096);
+    transport_t* t = transportCreateShm(ring, 1);
     assert_non_null(t);
     assert_false(transportNeedsConnection(t));
     transportDestroy(&t);
     assert_null(t);
+
+    // Without a ring there's nowhere to send
+    t = transportCreateShm(NULL, 1);
+    assert_non_null(t);
+    assert_true(transportNeedsConnection(t));
+    transportDestroy(&t);
+
+    shmringDestroy(&ring);
+}
+
+static unsigned shm_chan;
+static char shm_msg[64];
+
+static void
+saveRecord(void* arg, unsigned chan, const char* buf, size_t len)
+{
+    shm_chan = chan;
+    assert_true(len < sizeof(shm_msg));
+    memcpy(shm_msg, buf, len + 1);
+}
+
+static void
+transportSendForShmPutsMsgInRing(void** state)
+{
+    shmring_t* ring = shmringCreate(4096);
+    transport_t* t = transportCreateShm(ring, 3);
+
+    const char* msg = "counter:1|c\n";
+    assert_int_equal(transportSend(t, msg, strlen(msg)), 0);
+    assert_int_equal(transportFlush(t), 0);
+
+    assert_int_equal(shmringDrain(ring, saveRecord, NULL), 1);
+    assert_int_equal(shm_chan, 3);
+    assert_string_equal(shm_msg, msg);
+
+    transportDestroy(&t);
+    shmringDestroy(&ring);
 }
 
 static void
@@ -253,11 +364,11 @@ transportSendForUnimplementedTransportTypesIsHarmless(void** state)
     transportSend(t, "blah", strlen("blah"));
     transportDestroy(&t);
 
-    t = transportCreateSyslog();
+    t = transportCreateSyslog("/tmp/no-syslogd-here.sock");
     transportSend(t, "blah", strlen("blah"));
     transportDestroy(&t);
 
-    t = transportCreateShm();
+    t = transportCreateShm(NULL, 0);
     transportSend(t, "blah", strlen("blah"));
     transportDestroy(&t);
 }
@@ -346,6 +457,54 @@ transportSendForFileWritesToFileAfterFlushWhenFullyBuffered(void** state)
         fail_msg("Couldn't delete test file %s", path);
 }
 
+static void
+transportSendForFileCompressesOnFlush(void** state)
+{
+    const char* path = "/tmp/mypath";
+    transport_t* t = transportCreateFile(path, CFG_BUFFER_LINE);
+    assert_non_null(t);
+    transportCompressSet(t, CFG_COMPRESS_LZ4, DEFAULT_COMPRESS_BLOCK);
+
+    long file_pos_before = fileEndPosition(path);
+    const char msg[] = "This is the payload message to transfer.\n";
+    int i;
+    for (i=0; i<100; i++) {
+        assert_int_equal(transportSend(t, msg, strlen(msg)), 0);
+    }
+
+    // Even line buffered, nothing is written until the block is framed
+    assert_int_equal(file_pos_before, fileEndPosition(path));
+
+    assert_int_equal(transportFlush(t), 0);
+    long file_pos_after = fileEndPosition(path);
+    assert_true(file_pos_after > file_pos_before);
+    assert_true(file_pos_after - file_pos_before < strlen(msg) * 100 / 4);
+
+    FILE* f = fopen(path, "r");
+    if (!f)
+        fail_msg("Couldn't open file %s", path);
+    unsigned char magic[4];
+    assert_int_equal(fread(magic, 1, sizeof(magic), f), sizeof(magic));
+    assert_int_equal(magic[0] | magic[1] << 8 | magic[2] << 16 | magic[3] << 24,
+                     LZ4_FRAME_MAGIC);
+    if (fclose(f)) fail_msg("Couldn't close file %s", path);
+
+    // Nothing left to frame
+    assert_int_equal(transportFlush(t), 0);
+    assert_int_equal(file_pos_after, fileEndPosition(path));
+
+    // A forked child doesn't write out what its parent had gathered
+    assert_int_equal(transportSend(t, msg, strlen(msg)), 0);
+    assert_int_equal(transportReconnect(t), 0);
+    assert_int_equal(transportFlush(t), 0);
+    assert_int_equal(file_pos_after, fileEndPosition(path));
+
+    transportDestroy(&t);
+
+    if (unlink(path))
+        fail_msg("Couldn't delete test file %s", path);
+}
+
 static void
 transportSendForFileWritesToFileImmediatelyWhenLineBuffered(void** state)
 {
@@ -391,6 +550,161 @@ transportSendForFileWritesToFileImmediatelyWhenLineBuffered(void** state)
 }
 
 
+static void
+transportSendForTcpQueuesWhileReceiverIsBehind(void** state)
+{
+    // A receiver that doesn't read until everything has been sent
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(listener != -1);
+    int small = 4096;
+    assert_int_equal(setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)), 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrlen = sizeof(addr);
+    assert_int_equal(bind(listener, (struct sockaddr *)&addr, addrlen), 0);
+    assert_int_equal(listen(listener, 1), 0);
+    assert_int_equal(getsockname(listener, (struct sockaddr *)&addr, &addrlen), 0);
+    char port[16];
+    snprintf(port, sizeof(port), "%d", ntohs(addr.sin_port));
+
+    transport_t* t = transportCreateTCP("127.0.0.1", port);
+    assert_non_null(t);
+    transportQueueSet(t, 64 * 1024, NULL, 0);
+    int tries;
+    for (tries = 0; transportNeedsConnection(t) && tries < 100; tries++) {
+        transportConnect(t);
+        usleep(10000);
+    }
+    assert_false(transportNeedsConnection(t));
+
+    // Far more than the socket buffers and queue hold; none of it blocks
+    char rec[1000];
+    int i, num = 16 * 1024;
+    for (i = 0; i < num; i++) {
+        memset(rec, 'a' + i % 26, sizeof(rec));
+        snprintf(rec, sizeof(rec), "%08d", i);
+        rec[8] = ' ';
+        rec[sizeof(rec) - 1] = '\n';
+        transportSend(t, rec, sizeof(rec));
+    }
+    uint64_t queued, dropped, spilled;
+    assert_int_equal(transportQueueStats(t, &queued, &dropped, &spilled), 0);
+    assert_true(queued > 0);
+    assert_true(queued <= 64 * 1024);
+    assert_true(dropped > 0);
+    assert_int_equal(spilled, 0);
+
+    // What arrives is whole records, in order
+    int rx = accept(listener, NULL, NULL);
+    assert_true(rx != -1);
+    uint64_t sent = (uint64_t)num * sizeof(rec);
+    uint64_t got = 0;
+    int last = -1;
+    char buf[sizeof(rec)];
+    size_t have = 0;
+    while (got + dropped < sent) {
+        transportFlush(t);
+        assert_int_equal(transportQueueStats(t, &queued, &dropped, &spilled), 0);
+
+        struct pollfd pfd = {.fd = rx, .events = POLLIN};
+        if (poll(&pfd, 1, 1000) != 1) {
+            if (!queued) break;
+            fail_msg("stalled with %lu queued", (unsigned long)queued);
+        }
+        ssize_t n = read(rx, &buf[have], sizeof(buf) - have);
+        assert_true(n > 0);
+        have += n;
+        got += n;
+        if (have < sizeof(buf)) continue;
+
+        int seq = atoi(buf);
+        assert_true(seq > last);
+        assert_int_equal(buf[sizeof(buf) - 2], 'a' + seq % 26);
+        assert_int_equal(buf[sizeof(buf) - 1], '\n');
+        last = seq;
+        have = 0;
+    }
+    assert_int_equal(got + dropped, sent);
+    assert_true(last >= 0);
+    assert_int_equal(queued, 0);
+
+    transportDestroy(&t);
+    close(rx);
+    close(listener);
+}
+
+static void
+transportSendForTcpLeavesReconnectingToCaller(void** state)
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(listener != -1);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addrlen = sizeof(addr);
+    assert_int_equal(bind(listener, (struct sockaddr *)&addr, addrlen), 0);
+    assert_int_equal(listen(listener, 1), 0);
+    assert_int_equal(getsockname(listener, (struct sockaddr *)&addr, &addrlen), 0);
+    char port[16];
+    snprintf(port, sizeof(port), "%d", ntohs(addr.sin_port));
+
+    transport_t* t = transportCreateTCP("127.0.0.1", port);
+    assert_non_null(t);
+    transportQueueSet(t, 64 * 1024, NULL, 0);
+    int tries;
+    for (tries = 0; transportNeedsConnection(t) && tries < 100; tries++) {
+        transportConnect(t);
+        usleep(10000);
+    }
+    assert_false(transportNeedsConnection(t));
+
+    // The receiver resets the connection
+    int rx = accept(listener, NULL, NULL);
+    assert_true(rx != -1);
+    struct linger reset = {.l_onoff = 1, .l_linger = 0};
+    assert_int_equal(setsockopt(rx, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset)), 0);
+    close(rx);
+
+    const char old[] = "old\n";
+    for (tries = 0; !transportNeedsConnection(t) && tries < 100; tries++) {
+        transportSend(t, old, strlen(old));
+        usleep(10000);
+    }
+    assert_true(transportNeedsConnection(t));
+    assert_true(dbgCountMatchingLines("src/transport.c") > 0);
+    dbgInit(); // reset dbg for the rest of the tests
+
+    // It's disconnected, and hasn't connected again by itself
+    transportSend(t, old, strlen(old));
+    struct pollfd pfd = {.fd = listener, .events = POLLIN};
+    assert_int_equal(poll(&pfd, 1, 100), 0);
+    uint64_t queued;
+    assert_int_equal(transportQueueStats(t, &queued, NULL, NULL), 0);
+    assert_true(queued > 0);
+
+    // What mtcConnect() does for binary records; only new ones arrive
+    transportQueueDiscard(t);
+    for (tries = 0; transportNeedsConnection(t) && tries < 100; tries++) {
+        transportConnect(t);
+        usleep(10000);
+    }
+    assert_false(transportNeedsConnection(t));
+    rx = accept(listener, NULL, NULL);
+    assert_true(rx != -1);
+
+    const char new[] = "new\n";
+    assert_int_equal(transportSend(t, new, strlen(new)), 0);
+    assert_int_equal(transportFlush(t), 0);
+    char buf[16] = {0};
+    pfd.fd = rx;
+    assert_int_equal(poll(&pfd, 1, 1000), 1);
+    assert_int_equal(read(rx, buf, sizeof(buf) - 1), strlen(new));
+    assert_string_equal(buf, new);
+
+    transportDestroy(&t);
+    close(rx);
+    close(listener);
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -412,14 +726,20 @@ main(int argc, char* argv[])
         cmocka_unit_test(transportCreateUnixReturnsValidPtrInHappyPath),
         cmocka_unit_test(transportCreateUnixReturnsNullForInvalidPath),
         cmocka_unit_test(transportCreateSyslogReturnsValidPtrInHappyPath),
+        cmocka_unit_test(transportCreateSyslogReturnsUnconnectedForMissingPath),
         cmocka_unit_test(transportCreateShmReturnsValidPtrInHappyPath),
         cmocka_unit_test(transportDestroyNullTransportDoesNothing),
         cmocka_unit_test(transportSendForNullTransportDoesNothing),
         cmocka_unit_test(transportSendForNullMessageDoesNothing),
         cmocka_unit_test(transportSendForUnimplementedTransportTypesIsHarmless),
         cmocka_unit_test(transportSendForUdpTransmitsMsg),
+        cmocka_unit_test(transportSendForSyslogSendsOneRecordPerLine),
+        cmocka_unit_test(transportSendForShmPutsMsgInRing),
         cmocka_unit_test(transportSendForFileWritesToFileAfterFlushWhenFullyBuffered),
         cmocka_unit_test(transportSendForFileWritesToFileImmediatelyWhenLineBuffered),
+        cmocka_unit_test(transportSendForFileCompressesOnFlush),
+        cmocka_unit_test(transportSendForTcpQueuesWhileReceiverIsBehind),
+        cmocka_unit_test(transportSendForTcpLeavesReconnectingToCaller),
         cmocka_unit_test(dbgHasNoUnexpectedFailures),
     };
     return cmocka_run_group_tests(tests, groupSetup, groupTeardown);